@@ -0,0 +1,292 @@
+//
+// AssetLoader.cpp
+//
+
+#include "AssetLoader.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <stdio.h>
+
+namespace
+{
+    const char* const STATE_NAMES[] = { "queued", "loading", "loaded", "ready", "failed" };
+
+    double ToMilliseconds(uint64_t nanoseconds)
+    {
+        return double(nanoseconds) * 1e-6;
+    }
+}
+
+AssetLoader::AssetLoader(DX::JobSystem& jobs) :
+    m_jobs(&jobs),
+    m_start(DX::Profiler::ClockNow()),
+    m_firstFrame(0),
+    m_lastReady(0),
+    m_pending(0)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    while (WaitForLoad())
+    {
+    }
+}
+
+uint32_t AssetLoader::Load(const char* name, LoadFunction load)
+{
+    DX::JobSystem::Job* job = nullptr;
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        index = static_cast<uint32_t>(m_entries.size());
+        m_entries.emplace_back();
+
+        Entry& entry = m_entries.back();
+        entry.asset = { name, Queued, Now(), 0, 0, 0 };
+        entry.load = std::move(load);
+        ++m_pending;
+
+        // Without workers, waiting on a job would run every queued load at once.
+        if (m_jobs->GetThreadCount() > 1)
+        {
+            entry.job = job = m_jobs->CreateJob([this, index]() { RunLoad(index); });
+        }
+        else
+        {
+            entry.job = nullptr;
+        }
+    }
+
+    if (job)
+    {
+        m_jobs->Run(job);
+    }
+    return index;
+}
+
+uint32_t AssetLoader::Update(uint32_t maxFinishes)
+{
+    // Nothing else would run the loads.
+    if (m_jobs->GetThreadCount() == 1)
+    {
+        bool completed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            completed = !m_completed.empty();
+        }
+        if (!completed)
+        {
+            WaitForLoad();
+        }
+    }
+
+    uint32_t finished = 0;
+    while (finished < maxFinishes)
+    {
+        Entry* entry;
+        FinishFunction finish;
+        std::string error;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_completed.empty())
+                break;
+
+            entry = &m_entries[m_completed.front()];
+            m_completed.erase(m_completed.begin());
+            finish = std::move(entry->finish);
+            error = entry->error;
+        }
+
+        if (error.empty() && finish)
+        {
+            try
+            {
+                finish();
+            }
+            catch (const std::exception& e)
+            {
+                error = *e.what() ? e.what() : "unknown error";
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_pending;
+        if (!error.empty())
+        {
+            entry->asset.state = Failed;
+            throw std::runtime_error(std::string("AssetLoader: ") + entry->asset.name + ": " + error);
+        }
+
+        entry->asset.state = Ready;
+        entry->asset.ready = m_lastReady = Now();
+        ++finished;
+    }
+
+    return finished;
+}
+
+void AssetLoader::FinishAll()
+{
+    while (WaitForLoad())
+    {
+    }
+    Update();
+}
+
+void AssetLoader::MarkFirstFrame()
+{
+    if (m_firstFrame == 0)
+    {
+        m_firstFrame = std::max<uint64_t>(Now(), 1);
+    }
+}
+
+uint32_t AssetLoader::GetAssetCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<uint32_t>(m_entries.size());
+}
+
+uint32_t AssetLoader::GetReadyCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t ready = 0;
+    for (const Entry& entry : m_entries)
+    {
+        ready += (entry.asset.state == Ready) ? 1 : 0;
+    }
+    return ready;
+}
+
+bool AssetLoader::IsIdle() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending == 0;
+}
+
+AssetLoader::Asset AssetLoader::GetAsset(uint32_t index) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries[index].asset;
+}
+
+uint64_t AssetLoader::GetFirstFrameTime() const
+{
+    return m_firstFrame;
+}
+
+uint64_t AssetLoader::GetLastReadyTime() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastReady;
+}
+
+std::string AssetLoader::FormatReport() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string report = "asset                                  wait ms   load ms  finish ms  ready at ms\n";
+    char line[160];
+    uint64_t loading = 0;
+    for (const Entry& entry : m_entries)
+    {
+        const Asset& asset = entry.asset;
+        if (asset.state == Ready)
+        {
+            snprintf(line, sizeof(line), "%-36s %9.1f %9.1f %10.1f %12.1f\n", asset.name,
+                ToMilliseconds(asset.loadBegin - asset.queued), ToMilliseconds(asset.loadEnd - asset.loadBegin),
+                ToMilliseconds(asset.ready - asset.loadEnd), ToMilliseconds(asset.ready));
+            loading += asset.loadEnd - asset.loadBegin;
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "%-36s %s\n", asset.name, STATE_NAMES[asset.state]);
+        }
+        report += line;
+    }
+
+    // How much the loads overlapped: one after another they would have taken the sum.
+    snprintf(line, sizeof(line), "first frame at %.1f ms, last asset ready at %.1f ms, %.1f ms of loading (%.1fx overlap)\n",
+        ToMilliseconds(m_firstFrame), ToMilliseconds(m_lastReady), ToMilliseconds(loading),
+        m_lastReady ? double(loading) / double(m_lastReady) : 0.0);
+    report += line;
+    return report;
+}
+
+void AssetLoader::RunLoad(uint32_t index)
+{
+    Entry* entry;
+    LoadFunction load;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        entry = &m_entries[index];
+        entry->asset.state = Loading;
+        entry->asset.loadBegin = Now();
+        load = std::move(entry->load);
+    }
+
+    const uint64_t begin = DX::Profiler::Now();
+    FinishFunction finish;
+    std::string error;
+    try
+    {
+        finish = load();
+    }
+    catch (const std::exception& e)
+    {
+        error = *e.what() ? e.what() : "unknown error";
+    }
+    catch (...)
+    {
+        error = "unknown error";
+    }
+    DX::Profiler::Record(entry->asset.name, begin, DX::Profiler::Now());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    entry->finish = std::move(finish);
+    entry->error = std::move(error);
+    entry->asset.state = Loaded;
+    entry->asset.loadEnd = Now();
+    m_completed.push_back(index);
+}
+
+uint64_t AssetLoader::Now() const
+{
+    return DX::Profiler::ClockNow() - m_start;
+}
+
+bool AssetLoader::WaitForLoad()
+{
+    DX::JobSystem::Job* job = nullptr;
+    uint32_t index = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (; index < m_entries.size(); ++index)
+        {
+            const Entry& entry = m_entries[index];
+            if (entry.asset.state == Queued || entry.asset.state == Loading)
+            {
+                job = entry.job;
+                break;
+            }
+        }
+
+        if (index == m_entries.size())
+            return false;
+    }
+
+    // The job cannot have been recycled: it is still running or only just finished.
+    if (job)
+    {
+        m_jobs->Wait(job);
+    }
+    else
+    {
+        RunLoad(index);
+    }
+    return true;
+}
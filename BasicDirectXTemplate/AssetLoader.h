@@ -0,0 +1,115 @@
+//
+// AssetLoader.h - Loads assets on worker threads and publishes them on the render thread
+//
+
+#pragma once
+
+#include "JobSystem.h"
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Each asset loads in two steps. Its load function runs on a worker: it reads and
+// decodes the file and creates whatever can be created off the render thread (a D3D11
+// device is free threaded, its immediate context is not). It returns a finish function
+// that Update runs on the render thread to do the rest and publish the result. Until
+// then the renderer uses a placeholder or skips what is missing, so the first frames do
+// not wait for the slowest file.
+//
+// Every asset's timeline is kept in nanoseconds from the loader's construction, along
+// with when the first frame was presented; FormatReport lays them out per asset. The
+// loads also appear in profiler captures under the asset's name.
+//
+// A load that throws fails only its own asset: Update rethrows the error on the render
+// thread as std::runtime_error, and later calls finish the loads after it. With no
+// worker threads the loads run inside Update, one per call.
+class AssetLoader
+{
+public:
+    typedef std::function<void()> FinishFunction;
+    typedef std::function<FinishFunction()> LoadFunction;
+
+    enum State : uint32_t
+    {
+        Queued,
+        Loading,
+        Loaded,                         // Waiting for Update to finish it
+        Ready,
+        Failed,
+    };
+
+    struct Asset
+    {
+        const char*     name;           // Must outlive the loader and any profiler capture
+        State           state;
+        uint64_t        queued;         // Nanoseconds since the loader was created
+        uint64_t        loadBegin;
+        uint64_t        loadEnd;
+        uint64_t        ready;          // When its finish function returned
+    };
+
+    explicit AssetLoader(DX::JobSystem& jobs);
+
+    // Waits for the loads in flight; finish functions that have not run are dropped.
+    ~AssetLoader();
+
+    AssetLoader(AssetLoader const&) = delete;
+    AssetLoader& operator= (AssetLoader const&) = delete;
+
+    // Queues a load and returns the asset's index.
+    uint32_t Load(const char* name, LoadFunction load);
+
+    // Runs the finish functions of completed loads, in the order they completed, up to
+    // maxFinishes. Returns how many ran.
+    uint32_t Update(uint32_t maxFinishes = ~0u);
+
+    // Waits for every load and finishes them all, unless one throws.
+    void FinishAll();
+
+    // Records the first call only.
+    void MarkFirstFrame();
+
+    uint32_t GetAssetCount() const;
+    uint32_t GetReadyCount() const;
+    bool IsIdle() const;                // Nothing queued, loading or waiting to finish
+    Asset GetAsset(uint32_t index) const;
+
+    // 0 until it happened.
+    uint64_t GetFirstFrameTime() const;
+    uint64_t GetLastReadyTime() const;
+
+    // One line per asset (wait for a worker, load, wait to finish, ready at) and totals.
+    std::string FormatReport() const;
+
+private:
+    struct Entry
+    {
+        Asset                   asset;
+        LoadFunction            load;
+        FinishFunction          finish;
+        std::string             error;
+        DX::JobSystem::Job*     job;
+    };
+
+    void RunLoad(uint32_t index);
+    uint64_t Now() const;
+
+    // Waits for, or without workers runs, the oldest load still going. Returns false if
+    // there is none.
+    bool WaitForLoad();
+
+    DX::JobSystem*              m_jobs;
+    uint64_t                    m_start;
+    uint64_t                    m_firstFrame;
+    uint64_t                    m_lastReady;
+
+    // Guards the entries' state and timings, and m_completed. Entries never move.
+    mutable std::mutex          m_mutex;
+    std::deque<Entry>           m_entries;
+    std::vector<uint32_t>       m_completed;
+    uint32_t                    m_pending;              // Not yet Ready or Failed
+};
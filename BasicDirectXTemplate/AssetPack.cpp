@@ -0,0 +1,504 @@
+//
+// AssetPack.cpp
+//
+
+#include "AssetPack.h"
+
+#include "FileFormat.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+#include <utility>
+
+using FileFormat::Fail;
+using FileFormat::FitsIn;
+
+namespace
+{
+    const uint32_t EMPTY_BUCKET = ~0u;
+
+    // The LZ4 block format's limits: the last match starts at least MFLIMIT bytes before
+    // the end and the last LAST_LITERALS bytes are always literals.
+    const size_t MIN_MATCH = 4;
+    const size_t LAST_LITERALS = 5;
+    const size_t MFLIMIT = 12;
+    const size_t MAX_OFFSET = 65535;
+
+    // A block expands at most this much: a match's length grows by 255 per extra byte.
+    // The small constant covers the token and offset of a block too short for that.
+    const uint64_t MAX_EXPANSION = 255;
+    const uint64_t MAX_EXPANSION_SLACK = 32;
+    const uint32_t HASH_BITS = 16;
+
+    bool IsPowerOfTwo(uint64_t value)
+    {
+        return value && !(value & (value - 1));
+    }
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Paths compare as FileFormat::ComparePaths does, with or without "./".
+    const char* SkipCurrentDirectory(const char* path)
+    {
+        while (path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+        {
+            path += 2;
+        }
+        return path;
+    }
+
+    bool SamePath(const char* a, const char* b)
+    {
+        return FileFormat::ComparePaths(SkipCurrentDirectory(a), SkipCurrentDirectory(b)) == 0;
+    }
+
+    uint32_t Read32(const uint8_t* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void WriteLength(std::vector<uint8_t>& output, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            output.push_back(255);
+        }
+        output.push_back(uint8_t(length));
+    }
+
+    bool ReadLength(const uint8_t*& input, const uint8_t* end, size_t& length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (input == end)
+                return false;
+            byte = *input++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    // A run of literals, then a match unless matchLength is 0 (the block's last sequence).
+    void WriteSequence(std::vector<uint8_t>& output, const uint8_t* literals, size_t literalCount, size_t offset,
+        size_t matchLength)
+    {
+        const size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+        output.push_back(uint8_t((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+        if (literalCount >= 15)
+            WriteLength(output, literalCount - 15);
+        output.insert(output.end(), literals, literals + literalCount);
+        if (!matchLength)
+            return;
+
+        output.push_back(uint8_t(offset));
+        output.push_back(uint8_t(offset >> 8));
+        if (matchCode >= 15)
+            WriteLength(output, matchCode - 15);
+    }
+}
+
+std::vector<uint8_t> CompressLz4(const uint8_t* data, size_t size)
+{
+    std::vector<uint8_t> output;
+    output.reserve(size + size / 255 + 16);
+
+    size_t anchor = 0;
+    if (size > MFLIMIT)
+    {
+        // The latest position seen of each hashed 4 bytes; a stale or colliding one is
+        // caught by comparing the bytes themselves.
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+        const size_t matchLimit = size - LAST_LITERALS;
+        const size_t lastMatchStart = size - MFLIMIT;
+
+        size_t position = 0;
+        while (position <= lastMatchStart)
+        {
+            const uint32_t sequence = Read32(data + position);
+            uint32_t& slot = table[(sequence * 2654435761u) >> (32 - HASH_BITS)];
+            const size_t candidate = slot;
+            slot = uint32_t(position);
+
+            if (candidate >= position || position - candidate > MAX_OFFSET || Read32(data + candidate) != sequence)
+            {
+                // Step further the longer nothing has matched, to get through data that
+                // does not compress quickly.
+                position += 1 + ((position - anchor) >> 6);
+                continue;
+            }
+
+            size_t start = position;
+            size_t reference = candidate;
+            while (start > anchor && reference > 0 && data[start - 1] == data[reference - 1])
+            {
+                --start;
+                --reference;
+            }
+            size_t end = position + MIN_MATCH;
+            for (size_t from = candidate + MIN_MATCH; end < matchLimit && data[end] == data[from]; ++end, ++from)
+            {
+            }
+
+            WriteSequence(output, data + anchor, start - anchor, start - reference, end - start);
+            anchor = end;
+            position = end;
+        }
+    }
+
+    WriteSequence(output, data + anchor, size - anchor, 0, 0);
+    return output;
+}
+
+bool DecompressLz4(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize)
+{
+    const uint8_t* input = data;
+    const uint8_t* inputEnd = data + size;
+    uint8_t* out = output;
+    uint8_t* outEnd = output + outputSize;
+
+    while (input < inputEnd)
+    {
+        const uint8_t token = *input++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !ReadLength(input, inputEnd, literals))
+            return false;
+        if (literals > size_t(inputEnd - input) || literals > size_t(outEnd - out))
+            return false;
+        memcpy(out, input, literals);
+        input += literals;
+        out += literals;
+
+        // The last sequence has no match.
+        if (input == inputEnd)
+            break;
+
+        if (inputEnd - input < 2)
+            return false;
+        const size_t offset = size_t(input[0]) | (size_t(input[1]) << 8);
+        input += 2;
+        if (offset == 0 || offset > size_t(out - output))
+            return false;
+
+        size_t length = token & 15;
+        if (length == 15 && !ReadLength(input, inputEnd, length))
+            return false;
+        length += MIN_MATCH;
+        if (length > size_t(outEnd - out))
+            return false;
+
+        // Overlapping matches repeat the bytes just written, so they go a byte at a time.
+        const uint8_t* from = out - offset;
+        if (offset >= length)
+        {
+            memcpy(out, from, length);
+        }
+        else
+        {
+            for (size_t i = 0; i < length; ++i)
+            {
+                out[i] = from[i];
+            }
+        }
+        out += length;
+    }
+
+    return out == outEnd;
+}
+
+AssetPack::AssetPack(AssetPack&& other) noexcept :
+    m_file(std::move(other.m_file)),
+    m_header(other.m_header),
+    m_entries(other.m_entries),
+    m_buckets(other.m_buckets),
+    m_paths(other.m_paths)
+{
+    other.Close();
+}
+
+AssetPack& AssetPack::operator= (AssetPack&& other) noexcept
+{
+    if (this != &other)
+    {
+        m_file = std::move(other.m_file);
+        m_header = other.m_header;
+        m_entries = other.m_entries;
+        m_buckets = other.m_buckets;
+        m_paths = other.m_paths;
+        other.Close();
+    }
+    return *this;
+}
+
+bool AssetPack::Open(const char* path)
+{
+    Close();
+
+    DX::MappedFile file;
+    try
+    {
+        file = DX::MapData(path);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+
+    const char* prefix = "AssetPack: ";
+    const uint64_t size = file.size();
+    if (size < sizeof(AssetPackHeader))
+        Fail(prefix, "%s is too small", path);
+
+    auto header = reinterpret_cast<const AssetPackHeader*>(file.data());
+    if (header->magic != Magic)
+        Fail(prefix, "%s is not a pack", path);
+    if (header->version != Version)
+        Fail(prefix, "%s is version %u, not %u", path, header->version, Version);
+    if (header->fileSize != size)
+        Fail(prefix, "%s is %llu bytes, not %llu", path, static_cast<unsigned long long>(size),
+            static_cast<unsigned long long>(header->fileSize));
+    if (!IsPowerOfTwo(header->pageSize) || header->pageSize < 8)
+        Fail(prefix, "%s has a page size of %u", path, header->pageSize);
+    if (!IsPowerOfTwo(header->bucketCount) || header->bucketCount <= header->entryCount)
+        Fail(prefix, "%s has %u buckets for %u entries", path, header->bucketCount, header->entryCount);
+    if ((header->entryOffset % alignof(AssetPackEntry)) || (header->bucketOffset % alignof(uint32_t)))
+        Fail(prefix, "%s has a misaligned table of contents", path);
+    if (!FitsIn(header->entryOffset, uint64_t(header->entryCount) * sizeof(AssetPackEntry), size)
+        || !FitsIn(header->bucketOffset, uint64_t(header->bucketCount) * sizeof(uint32_t), size)
+        || !FitsIn(header->pathOffset, header->pathSize, size) || header->pathSize > UINT32_MAX)
+        Fail(prefix, "%s has a table of contents past its end", path);
+    if (header->pathSize && file.data()[header->pathOffset + header->pathSize - 1] != 0)
+        Fail(prefix, "%s has an unterminated path", path);
+
+    m_header = header;
+    m_entries = reinterpret_cast<const AssetPackEntry*>(file.data() + header->entryOffset);
+    m_buckets = reinterpret_cast<const uint32_t*>(file.data() + header->bucketOffset);
+    m_paths = reinterpret_cast<const char*>(file.data() + header->pathOffset);
+    m_file = std::move(file);
+
+    try
+    {
+        for (uint32_t i = 0; i < header->bucketCount; ++i)
+        {
+            if (m_buckets[i] != EMPTY_BUCKET && m_buckets[i] >= header->entryCount)
+                Fail(prefix, "%s has bucket %u out of range", path, i);
+        }
+
+        const uint64_t payloadStart = header->pathOffset + header->pathSize;
+        for (uint32_t i = 0; i < header->entryCount; ++i)
+        {
+            const AssetPackEntry& entry = m_entries[i];
+            if (entry.pathOffset >= header->pathSize || !m_paths[entry.pathOffset])
+                Fail(prefix, "%s has entry %u with no path", path, i);
+            const char* entryPath = GetPath(entry);
+            if (entry.offset % header->pageSize || entry.offset < payloadStart
+                || !FitsIn(entry.offset, entry.storedSize, size) || entry.size > SIZE_MAX)
+                Fail(prefix, "%s has %s past its end", path, entryPath);
+            if (entry.compression > AssetPackLz4
+                || (entry.compression == AssetPackStored && entry.storedSize != entry.size)
+                || (entry.compression == AssetPackLz4 && entry.size > entry.storedSize * MAX_EXPANSION + MAX_EXPANSION_SLACK))
+                Fail(prefix, "%s has %s with bad compression", path, entryPath);
+            if (entry.pathHash != HashPath(entryPath))
+                Fail(prefix, "%s has %s with the wrong hash", path, entryPath);
+            // Also catches missing buckets and paths held twice.
+            if (Find(entryPath) != &entry)
+                Fail(prefix, "%s cannot find %s", path, entryPath);
+        }
+    }
+    catch (...)
+    {
+        Close();
+        throw;
+    }
+
+    return true;
+}
+
+void AssetPack::Close()
+{
+    m_file.Close();
+    m_header = nullptr;
+    m_entries = nullptr;
+    m_buckets = nullptr;
+    m_paths = nullptr;
+}
+
+const AssetPackEntry* AssetPack::Find(const char* path) const
+{
+    if (!m_header)
+        return nullptr;
+
+    const uint64_t hash = HashPath(path);
+    const uint32_t mask = m_header->bucketCount - 1;
+    uint32_t bucket = uint32_t(hash) & mask;
+    for (uint32_t probe = 0; probe < m_header->bucketCount; ++probe, bucket = (bucket + 1) & mask)
+    {
+        const uint32_t index = m_buckets[bucket];
+        if (index == EMPTY_BUCKET)
+            return nullptr;
+        const AssetPackEntry& entry = m_entries[index];
+        if (entry.pathHash == hash && SamePath(GetPath(entry), path))
+            return &entry;
+    }
+    return nullptr;
+}
+
+AssetPack::Bytes AssetPack::Get(const AssetPackEntry& entry, std::vector<uint8_t>& storage) const
+{
+    const uint8_t* payload = m_file.data() + entry.offset;
+    if (entry.compression == AssetPackStored)
+        return Bytes{ payload, size_t(entry.size) };
+
+    storage.resize(size_t(entry.size));
+    if (!DecompressLz4(payload, size_t(entry.storedSize), storage.data(), storage.size())
+        || HashContents(storage.data(), storage.size()) != entry.contentHash)
+        Fail("AssetPack: ", "%s is corrupt", GetPath(entry));
+    return Bytes{ storage.data(), storage.size() };
+}
+
+uint64_t AssetPack::HashPath(const char* path)
+{
+    return FileFormat::HashPath(SkipCurrentDirectory(path));
+}
+
+uint64_t AssetPack::HashContents(const uint8_t* data, size_t size)
+{
+    return FileFormat::Hash(data, size);
+}
+
+void AssetPackWriter::Add(const char* path, std::vector<uint8_t> contents, bool compress)
+{
+    std::string stored = SkipCurrentDirectory(path);
+    std::replace(stored.begin(), stored.end(), '\\', '/');
+    if (stored.empty())
+        Fail("AssetPackWriter: ", "an asset has no path");
+
+    const uint64_t hash = AssetPack::HashPath(stored.c_str());
+    for (const Entry& entry : m_entries)
+    {
+        if (AssetPack::HashPath(entry.path.c_str()) != hash)
+            continue;
+        if (SamePath(entry.path.c_str(), stored.c_str()))
+            Fail("AssetPackWriter: ", "%s is added twice", stored.c_str());
+        Fail("AssetPackWriter: ", "%s has the same hash as %s", stored.c_str(), entry.path.c_str());
+    }
+
+    m_entries.push_back(Entry{ std::move(stored), std::move(contents), compress, AssetPackStored, 0 });
+}
+
+bool AssetPackWriter::Save(const char* path, DX::JobSystem* jobs)
+{
+    if (!IsPowerOfTwo(m_pageSize) || m_pageSize < 8)
+        Fail("AssetPackWriter: ", "page size %u is not a power of two of at least 8", m_pageSize);
+
+    std::sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) { return a.path < b.path; });
+
+    // Compressed only where it saves an eighth or more; the rest is stored as it is.
+    std::vector<std::vector<uint8_t>> compressed(m_entries.size());
+    auto compress = [this, &compressed](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            Entry& entry = m_entries[i];
+            entry.compression = AssetPackStored;
+            entry.storedSize = entry.contents.size();
+            if (!entry.compress || entry.contents.empty())
+                continue;
+
+            std::vector<uint8_t> block = CompressLz4(entry.contents.data(), entry.contents.size());
+            if (block.size() <= entry.contents.size() - entry.contents.size() / 8)
+            {
+                entry.compression = AssetPackLz4;
+                entry.storedSize = block.size();
+                compressed[i] = std::move(block);
+            }
+        }
+    };
+    if (jobs)
+    {
+        jobs->ParallelFor(m_entries.size(), 1, compress);
+    }
+    else
+    {
+        compress(0, m_entries.size());
+    }
+
+    const uint32_t entryCount = uint32_t(m_entries.size());
+    uint32_t bucketCount = 1;
+    while (bucketCount <= entryCount * 2)
+    {
+        bucketCount *= 2;
+    }
+
+    AssetPackHeader header = {};
+    header.magic = AssetPack::Magic;
+    header.version = AssetPack::Version;
+    header.entryCount = entryCount;
+    header.bucketCount = bucketCount;
+    header.pageSize = m_pageSize;
+    header.entryOffset = sizeof(AssetPackHeader);
+    header.bucketOffset = header.entryOffset + uint64_t(entryCount) * sizeof(AssetPackEntry);
+    header.pathOffset = header.bucketOffset + uint64_t(bucketCount) * sizeof(uint32_t);
+
+    std::vector<AssetPackEntry> entries(entryCount);
+    std::vector<uint32_t> buckets(bucketCount, EMPTY_BUCKET);
+    std::string paths;
+    for (uint32_t i = 0; i < entryCount; ++i)
+    {
+        const Entry& source = m_entries[i];
+        AssetPackEntry& entry = entries[i];
+        entry.pathHash = AssetPack::HashPath(source.path.c_str());
+        entry.storedSize = source.storedSize;
+        entry.size = source.contents.size();
+        entry.contentHash = AssetPack::HashContents(source.contents.data(), source.contents.size());
+        entry.pathOffset = uint32_t(paths.size());
+        entry.compression = source.compression;
+        paths.append(source.path.c_str(), source.path.size() + 1);
+
+        uint32_t bucket = uint32_t(entry.pathHash) & (bucketCount - 1);
+        while (buckets[bucket] != EMPTY_BUCKET)
+        {
+            bucket = (bucket + 1) & (bucketCount - 1);
+        }
+        buckets[bucket] = i;
+    }
+    header.pathSize = paths.size();
+
+    uint64_t end = header.pathOffset + header.pathSize;
+    for (AssetPackEntry& entry : entries)
+    {
+        entry.offset = AlignUp(end, m_pageSize);
+        end = entry.offset + entry.storedSize;
+    }
+    header.fileSize = end;
+
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(AssetPackEntry)));
+    file.write(reinterpret_cast<const char*>(buckets.data()), std::streamsize(buckets.size() * sizeof(uint32_t)));
+    file.write(paths.data(), std::streamsize(paths.size()));
+
+    uint64_t written = header.pathOffset + header.pathSize;
+    const std::vector<char> padding(m_pageSize, 0);
+    for (uint32_t i = 0; i < entryCount; ++i)
+    {
+        const AssetPackEntry& entry = entries[i];
+        file.write(padding.data(), std::streamsize(entry.offset - written));
+        const std::vector<uint8_t>& payload = (entry.compression == AssetPackLz4) ? compressed[i] : m_entries[i].contents;
+        file.write(reinterpret_cast<const char*>(payload.data()), std::streamsize(entry.storedSize));
+        written = entry.offset + entry.storedSize;
+    }
+
+    return file.good();
+}
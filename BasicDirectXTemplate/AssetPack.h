@@ -0,0 +1,162 @@
+//
+// AssetPack.h - One memory mapped file holding many assets, found by path hash
+//
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Layout, little endian:
+//
+//  header          AssetPackHeader, 64 bytes
+//  entries         entryCount AssetPackEntry, 48 bytes each
+//  buckets         bucketCount uint32_t entry indices (~0u for none), a power of two
+//                  greater than the entry count, probed linearly from pathHash
+//  paths           the entries' paths, NUL terminated
+//  payloads        each starting on a page boundary, so a stored asset can be used
+//                  straight from the mapping with its own pages
+//
+// Paths are relative, with forward slashes, and match case insensitively and with either
+// slash, as on Windows; pathHash is 64 bit FNV-1a of the path lower cased with forward
+// slashes. Payloads are stored as they are or compressed in the LZ4 block format,
+// whichever the writer was asked for and found worthwhile.
+#pragma pack(push, 8)
+
+struct AssetPackHeader
+{
+    uint32_t    magic;                  // "APAK"
+    uint32_t    version;
+    uint32_t    entryCount;
+    uint32_t    bucketCount;
+    uint32_t    pageSize;               // Payload alignment, a power of two
+    uint32_t    reserved;
+    uint64_t    entryOffset;
+    uint64_t    bucketOffset;
+    uint64_t    pathOffset;
+    uint64_t    pathSize;
+    uint64_t    fileSize;
+};
+
+enum AssetPackCompression : uint32_t
+{
+    AssetPackStored,
+    AssetPackLz4,
+};
+
+struct AssetPackEntry
+{
+    uint64_t    pathHash;
+    uint64_t    offset;                 // Of the payload, a multiple of the page size
+    uint64_t    storedSize;             // In the pack
+    uint64_t    size;                   // Once decompressed
+    uint64_t    contentHash;            // FNV-1a of the decompressed bytes
+    uint32_t    pathOffset;             // Into the paths
+    uint32_t    compression;            // AssetPackCompression
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(AssetPackHeader) == 64, "AssetPackHeader size");
+static_assert(sizeof(AssetPackEntry) == 48, "AssetPackEntry size");
+
+// A pack opened for reading: one open and one mapping, however many assets it holds.
+// Open validates the table of contents, so Find and Get never read outside the file
+// and Get never allocates more than a payload can decompress to.
+// Both are const and safe to call from any thread.
+class AssetPack
+{
+public:
+    static const uint32_t Magic = 0x4b415041;           // "APAK"
+    static const uint32_t Version = 1;
+    static const uint32_t DefaultPageSize = 4096;
+
+    struct Bytes
+    {
+        const uint8_t*  data;
+        size_t          size;
+    };
+
+    AssetPack() noexcept : m_header(nullptr), m_entries(nullptr), m_buckets(nullptr), m_paths(nullptr) {}
+
+    AssetPack(AssetPack&& other) noexcept;
+    AssetPack& operator= (AssetPack&& other) noexcept;
+
+    AssetPack(AssetPack const&) = delete;
+    AssetPack& operator= (AssetPack const&) = delete;
+
+    // Maps path as DX::MapData does, falling back to the executable's directory. Returns
+    // false if there is no such file; throws std::runtime_error if it is not a valid pack.
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const                                 { return m_header != nullptr; }
+    uint32_t GetEntryCount() const                      { return m_header ? m_header->entryCount : 0; }
+    const AssetPackEntry* GetEntries() const            { return m_entries; }
+    const AssetPackHeader& GetHeader() const            { return *m_header; }
+    uint64_t GetFileSize() const                        { return m_file.size(); }
+    const char* GetPath(const AssetPackEntry& entry) const  { return m_paths + entry.pathOffset; }
+
+    // nullptr if the pack does not hold path.
+    const AssetPackEntry* Find(const char* path) const;
+
+    // An entry's contents. Stored entries are a view of the mapping and leave storage
+    // alone; compressed ones are decompressed into storage, which the result then views.
+    // Decompressed contents are checked against the entry's content hash; stored ones
+    // are not, as that would read every page of a view that may only be partly used
+    // (PackCommand checks them when the pack is built). Throws std::runtime_error if a
+    // compressed payload is corrupt or does not decompress to the hashed contents.
+    Bytes Get(const AssetPackEntry& entry, std::vector<uint8_t>& storage) const;
+
+    // Of a path as Find looks it up, and of contents as entries record them.
+    static uint64_t HashPath(const char* path);
+    static uint64_t HashContents(const uint8_t* data, size_t size);
+
+private:
+    DX::MappedFile              m_file;
+    const AssetPackHeader*      m_header;
+    const AssetPackEntry*       m_entries;
+    const uint32_t*             m_buckets;
+    const char*                 m_paths;
+};
+
+// Collects assets and writes them out as a pack.
+class AssetPackWriter
+{
+public:
+    struct Entry
+    {
+        std::string             path;
+        std::vector<uint8_t>    contents;
+        bool                    compress;
+        AssetPackCompression    compression;        // What Save chose
+        uint64_t                storedSize;
+    };
+
+    explicit AssetPackWriter(uint32_t pageSize = AssetPack::DefaultPageSize) noexcept : m_pageSize(pageSize) {}
+
+    // With compress, Save keeps the LZ4 compressed contents if they are at least an
+    // eighth smaller. Throws std::runtime_error if the pack already has the path, or
+    // another path with the same hash.
+    void Add(const char* path, std::vector<uint8_t> contents, bool compress);
+
+    const std::vector<Entry>& GetEntries() const        { return m_entries; }
+
+    // Compressing is done on jobs' threads when given.
+    bool Save(const char* path, DX::JobSystem* jobs = nullptr);
+
+private:
+    uint32_t            m_pageSize;
+    std::vector<Entry>  m_entries;
+};
+
+// The LZ4 block format, without a frame: Compress is a greedy single pass with a hash
+// table of recent positions; Decompress checks every length and offset against both
+// buffers and returns false, rather than reading or writing outside them, if the block
+// is corrupt or does not decompress to exactly outputSize bytes.
+std::vector<uint8_t> CompressLz4(const uint8_t* data, size_t size);
+bool DecompressLz4(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize);
@@ -0,0 +1,115 @@
+//
+// AsteroidField.cpp
+//
+
+#include "AsteroidField.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    const float MIN_ORBIT_SPEED = 0.05f;    // radians per second
+    const float MAX_ORBIT_SPEED = 0.25f;
+    const float MAX_INCLINATION = 0.15f;    // radians
+    const float MAX_SPIN_SPEED = 2.f;       // radians per second
+    const float MIN_SCALE = 0.05f;
+    const float MAX_SCALE = 0.3f;
+
+    // xorshift32; used instead of <random> so every platform builds the same field.
+    class Random
+    {
+    public:
+        explicit Random(uint32_t seed) : m_state(seed ? seed : 0x9e3779b9u) {}
+
+        float Next(float minimum, float maximum)
+        {
+            m_state ^= m_state << 13;
+            m_state ^= m_state >> 17;
+            m_state ^= m_state << 5;
+            return minimum + (maximum - minimum) * float(m_state >> 8) * (1.f / 16777216.f);
+        }
+
+    private:
+        uint32_t m_state;
+    };
+
+    inline XMVECTOR LoadFour(const std::vector<float>& values, size_t index)
+    {
+        return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&values[index]));
+    }
+
+    inline void XM_CALLCONV StoreFour(std::vector<float>& values, size_t index, FXMVECTOR v)
+    {
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&values[index]), v);
+    }
+}
+
+void AsteroidField::Create(size_t count, uint32_t seed, float innerRadius, float outerRadius)
+{
+    m_count = count;
+
+    const size_t padded = (count + BatchSize - 1) / BatchSize * BatchSize;
+    for (auto array : { &m_orbitRadius, &m_orbitAngle, &m_orbitSpeed, &m_inclinationSin, &m_inclinationCos,
+                        &m_spinAngle, &m_spinSpeed, &m_scale, &m_positionX, &m_positionY, &m_positionZ })
+    {
+        array->assign(padded, 0.f);
+    }
+
+    Random random(seed);
+    for (size_t i = 0; i < count; ++i)
+    {
+        float inclination = random.Next(-MAX_INCLINATION, MAX_INCLINATION);
+
+        m_orbitRadius[i] = random.Next(innerRadius, outerRadius);
+        m_orbitAngle[i] = random.Next(-XM_PI, XM_PI);
+        m_orbitSpeed[i] = random.Next(MIN_ORBIT_SPEED, MAX_ORBIT_SPEED);
+        m_inclinationSin[i] = sinf(inclination);
+        m_inclinationCos[i] = cosf(inclination);
+        m_spinAngle[i] = random.Next(-XM_PI, XM_PI);
+        m_spinSpeed[i] = random.Next(-MAX_SPIN_SPEED, MAX_SPIN_SPEED);
+        m_scale[i] = random.Next(MIN_SCALE, MAX_SCALE);
+    }
+
+    UpdateRange(0, m_count, 0.f);
+}
+
+void AsteroidField::UpdateRange(size_t first, size_t count, float elapsedSeconds)
+{
+    const XMVECTOR dt = XMVectorReplicate(elapsedSeconds);
+    const size_t end = std::min(first + count, m_orbitRadius.size());
+
+    for (size_t batch = first; batch < end; batch += BatchSize)
+    {
+        // Two independent groups of four per batch keep both halves of the pipeline busy.
+        for (size_t i = batch; i < batch + BatchSize; i += 4)
+        {
+            XMVECTOR angle = XMVectorMultiplyAdd(LoadFour(m_orbitSpeed, i), dt, LoadFour(m_orbitAngle, i));
+            angle = XMVectorModAngles(angle);
+            StoreFour(m_orbitAngle, i, angle);
+
+            XMVECTOR sinAngle, cosAngle;
+            XMVectorSinCos(&sinAngle, &cosAngle, angle);
+
+            XMVECTOR radius = LoadFour(m_orbitRadius, i);
+            XMVECTOR across = XMVectorMultiply(radius, sinAngle);
+
+            StoreFour(m_positionX, i, XMVectorMultiply(radius, cosAngle));
+            StoreFour(m_positionY, i, XMVectorMultiply(across, LoadFour(m_inclinationSin, i)));
+            StoreFour(m_positionZ, i, XMVectorMultiply(across, LoadFour(m_inclinationCos, i)));
+
+            XMVECTOR spin = XMVectorMultiplyAdd(LoadFour(m_spinSpeed, i), dt, LoadFour(m_spinAngle, i));
+            StoreFour(m_spinAngle, i, XMVectorModAngles(spin));
+        }
+    }
+}
+
+XMMATRIX AsteroidField::GetWorld(size_t index) const
+{
+    XMMATRIX world = XMMatrixScaling(m_scale[index], m_scale[index], m_scale[index]);
+    world = XMMatrixMultiply(world, XMMatrixRotationY(m_spinAngle[index]));
+    world.r[3] = XMVectorSetW(GetPosition(index), 1.f);
+    return world;
+}
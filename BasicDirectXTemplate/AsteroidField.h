@@ -0,0 +1,67 @@
+//
+// AsteroidField.h - Belt of asteroids orbiting the sun, stored as structure of arrays
+//
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+// Every per-asteroid attribute lives in its own array, padded to a multiple of
+// BatchSize, so an update streams through memory eight bodies at a time.
+class AsteroidField
+{
+public:
+    // Asteroids updated per loop iteration (two XMVECTORs per attribute).
+    static const size_t BatchSize = 8;
+
+    AsteroidField() noexcept : m_count(0) {}
+
+    // Scatters count asteroids in a belt around the origin. The layout only depends on seed.
+    void Create(size_t count, uint32_t seed, float innerRadius, float outerRadius);
+
+    // Advances every asteroid.
+    void Update(float elapsedSeconds)                   { UpdateRange(0, m_count, elapsedSeconds); }
+
+    // Advances asteroids [first, first + count). first must be a multiple of BatchSize so
+    // ranges can be handed to different threads; count is rounded up to whole batches.
+    void UpdateRange(size_t first, size_t count, float elapsedSeconds);
+
+    size_t GetCount() const                             { return m_count; }
+
+    DirectX::XMVECTOR GetPosition(size_t index) const
+    {
+        return DirectX::XMVectorSet(m_positionX[index], m_positionY[index], m_positionZ[index], 0.f);
+    }
+
+    // Scale, spin about Y, then translate to the orbit position.
+    DirectX::XMMATRIX GetWorld(size_t index) const;
+
+    // Raw arrays for batch consumers, each GetCount() long (plus padding).
+    const float* GetPositionsX() const                  { return m_positionX.data(); }
+    const float* GetPositionsY() const                  { return m_positionY.data(); }
+    const float* GetPositionsZ() const                  { return m_positionZ.data(); }
+    const float* GetScales() const                      { return m_scale.data(); }
+    const float* GetSpinAngles() const                  { return m_spinAngle.data(); }
+
+private:
+    size_t              m_count;
+
+    // Orbit parameters
+    std::vector<float>  m_orbitRadius;
+    std::vector<float>  m_orbitAngle;
+    std::vector<float>  m_orbitSpeed;
+    std::vector<float>  m_inclinationSin;
+    std::vector<float>  m_inclinationCos;
+
+    // Spin about the asteroid's own Y axis
+    std::vector<float>  m_spinAngle;
+    std::vector<float>  m_spinSpeed;
+    std::vector<float>  m_scale;
+
+    // Results of the last update
+    std::vector<float>  m_positionX;
+    std::vector<float>  m_positionY;
+    std::vector<float>  m_positionZ;
+};
@@ -0,0 +1,1044 @@
+//
+// BlockCompression.cpp
+//
+
+#include "BlockCompression.h"
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_COMPRESSION_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(BLOCK_COMPRESSION_SSE2) && defined(__AVX2__)
+#define BLOCK_COMPRESSION_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const uint32_t BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    const char* const FORMAT_NAMES[BlockFormatCount] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+    const char* const QUALITY_NAMES[BlockQualityCount] = { "fast", "normal", "high" };
+    const char* const INSTRUCTION_SET_NAMES[] = { "scalar", "SSE2", "AVX2" };
+
+    // A block's texels a channel at a time, for the SIMD loops.
+    struct BlockTexels
+    {
+        alignas(32) float   channels[4][16];
+    };
+
+    // Up to 16 entries of up to 4 channels.
+    typedef float Palette[16][4];
+
+    // Channels [first, first + count) of the texels and palette take part.
+    struct ChannelRange
+    {
+        uint32_t    first;
+        uint32_t    count;
+    };
+
+    void LoadTexels(const uint8_t* rgba, BlockTexels& texels)
+    {
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                texels.channels[c][i] = rgba[i * 4 + c];
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------------------
+    // Index selection: the nearest palette entry to every texel
+    //-------------------------------------------------------------------------------------
+
+    // Each returns the summed squared error. Distances are sums of squared integers well
+    // below 2^24, so they are exact in floats and every version picks the same indices
+    // (the first of equally near entries) and returns the same error.
+    float SelectIndicesScalar(const BlockTexels& texels, const Palette& palette, uint32_t count,
+        ChannelRange channels, uint8_t* indices)
+    {
+        float error = 0.f;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            float bestDistance = FLT_MAX;
+            uint32_t best = 0;
+            for (uint32_t p = 0; p < count; ++p)
+            {
+                float distance = 0.f;
+                for (uint32_t c = channels.first; c < channels.first + channels.count; ++c)
+                {
+                    const float delta = texels.channels[c][i] - palette[p][c];
+                    distance += delta * delta;
+                }
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices[i] = uint8_t(best);
+            error += bestDistance;
+        }
+        return error;
+    }
+
+#if defined(BLOCK_COMPRESSION_SSE2)
+    float SelectIndicesSse2(const BlockTexels& texels, const Palette& palette, uint32_t count,
+        ChannelRange channels, uint8_t* indices)
+    {
+        alignas(16) float distances[16];
+        alignas(16) int32_t best[16];
+        for (uint32_t group = 0; group < 16; group += 4)
+        {
+            __m128 bestDistance = _mm_set1_ps(FLT_MAX);
+            __m128i bestIndex = _mm_setzero_si128();
+            for (uint32_t p = 0; p < count; ++p)
+            {
+                __m128 distance = _mm_setzero_ps();
+                for (uint32_t c = channels.first; c < channels.first + channels.count; ++c)
+                {
+                    const __m128 delta = _mm_sub_ps(_mm_load_ps(&texels.channels[c][group]), _mm_set1_ps(palette[p][c]));
+                    distance = _mm_add_ps(distance, _mm_mul_ps(delta, delta));
+                }
+                const __m128i nearer = _mm_castps_si128(_mm_cmplt_ps(distance, bestDistance));
+                bestDistance = _mm_min_ps(distance, bestDistance);
+                bestIndex = _mm_or_si128(_mm_and_si128(nearer, _mm_set1_epi32(int32_t(p))),
+                    _mm_andnot_si128(nearer, bestIndex));
+            }
+            _mm_store_ps(&distances[group], bestDistance);
+            _mm_store_si128(reinterpret_cast<__m128i*>(&best[group]), bestIndex);
+        }
+
+        float error = 0.f;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            indices[i] = uint8_t(best[i]);
+            error += distances[i];
+        }
+        return error;
+    }
+#endif
+
+#if defined(BLOCK_COMPRESSION_AVX2)
+    float SelectIndicesAvx2(const BlockTexels& texels, const Palette& palette, uint32_t count,
+        ChannelRange channels, uint8_t* indices)
+    {
+        alignas(32) float distances[16];
+        alignas(32) int32_t best[16];
+        for (uint32_t group = 0; group < 16; group += 8)
+        {
+            __m256 bestDistance = _mm256_set1_ps(FLT_MAX);
+            __m256i bestIndex = _mm256_setzero_si256();
+            for (uint32_t p = 0; p < count; ++p)
+            {
+                __m256 distance = _mm256_setzero_ps();
+                for (uint32_t c = channels.first; c < channels.first + channels.count; ++c)
+                {
+                    const __m256 delta = _mm256_sub_ps(_mm256_load_ps(&texels.channels[c][group]),
+                        _mm256_set1_ps(palette[p][c]));
+                    distance = _mm256_add_ps(distance, _mm256_mul_ps(delta, delta));
+                }
+                const __m256 nearer = _mm256_cmp_ps(distance, bestDistance, _CMP_LT_OQ);
+                bestDistance = _mm256_min_ps(distance, bestDistance);
+                bestIndex = _mm256_blendv_epi8(bestIndex, _mm256_set1_epi32(int32_t(p)), _mm256_castps_si256(nearer));
+            }
+            _mm256_store_ps(&distances[group], bestDistance);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&best[group]), bestIndex);
+        }
+
+        float error = 0.f;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            indices[i] = uint8_t(best[i]);
+            error += distances[i];
+        }
+        return error;
+    }
+#endif
+
+    float SelectIndices(BlockInstructionSet instructionSet, const BlockTexels& texels, const Palette& palette,
+        uint32_t count, ChannelRange channels, uint8_t* indices)
+    {
+#if defined(BLOCK_COMPRESSION_AVX2)
+        if (instructionSet == BlockAvx2)
+            return SelectIndicesAvx2(texels, palette, count, channels, indices);
+#endif
+#if defined(BLOCK_COMPRESSION_SSE2)
+        if (instructionSet != BlockScalar)
+            return SelectIndicesSse2(texels, palette, count, channels, indices);
+#endif
+        (void)instructionSet;
+        return SelectIndicesScalar(texels, palette, count, channels, indices);
+    }
+
+    //-------------------------------------------------------------------------------------
+    // Endpoint fitting shared by BC1 and BC7
+    //-------------------------------------------------------------------------------------
+
+    // The texels' extremes along their principal axis.
+    void FitPrincipalAxis(const BlockTexels& texels, ChannelRange channels, float* low, float* high)
+    {
+        const uint32_t first = channels.first, last = channels.first + channels.count;
+
+        float mean[4] = {};
+        for (uint32_t c = first; c < last; ++c)
+        {
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                mean[c] += texels.channels[c][i];
+            }
+            mean[c] /= 16.f;
+        }
+
+        float covariance[4][4] = {};
+        for (uint32_t a = first; a < last; ++a)
+        {
+            for (uint32_t b = a; b < last; ++b)
+            {
+                float sum = 0.f;
+                for (uint32_t i = 0; i < 16; ++i)
+                {
+                    sum += (texels.channels[a][i] - mean[a]) * (texels.channels[b][i] - mean[b]);
+                }
+                covariance[a][b] = covariance[b][a] = sum;
+            }
+        }
+
+        // Power iteration from the diagonal, which converges quickly for these sizes.
+        float axis[4] = {};
+        for (uint32_t c = first; c < last; ++c)
+        {
+            axis[c] = covariance[c][c];
+        }
+        for (uint32_t iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[4] = {};
+            float largest = 0.f;
+            for (uint32_t a = first; a < last; ++a)
+            {
+                for (uint32_t b = first; b < last; ++b)
+                {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+                largest = std::max(largest, fabsf(next[a]));
+            }
+            if (largest < FLT_EPSILON)
+                break;
+            for (uint32_t c = first; c < last; ++c)
+            {
+                axis[c] = next[c] / largest;
+            }
+        }
+
+        float lowest = FLT_MAX, highest = -FLT_MAX;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            float projection = 0.f;
+            for (uint32_t c = first; c < last; ++c)
+            {
+                projection += (texels.channels[c][i] - mean[c]) * axis[c];
+            }
+            lowest = std::min(lowest, projection);
+            highest = std::max(highest, projection);
+        }
+
+        float lengthSquared = 0.f;
+        for (uint32_t c = first; c < last; ++c)
+        {
+            lengthSquared += axis[c] * axis[c];
+        }
+        const float scale = (lengthSquared > FLT_EPSILON) ? 1.f / lengthSquared : 0.f;
+        for (uint32_t c = first; c < last; ++c)
+        {
+            low[c] = std::min(std::max(mean[c] + axis[c] * lowest * scale, 0.f), 255.f);
+            high[c] = std::min(std::max(mean[c] + axis[c] * highest * scale, 0.f), 255.f);
+        }
+    }
+
+    // Least squares endpoints for the texels' current interpolation weights (0 at low,
+    // 1 at high). Returns false when the weights do not constrain both endpoints.
+    bool RefineEndpoints(const BlockTexels& texels, ChannelRange channels, const float* weights, float* low, float* high)
+    {
+        float aa = 0.f, ab = 0.f, bb = 0.f;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            aa += (1.f - weights[i]) * (1.f - weights[i]);
+            ab += (1.f - weights[i]) * weights[i];
+            bb += weights[i] * weights[i];
+        }
+
+        const float determinant = aa * bb - ab * ab;
+        if (fabsf(determinant) < 1e-6f)
+            return false;
+
+        for (uint32_t c = channels.first; c < channels.first + channels.count; ++c)
+        {
+            float ax = 0.f, bx = 0.f;
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                ax += (1.f - weights[i]) * texels.channels[c][i];
+                bx += weights[i] * texels.channels[c][i];
+            }
+            low[c] = std::min(std::max((ax * bb - bx * ab) / determinant, 0.f), 255.f);
+            high[c] = std::min(std::max((bx * aa - ax * ab) / determinant, 0.f), 255.f);
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------------------------------
+    // BC1, and the colour half of BC3
+    //-------------------------------------------------------------------------------------
+
+    const ChannelRange BC1_CHANNELS = { 0, 3 };
+    const uint32_t BC1_BITS[3] = { 5, 6, 5 };
+    const uint32_t BC1_SHIFTS[3] = { 11, 5, 0 };
+
+    inline uint32_t To565(const float* color)
+    {
+        uint32_t packed = 0;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            const float maximum = float((1u << BC1_BITS[c]) - 1);
+            packed |= uint32_t(color[c] * maximum / 255.f + 0.5f) << BC1_SHIFTS[c];
+        }
+        return packed;
+    }
+
+    inline void From565(uint32_t color, float* rgb)
+    {
+        const uint32_t r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = float((r << 3) | (r >> 2));
+        rgb[1] = float((g << 2) | (g >> 4));
+        rgb[2] = float((b << 3) | (b >> 2));
+    }
+
+    // Four colour mode palette: the endpoints, then the colours a third and two thirds
+    // of the way from color0 to color1.
+    float EvaluateBC1(const BlockTexels& texels, uint32_t color0, uint32_t color1, BlockInstructionSet instructionSet,
+        uint8_t* indices)
+    {
+        Palette palette;
+        From565(color0, palette[0]);
+        From565(color1, palette[1]);
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+            palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+        }
+        return SelectIndices(instructionSet, texels, palette, 4, BC1_CHANNELS, indices);
+    }
+
+    void CompressColorBlock(const BlockTexels& texels, uint8_t* block, BlockQuality quality,
+        BlockInstructionSet instructionSet)
+    {
+        float low[4], high[4];
+        FitPrincipalAxis(texels, BC1_CHANNELS, low, high);
+
+        uint32_t color0 = To565(high), color1 = To565(low);
+        uint8_t indices[16];
+        float error = EvaluateBC1(texels, color0, color1, instructionSet, indices);
+
+        // Least squares passes over the chosen palette weights, while they help.
+        static const float WEIGHTS[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+        const uint32_t passes = (quality == BlockQualityFast) ? 0 : (quality == BlockQualityNormal) ? 2 : 8;
+        for (uint32_t pass = 0; pass < passes && error > 0.f; ++pass)
+        {
+            float weights[16];
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                weights[i] = WEIGHTS[indices[i]];
+            }
+            if (!RefineEndpoints(texels, BC1_CHANNELS, weights, high, low))
+                break;
+
+            const uint32_t refined0 = To565(high), refined1 = To565(low);
+            uint8_t refinedIndices[16];
+            const float refinedError = EvaluateBC1(texels, refined0, refined1, instructionSet, refinedIndices);
+            if (refinedError >= error)
+                break;
+            color0 = refined0;
+            color1 = refined1;
+            memcpy(indices, refinedIndices, sizeof(indices));
+            error = refinedError;
+        }
+
+        // Nudge each endpoint channel a step up or down while that lowers the error.
+        for (uint32_t round = 0; quality == BlockQualityHigh && round < 4 && error > 0.f; ++round)
+        {
+            bool improved = false;
+            for (uint32_t endpoint = 0; endpoint < 2; ++endpoint)
+            {
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    for (int32_t step = -1; step <= 1; step += 2)
+                    {
+                        uint32_t colors[2] = { color0, color1 };
+                        const uint32_t mask = (1u << BC1_BITS[c]) - 1;
+                        const int32_t value = int32_t((colors[endpoint] >> BC1_SHIFTS[c]) & mask) + step;
+                        if (value < 0 || value > int32_t(mask))
+                            continue;
+                        colors[endpoint] = (colors[endpoint] & ~(mask << BC1_SHIFTS[c])) | (uint32_t(value) << BC1_SHIFTS[c]);
+
+                        uint8_t candidateIndices[16];
+                        const float candidateError = EvaluateBC1(texels, colors[0], colors[1], instructionSet,
+                            candidateIndices);
+                        if (candidateError < error)
+                        {
+                            color0 = colors[0];
+                            color1 = colors[1];
+                            memcpy(indices, candidateIndices, sizeof(indices));
+                            error = candidateError;
+                            improved = true;
+                        }
+                    }
+                }
+            }
+            if (!improved)
+                break;
+        }
+
+        // color0 > color1 selects four colour mode; swapping the endpoints swaps 0 with 1
+        // and 2 with 3. Equal endpoints are three colour mode, where index 0 still works.
+        uint32_t packed = 0;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            packed |= uint32_t(indices[i]) << (i * 2);
+        }
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+            packed ^= 0x55555555;
+        }
+        else if (color0 == color1)
+        {
+            packed = 0;
+        }
+
+        block[0] = uint8_t(color0);
+        block[1] = uint8_t(color0 >> 8);
+        block[2] = uint8_t(color1);
+        block[3] = uint8_t(color1 >> 8);
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            block[4 + i] = uint8_t(packed >> (i * 8));
+        }
+    }
+
+    //-------------------------------------------------------------------------------------
+    // BC4, and the alpha half of BC3 and both halves of BC5
+    //-------------------------------------------------------------------------------------
+
+    // Endpoint 0 above endpoint 1 gives six values between them; otherwise four, and
+    // 0 and 255.
+    float EvaluateBC4(const BlockTexels& texels, uint32_t channel, uint32_t endpoint0, uint32_t endpoint1,
+        BlockInstructionSet instructionSet, uint8_t* indices)
+    {
+        Palette palette;
+        palette[0][channel] = float(endpoint0);
+        palette[1][channel] = float(endpoint1);
+        if (endpoint0 > endpoint1)
+        {
+            for (uint32_t i = 2; i < 8; ++i)
+            {
+                palette[i][channel] = float((8 - i) * endpoint0 + (i - 1) * endpoint1) / 7.f;
+            }
+        }
+        else
+        {
+            for (uint32_t i = 2; i < 6; ++i)
+            {
+                palette[i][channel] = float((6 - i) * endpoint0 + (i - 1) * endpoint1) / 5.f;
+            }
+            palette[6][channel] = 0.f;
+            palette[7][channel] = 255.f;
+        }
+        return SelectIndices(instructionSet, texels, palette, 8, ChannelRange{ channel, 1 }, indices);
+    }
+
+    void CompressAlphaBlock(const BlockTexels& texels, uint32_t channel, uint8_t* block, BlockQuality quality,
+        BlockInstructionSet instructionSet)
+    {
+        // The range, and the range without the values six value mode has for free.
+        uint32_t low = 255, high = 0, innerLow = 255, innerHigh = 0;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            const uint32_t value = uint32_t(texels.channels[channel][i]);
+            low = std::min(low, value);
+            high = std::max(high, value);
+            if (value != 0 && value != 255)
+            {
+                innerLow = std::min(innerLow, value);
+                innerHigh = std::max(innerHigh, value);
+            }
+        }
+
+        uint32_t endpoint0 = high, endpoint1 = low;
+        uint8_t indices[16] = {};
+        float error = 0.f;
+        if (high > low)
+        {
+            error = EvaluateBC4(texels, channel, endpoint0, endpoint1, instructionSet, indices);
+
+            auto consider = [&](uint32_t candidate0, uint32_t candidate1)
+            {
+                uint8_t candidateIndices[16];
+                const float candidateError = EvaluateBC4(texels, channel, candidate0, candidate1, instructionSet,
+                    candidateIndices);
+                if (candidateError < error)
+                {
+                    endpoint0 = candidate0;
+                    endpoint1 = candidate1;
+                    memcpy(indices, candidateIndices, sizeof(indices));
+                    error = candidateError;
+                }
+            };
+
+            if (quality != BlockQualityFast && (low == 0 || high == 255) && innerLow <= innerHigh)
+            {
+                consider(innerLow, innerHigh);
+            }
+
+            // Pulling the endpoints in spends the palette on where the values are.
+            if (quality == BlockQualityHigh)
+            {
+                for (uint32_t inset0 = 0; inset0 < 4; ++inset0)
+                {
+                    for (uint32_t inset1 = 0; inset1 < 4; ++inset1)
+                    {
+                        if (high - inset0 > low + inset1 && (inset0 || inset1))
+                        {
+                            consider(high - inset0, low + inset1);
+                        }
+                    }
+                }
+            }
+        }
+
+        block[0] = uint8_t(endpoint0);
+        block[1] = uint8_t(endpoint1);
+        uint64_t packed = 0;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            packed |= uint64_t(indices[i]) << (i * 3);
+        }
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            block[2 + i] = uint8_t(packed >> (i * 8));
+        }
+    }
+
+    //-------------------------------------------------------------------------------------
+    // BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints with a p-bit each, 4 bit indices
+    //-------------------------------------------------------------------------------------
+
+    const ChannelRange BC7_CHANNELS = { 0, 4 };
+
+    struct Bc7Endpoint
+    {
+        uint32_t    color[4];       // 7 bits each
+        uint32_t    pbit;
+    };
+
+    // Quantizes an endpoint to 7 bits per channel with the given p-bit.
+    Bc7Endpoint QuantizeBC7Endpoint(const float* color, uint32_t pbit)
+    {
+        Bc7Endpoint endpoint;
+        endpoint.pbit = pbit;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            const float value = (color[c] - float(pbit)) / 2.f;
+            endpoint.color[c] = uint32_t(std::min(std::max(value + 0.5f, 0.f), 127.f));
+        }
+        return endpoint;
+    }
+
+    // With the p-bit that keeps it nearest.
+    Bc7Endpoint QuantizeBC7Endpoint(const float* color)
+    {
+        Bc7Endpoint best = {};
+        float bestError = FLT_MAX;
+        for (uint32_t pbit = 0; pbit < 2; ++pbit)
+        {
+            const Bc7Endpoint endpoint = QuantizeBC7Endpoint(color, pbit);
+            float error = 0.f;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                const float delta = float((endpoint.color[c] << 1) | pbit) - color[c];
+                error += delta * delta;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best = endpoint;
+            }
+        }
+        return best;
+    }
+
+    float EvaluateBC7(const BlockTexels& texels, const Bc7Endpoint& endpoint0, const Bc7Endpoint& endpoint1,
+        BlockInstructionSet instructionSet, uint8_t* indices)
+    {
+        Palette palette;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            const uint32_t e0 = (endpoint0.color[c] << 1) | endpoint0.pbit;
+            const uint32_t e1 = (endpoint1.color[c] << 1) | endpoint1.pbit;
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                palette[i][c] = float(((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6);
+            }
+        }
+        return SelectIndices(instructionSet, texels, palette, 16, BC7_CHANNELS, indices);
+    }
+
+    // Appends bits to a 128 bit block, least significant first.
+    class BlockWriter
+    {
+    public:
+        explicit BlockWriter(uint8_t* block) : m_block(block), m_position(0)
+        {
+            memset(block, 0, 16);
+        }
+
+        void Write(uint32_t value, uint32_t bits)
+        {
+            for (uint32_t i = 0; i < bits; ++i, ++m_position)
+            {
+                m_block[m_position >> 3] |= uint8_t(((value >> i) & 1) << (m_position & 7));
+            }
+        }
+
+    private:
+        uint8_t*    m_block;
+        uint32_t    m_position;
+    };
+
+    class BlockReader
+    {
+    public:
+        explicit BlockReader(const uint8_t* block) : m_block(block), m_position(0)
+        {
+        }
+
+        uint32_t Read(uint32_t bits)
+        {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < bits; ++i, ++m_position)
+            {
+                value |= uint32_t((m_block[m_position >> 3] >> (m_position & 7)) & 1) << i;
+            }
+            return value;
+        }
+
+    private:
+        const uint8_t*  m_block;
+        uint32_t        m_position;
+    };
+
+    void CompressBC7Block(const BlockTexels& texels, uint8_t* block, BlockQuality quality,
+        BlockInstructionSet instructionSet)
+    {
+        float low[4], high[4];
+        FitPrincipalAxis(texels, BC7_CHANNELS, low, high);
+
+        Bc7Endpoint endpoints[2] = { QuantizeBC7Endpoint(low), QuantizeBC7Endpoint(high) };
+        uint8_t indices[16];
+        float error = EvaluateBC7(texels, endpoints[0], endpoints[1], instructionSet, indices);
+
+        auto consider = [&](const Bc7Endpoint& candidate0, const Bc7Endpoint& candidate1)
+        {
+            uint8_t candidateIndices[16];
+            const float candidateError = EvaluateBC7(texels, candidate0, candidate1, instructionSet, candidateIndices);
+            if (candidateError >= error)
+                return false;
+            endpoints[0] = candidate0;
+            endpoints[1] = candidate1;
+            memcpy(indices, candidateIndices, sizeof(indices));
+            error = candidateError;
+            return true;
+        };
+
+        // High tries every p-bit pair for the refined endpoints, not just the nearest.
+        const uint32_t passes = (quality == BlockQualityFast) ? 0 : (quality == BlockQualityNormal) ? 2 : 6;
+        for (uint32_t pass = 0; pass < passes && error > 0.f; ++pass)
+        {
+            float weights[16];
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                weights[i] = BC7_WEIGHTS[indices[i]] / 64.f;
+            }
+            if (!RefineEndpoints(texels, BC7_CHANNELS, weights, low, high))
+                break;
+
+            bool improved = consider(QuantizeBC7Endpoint(low), QuantizeBC7Endpoint(high));
+            if (quality == BlockQualityHigh)
+            {
+                for (uint32_t pbits = 0; pbits < 4; ++pbits)
+                {
+                    improved |= consider(QuantizeBC7Endpoint(low, pbits & 1), QuantizeBC7Endpoint(high, pbits >> 1));
+                }
+            }
+            if (!improved)
+                break;
+        }
+
+        // Nudge each endpoint channel, and flip each p-bit, while that lowers the error.
+        for (uint32_t round = 0; quality == BlockQualityHigh && round < 4 && error > 0.f; ++round)
+        {
+            bool improved = false;
+            for (uint32_t endpoint = 0; endpoint < 2; ++endpoint)
+            {
+                for (uint32_t c = 0; c < 5; ++c)
+                {
+                    for (int32_t step = -1; step <= 1; step += 2)
+                    {
+                        Bc7Endpoint candidates[2] = { endpoints[0], endpoints[1] };
+                        if (c == 4)
+                        {
+                            if (step > 0)
+                                continue;
+                            candidates[endpoint].pbit ^= 1;
+                        }
+                        else
+                        {
+                            const int32_t value = int32_t(candidates[endpoint].color[c]) + step;
+                            if (value < 0 || value > 127)
+                                continue;
+                            candidates[endpoint].color[c] = uint32_t(value);
+                        }
+                        improved |= consider(candidates[0], candidates[1]);
+                    }
+                }
+            }
+            if (!improved)
+                break;
+        }
+
+        // The first texel's index has an implicit top bit of 0; swap the endpoints if not.
+        if (indices[0] & 8)
+        {
+            std::swap(endpoints[0], endpoints[1]);
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                indices[i] = uint8_t(15 - indices[i]);
+            }
+        }
+
+        BlockWriter writer(block);
+        writer.Write(1 << 6, 7);
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            writer.Write(endpoints[0].color[c], 7);
+            writer.Write(endpoints[1].color[c], 7);
+        }
+        writer.Write(endpoints[0].pbit, 1);
+        writer.Write(endpoints[1].pbit, 1);
+        writer.Write(indices[0], 3);
+        for (uint32_t i = 1; i < 16; ++i)
+        {
+            writer.Write(indices[i], 4);
+        }
+    }
+
+    //-------------------------------------------------------------------------------------
+    // Decoding
+    //-------------------------------------------------------------------------------------
+
+    void DecompressColorBlock(const uint8_t* block, uint8_t* texels, bool allowThreeColor)
+    {
+        const uint32_t color0 = block[0] | (uint32_t(block[1]) << 8);
+        const uint32_t color1 = block[2] | (uint32_t(block[3]) << 8);
+
+        float palette[4][3];
+        From565(color0, palette[0]);
+        From565(color1, palette[1]);
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            if (color0 > color1 || !allowThreeColor)
+            {
+                palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+                palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2.f;
+                palette[3][c] = 0.f;
+            }
+        }
+
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            const uint32_t index = (block[4 + i / 4] >> ((i % 4) * 2)) & 3;
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                texels[i * 4 + c] = uint8_t(palette[index][c] + 0.5f);
+            }
+        }
+    }
+
+    void DecompressAlphaBlock(const uint8_t* block, uint8_t* texels, uint32_t channel)
+    {
+        const uint32_t endpoint0 = block[0], endpoint1 = block[1];
+        float palette[8] = { float(endpoint0), float(endpoint1) };
+        if (endpoint0 > endpoint1)
+        {
+            for (uint32_t i = 2; i < 8; ++i)
+            {
+                palette[i] = float((8 - i) * endpoint0 + (i - 1) * endpoint1) / 7.f;
+            }
+        }
+        else
+        {
+            for (uint32_t i = 2; i < 6; ++i)
+            {
+                palette[i] = float((6 - i) * endpoint0 + (i - 1) * endpoint1) / 5.f;
+            }
+            palette[6] = 0.f;
+            palette[7] = 255.f;
+        }
+
+        uint64_t packed = 0;
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            packed |= uint64_t(block[2 + i]) << (i * 8);
+        }
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            texels[i * 4 + channel] = uint8_t(palette[(packed >> (i * 3)) & 7] + 0.5f);
+        }
+    }
+
+    void DecompressBC7Block(const uint8_t* block, uint8_t* texels)
+    {
+        BlockReader reader(block);
+        if (reader.Read(7) != (1 << 6))
+            return;
+
+        uint32_t endpoints[2][4];
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] = reader.Read(7) << 1;
+            endpoints[1][c] = reader.Read(7) << 1;
+        }
+        const uint32_t pbit0 = reader.Read(1), pbit1 = reader.Read(1);
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] |= pbit0;
+            endpoints[1][c] |= pbit1;
+        }
+
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            const uint32_t weight = BC7_WEIGHTS[reader.Read(i ? 4 : 3)];
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                texels[i * 4 + c] = uint8_t(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+            }
+        }
+    }
+
+    // Gathers a block's texels, repeating the last row and column past the edges.
+    void GatherBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, uint8_t* texels)
+    {
+        for (uint32_t y = 0; y < 4; ++y)
+        {
+            const uint32_t sourceY = std::min(by * 4 + y, height - 1);
+            for (uint32_t x = 0; x < 4; ++x)
+            {
+                const uint32_t sourceX = std::min(bx * 4 + x, width - 1);
+                memcpy(texels + (y * 4 + x) * 4, pixels + (size_t(sourceY) * width + sourceX) * 4, 4);
+            }
+        }
+    }
+}
+
+BlockOptions GetDefaultBlockOptions()
+{
+    return BlockOptions{ BlockQualityNormal, GetBestInstructionSet(), nullptr };
+}
+
+BlockInstructionSet GetBestInstructionSet()
+{
+#if defined(BLOCK_COMPRESSION_AVX2)
+    return BlockAvx2;
+#elif defined(BLOCK_COMPRESSION_SSE2)
+    return BlockSse2;
+#else
+    return BlockScalar;
+#endif
+}
+
+const char* GetInstructionSetName(BlockInstructionSet instructionSet)
+{
+    return INSTRUCTION_SET_NAMES[instructionSet];
+}
+
+const char* GetBlockQualityName(BlockQuality quality)
+{
+    return QUALITY_NAMES[quality];
+}
+
+const char* GetBlockFormatName(BlockFormat format)
+{
+    return FORMAT_NAMES[format];
+}
+
+uint32_t GetBlockBytes(BlockFormat format)
+{
+    return (format == BlockBC1 || format == BlockBC4) ? 8 : 16;
+}
+
+uint32_t GetBlockChannelMask(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockBC1:  return 0x7;
+    case BlockBC4:  return 0x1;
+    case BlockBC5:  return 0x3;
+    default:        return 0xf;
+    }
+}
+
+void CompressBlock(BlockFormat format, const uint8_t* texels, uint8_t* block, BlockQuality quality,
+    BlockInstructionSet instructionSet)
+{
+    BlockTexels loaded;
+    LoadTexels(texels, loaded);
+
+    switch (format)
+    {
+    case BlockBC1:
+        CompressColorBlock(loaded, block, quality, instructionSet);
+        break;
+    case BlockBC3:
+        CompressAlphaBlock(loaded, 3, block, quality, instructionSet);
+        CompressColorBlock(loaded, block + 8, quality, instructionSet);
+        break;
+    case BlockBC4:
+        CompressAlphaBlock(loaded, 0, block, quality, instructionSet);
+        break;
+    case BlockBC5:
+        CompressAlphaBlock(loaded, 0, block, quality, instructionSet);
+        CompressAlphaBlock(loaded, 1, block + 8, quality, instructionSet);
+        break;
+    default:
+        CompressBC7Block(loaded, block, quality, instructionSet);
+        break;
+    }
+}
+
+void DecompressBlock(BlockFormat format, const uint8_t* block, uint8_t* texels)
+{
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        texels[i * 4 + 0] = texels[i * 4 + 1] = texels[i * 4 + 2] = 0;
+        texels[i * 4 + 3] = 255;
+    }
+
+    switch (format)
+    {
+    case BlockBC1:
+        DecompressColorBlock(block, texels, true);
+        break;
+    case BlockBC3:
+        DecompressAlphaBlock(block, texels, 3);
+        DecompressColorBlock(block + 8, texels, false);
+        break;
+    case BlockBC4:
+        DecompressAlphaBlock(block, texels, 0);
+        break;
+    case BlockBC5:
+        DecompressAlphaBlock(block, texels, 0);
+        DecompressAlphaBlock(block + 8, texels, 1);
+        break;
+    default:
+        DecompressBC7Block(block, texels);
+        break;
+    }
+}
+
+std::vector<uint8_t> CompressImage(const uint8_t* pixels, uint32_t width, uint32_t height, BlockFormat format,
+    const BlockOptions& options)
+{
+    const uint32_t blocksWide = (width + 3) / 4;
+    const uint32_t blocksHigh = (height + 3) / 4;
+    const uint32_t blockBytes = GetBlockBytes(format);
+    std::vector<uint8_t> blocks(size_t(blocksWide) * blocksHigh * blockBytes);
+
+    // Rows of blocks are independent.
+    auto compressRows = [&](size_t begin, size_t end)
+    {
+        uint8_t texels[64];
+        for (size_t by = begin; by < end; ++by)
+        {
+            uint8_t* block = blocks.data() + by * blocksWide * blockBytes;
+            for (uint32_t bx = 0; bx < blocksWide; ++bx, block += blockBytes)
+            {
+                GatherBlock(pixels, width, height, bx, uint32_t(by), texels);
+                CompressBlock(format, texels, block, options.quality, options.instructionSet);
+            }
+        }
+    };
+
+    if (options.jobs)
+    {
+        options.jobs->ParallelFor(blocksHigh, 1, compressRows);
+    }
+    else
+    {
+        compressRows(0, blocksHigh);
+    }
+    return blocks;
+}
+
+std::vector<uint8_t> DecompressImage(const uint8_t* blocks, uint32_t width, uint32_t height, BlockFormat format)
+{
+    const uint32_t blocksWide = (width + 3) / 4;
+    const uint32_t blocksHigh = (height + 3) / 4;
+    const uint32_t blockBytes = GetBlockBytes(format);
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+
+    uint8_t texels[64];
+    for (uint32_t by = 0; by < blocksHigh; ++by)
+    {
+        for (uint32_t bx = 0; bx < blocksWide; ++bx, blocks += blockBytes)
+        {
+            DecompressBlock(format, blocks, texels);
+            for (uint32_t y = 0; y < 4 && by * 4 + y < height; ++y)
+            {
+                const uint32_t columns = std::min(4u, width - bx * 4);
+                memcpy(pixels.data() + (size_t(by * 4 + y) * width + bx * 4) * 4, texels + y * 16, columns * 4);
+            }
+        }
+    }
+    return pixels;
+}
+
+double ComputePsnr(const uint8_t* reference, const uint8_t* image, size_t pixelCount, BlockFormat format)
+{
+    const uint32_t mask = GetBlockChannelMask(format);
+    uint64_t squaredError = 0, samples = 0;
+    for (size_t i = 0; i < pixelCount * 4; ++i)
+    {
+        if (mask & (1u << (i & 3)))
+        {
+            const int32_t delta = int32_t(reference[i]) - int32_t(image[i]);
+            squaredError += uint64_t(delta * delta);
+            ++samples;
+        }
+    }
+
+    if (squaredError == 0)
+        return INFINITY;
+    const double meanSquaredError = double(squaredError) / double(samples);
+    return 10.0 * log10(255.0 * 255.0 / meanSquaredError);
+}
@@ -0,0 +1,87 @@
+//
+// BlockCompression.h - BC1/BC3/BC4/BC5/BC7 encoding of RGBA8 images on the CPU
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DX
+{
+    class JobSystem;
+}
+
+enum BlockFormat : uint32_t
+{
+    BlockBC1,           // RGB, 4 bits per texel
+    BlockBC3,           // RGB as BC1 and alpha as BC4, 8 bits per texel
+    BlockBC4,           // Red only, 4 bits per texel
+    BlockBC5,           // Red and green as two BC4 blocks, 8 bits per texel
+    BlockBC7,           // RGBA, mode 6 only, 8 bits per texel
+    BlockFormatCount
+};
+
+// How hard the encoder searches for endpoints. Fast takes the extremes along the
+// texels' principal axis; Normal adds least squares refinement of the endpoints against
+// the chosen indices; High refines further, tries every BC7 p-bit pair and nudges each
+// endpoint channel a step either way while that lowers the error.
+enum BlockQuality : uint32_t
+{
+    BlockQualityFast,
+    BlockQualityNormal,
+    BlockQualityHigh,
+    BlockQualityCount
+};
+
+// Index selection, the inner loop of every format, compares the 16 texels of a block
+// with each palette entry four (SSE2) or eight (AVX2) texels at a time. AVX2 is used
+// when the compiler targets it (-mavx2, /arch:AVX2), SSE2 on any other x86 or x64
+// build. Every instruction set produces the same blocks.
+enum BlockInstructionSet : uint32_t
+{
+    BlockScalar,
+    BlockSse2,
+    BlockAvx2,
+};
+
+struct BlockOptions
+{
+    BlockQuality            quality;
+    BlockInstructionSet     instructionSet;
+    DX::JobSystem*          jobs;               // Splits the rows of blocks across its threads
+};
+
+// Normal quality, the best instruction set compiled in, on the calling thread.
+BlockOptions GetDefaultBlockOptions();
+
+BlockInstructionSet GetBestInstructionSet();
+const char* GetInstructionSetName(BlockInstructionSet instructionSet);
+const char* GetBlockQualityName(BlockQuality quality);
+const char* GetBlockFormatName(BlockFormat format);
+
+// Bytes in one 4x4 block: 8 or 16.
+uint32_t GetBlockBytes(BlockFormat format);
+
+// The RGBA channels a format keeps, 1 bit each from red up: BC4 keeps 0x1, BC7 0xf.
+uint32_t GetBlockChannelMask(BlockFormat format);
+
+// Compresses the 16 texels of a 4x4 block, RGBA8 in rows, into one block. Colours are
+// fitted as they are stored, as the hardware interpolates them.
+void CompressBlock(BlockFormat format, const uint8_t* texels, uint8_t* block,
+    BlockQuality quality = BlockQualityNormal, BlockInstructionSet instructionSet = GetBestInstructionSet());
+
+// The reverse, for measuring the error. Channels the format does not keep come back as
+// 0 (alpha as 255). Only BC7 mode 6 blocks are decoded; the encoder writes no others.
+void DecompressBlock(BlockFormat format, const uint8_t* block, uint8_t* texels);
+
+// Whole images, blocks in rows. Sizes that are not a multiple of four repeat the last
+// row and column into the partial blocks.
+std::vector<uint8_t> CompressImage(const uint8_t* pixels, uint32_t width, uint32_t height, BlockFormat format,
+    const BlockOptions& options = GetDefaultBlockOptions());
+std::vector<uint8_t> DecompressImage(const uint8_t* blocks, uint32_t width, uint32_t height, BlockFormat format);
+
+// Peak signal to noise ratio in dB over the channels the format keeps, between two
+// RGBA8 images of pixelCount pixels; infinite when they are equal.
+double ComputePsnr(const uint8_t* reference, const uint8_t* image, size_t pixelCount, BlockFormat format);
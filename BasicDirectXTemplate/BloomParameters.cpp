@@ -0,0 +1,152 @@
+//
+// BloomParameters.cpp
+//
+
+#include "BloomParameters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+    struct BlurKernelTable
+    {
+        BlurKernel kernels[BloomQualityCount][BloomPresetCount];
+    };
+
+    constexpr BlurKernelTable MakeBlurKernelTable()
+    {
+        BlurKernelTable table = {};
+        for (int quality = 0; quality < BloomQualityCount; ++quality)
+        {
+            for (int preset = 0; preset < BloomPresetCount; ++preset)
+            {
+                table.kernels[quality][preset] = MakeBlurKernel(g_BloomSampleCounts[quality],
+                    GetLevelBlurAmount(BloomQuality(quality), BloomPresets(preset)));
+            }
+        }
+        return table;
+    }
+
+    constexpr bool KernelsAreValid(const BlurKernelTable& table)
+    {
+        for (int quality = 0; quality < BloomQualityCount; ++quality)
+        {
+            for (int preset = 0; preset < BloomPresetCount; ++preset)
+            {
+                const BlurKernel& kernel = table.kernels[quality][preset];
+                float total = 0.f;
+                for (uint32_t i = 0; i < kernel.sampleCount; ++i)
+                {
+                    total += kernel.weights[i];
+                }
+
+                if (kernel.sampleCount > BlurKernel::MaxSamples || !(kernel.sampleCount & 1)
+                    || total < 0.999f || total > 1.001f || kernel.weights[0] <= 0.f)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr BlurKernelTable BLUR_KERNELS = MakeBlurKernelTable();
+
+    static_assert(KernelsAreValid(BLUR_KERNELS), "Blur kernels must be odd sized and normalised");
+}
+
+const BlurKernel& GetBlurKernel(BloomQuality quality, BloomPresets preset)
+{
+    return BLUR_KERNELS.kernels[quality][preset];
+}
+
+void VS_BLUR_PARAMETERS::SetKernel(const BlurKernel& kernel, float directionX, float directionY)
+{
+    memset(this, 0, sizeof(*this));
+    for (uint32_t i = 0; i < kernel.sampleCount; ++i)
+    {
+        sampleOffsets[i].x = kernel.offsets[i] * directionX;
+        sampleOffsets[i].y = kernel.offsets[i] * directionY;
+        sampleWeights[i].x = kernel.weights[i];
+    }
+}
+
+uint32_t GetBloomLevelLimit(uint32_t sceneWidth, uint32_t sceneHeight)
+{
+    // Level i is (size >> (i + 1)) texels across.
+    const uint32_t smallest = std::min(sceneWidth, sceneHeight) / 2;
+    uint32_t fit = 1;
+    while (fit < BloomChain::MaxLevels && (smallest >> fit) >= BloomChain::MinLevelSize)
+    {
+        ++fit;
+    }
+    return fit;
+}
+
+float GetBloomCost(uint32_t sampleCount, uint32_t levels)
+{
+    // Level i covers 4^-(i + 1) of the scene's pixels.
+    float cost = 0.f;
+    float area = 0.25f;
+    for (uint32_t i = 0; i < levels; ++i)
+    {
+        // Both blur directions, plus the downsample into the level and the upsample
+        // (a sample and a blend) into the level above.
+        cost += area * float(sampleCount * 2);
+        if (i > 0)
+        {
+            cost += area + area * 4 * 2;
+        }
+        area *= 0.25f;
+    }
+    return cost;
+}
+
+float GetBloomBudget(BloomQuality quality)
+{
+    return 1.5f * GetBloomCost(g_BloomSampleCounts[quality], 1);
+}
+
+BloomChain GetBloomChain(BloomPresets preset, BloomQuality quality, uint32_t sceneWidth, uint32_t sceneHeight)
+{
+    const VS_BLOOM_PARAMETERS& params = g_BloomPresets[preset];
+
+    BloomChain chain = {};
+    chain.kernel = &GetBlurKernel(quality, preset);
+
+    // Level i reaches about the kernel's theta * 2^i half size texels.
+    const float levelBlurAmount = chain.kernel->blurAmount;
+    const float reach = std::max(params.blurAmount / levelBlurAmount, 1.f);
+    const uint32_t reachLevels = 1 + static_cast<uint32_t>(std::ceil(std::log2(reach)));
+    const uint32_t glowLevels = 1 + static_cast<uint32_t>(std::floor(std::log2(std::max(params.blurAmount, 1.f))));
+    const float budget = GetBloomBudget(quality);
+    uint32_t levels = std::max(reachLevels, glowLevels);
+    while (levels > reachLevels && GetBloomCost(chain.kernel->sampleCount, levels) > budget)
+    {
+        --levels;
+    }
+    chain.levels = std::min(levels, GetBloomLevelLimit(sceneWidth, sceneHeight));
+
+    const float falloff = params.blurAmount / (params.blurAmount + levelBlurAmount);
+    float total = 0.f;
+    float weight = 1.f;
+    for (uint32_t i = 0; i < chain.levels; ++i)
+    {
+        chain.weights[i] = weight;
+        total += weight;
+        weight *= falloff;
+    }
+
+    // Normalising keeps the preset's bloom intensity whatever the number of levels.
+    float remaining = 1.f;
+    for (uint32_t i = 0; i < chain.levels; ++i)
+    {
+        chain.weights[i] /= total;
+        chain.blendFactors[i] = (i + 1 < chain.levels) ? chain.weights[i] / remaining : 1.f;
+        remaining -= chain.weights[i];
+    }
+
+    return chain;
+}
@@ -0,0 +1,220 @@
+//
+// BloomParameters.h - Bloom settings shared by the post-process shaders and the CPU reference
+//
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Matches cbuffer VS_BLOOM_PARAMETERS in Bloom.hlsli.
+struct VS_BLOOM_PARAMETERS
+{
+    float bloomThreshold;
+    float blurAmount;
+    float bloomIntensity;
+    float baseIntensity;
+    float bloomSaturation;
+    float baseSaturation;
+    uint8_t na[8];
+};
+
+static_assert(!(sizeof(VS_BLOOM_PARAMETERS) % 16),
+    "VS_BLOOM_PARAMETERS needs to be 16 bytes aligned");
+
+enum BloomPresets
+{
+    Default = 0,
+    Soft,
+    Desaturated,
+    Saturated,
+    Blurry,
+    Subtle,
+    None,
+    BloomPresetCount
+};
+
+// constexpr so the blur kernels below can be generated from it at compile time.
+constexpr VS_BLOOM_PARAMETERS g_BloomPresets[BloomPresetCount] =
+{
+    //Thresh  Blur Bloom  Base  BloomSat BaseSat
+    { 0.25f,  4,   1.25f, 1,    1,       1 }, // Default
+    { 0,      3,   1,     1,    1,       1 }, // Soft
+    { 0.5f,   8,   2,     1,    0,       1 }, // Desaturated
+    { 0.25f,  4,   2,     1,    2,       0 }, // Saturated
+    { 0,      2,   1,     0.1f, 1,       1 }, // Blurry
+    { 0.5f,   2,   1,     1,    1,       1 }, // Subtle
+    { 0.25f,  4,   1.25f, 1,    1,       1 }, // None
+};
+
+// Each tier is a GaussianBlur<N>.hlsl permutation with that many taps.
+enum BloomQuality
+{
+    BloomQualityLow = 0,
+    BloomQualityMedium,
+    BloomQualityHigh,
+    BloomQualityUltra,
+    BloomQualityExtreme,
+    BloomQualityCount
+};
+
+constexpr uint32_t g_BloomSampleCounts[BloomQualityCount] = { 7, 11, 15, 23, 31 };
+
+// The game starts on this tier; see GetBloomChain for what each one costs.
+constexpr BloomQuality g_DefaultBloomQuality = BloomQualityHigh;
+
+// The weights and offsets of one GaussianBlur permutation's taps. Offsets are in texels
+// along the blur direction (the shader scales them by the texture's size), so one kernel
+// serves every level of the pyramid and every window size.
+struct BlurKernel
+{
+    static const uint32_t MaxSamples = 31;
+
+    uint32_t    sampleCount;
+    float       blurAmount;                 // Gaussian theta, in texels
+    float       offsets[MaxSamples];
+    float       weights[MaxSamples];        // They sum to 1
+};
+
+namespace BlurKernelDetail
+{
+    // expf for the constant expressions below; x is never positive here. The argument is
+    // halved until the series converges quickly, then the result squared back up.
+    constexpr float Exp(float x)
+    {
+        double reduced = x;
+        int halvings = 0;
+        while (reduced < -0.5)
+        {
+            reduced *= 0.5;
+            ++halvings;
+        }
+
+        double term = 1.0;
+        double sum = 1.0;
+        for (int n = 1; n < 16; ++n)
+        {
+            term *= reduced / n;
+            sum += term;
+        }
+
+        while (halvings-- > 0)
+        {
+            sum *= sum;
+        }
+        return static_cast<float>(sum);
+    }
+
+    // The Gaussian's scale factor cancels out when the weights are normalised.
+    constexpr float Gaussian(float n, float theta)
+    {
+        return Exp(-(n * n) / (2 * theta * theta));
+    }
+}
+
+// The tap layout GaussianBlur has always used: the centre texel, then pairs of taps
+// either side. To get the maximum amount of blurring from a limited number of pixel
+// shader samples, the taps sit exactly halfway between two texels so the bilinear
+// filtering hardware averages them for us, which lets us step two texels per sample.
+// The 1.5 offset kicks things off by positioning us nicely in between two texels.
+constexpr BlurKernel MakeBlurKernel(uint32_t sampleCount, float blurAmount)
+{
+    BlurKernel kernel = {};
+    kernel.sampleCount = sampleCount;
+    kernel.blurAmount = blurAmount;
+
+    kernel.weights[0] = BlurKernelDetail::Gaussian(0, blurAmount);
+    float totalWeights = kernel.weights[0];
+
+    for (uint32_t i = 0; i < sampleCount / 2; ++i)
+    {
+        const float weight = BlurKernelDetail::Gaussian(float(i + 1), blurAmount);
+        const float offset = float(i) * 2.f + 1.5f;
+
+        kernel.weights[i * 2 + 1] = weight;
+        kernel.weights[i * 2 + 2] = weight;
+        kernel.offsets[i * 2 + 1] = offset;
+        kernel.offsets[i * 2 + 2] = -offset;
+        totalWeights += weight * 2;
+    }
+
+    for (uint32_t i = 0; i < sampleCount; ++i)
+    {
+        kernel.weights[i] /= totalWeights;
+    }
+
+    return kernel;
+}
+
+// The theta a tier blurs a preset with: the preset's blur amount, unless the taps cannot
+// reach three standard deviations of it, in which case the pyramid adds levels instead.
+constexpr float GetLevelBlurAmount(BloomQuality quality, BloomPresets preset)
+{
+    return (g_BloomPresets[preset].blurAmount * 3 < float(g_BloomSampleCounts[quality] - 1))
+        ? g_BloomPresets[preset].blurAmount
+        : float(g_BloomSampleCounts[quality] - 1) / 3;
+}
+
+// Kernels for every tier and preset, generated at compile time.
+const BlurKernel& GetBlurKernel(BloomQuality quality, BloomPresets preset);
+
+// Matches cbuffer VS_BLUR_PARAMETERS in GaussianBlur.hlsli, which is sized for the
+// longest kernel whatever the permutation. Filled once per kernel and direction when
+// the constant buffers are created.
+struct VS_BLUR_PARAMETERS
+{
+    DirectX::XMFLOAT4 sampleOffsets[BlurKernel::MaxSamples];
+    DirectX::XMFLOAT4 sampleWeights[BlurKernel::MaxSamples];
+
+    // (directionX, directionY) is the blur direction, e.g. (1, 0) for horizontal.
+    void SetKernel(const BlurKernel& kernel, float directionX, float directionY);
+};
+
+static_assert(!(sizeof(VS_BLUR_PARAMETERS) % 16),
+    "VS_BLUR_PARAMETERS needs to be 16 bytes aligned");
+
+// Bloom is blurred as a pyramid: level 0 is half the scene's size and each further level
+// halves again. Every level is blurred with the same kernel, so each one doubles the
+// reach for a quarter of the previous level's cost. The levels are then added back up
+// the chain, smallest first, each upsample being blended with the next level up by its
+// blend factor.
+struct BloomChain
+{
+    static const uint32_t MaxLevels = 6;
+
+    // Levels stop before either side would drop below this many texels.
+    static const uint32_t MinLevelSize = 8;
+
+    uint32_t            levels;
+    const BlurKernel*   kernel;                     // Every level's blur
+    float               weights[MaxLevels];         // Share of each level in the final bloom; they sum to 1
+
+    // Factor to blend level i with the upsampled levels below it: the bloom at level i
+    // is lerp(upsampled, level i, blendFactors[i]). The last level's factor is 1.
+    float               blendFactors[MaxLevels];
+};
+
+// The number of levels a scene of this size has room for.
+uint32_t GetBloomLevelLimit(uint32_t sceneWidth, uint32_t sceneHeight);
+
+// Texture fetches per scene pixel of a pyramid's downsample, blur and upsample passes
+// (the extract and combine passes are the same whatever the pyramid). An upsample's
+// blend with the level it draws into counts as a fetch.
+float GetBloomCost(uint32_t sampleCount, uint32_t levels);
+
+// What the single half size 15 tap blur cost before the pyramid, 2 * 15 / 4 fetches per
+// scene pixel; for comparison only.
+constexpr float g_BloomBaselineCost = 7.5f;
+
+// What a tier may spend on a pyramid: half as much again as one level of its kernel.
+// Only Low's budget is below what its longest chains cost.
+float GetBloomBudget(BloomQuality quality);
+
+// Derives the pyramid from a preset's blur amount, which the single half size blur used
+// to take as its Gaussian theta: a level for each doubling of the blur amount (so Soft,
+// Blurry and Subtle get fewer than Default), never fewer than the tier's kernel needs to
+// reach it, and weights that fall off more slowly the blurrier the preset. Levels beyond
+// the reach are dropped if the chain would go over the tier's budget; the levels the
+// preset's reach needs never are.
+BloomChain GetBloomChain(BloomPresets preset, BloomQuality quality, uint32_t sceneWidth, uint32_t sceneHeight);
@@ -0,0 +1,401 @@
+//
+// BloomReference.cpp
+//
+
+#include "BloomReference.h"
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using namespace DirectX;
+
+namespace
+{
+    // BloomCombine's AdjustSaturation weights.
+    const XMVECTORF32 LUMINANCE = { { { 0.3f, 0.59f, 0.11f, 0.f } } };
+
+    // Linear filtering resolves the position between two texels to 1/256th.
+    const float FILTER_STEPS = 256.f;
+
+    const size_t ROW_GRAIN = 8;
+
+    inline XMVECTOR XM_CALLCONV AdjustSaturation(FXMVECTOR color, float saturation)
+    {
+        XMVECTOR grey = XMVector3Dot(color, LUMINANCE);
+        return XMVectorLerp(grey, color, saturation);
+    }
+
+    inline XMVECTOR XM_CALLCONV Bilinear(const XMFLOAT4* row0, const XMFLOAT4* row1,
+        uint32_t x0, uint32_t x1, float blendX, float blendY)
+    {
+        XMVECTOR top = XMVectorLerp(XMLoadFloat4(&row0[x0]), XMLoadFloat4(&row0[x1]), blendX);
+        XMVECTOR bottom = XMVectorLerp(XMLoadFloat4(&row1[x0]), XMLoadFloat4(&row1[x1]), blendX);
+        return XMVectorLerp(top, bottom, blendY);
+    }
+}
+
+void FloatImage::Resize(uint32_t newWidth, uint32_t newHeight)
+{
+    width = newWidth;
+    height = newHeight;
+    pixels.resize(size_t(width) * height);
+}
+
+bool FloatImage::LoadPfm(const char* path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+
+    std::string type;
+    uint32_t fileWidth = 0, fileHeight = 0;
+    float scale = 0.f;
+    if (!(file >> type >> fileWidth >> fileHeight >> scale) || (type != "PF" && type != "Pf"))
+        return false;
+
+    // A negative scale means little endian; a single whitespace character ends the header.
+    if (scale >= 0.f || fileWidth == 0 || fileHeight == 0)
+        return false;
+    file.get();
+
+    const uint32_t channels = (type == "PF") ? 3 : 1;
+    std::vector<float> row(size_t(fileWidth) * channels);
+
+    Resize(fileWidth, fileHeight);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        if (!file.read(reinterpret_cast<char*>(row.data()), std::streamsize(row.size() * sizeof(float))))
+            return false;
+
+        XMFLOAT4* pixel = GetRow(height - 1 - y);
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            const float* value = &row[size_t(x) * channels];
+            pixel[x] = (channels == 3)
+                ? XMFLOAT4(value[0], value[1], value[2], 1.f)
+                : XMFLOAT4(value[0], value[0], value[0], 1.f);
+        }
+    }
+
+    return true;
+}
+
+bool FloatImage::SavePfm(const char* path) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+
+    std::vector<float> row(size_t(width) * 3);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const XMFLOAT4* pixel = GetRow(height - 1 - y);
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            row[size_t(x) * 3 + 0] = pixel[x].x;
+            row[size_t(x) * 3 + 1] = pixel[x].y;
+            row[size_t(x) * 3 + 2] = pixel[x].z;
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size() * sizeof(float)));
+    }
+
+    return file.good();
+}
+
+void BloomReference::Process(const FloatImage& scene, BloomPresets preset, BloomQuality quality, FloatImage& output)
+{
+    if (scene.width < 2 || scene.height < 2)
+        throw std::invalid_argument("BloomReference: scene must be at least 2x2");
+
+    const VS_BLOOM_PARAMETERS& params = g_BloomPresets[preset];
+    m_chain = GetBloomChain(preset, quality, scene.width, scene.height);
+    m_levels.resize(m_chain.levels);
+    BuildKernel(*m_chain.kernel, m_kernel);
+
+    // Game::CreateWindowSizeDependentResources sizes the levels the same way.
+    for (uint32_t i = 0; i < m_chain.levels; ++i)
+    {
+        const uint32_t width = std::max(scene.width >> (i + 1), 1u);
+        const uint32_t height = std::max(scene.height >> (i + 1), 1u);
+
+        Level& level = m_levels[i];
+        level.image.Resize(width, height);
+        level.horizontal.Resize(width, height);
+    }
+
+    m_extracted.Resize(m_levels[0].image.width, m_levels[0].image.height);
+    output.Resize(scene.width, scene.height);
+
+    Extract(scene, params);
+    for (uint32_t i = 0; i < m_chain.levels; ++i)
+    {
+        Level& level = m_levels[i];
+        if (i > 0)
+        {
+            Downsample(m_levels[i - 1].image, level.image);
+        }
+        BlurHorizontal(i > 0 ? level.image : m_extracted, m_kernel, level.horizontal);
+        BlurVertical(level.horizontal, m_kernel, level.image);
+    }
+
+    for (uint32_t i = m_chain.levels - 1; i > 0; --i)
+    {
+        Upsample(m_levels[i].image, m_chain.blendFactors[i - 1], m_levels[i - 1].image);
+    }
+
+    Combine(scene, params, output);
+}
+
+// position is in texels, 0 being the centre of the first.
+BloomReference::Tap BloomReference::ResolveTexel(float position, uint32_t size)
+{
+    const float steps = std::floor(position * FILTER_STEPS + 0.5f);
+    const float texel = std::floor(steps / FILTER_STEPS);
+    const int32_t first = static_cast<int32_t>(texel);
+    const int32_t last = static_cast<int32_t>(size) - 1;
+
+    Tap tap;
+    tap.first = static_cast<uint32_t>(std::min(std::max(first, 0), last));
+    tap.second = static_cast<uint32_t>(std::min(std::max(first + 1, 0), last));
+    tap.blend = (steps - texel * FILTER_STEPS) / FILTER_STEPS;
+    return tap;
+}
+
+// The texels sampled when a full screen quad of destinationSize pixels is drawn from
+// a texture of sourceSize texels.
+void BloomReference::BuildTaps(uint32_t sourceSize, uint32_t destinationSize, std::vector<Tap>& taps)
+{
+    const float scale = float(sourceSize) / float(destinationSize);
+
+    taps.resize(destinationSize);
+    for (uint32_t i = 0; i < destinationSize; ++i)
+    {
+        taps[i] = ResolveTexel((float(i) + 0.5f) * scale - 0.5f, sourceSize);
+    }
+}
+
+// GaussianBlur samples between pairs of texels; splitting each tap's weight over the two
+// texels it blends gives a plain convolution with the same result.
+void BloomReference::BuildKernel(const BlurKernel& blur, Kernel& kernel)
+{
+    float reach = 0.f;
+    for (uint32_t i = 0; i < blur.sampleCount; ++i)
+    {
+        reach = std::max(reach, std::fabs(blur.offsets[i]));
+    }
+
+    kernel.radius = static_cast<int32_t>(std::ceil(reach));
+    kernel.weights.assign(size_t(kernel.radius) * 2 + 1, 0.f);
+
+    for (uint32_t i = 0; i < blur.sampleCount; ++i)
+    {
+        const float steps = std::floor(blur.offsets[i] * FILTER_STEPS + 0.5f);
+        const float texel = std::floor(steps / FILTER_STEPS);
+        const float blend = (steps - texel * FILTER_STEPS) / FILTER_STEPS;
+        const float weight = blur.weights[i];
+
+        const int32_t index = static_cast<int32_t>(texel) + kernel.radius;
+        kernel.weights[size_t(index)] += weight * (1.f - blend);
+        if (blend > 0.f)
+        {
+            kernel.weights[size_t(index) + 1] += weight * blend;
+        }
+    }
+}
+
+template<typename F>
+void BloomReference::ForEachRow(uint32_t height, const F& function)
+{
+    if (m_jobs)
+    {
+        m_jobs->ParallelFor(height, ROW_GRAIN, [&function](size_t begin, size_t end)
+        {
+            function(static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+        });
+    }
+    else
+    {
+        function(0u, height);
+    }
+}
+
+// BloomExtract, drawn into the half size target so each pixel filters the scene first.
+void BloomReference::Extract(const FloatImage& scene, const VS_BLOOM_PARAMETERS& params)
+{
+    BuildTaps(scene.width, m_extracted.width, m_columnTaps);
+    BuildTaps(scene.height, m_extracted.height, m_rowTaps);
+
+    const XMVECTOR threshold = XMVectorReplicate(params.bloomThreshold);
+    const XMVECTOR range = XMVectorReplicate(1.f - params.bloomThreshold);
+
+    ForEachRow(m_extracted.height, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t y = begin; y < end; ++y)
+        {
+            const Tap& row = m_rowTaps[y];
+            const XMFLOAT4* row0 = scene.GetRow(row.first);
+            const XMFLOAT4* row1 = scene.GetRow(row.second);
+            XMFLOAT4* destination = m_extracted.GetRow(y);
+
+            for (uint32_t x = 0; x < m_extracted.width; ++x)
+            {
+                const Tap& column = m_columnTaps[x];
+                XMVECTOR c = Bilinear(row0, row1, column.first, column.second, column.blend, row.blend);
+                XMStoreFloat4(&destination[x], XMVectorSaturate(XMVectorDivide(XMVectorSubtract(c, threshold), range)));
+            }
+        }
+    });
+}
+
+// A plain draw of the previous level into this one's target.
+void BloomReference::Downsample(const FloatImage& source, FloatImage& destination)
+{
+    BuildTaps(source.width, destination.width, m_columnTaps);
+    BuildTaps(source.height, destination.height, m_rowTaps);
+
+    ForEachRow(destination.height, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t y = begin; y < end; ++y)
+        {
+            const Tap& row = m_rowTaps[y];
+            const XMFLOAT4* row0 = source.GetRow(row.first);
+            const XMFLOAT4* row1 = source.GetRow(row.second);
+            XMFLOAT4* output = destination.GetRow(y);
+
+            for (uint32_t x = 0; x < destination.width; ++x)
+            {
+                const Tap& column = m_columnTaps[x];
+                XMStoreFloat4(&output[x], Bilinear(row0, row1, column.first, column.second, column.blend, row.blend));
+            }
+        }
+    });
+}
+
+void BloomReference::BlurHorizontal(const FloatImage& source, const Kernel& kernel, FloatImage& destination)
+{
+    const uint32_t width = source.width;
+    const uint32_t radius = static_cast<uint32_t>(kernel.radius);
+
+    ForEachRow(source.height, [&](uint32_t begin, uint32_t end)
+    {
+        // Each row is copied with its edge texels repeated, as clamp addressing reads them,
+        // so the taps need no bounds checks.
+        std::vector<XMFLOAT4> padded(size_t(width) + radius * 2);
+
+        for (uint32_t y = begin; y < end; ++y)
+        {
+            const XMFLOAT4* row = source.GetRow(y);
+            std::fill(padded.begin(), padded.begin() + radius, row[0]);
+            std::copy(row, row + width, padded.begin() + radius);
+            std::fill(padded.begin() + radius + width, padded.end(), row[width - 1]);
+
+            XMFLOAT4* output = destination.GetRow(y);
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const XMFLOAT4* taps = &padded[x];
+                XMVECTOR sum = XMVectorZero();
+                for (size_t k = 0; k < kernel.weights.size(); ++k)
+                {
+                    sum = XMVectorMultiplyAdd(XMLoadFloat4(&taps[k]), XMVectorReplicatePtr(&kernel.weights[k]), sum);
+                }
+                XMStoreFloat4(&output[x], sum);
+            }
+        }
+    });
+}
+
+void BloomReference::BlurVertical(const FloatImage& source, const Kernel& kernel, FloatImage& destination)
+{
+    const int32_t last = static_cast<int32_t>(source.height) - 1;
+
+    ForEachRow(source.height, [&](uint32_t begin, uint32_t end)
+    {
+        // Whole rows are accumulated one tap at a time, so every read is sequential.
+        for (uint32_t y = begin; y < end; ++y)
+        {
+            XMFLOAT4* output = destination.GetRow(y);
+            std::fill(output, output + source.width, XMFLOAT4(0.f, 0.f, 0.f, 0.f));
+
+            for (int32_t k = -kernel.radius; k <= kernel.radius; ++k)
+            {
+                const int32_t sourceY = std::min(std::max(int32_t(y) + k, 0), last);
+                const XMFLOAT4* row = source.GetRow(static_cast<uint32_t>(sourceY));
+                const XMVECTOR weight = XMVectorReplicatePtr(&kernel.weights[size_t(k + kernel.radius)]);
+
+                for (uint32_t x = 0; x < source.width; ++x)
+                {
+                    XMStoreFloat4(&output[x], XMVectorMultiplyAdd(XMLoadFloat4(&row[x]), weight, XMLoadFloat4(&output[x])));
+                }
+            }
+        }
+    });
+}
+
+// A draw of the level below into this one's target, blending src * (1 - factor) +
+// dest * factor.
+void BloomReference::Upsample(const FloatImage& source, float blendFactor, FloatImage& destination)
+{
+    BuildTaps(source.width, destination.width, m_columnTaps);
+    BuildTaps(source.height, destination.height, m_rowTaps);
+
+    ForEachRow(destination.height, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t y = begin; y < end; ++y)
+        {
+            const Tap& row = m_rowTaps[y];
+            const XMFLOAT4* row0 = source.GetRow(row.first);
+            const XMFLOAT4* row1 = source.GetRow(row.second);
+            XMFLOAT4* output = destination.GetRow(y);
+
+            for (uint32_t x = 0; x < destination.width; ++x)
+            {
+                const Tap& column = m_columnTaps[x];
+                XMVECTOR upsampled = Bilinear(row0, row1, column.first, column.second, column.blend, row.blend);
+                XMStoreFloat4(&output[x], XMVectorLerp(upsampled, XMLoadFloat4(&output[x]), blendFactor));
+            }
+        }
+    });
+}
+
+// BloomCombine, with the half size bloom filtered up to the scene's size.
+void BloomReference::Combine(const FloatImage& scene, const VS_BLOOM_PARAMETERS& params, FloatImage& output)
+{
+    const FloatImage& blurred = m_levels[0].image;
+    BuildTaps(blurred.width, scene.width, m_columnTaps);
+    BuildTaps(blurred.height, scene.height, m_rowTaps);
+
+    ForEachRow(scene.height, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t y = begin; y < end; ++y)
+        {
+            const Tap& row = m_rowTaps[y];
+            const XMFLOAT4* bloom0 = blurred.GetRow(row.first);
+            const XMFLOAT4* bloom1 = blurred.GetRow(row.second);
+            const XMFLOAT4* baseRow = scene.GetRow(y);
+            XMFLOAT4* destination = output.GetRow(y);
+
+            for (uint32_t x = 0; x < scene.width; ++x)
+            {
+                const Tap& column = m_columnTaps[x];
+                XMVECTOR bloom = Bilinear(bloom0, bloom1, column.first, column.second, column.blend, row.blend);
+                XMVECTOR base = XMLoadFloat4(&baseRow[x]);
+
+                // Adjust color saturation and intensity.
+                bloom = XMVectorScale(AdjustSaturation(bloom, params.bloomSaturation), params.bloomIntensity);
+                base = XMVectorScale(AdjustSaturation(base, params.baseSaturation), params.baseIntensity);
+
+                // Darken down the base image in areas where there is a lot of bloom.
+                base = XMVectorMultiply(base, XMVectorSubtract(g_XMOne, XMVectorSaturate(bloom)));
+
+                XMStoreFloat4(&destination[x], XMVectorAdd(base, bloom));
+            }
+        }
+    });
+}
@@ -0,0 +1,119 @@
+//
+// BloomReference.h - CPU implementation of the bloom post-process, for checking the shaders
+//
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+#include "BloomParameters.h"
+
+namespace DX
+{
+    class JobSystem;
+}
+
+// Linear RGBA float image, rows stored top to bottom without padding.
+struct FloatImage
+{
+    FloatImage() noexcept :
+        width(0),
+        height(0)
+    {
+    }
+
+    void Resize(uint32_t newWidth, uint32_t newHeight);
+
+    DirectX::XMFLOAT4* GetRow(uint32_t y)               { return pixels.data() + size_t(y) * width; }
+    const DirectX::XMFLOAT4* GetRow(uint32_t y) const   { return pixels.data() + size_t(y) * width; }
+
+    // Portable float maps: "PF" (RGB) or "Pf" (grey), little endian, bottom row first.
+    // Alpha is 1 after loading and is not saved.
+    bool LoadPfm(const char* path);
+    bool SavePfm(const char* path) const;
+
+    uint32_t                        width;
+    uint32_t                        height;
+    std::vector<DirectX::XMFLOAT4>  pixels;
+};
+
+// Runs the passes of Game::PostProcess on the CPU: BloomExtract into a half size image,
+// then down the BloomChain a downsample (after the first level) and the quality tier's
+// GaussianBlur horizontally then vertically; the levels are blended back up the chain and
+// BloomCombine adds the result to the scene. Sampling follows D3D's linear clamp sampler
+// (with 8-bit filter weights), including the blur's taps that land between two texels,
+// so each intermediate image can be compared with the render target the GPU pass wrote.
+//
+// Each pixel is one XMVECTOR, and rows are split across the job system when one is set.
+// A pixel's arithmetic does not depend on how rows are split, so the result is the same
+// for any number of threads.
+class BloomReference
+{
+public:
+    BloomReference() noexcept :
+        m_jobs(nullptr),
+        m_chain{}
+    {
+    }
+
+    void SetJobSystem(DX::JobSystem* jobs)              { m_jobs = jobs; }
+
+    // output is resized to the scene's size.
+    void Process(const FloatImage& scene, BloomPresets preset, BloomQuality quality, FloatImage& output);
+
+    // Intermediate images of the last Process. The extracted image and level 0 are half
+    // the scene's size. A level holds its share of the bloom once the chain has been
+    // blended back up; level 0 is what BloomCombine reads.
+    const BloomChain& GetChain() const                  { return m_chain; }
+    const FloatImage& GetExtracted() const              { return m_extracted; }
+    const FloatImage& GetBlurredHorizontal() const      { return m_levels[0].horizontal; }
+    const FloatImage& GetLevel(uint32_t level) const    { return m_levels[level].image; }
+    const FloatImage& GetBlurred() const                { return m_levels[0].image; }
+
+private:
+    // The two texels a linear sampler blends for one coordinate, and the second's weight.
+    struct Tap
+    {
+        uint32_t    first;
+        uint32_t    second;
+        float       blend;
+    };
+
+    // A blur kernel's taps resolved to whole texels: weights for offsets -radius..radius.
+    struct Kernel
+    {
+        int32_t             radius;
+        std::vector<float>  weights;
+    };
+
+    // A pyramid level and the target its horizontal blur goes through, as on the GPU.
+    struct Level
+    {
+        FloatImage          image;
+        FloatImage          horizontal;
+    };
+
+    static Tap ResolveTexel(float position, uint32_t size);
+    static void BuildTaps(uint32_t sourceSize, uint32_t destinationSize, std::vector<Tap>& taps);
+    static void BuildKernel(const BlurKernel& blur, Kernel& kernel);
+
+    template<typename F>
+    void ForEachRow(uint32_t height, const F& function);
+
+    void Extract(const FloatImage& scene, const VS_BLOOM_PARAMETERS& params);
+    void Downsample(const FloatImage& source, FloatImage& destination);
+    void BlurHorizontal(const FloatImage& source, const Kernel& kernel, FloatImage& destination);
+    void BlurVertical(const FloatImage& source, const Kernel& kernel, FloatImage& destination);
+    void Upsample(const FloatImage& source, float blendFactor, FloatImage& destination);
+    void Combine(const FloatImage& scene, const VS_BLOOM_PARAMETERS& params, FloatImage& output);
+
+    DX::JobSystem*      m_jobs;
+    BloomChain          m_chain;
+    std::vector<Tap>    m_columnTaps;
+    std::vector<Tap>    m_rowTaps;
+    Kernel              m_kernel;
+    FloatImage          m_extracted;
+    std::vector<Level>  m_levels;
+};
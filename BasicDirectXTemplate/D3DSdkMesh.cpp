@@ -0,0 +1,321 @@
+//
+// D3DSdkMesh.cpp
+//
+
+#include "pch.h"
+#include "D3DSdkMesh.h"
+
+using namespace DirectX;
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // What a vertex format asks of the effect, as DirectXTK's loader works it out.
+    enum VertexFlags : uint32_t
+    {
+        PerVertexColor = 0x1,
+        Skinning = 0x2,
+        DualTexture = 0x4,
+        NormalMaps = 0x8,
+        BiasedVertexNormals = 0x10,
+    };
+
+    struct VertexFormat
+    {
+        std::shared_ptr<std::vector<D3D11_INPUT_ELEMENT_DESC>>  elements;
+        uint32_t                                                flags;
+    };
+
+    std::wstring ToWide(const char* text)
+    {
+        wchar_t wide[MAX_PATH] = {};
+        MultiByteToWideChar(CP_UTF8, 0, text, -1, wide, MAX_PATH);
+        return wide;
+    }
+
+    // The D3D11 input layout of a vertex buffer's declaration. The DirectXTK effects
+    // take positions, normals, colours, tangents, binormals, texture coordinates and
+    // skinning weights in a few formats each.
+    VertexFormat GetVertexFormat(const SdkMeshVertexBuffer& buffer, size_t index)
+    {
+        VertexFormat format;
+        format.elements = std::make_shared<std::vector<D3D11_INPUT_ELEMENT_DESC>>();
+        format.flags = 0;
+
+        bool position = false;
+        uint32_t texcoords = 0;
+        for (const SdkMeshVertexElement& element : SdkMesh::GetElements(buffer))
+        {
+            D3D11_INPUT_ELEMENT_DESC desc = { nullptr, element.usageIndex, DXGI_FORMAT_UNKNOWN, 0, element.offset,
+                D3D11_INPUT_PER_VERTEX_DATA, 0 };
+            switch (element.usage)
+            {
+            case UsagePosition:
+                desc.SemanticName = "SV_Position";
+                desc.Format = (element.type == DeclFloat3) ? DXGI_FORMAT_R32G32B32_FLOAT
+                    : (element.type == DeclFloat4) ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_UNKNOWN;
+                position = true;
+                break;
+
+            case UsageNormal:
+            case UsageTangent:
+            case UsageBinormal:
+                desc.SemanticName = (element.usage == UsageNormal) ? "NORMAL"
+                    : (element.usage == UsageTangent) ? "TANGENT" : "BINORMAL";
+                switch (element.type)
+                {
+                case DeclFloat3:    desc.Format = DXGI_FORMAT_R32G32B32_FLOAT; break;
+                case DeclFloat16x4: desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT; break;
+                case DeclShort4N:   desc.Format = DXGI_FORMAT_R16G16B16A16_SNORM; break;
+                case DeclUByte4:
+                    // Stored as 0..255 and unpacked by the shader.
+                    desc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+                    format.flags |= (element.usage == UsageNormal) ? BiasedVertexNormals : 0;
+                    break;
+                default:
+                    break;
+                }
+                format.flags |= (element.usage == UsageTangent) ? NormalMaps : 0;
+                break;
+
+            case UsageColor:
+                desc.SemanticName = "COLOR";
+                desc.Format = (element.type == DeclColor) ? DXGI_FORMAT_B8G8R8A8_UNORM
+                    : (element.type == DeclUByte4N) ? DXGI_FORMAT_R8G8B8A8_UNORM
+                    : (element.type == DeclFloat4) ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_UNKNOWN;
+                format.flags |= PerVertexColor;
+                break;
+
+            case UsageTexCoord:
+                desc.SemanticName = "TEXCOORD";
+                switch (element.type)
+                {
+                case DeclFloat1:    desc.Format = DXGI_FORMAT_R32_FLOAT; break;
+                case DeclFloat2:    desc.Format = DXGI_FORMAT_R32G32_FLOAT; break;
+                case DeclFloat3:    desc.Format = DXGI_FORMAT_R32G32B32_FLOAT; break;
+                case DeclFloat4:    desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT; break;
+                case DeclFloat16x2: desc.Format = DXGI_FORMAT_R16G16_FLOAT; break;
+                case DeclFloat16x4: desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT; break;
+                default:            break;
+                }
+                ++texcoords;
+                break;
+
+            case UsageBlendIndices:
+                desc.SemanticName = "BLENDINDICES";
+                desc.Format = (element.type == DeclUByte4) ? DXGI_FORMAT_R8G8B8A8_UINT : DXGI_FORMAT_UNKNOWN;
+                format.flags |= Skinning;
+                break;
+
+            case UsageBlendWeight:
+                desc.SemanticName = "BLENDWEIGHT";
+                desc.Format = (element.type == DeclUByte4N) ? DXGI_FORMAT_R8G8B8A8_UNORM
+                    : (element.type == DeclFloat4) ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_UNKNOWN;
+                break;
+
+            default:
+                break;
+            }
+
+            if (desc.Format == DXGI_FORMAT_UNKNOWN)
+            {
+                throw std::runtime_error(std::string("CreateModelFromSdkMesh: vertex buffer ") + std::to_string(index)
+                    + " has " + SdkMesh::GetDeclUsageName(element.usage) + " as "
+                    + SdkMesh::GetDeclTypeName(element.type));
+            }
+            format.elements->push_back(desc);
+        }
+
+        if (!position)
+            throw std::runtime_error("CreateModelFromSdkMesh: vertex buffer " + std::to_string(index) + " has no positions");
+
+        // The effects do one of these at a time.
+        format.flags |= (texcoords > 1) ? DualTexture : 0;
+        if (format.flags & Skinning)
+        {
+            format.flags &= ~(DualTexture | NormalMaps);
+        }
+        if (format.flags & DualTexture)
+        {
+            format.flags &= ~NormalMaps;
+        }
+        return format;
+    }
+
+    // As DirectXTK reads a version 101 material: all zero colours mean white, and a
+    // diffuse alpha of 0 or 1 means opaque.
+    std::shared_ptr<IEffect> CreateMaterialEffect(const SdkMeshMaterial& material, uint32_t flags,
+        IEffectFactory& fxFactory, bool& isAlpha)
+    {
+        const std::wstring name = ToWide(material.name);
+        const std::wstring diffuseTexture = ToWide(material.diffuseTexture);
+        const std::wstring normalTexture = ToWide(material.normalTexture);
+        const std::wstring specularTexture = ToWide(material.specularTexture);
+
+        EffectFactory::EffectInfo info;
+        info.name = name.c_str();
+        info.perVertexColor = (flags & PerVertexColor) != 0;
+        info.enableSkinning = (flags & Skinning) != 0;
+        info.enableDualTexture = (flags & DualTexture) != 0;
+        info.enableNormalMaps = (flags & NormalMaps) != 0;
+        info.biasedVertexNormals = (flags & BiasedVertexNormals) != 0;
+
+        const bool uninitialized = std::all_of(material.ambient, material.ambient + 4, [](float c) { return c == 0.f; })
+            && std::all_of(material.diffuse, material.diffuse + 4, [](float c) { return c == 0.f; });
+        if (uninitialized)
+        {
+            info.diffuseColor = XMFLOAT3(1.f, 1.f, 1.f);
+            info.alpha = 1.f;
+        }
+        else
+        {
+            info.ambientColor = XMFLOAT3(material.ambient);
+            info.diffuseColor = XMFLOAT3(material.diffuse);
+            info.emissiveColor = XMFLOAT3(material.emissive);
+            info.alpha = (material.diffuse[3] != 0.f && material.diffuse[3] != 1.f) ? material.diffuse[3] : 1.f;
+            if (material.power != 0.f)
+            {
+                info.specularPower = material.power;
+                info.specularColor = XMFLOAT3(material.specular);
+            }
+        }
+
+        info.diffuseTexture = diffuseTexture.c_str();
+        info.normalTexture = normalTexture.c_str();
+        info.specularTexture = specularTexture.c_str();
+
+        isAlpha = info.alpha < 1.f;
+        return fxFactory.CreateEffect(info, nullptr);
+    }
+
+    // Version 200 materials are meant for a PBREffectFactory: albedo in the diffuse slot,
+    // roughness, metalness and occlusion in the specular one.
+    std::shared_ptr<IEffect> CreateMaterialEffect(const SdkMeshPbrMaterial& material, uint32_t flags,
+        IEffectFactory& fxFactory, bool& isAlpha)
+    {
+        const std::wstring name = ToWide(material.name);
+        const std::wstring albedoTexture = ToWide(material.albedoTexture);
+        const std::wstring rmaTexture = ToWide(material.rmaTexture);
+        const std::wstring normalTexture = ToWide(material.normalTexture);
+        const std::wstring emissiveTexture = ToWide(material.emissiveTexture);
+
+        EffectFactory::EffectInfo info;
+        info.name = name.c_str();
+        info.perVertexColor = (flags & PerVertexColor) != 0;
+        info.enableSkinning = (flags & Skinning) != 0;
+        info.enableDualTexture = (flags & DualTexture) != 0;
+        info.enableNormalMaps = (flags & NormalMaps) != 0;
+        info.biasedVertexNormals = (flags & BiasedVertexNormals) != 0;
+        info.alpha = (material.alpha != 0.f) ? material.alpha : 1.f;
+        info.diffuseTexture = albedoTexture.c_str();
+        info.specularTexture = rmaTexture.c_str();
+        info.normalTexture = normalTexture.c_str();
+        info.emissiveTexture = emissiveTexture.c_str();
+
+        isAlpha = info.alpha < 1.f;
+        return fxFactory.CreateEffect(info, nullptr);
+    }
+
+    D3D11_PRIMITIVE_TOPOLOGY GetTopology(uint32_t primitiveType)
+    {
+        // SdkMesh rejects the patch lists.
+        static const D3D11_PRIMITIVE_TOPOLOGY topologies[] =
+        {
+            D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP,
+            D3D11_PRIMITIVE_TOPOLOGY_LINELIST, D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP, D3D11_PRIMITIVE_TOPOLOGY_POINTLIST,
+            D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP_ADJ,
+            D3D11_PRIMITIVE_TOPOLOGY_LINELIST_ADJ, D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP_ADJ,
+        };
+        return topologies[primitiveType];
+    }
+
+    ComPtr<ID3D11Buffer> CreateBuffer(ID3D11Device* device, SdkMesh::View<uint8_t> data, UINT bindFlags)
+    {
+        // Immutable buffers copy their initial data, so the view can go straight in.
+        CD3D11_BUFFER_DESC desc(static_cast<UINT>(data.size()), bindFlags, D3D11_USAGE_IMMUTABLE);
+        D3D11_SUBRESOURCE_DATA initData = { data.data(), 0, 0 };
+        ComPtr<ID3D11Buffer> buffer;
+        DX::ThrowIfFailed(device->CreateBuffer(&desc, &initData, buffer.GetAddressOf()));
+        return buffer;
+    }
+}
+
+std::unique_ptr<Model> CreateModelFromSdkMesh(ID3D11Device* device, const SdkMesh& mesh, IEffectFactory& fxFactory,
+    const wchar_t* name)
+{
+    const auto vertexBuffers = mesh.GetVertexBuffers();
+    const auto indexBuffers = mesh.GetIndexBuffers();
+    const auto subsets = mesh.GetSubsets();
+    const uint32_t materialCount = mesh.GetHeader().materialCount;
+
+    // Only the buffers and formats some mesh draws.
+    std::vector<ComPtr<ID3D11Buffer>> vbs(vertexBuffers.size());
+    std::vector<ComPtr<ID3D11Buffer>> ibs(indexBuffers.size());
+    std::vector<VertexFormat> formats(vertexBuffers.size());
+    for (const SdkMeshMesh& source : mesh.GetMeshes())
+    {
+        const uint32_t vb = source.vertexBuffers[0];
+        if (!vbs[vb])
+        {
+            formats[vb] = GetVertexFormat(vertexBuffers[vb], vb);
+            vbs[vb] = CreateBuffer(device, mesh.GetVertexData(vertexBuffers[vb]), D3D11_BIND_VERTEX_BUFFER);
+        }
+        if (!ibs[source.indexBuffer])
+        {
+            ibs[source.indexBuffer] = CreateBuffer(device, mesh.GetIndexData(indexBuffers[source.indexBuffer]),
+                D3D11_BIND_INDEX_BUFFER);
+        }
+    }
+
+    std::vector<std::shared_ptr<IEffect>> effects(materialCount);
+    std::vector<bool> alphas(materialCount);
+
+    auto model = std::make_unique<Model>();
+    model->name = name;
+    model->meshes.reserve(mesh.GetMeshes().size());
+    for (const SdkMeshMesh& source : mesh.GetMeshes())
+    {
+        auto modelMesh = std::make_shared<ModelMesh>();
+        modelMesh->name = ToWide(source.name);
+        modelMesh->ccw = false;
+        modelMesh->pmalpha = false;
+        modelMesh->boundingBox.Center = XMFLOAT3(source.boundingBoxCenter);
+        modelMesh->boundingBox.Extents = XMFLOAT3(source.boundingBoxExtents);
+        BoundingSphere::CreateFromBoundingBox(modelMesh->boundingSphere, modelMesh->boundingBox);
+
+        const uint32_t vb = source.vertexBuffers[0];
+        const SdkMeshIndexBuffer& indices = indexBuffers[source.indexBuffer];
+        for (uint32_t subsetIndex : mesh.GetSubsetIndices(source))
+        {
+            const SdkMeshSubset& subset = subsets[subsetIndex];
+            if (!effects[subset.material])
+            {
+                bool isAlpha;
+                effects[subset.material] = mesh.HasPbrMaterials()
+                    ? CreateMaterialEffect(mesh.GetPbrMaterials()[subset.material], formats[vb].flags, fxFactory, isAlpha)
+                    : CreateMaterialEffect(mesh.GetMaterials()[subset.material], formats[vb].flags, fxFactory, isAlpha);
+                alphas[subset.material] = isAlpha;
+            }
+
+            auto part = std::make_unique<ModelMeshPart>();
+            part->isAlpha = alphas[subset.material];
+            part->indexCount = static_cast<uint32_t>(subset.indexCount);
+            part->startIndex = static_cast<uint32_t>(subset.indexStart);
+            part->vertexOffset = static_cast<int32_t>(subset.vertexStart);
+            part->vertexStride = static_cast<uint32_t>(vertexBuffers[vb].strideBytes);
+            part->indexFormat = indices.indexType ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+            part->primitiveType = GetTopology(subset.primitiveType);
+            part->indexBuffer = ibs[source.indexBuffer];
+            part->vertexBuffer = vbs[vb];
+            part->effect = effects[subset.material];
+            part->vbDecl = formats[vb].elements;
+            part->CreateInputLayout(device, part->effect.get(), part->inputLayout.ReleaseAndGetAddressOf());
+            modelMesh->meshParts.emplace_back(std::move(part));
+        }
+
+        model->meshes.emplace_back(std::move(modelMesh));
+    }
+
+    return model;
+}
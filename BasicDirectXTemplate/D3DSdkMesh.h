@@ -0,0 +1,16 @@
+//
+// D3DSdkMesh.h - Builds a DirectXTK Model from an SdkMesh's views
+//
+
+#pragma once
+
+#include "SdkMesh.h"
+
+// What Model::CreateFromSDKMESH makes of the file (clockwise winding, straight alpha),
+// with the vertex and index buffers created straight from the file's mapped data. Each
+// mesh draws its first vertex stream, and each material becomes one effect, created
+// with the vertex format of the first mesh that uses it; version 200 (PBR) materials need
+// a PBREffectFactory. Throws std::runtime_error for vertex formats the DirectXTK effects
+// cannot take.
+std::unique_ptr<DirectX::Model> CreateModelFromSdkMesh(ID3D11Device* device, const SdkMesh& mesh,
+    DirectX::IEffectFactory& fxFactory, const wchar_t* name);
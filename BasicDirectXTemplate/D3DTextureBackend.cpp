@@ -0,0 +1,61 @@
+//
+// D3DTextureBackend.cpp
+//
+
+#include "pch.h"
+#include "D3DTextureBackend.h"
+
+namespace
+{
+    // Bytes per texel of the render target formats this game uses; others count as 4.
+    uint32_t BytesPerTexel(DXGI_FORMAT format)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+            return 16;
+
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+            return 8;
+
+        case DXGI_FORMAT_R8G8_UNORM:
+        case DXGI_FORMAT_R16_FLOAT:
+            return 2;
+
+        case DXGI_FORMAT_R8_UNORM:
+            return 1;
+
+        default:
+            return 4;
+        }
+    }
+}
+
+void* D3DTextureBackend::Create(const TransientTextureDesc& desc, uint64_t& bytes)
+{
+    auto target = std::make_unique<PooledRenderTarget>();
+
+    const DXGI_FORMAT format = static_cast<DXGI_FORMAT>(desc.format);
+    CD3D11_TEXTURE2D_DESC textureDesc(format, desc.width, desc.height, 1, 1, desc.bindFlags);
+    DX::ThrowIfFailed(m_device->CreateTexture2D(&textureDesc, nullptr, target->texture.GetAddressOf()));
+
+    if (desc.bindFlags & D3D11_BIND_RENDER_TARGET)
+    {
+        DX::ThrowIfFailed(m_device->CreateRenderTargetView(target->texture.Get(), nullptr,
+            target->rtv.GetAddressOf()));
+    }
+    if (desc.bindFlags & D3D11_BIND_SHADER_RESOURCE)
+    {
+        DX::ThrowIfFailed(m_device->CreateShaderResourceView(target->texture.Get(), nullptr,
+            target->srv.GetAddressOf()));
+    }
+
+    bytes = uint64_t(desc.width) * desc.height * BytesPerTexel(format);
+    return target.release();
+}
+
+void D3DTextureBackend::Destroy(void* texture) noexcept
+{
+    delete static_cast<PooledRenderTarget*>(texture);
+}
@@ -0,0 +1,36 @@
+//
+// D3DTextureBackend.h - Creates TransientTexturePool textures on a Direct3D 11 device
+//
+
+#pragma once
+
+#include "TransientTexturePool.h"
+
+// What the pool's GetTexture returns with this backend. The views exist for the bind
+// flags the texture was requested with.
+struct PooledRenderTarget
+{
+    Microsoft::WRL::ComPtr<ID3D11Texture2D>             texture;
+    Microsoft::WRL::ComPtr<ID3D11RenderTargetView>      rtv;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    srv;
+};
+
+class D3DTextureBackend : public TransientTextureBackend
+{
+public:
+    explicit D3DTextureBackend(ID3D11Device* device) noexcept :
+        m_device(device)
+    {
+    }
+
+    void* Create(const TransientTextureDesc& desc, uint64_t& bytes) override;
+    void Destroy(void* texture) noexcept override;
+
+    static const PooledRenderTarget& Get(const TransientTexturePool& pool, TransientTexturePool::Handle handle)
+    {
+        return *static_cast<const PooledRenderTarget*>(pool.GetTexture(handle));
+    }
+
+private:
+    Microsoft::WRL::ComPtr<ID3D11Device>    m_device;
+};
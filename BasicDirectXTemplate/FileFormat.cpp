@@ -0,0 +1,61 @@
+//
+// FileFormat.cpp
+//
+
+#include "FileFormat.h"
+
+#include <stdarg.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+
+namespace
+{
+    const uint64_t FNV_PRIME = 1099511628211ull;
+}
+
+uint64_t FileFormat::Hash(const void* data, size_t size, uint64_t hash)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+char FileFormat::NormalizePathChar(char c)
+{
+    if (c == '\\')
+        return '/';
+    return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+int FileFormat::ComparePaths(const char* a, const char* b)
+{
+    for (; *a && NormalizePathChar(*a) == NormalizePathChar(*b); ++a, ++b)
+    {
+    }
+    return int(uint8_t(NormalizePathChar(*a))) - int(uint8_t(NormalizePathChar(*b)));
+}
+
+uint64_t FileFormat::HashPath(const char* path, uint64_t hash)
+{
+    for (; *path; ++path)
+    {
+        hash ^= uint8_t(NormalizePathChar(*path));
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+void FileFormat::Fail(const char* prefix, const char* format, ...)
+{
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    throw std::runtime_error(std::string(prefix) + message);
+}
@@ -0,0 +1,31 @@
+//
+// FileFormat.h - Hashing, path comparison and validation shared by the file format readers and writers
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace FileFormat
+{
+    const uint64_t FnvOffsetBasis = 14695981039346656037ull;
+
+    // 64 bit FNV-1a, continued from hash.
+    uint64_t Hash(const void* data, size_t size, uint64_t hash = FnvOffsetBasis);
+
+    // Paths compare as Windows compares them: either slash and any case. HashPath hashes
+    // a path as ComparePaths sees it, lower cased with forward slashes.
+    char NormalizePathChar(char c);
+    int ComparePaths(const char* a, const char* b);
+    uint64_t HashPath(const char* path, uint64_t hash = FnvOffsetBasis);
+
+    // a + b <= limit, without overflow.
+    inline bool FitsIn(uint64_t a, uint64_t b, uint64_t limit)
+    {
+        return a <= limit && b <= limit - a;
+    }
+
+    // Throws std::runtime_error with prefix (e.g. "SdkMesh: ") and the formatted message.
+    [[noreturn]] void Fail(const char* prefix, const char* format, ...);
+}
@@ -0,0 +1,378 @@
+//
+// FrameGraph.cpp
+//
+
+#include "FrameGraph.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    const uint32_t NO_PHYSICAL = ~0u;
+
+    inline bool SameDesc(const TransientTextureDesc& a, const TransientTextureDesc& b)
+    {
+        return a.format == b.format && a.width == b.width && a.height == b.height && a.bindFlags == b.bindFlags;
+    }
+
+    inline void AddDependency(std::vector<uint32_t>& dependencies, uint32_t pass)
+    {
+        if (std::find(dependencies.begin(), dependencies.end(), pass) == dependencies.end())
+        {
+            dependencies.push_back(pass);
+        }
+    }
+}
+
+void FrameGraph::Reset()
+{
+    m_resources.clear();
+    m_passes.clear();
+    m_outputs.clear();
+    m_order.clear();
+    m_physical.clear();
+    m_compiled = false;
+    m_statistics = {};
+}
+
+FrameGraph::Resource FrameGraph::CreateTexture(const char* name, const TransientTextureDesc& desc)
+{
+    return ImportTexture(name, desc, nullptr);
+}
+
+FrameGraph::Resource FrameGraph::ImportTexture(const char* name, const TransientTextureDesc& desc, const void* texture)
+{
+    ResourceEntry resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.imported = texture;
+    resource.versions.push_back({ NoPass, {} });
+    resource.firstUse = resource.lastUse = 0;
+    resource.physical = NO_PHYSICAL;
+    m_resources.push_back(std::move(resource));
+    m_compiled = false;
+
+    return { static_cast<uint32_t>(m_resources.size() - 1), 0 };
+}
+
+uint32_t FrameGraph::AddPass(const char* name, ExecuteFunction execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    pass.culled = false;
+    pass.unbindAfter = 0;
+    m_passes.push_back(std::move(pass));
+    m_compiled = false;
+
+    return static_cast<uint32_t>(m_passes.size() - 1);
+}
+
+void FrameGraph::Read(uint32_t pass, Resource resource)
+{
+    ResourceEntry& entry = m_resources.at(resource.index);
+    entry.versions.at(resource.version).readers.push_back(pass);
+    m_passes.at(pass).reads.push_back(resource);
+    m_compiled = false;
+}
+
+FrameGraph::Resource FrameGraph::Write(uint32_t pass, Resource resource)
+{
+    ResourceEntry& entry = m_resources.at(resource.index);
+    if (resource.version + 1 != entry.versions.size())
+        throw std::logic_error(std::string("FrameGraph: '") + entry.name + "' written from an old version");
+
+    entry.versions.push_back({ pass, {} });
+    const Resource written = { resource.index, resource.version + 1 };
+    m_passes.at(pass).writes.push_back(written);
+    m_compiled = false;
+
+    return written;
+}
+
+void FrameGraph::MarkOutput(Resource resource)
+{
+    m_outputs.push_back(resource);
+    m_compiled = false;
+}
+
+void FrameGraph::Compile()
+{
+    for (Pass& pass : m_passes)
+    {
+        pass.dependencies.clear();
+        pass.culled = true;
+        pass.unbindAfter = 0;
+    }
+
+    // A version's readers follow its producer, and the next version's producer follows
+    // both (the previous writer and everything that read what it overwrites).
+    for (const ResourceEntry& resource : m_resources)
+    {
+        for (size_t v = 0; v < resource.versions.size(); ++v)
+        {
+            const Version& version = resource.versions[v];
+            if (version.producer == NoPass && !resource.imported && !version.readers.empty())
+                throw std::logic_error(std::string("FrameGraph: '") + resource.name + "' is read before it is written");
+
+            for (uint32_t reader : version.readers)
+            {
+                if (version.producer != NoPass && reader != version.producer)
+                {
+                    AddDependency(m_passes[reader].dependencies, version.producer);
+                }
+            }
+
+            if (v + 1 < resource.versions.size())
+            {
+                const uint32_t next = resource.versions[v + 1].producer;
+                if (version.producer != NoPass)
+                {
+                    AddDependency(m_passes[next].dependencies, version.producer);
+                }
+                for (uint32_t reader : version.readers)
+                {
+                    if (reader != next)
+                    {
+                        AddDependency(m_passes[next].dependencies, reader);
+                    }
+                }
+            }
+        }
+    }
+
+    Cull();
+    Sort();
+    AssignPhysicalTextures();
+    PlanUnbinds();
+
+    m_statistics.passes = static_cast<uint32_t>(m_passes.size());
+    m_statistics.culledPasses = static_cast<uint32_t>(m_passes.size() - m_order.size());
+    m_compiled = true;
+}
+
+// Only what a pass reads keeps its producer alive; a pass that just overwrites a
+// texture does not need whoever wrote it before.
+void FrameGraph::Cull()
+{
+    std::vector<uint32_t> pending;
+    for (const Resource& output : m_outputs)
+    {
+        const uint32_t producer = m_resources.at(output.index).versions.at(output.version).producer;
+        if (producer != NoPass)
+        {
+            pending.push_back(producer);
+        }
+    }
+
+    while (!pending.empty())
+    {
+        Pass& pass = m_passes[pending.back()];
+        pending.pop_back();
+        if (!pass.culled)
+            continue;
+
+        pass.culled = false;
+        for (const Resource& read : pass.reads)
+        {
+            const uint32_t producer = m_resources[read.index].versions[read.version].producer;
+            if (producer != NoPass && m_passes[producer].culled)
+            {
+                pending.push_back(producer);
+            }
+        }
+    }
+}
+
+// Passes are few, so each step scans for the first one whose dependencies have run.
+void FrameGraph::Sort()
+{
+    m_order.clear();
+
+    std::vector<bool> done(m_passes.size(), false);
+    size_t remaining = 0;
+    for (const Pass& pass : m_passes)
+    {
+        remaining += pass.culled ? 0 : 1;
+    }
+
+    while (m_order.size() < remaining)
+    {
+        uint32_t next = NoPass;
+        for (uint32_t i = 0; i < m_passes.size() && next == NoPass; ++i)
+        {
+            const Pass& pass = m_passes[i];
+            if (pass.culled || done[i])
+                continue;
+
+            bool ready = true;
+            for (uint32_t dependency : pass.dependencies)
+            {
+                ready = ready && (m_passes[dependency].culled || done[dependency]);
+            }
+            next = ready ? i : NoPass;
+        }
+
+        if (next == NoPass)
+            throw std::logic_error("FrameGraph: passes depend on each other");
+
+        done[next] = true;
+        m_order.push_back(next);
+    }
+}
+
+void FrameGraph::AssignPhysicalTextures()
+{
+    m_physical.clear();
+    m_statistics.transientTextures = 0;
+    m_statistics.transientTexels = 0;
+    m_statistics.physicalTexels = 0;
+
+    const uint32_t unused = ~0u;
+    for (ResourceEntry& resource : m_resources)
+    {
+        resource.firstUse = unused;
+        resource.lastUse = 0;
+        resource.physical = NO_PHYSICAL;
+    }
+
+    for (uint32_t step = 0; step < m_order.size(); ++step)
+    {
+        const Pass& pass = m_passes[m_order[step]];
+        for (const std::vector<Resource>* accesses : { &pass.reads, &pass.writes })
+        {
+            for (const Resource& access : *accesses)
+            {
+                ResourceEntry& resource = m_resources[access.index];
+                resource.firstUse = std::min(resource.firstUse, step);
+                resource.lastUse = std::max(resource.lastUse, step);
+            }
+        }
+    }
+
+    // A texture is taken at its first use and given back after its last, for a later
+    // texture of the same description to reuse.
+    for (uint32_t step = 0; step < m_order.size(); ++step)
+    {
+        for (ResourceEntry& resource : m_resources)
+        {
+            if (resource.imported || resource.firstUse != step)
+                continue;
+
+            uint32_t physical = NO_PHYSICAL;
+            for (uint32_t i = 0; i < m_physical.size() && physical == NO_PHYSICAL; ++i)
+            {
+                physical = (m_physical[i].free && SameDesc(m_physical[i].desc, resource.desc)) ? i : NO_PHYSICAL;
+            }
+
+            const uint64_t texels = uint64_t(resource.desc.width) * resource.desc.height;
+            if (physical == NO_PHYSICAL)
+            {
+                physical = static_cast<uint32_t>(m_physical.size());
+                m_physical.push_back({ resource.desc, TransientTexturePool::InvalidHandle, false });
+                m_statistics.physicalTexels += texels;
+            }
+
+            m_physical[physical].free = false;
+            resource.physical = physical;
+            ++m_statistics.transientTextures;
+            m_statistics.transientTexels += texels;
+        }
+
+        for (const ResourceEntry& resource : m_resources)
+        {
+            if (resource.physical != NO_PHYSICAL && resource.lastUse == step)
+            {
+                m_physical[resource.physical].free = true;
+            }
+        }
+    }
+
+    m_statistics.physicalTextures = static_cast<uint32_t>(m_physical.size());
+}
+
+uint32_t FrameGraph::GetBacking(uint32_t resource) const
+{
+    const ResourceEntry& entry = m_resources[resource];
+    return entry.imported ? static_cast<uint32_t>(m_physical.size()) + resource : entry.physical;
+}
+
+// Inputs a pass leaves bound stay bound until something unbinds them, so everything
+// read since the last unbind counts when checking what the next pass writes.
+void FrameGraph::PlanUnbinds()
+{
+    m_statistics.unbinds = 0;
+
+    std::vector<uint32_t> bound;
+    uint32_t boundInputs = 0;
+    for (size_t step = 0; step < m_order.size(); ++step)
+    {
+        Pass& pass = m_passes[m_order[step]];
+        for (const Resource& read : pass.reads)
+        {
+            bound.push_back(GetBacking(read.index));
+        }
+        boundInputs = std::max(boundInputs, static_cast<uint32_t>(pass.reads.size()));
+
+        bool hazard = (step + 1 == m_order.size());
+        if (!hazard)
+        {
+            for (const Resource& write : m_passes[m_order[step + 1]].writes)
+            {
+                hazard = hazard || std::find(bound.begin(), bound.end(), GetBacking(write.index)) != bound.end();
+            }
+        }
+
+        if (hazard && boundInputs > 0)
+        {
+            pass.unbindAfter = boundInputs;
+            ++m_statistics.unbinds;
+            bound.clear();
+            boundInputs = 0;
+        }
+    }
+}
+
+void FrameGraph::Execute(TransientTexturePool& pool, const UnbindFunction& unbind)
+{
+    if (!m_compiled)
+    {
+        Compile();
+    }
+
+    m_pool = &pool;
+    for (Physical& physical : m_physical)
+    {
+        physical.handle = pool.Acquire(physical.desc);
+    }
+
+    for (uint32_t pass : m_order)
+    {
+        m_passes[pass].execute(*this);
+        if (m_passes[pass].unbindAfter > 0 && unbind)
+        {
+            unbind(m_passes[pass].unbindAfter);
+        }
+    }
+
+    for (Physical& physical : m_physical)
+    {
+        pool.Release(physical.handle);
+        physical.handle = TransientTexturePool::InvalidHandle;
+    }
+    m_pool = nullptr;
+}
+
+const void* FrameGraph::GetTexture(Resource resource) const
+{
+    const ResourceEntry& entry = m_resources[resource.index];
+    if (entry.imported)
+        return entry.imported;
+
+    if (!m_pool || entry.physical == NO_PHYSICAL)
+        throw std::logic_error(std::string("FrameGraph: '") + entry.name + "' has no texture outside Execute");
+
+    return m_pool->GetTexture(m_physical[entry.physical].handle);
+}
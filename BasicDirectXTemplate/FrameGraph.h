@@ -0,0 +1,153 @@
+//
+// FrameGraph.h - Passes ordered, culled and given memory from what they read and write
+//
+
+#pragma once
+
+#include "TransientTexturePool.h"
+
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+// Passes declare the textures they read and write instead of binding targets
+// themselves. Each Write returns a new version of the texture, and a Read names the
+// version it wants, so the graph knows which pass produced what. Compile then:
+//
+//  - culls the passes nothing marked as an output depends on,
+//  - orders the rest so every version is written before it is read and read before it
+//    is overwritten, otherwise keeping the order passes were added in,
+//  - gives transient textures whose lifetimes do not overlap the same physical texture
+//    (same description only), and
+//  - works out after which passes the inputs must be unbound: when the next pass writes
+//    a texture the pass read, and after the last pass.
+//
+// Execute acquires the physical textures from a TransientTexturePool for the frame and
+// runs the passes. The graph can be compiled once and executed every frame until what
+// it describes changes.
+class FrameGraph
+{
+public:
+    struct Resource
+    {
+        uint32_t    index;
+        uint32_t    version;
+    };
+
+    typedef std::function<void(const FrameGraph& graph)> ExecuteFunction;
+
+    // Unbinds the first inputCount shader inputs.
+    typedef std::function<void(uint32_t inputCount)> UnbindFunction;
+
+    struct Statistics
+    {
+        uint32_t    passes;
+        uint32_t    culledPasses;
+        uint32_t    transientTextures;
+        uint32_t    physicalTextures;           // After aliasing
+        uint64_t    transientTexels;
+        uint64_t    physicalTexels;
+        uint32_t    unbinds;
+    };
+
+    FrameGraph() noexcept :
+        m_pool(nullptr),
+        m_compiled(false),
+        m_statistics{}
+    {
+    }
+
+    FrameGraph(FrameGraph const&) = delete;
+    FrameGraph& operator= (FrameGraph const&) = delete;
+
+    // Forgets every pass and resource, keeping capacity.
+    void Reset();
+
+    // A texture the graph allocates; its first version has no contents.
+    Resource CreateTexture(const char* name, const TransientTextureDesc& desc);
+
+    // A texture owned elsewhere (the scene, the back buffer); its first version is
+    // whatever it holds when Execute runs.
+    Resource ImportTexture(const char* name, const TransientTextureDesc& desc, const void* texture);
+
+    uint32_t AddPass(const char* name, ExecuteFunction execute);
+    void Read(uint32_t pass, Resource resource);
+    Resource Write(uint32_t pass, Resource resource);
+
+    // The passes producing this version, and those they depend on, are never culled.
+    void MarkOutput(Resource resource);
+
+    // Throws std::logic_error for a read of a version nothing wrote or a dependency cycle.
+    void Compile();
+    void Execute(TransientTexturePool& pool, const UnbindFunction& unbind);
+
+    // For the passes while they execute. Every version of a resource is the same texture,
+    // so a pass can look up the handle it was declared with.
+    const void* GetTexture(Resource resource) const;
+    const TransientTextureDesc& GetDesc(Resource resource) const { return m_resources[resource.index].desc; }
+
+    // What Compile decided.
+    const Statistics& GetStatistics() const             { return m_statistics; }
+    const std::vector<uint32_t>& GetOrder() const       { return m_order; }
+    const char* GetPassName(uint32_t pass) const        { return m_passes[pass].name; }
+    bool IsCulled(uint32_t pass) const                  { return m_passes[pass].culled; }
+    uint32_t GetUnbindCount(uint32_t pass) const        { return m_passes[pass].unbindAfter; }
+
+    // The physical texture a transient resource was given, ~0u for imported or unused ones.
+    uint32_t GetPhysicalTexture(Resource resource) const { return m_resources[resource.index].physical; }
+
+private:
+    static const uint32_t NoPass = ~0u;
+
+    struct Version
+    {
+        uint32_t                producer;       // NoPass for the first version
+        std::vector<uint32_t>   readers;
+    };
+
+    struct ResourceEntry
+    {
+        const char*             name;
+        TransientTextureDesc    desc;
+        const void*             imported;       // nullptr for transient textures
+        std::vector<Version>    versions;
+        uint32_t                firstUse;       // Positions in m_order
+        uint32_t                lastUse;
+        uint32_t                physical;
+    };
+
+    struct Pass
+    {
+        const char*             name;
+        ExecuteFunction         execute;
+        std::vector<Resource>   reads;
+        std::vector<Resource>   writes;
+        std::vector<uint32_t>   dependencies;   // Passes that must run first
+        bool                    culled;
+        uint32_t                unbindAfter;
+    };
+
+    struct Physical
+    {
+        TransientTextureDesc            desc;
+        TransientTexturePool::Handle    handle;
+        bool                            free;
+    };
+
+    void Cull();
+    void Sort();
+    void AssignPhysicalTextures();
+    void PlanUnbinds();
+
+    // Physical identity of a resource: its physical texture, or past them for imports.
+    uint32_t GetBacking(uint32_t resource) const;
+
+    std::vector<ResourceEntry>  m_resources;
+    std::vector<Pass>           m_passes;
+    std::vector<Resource>       m_outputs;
+    std::vector<uint32_t>       m_order;
+    std::vector<Physical>       m_physical;
+    TransientTexturePool*       m_pool;                 // While Execute runs
+    bool                        m_compiled;
+    Statistics                  m_statistics;
+};
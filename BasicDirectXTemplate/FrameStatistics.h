@@ -0,0 +1,183 @@
+//
+// FrameStatistics.h - Rolling frame time percentiles and hitch log
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+
+namespace DX
+{
+    // Records the last SampleCount values of each channel and a log of hitches.
+    // There must be a single writer (the thread calling StepTimer::Tick); any thread
+    // may read. Recording is a couple of relaxed atomic stores, nothing is locked.
+    class FrameStatistics
+    {
+    public:
+        static const uint32_t SampleCount = 1024;
+        static const uint32_t HitchCount = 64;
+
+        enum Channel
+        {
+            FrameTicks = 0,     // raw time between Ticks, before clamping
+            UpdatesPerTick,     // fixed timestep updates run by a single Tick
+            RenderTicks,        // time spent in the render callback
+            ChannelCount
+        };
+
+        struct Summary
+        {
+            uint32_t samples;
+            uint32_t p50;
+            uint32_t p95;
+            uint32_t p99;
+            uint32_t max;
+        };
+
+        struct Hitch
+        {
+            uint32_t frameIndex;
+            uint32_t frameTicks;
+            uint32_t updates;
+        };
+
+        FrameStatistics() noexcept
+        {
+            Reset();
+        }
+
+        FrameStatistics(FrameStatistics const&) = delete;
+        FrameStatistics& operator= (FrameStatistics const&) = delete;
+
+        void Reset() noexcept
+        {
+            for (auto& channel : m_channels)
+            {
+                for (auto& sample : channel.samples)
+                {
+                    sample.store(0, std::memory_order_relaxed);
+                }
+                channel.count.store(0, std::memory_order_release);
+            }
+
+            for (auto& hitch : m_hitches)
+            {
+                hitch.sequence.store(0, std::memory_order_relaxed);
+            }
+            m_hitchCount.store(0, std::memory_order_release);
+        }
+
+        void Record(Channel channel, uint64_t value) noexcept
+        {
+            auto& ring = m_channels[channel];
+            uint64_t count = ring.count.load(std::memory_order_relaxed);
+            ring.samples[count % SampleCount].store(Saturate(value), std::memory_order_relaxed);
+            ring.count.store(count + 1, std::memory_order_release);
+        }
+
+        void RecordHitch(uint32_t frameIndex, uint64_t frameTicks, uint32_t updates) noexcept
+        {
+            uint64_t count = m_hitchCount.load(std::memory_order_relaxed);
+            auto& hitch = m_hitches[count % HitchCount];
+
+            // Odd sequence numbers mark an entry that is being written.
+            uint32_t sequence = hitch.sequence.load(std::memory_order_relaxed);
+            hitch.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            hitch.frameIndex.store(frameIndex, std::memory_order_relaxed);
+            hitch.frameTicks.store(Saturate(frameTicks), std::memory_order_relaxed);
+            hitch.updates.store(updates, std::memory_order_relaxed);
+            hitch.sequence.store(sequence + 2, std::memory_order_release);
+
+            m_hitchCount.store(count + 1, std::memory_order_release);
+        }
+
+        // Percentiles over the samples currently in the window.
+        Summary GetSummary(Channel channel) const noexcept
+        {
+            auto& ring = m_channels[channel];
+
+            uint32_t values[SampleCount];
+            uint64_t count = ring.count.load(std::memory_order_acquire);
+            uint32_t n = static_cast<uint32_t>(std::min<uint64_t>(count, SampleCount));
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                values[i] = ring.samples[i].load(std::memory_order_relaxed);
+            }
+
+            Summary summary = {};
+            summary.samples = n;
+            if (n == 0)
+                return summary;
+
+            std::sort(values, values + n);
+            summary.p50 = values[Rank(n, 50)];
+            summary.p95 = values[Rank(n, 95)];
+            summary.p99 = values[Rank(n, 99)];
+            summary.max = values[n - 1];
+            return summary;
+        }
+
+        // Total number of hitches recorded since the last reset.
+        uint64_t GetHitchCount() const noexcept { return m_hitchCount.load(std::memory_order_acquire); }
+
+        // Copies up to maxHitches of the most recent hitches, newest first.
+        uint32_t GetHitches(Hitch* hitches, uint32_t maxHitches) const noexcept
+        {
+            uint64_t count = m_hitchCount.load(std::memory_order_acquire);
+            uint32_t n = static_cast<uint32_t>(std::min<uint64_t>(std::min<uint64_t>(count, HitchCount), maxHitches));
+
+            uint32_t written = 0;
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                auto& entry = m_hitches[(count - 1 - i) % HitchCount];
+
+                uint32_t before = entry.sequence.load(std::memory_order_acquire);
+                Hitch hitch;
+                hitch.frameIndex = entry.frameIndex.load(std::memory_order_relaxed);
+                hitch.frameTicks = entry.frameTicks.load(std::memory_order_relaxed);
+                hitch.updates = entry.updates.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                uint32_t after = entry.sequence.load(std::memory_order_relaxed);
+
+                // Skip entries the writer touched while we were reading them.
+                if ((before & 1) == 0 && before == after)
+                {
+                    hitches[written++] = hitch;
+                }
+            }
+            return written;
+        }
+
+    private:
+        static uint32_t Saturate(uint64_t value) noexcept
+        {
+            return value > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(value);
+        }
+
+        static uint32_t Rank(uint32_t n, uint32_t percentile) noexcept
+        {
+            return std::min(n - 1, (n * percentile) / 100);
+        }
+
+        struct Ring
+        {
+            std::atomic<uint32_t> samples[SampleCount];
+            std::atomic<uint64_t> count;
+        };
+
+        struct HitchEntry
+        {
+            std::atomic<uint32_t> sequence;
+            std::atomic<uint32_t> frameIndex;
+            std::atomic<uint32_t> frameTicks;
+            std::atomic<uint32_t> updates;
+        };
+
+        Ring                    m_channels[ChannelCount];
+        HitchEntry              m_hitches[HitchCount];
+        std::atomic<uint64_t>   m_hitchCount;
+    };
+}
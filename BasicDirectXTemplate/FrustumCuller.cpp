@@ -0,0 +1,111 @@
+//
+// FrustumCuller.cpp
+//
+
+#include "FrustumCuller.h"
+
+using namespace DirectX;
+
+FrustumCuller::FrustumCuller() noexcept
+{
+    SetViewProjection(XMMatrixIdentity());
+}
+
+void XM_CALLCONV FrustumCuller::SetViewProjection(FXMMATRIX viewProjection)
+{
+    // With row vectors clip = v * M, so each clip coordinate is v dotted with a column.
+    XMMATRIX columns = XMMatrixTranspose(viewProjection);
+
+    const XMVECTOR planes[6] =
+    {
+        XMVectorAdd(columns.r[3], columns.r[0]),        // Left:   w + x >= 0
+        XMVectorSubtract(columns.r[3], columns.r[0]),   // Right:  w - x >= 0
+        XMVectorAdd(columns.r[3], columns.r[1]),        // Bottom: w + y >= 0
+        XMVectorSubtract(columns.r[3], columns.r[1]),   // Top:    w - y >= 0
+        columns.r[2],                                   // Near:   z >= 0
+        XMVectorSubtract(columns.r[3], columns.r[2]),   // Far:    w - z >= 0
+    };
+
+    for (size_t p = 0; p < 6; ++p)
+    {
+        XMVECTOR plane = XMPlaneNormalize(planes[p]);
+        XMStoreFloat4(&m_planes[p][0], XMVectorSplatX(plane));
+        XMStoreFloat4(&m_planes[p][1], XMVectorSplatY(plane));
+        XMStoreFloat4(&m_planes[p][2], XMVectorSplatZ(plane));
+        XMStoreFloat4(&m_planes[p][3], XMVectorSplatW(plane));
+    }
+}
+
+size_t FrustumCuller::Cull(const BoundingSphere* spheres, size_t count, size_t stride, uint8_t* visible) const
+{
+    auto base = reinterpret_cast<const uint8_t*>(spheres);
+    auto sphereAt = [base, stride](size_t index) -> const BoundingSphere&
+    {
+        return *reinterpret_cast<const BoundingSphere*>(base + index * stride);
+    };
+
+    XMVECTOR planes[6][4];
+    for (size_t p = 0; p < 6; ++p)
+    {
+        for (size_t c = 0; c < 4; ++c)
+        {
+            planes[p][c] = XMLoadFloat4(&m_planes[p][c]);
+        }
+    }
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        // Transpose four spheres into x, y, z and radius vectors.
+        XMMATRIX batch;
+        for (size_t k = 0; k < 4; ++k)
+        {
+            const BoundingSphere& sphere = sphereAt(i + k);
+            batch.r[k] = XMVectorSetW(XMLoadFloat3(&sphere.Center), sphere.Radius);
+        }
+        batch = XMMatrixTranspose(batch);
+
+        // A sphere is outside if it lies entirely behind any plane.
+        XMVECTOR negativeRadius = XMVectorNegate(batch.r[3]);
+        XMVECTOR inside = XMVectorTrueInt();
+        for (size_t p = 0; p < 6; ++p)
+        {
+            XMVECTOR distance = XMVectorMultiplyAdd(batch.r[0], planes[p][0],
+                XMVectorMultiplyAdd(batch.r[1], planes[p][1],
+                    XMVectorMultiplyAdd(batch.r[2], planes[p][2], planes[p][3])));
+            inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(distance, negativeRadius));
+        }
+
+        uint32_t mask[4];
+        XMStoreInt4(mask, inside);
+        for (size_t k = 0; k < 4; ++k)
+        {
+            visible[i + k] = mask[k] ? 1 : 0;
+            visibleCount += visible[i + k];
+        }
+    }
+
+    for (; i < count; ++i)
+    {
+        visible[i] = IsVisible(sphereAt(i)) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+
+    return visibleCount;
+}
+
+bool FrustumCuller::IsVisible(const BoundingSphere& sphere) const
+{
+    for (size_t p = 0; p < 6; ++p)
+    {
+        float distance = m_planes[p][0].x * sphere.Center.x
+            + m_planes[p][1].x * sphere.Center.y
+            + m_planes[p][2].x * sphere.Center.z
+            + m_planes[p][3].x;
+
+        if (distance < -sphere.Radius)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+//
+// FrustumCuller.h - Tests bounding spheres against a view frustum, four at a time
+//
+
+#pragma once
+
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Visible and culled counts from one or more Cull calls.
+struct CullStatistics
+{
+    uint32_t visible;
+    uint32_t culled;
+
+    void Add(size_t tested, size_t visibleCount)
+    {
+        visible += static_cast<uint32_t>(visibleCount);
+        culled += static_cast<uint32_t>(tested - visibleCount);
+    }
+};
+
+class FrustumCuller
+{
+public:
+    FrustumCuller() noexcept;
+
+    // Extracts the six frustum planes from a view * projection matrix (row vectors,
+    // Direct3D clip space with depth 0..1, as built by XMMatrixPerspectiveFovRH).
+    void XM_CALLCONV SetViewProjection(DirectX::FXMMATRIX viewProjection);
+
+    // Tests count spheres laid out stride bytes apart, so the spheres can live inside
+    // larger structures. Writes 1 (visible) or 0 per sphere and returns the visible count.
+    size_t Cull(const DirectX::BoundingSphere* spheres, size_t count, size_t stride, uint8_t* visible) const;
+
+    // Scalar reference for a single sphere.
+    bool IsVisible(const DirectX::BoundingSphere& sphere) const;
+
+private:
+    // Plane components splatted across four lanes: m_planes[plane][0..3] = a, b, c, d.
+    DirectX::XMFLOAT4 m_planes[6][4];
+};
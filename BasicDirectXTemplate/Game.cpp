@@ -4,15 +4,22 @@
 
 #include "pch.h"
 #include "Game.h"
+#include "D3DSdkMesh.h"
+#include "MappedFile.h"
+#include "Profiler.h"
 
 extern void ExitGame();
 
+// Windows 10 version 1803 and later; older SDKs do not define it.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
 using Microsoft::WRL::ComPtr;
 
-float rotation = 0;
 float pi = 3.14159265359f;
 float toRadians = pi / 180.0f;
 
@@ -70,128 +77,313 @@ namespace
 }
 namespace
 {
-    struct VS_BLOOM_PARAMETERS
-    {
-        float bloomThreshold;
-        float blurAmount;
-        float bloomIntensity;
-        float baseIntensity;
-        float bloomSaturation;
-        float baseSaturation;
-        uint8_t na[8];
+    // F6 cycles the preset and F7 the blur quality.
+    BloomPresets g_Bloom = Default;
+    BloomQuality g_BloomQuality = g_DefaultBloomQuality;
+}
+
+namespace
+{
+    // Slices of the planet texture array. Earth uses the first; the asteroid orbiting the
+    // earth keeps the second and the belt cycles through the rest.
+    const wchar_t* const PLANET_TEXTURES[] =
+    {
+        L"(1) Planet_Mesh_BaseColor.png",
+        L"(2) Planet_Mesh_BaseColor.png",
+        L"(3) Planet_Mesh_BaseColor.png",
+        L"(4) Planet_Mesh_BaseColor.png",
+        L"(5) Planet_Mesh_BaseColor.png",
     };
+    const uint32_t EARTH_SLICE = 0;
+    const uint32_t ASTEROID_SLICE = 1;
+    const uint32_t BELT_SLICES = _countof(PLANET_TEXTURES) - 1;
+
+    // Updates per second; F8 halves it.
+    const uint32_t SIMULATION_RATE = 60;
+
+    // Written by F10, replayed by F11 and by "simulate --replay".
+    const char* const INPUT_RECORDING_PATH = "input.rec";
+
+    // Render targets unused for this many frames are destroyed, and the least recently
+    // used free ones once the pool is over budget.
+    const uint32_t RENDER_TARGET_KEEP_FRAMES = 120;
+    const uint64_t RENDER_TARGET_BUDGET = 256ull * 1024 * 1024;
 
-    static_assert(!(sizeof(VS_BLOOM_PARAMETERS) % 16),
-        "VS_BLOOM_PARAMETERS needs to be 16 bytes aligned");
+    // Bloom pyramid textures in the post-process graph.
+    const char* const BLOOM_LEVEL_NAMES[BloomChain::MaxLevels] =
+    {
+        "bloom level 0", "bloom level 1", "bloom level 2", "bloom level 3", "bloom level 4", "bloom level 5",
+    };
+    const char* const BLOOM_BLUR_NAMES[BloomChain::MaxLevels] =
+    {
+        "bloom blur 0", "bloom blur 1", "bloom blur 2", "bloom blur 3", "bloom blur 4", "bloom blur 5",
+    };
 
-    struct VS_BLUR_PARAMETERS
+    // The blur permutation for each quality tier, by sample count.
+    const char* const BLUR_SHADERS[BloomQualityCount] =
     {
-        static const size_t SAMPLE_COUNT = 15;
+        "GaussianBlur7.cso", "GaussianBlur11.cso", "GaussianBlur15.cso", "GaussianBlur23.cso", "GaussianBlur31.cso",
+    };
 
-        XMFLOAT4 sampleOffsets[SAMPLE_COUNT];
-        XMFLOAT4 sampleWeights[SAMPLE_COUNT];
+    // Asset names are their (ASCII) file names.
+    inline std::wstring ToFileName(const char* name)
+    {
+        return std::wstring(name, name + strlen(name));
+    }
 
-        void SetBlurEffectParameters(float dx, float dy,
-            const VS_BLOOM_PARAMETERS& params)
+    inline std::string ToAssetName(const wchar_t* name)
+    {
+        std::string asset;
+        for (const wchar_t* c = name; *c; ++c)
         {
-            sampleWeights[0].x = ComputeGaussian(0, params.blurAmount);
-            sampleOffsets[0].x = sampleOffsets[0].y = 0.f;
+            asset += static_cast<char>(*c);
+        }
+        return asset;
+    }
 
-            float totalWeights = sampleWeights[0].x;
+    // Where "cook --source . --output Cooked" puts the DDS files and their manifest.
+    const char* const COOKED_DIRECTORY = "Cooked/";
+    const char* const COOKED_MANIFEST = "Cooked/manifest.txt";
 
-            // Add pairs of additional sample taps, positioned
-            // along a line in both directions from the center.
-            for (size_t i = 0; i < SAMPLE_COUNT / 2; i++)
-            {
-                // Store weights for the positive and negative taps.
-                float weight = ComputeGaussian(float(i + 1.f), params.blurAmount);
-
-                sampleWeights[i * 2 + 1].x = weight;
-                sampleWeights[i * 2 + 2].x = weight;
-
-                totalWeights += weight * 2;
-
-                // To get the maximum amount of blurring from a limited number of
-                // pixel shader samples, we take advantage of the bilinear filtering
-                // hardware inside the texture fetch unit. If we position our texture
-                // coordinates exactly halfway between two texels, the filtering unit
-                // will average them for us, giving two samples for the price of one.
-                // This allows us to step in units of two texels per sample, rather
-                // than just one at a time. The 1.5 offset kicks things off by
-                // positioning us nicely in between two texels.
-                float sampleOffset = float(i) * 2.f + 1.5f;
-
-                Vector2 delta = Vector2(dx, dy) * sampleOffset;
-
-                // Store texture coordinate offsets for the positive and negative taps.
-                sampleOffsets[i * 2 + 1].x = delta.x;
-                sampleOffsets[i * 2 + 1].y = delta.y;
-                sampleOffsets[i * 2 + 2].x = -delta.x;
-                sampleOffsets[i * 2 + 2].y = -delta.y;
-            }
+    // What "pack build --source . --output Assets.pack" writes: every asset, cooked
+    // textures included, in one file. The manifest stays a loose file beside it.
+    const char* const ASSET_PACK = "Assets.pack";
+
+    // The cooked DDS file for a source texture, or the source if it was not cooked.
+    std::string GetTexturePath(const TextureManifest& manifest, const char* name)
+    {
+        const TextureManifest::Entry* entry = manifest.Find(name);
+        if (!entry)
+            return name;
+        return COOKED_DIRECTORY + entry->cooked;
+    }
+
+    bool IsDdsFile(const std::string& path)
+    {
+        return path.size() > 4 && _stricmp(path.c_str() + path.size() - 4, ".dds") == 0;
+    }
+
+    // An asset's bytes, from the pack if it holds the asset and otherwise mapped from its
+    // loose file. They stay valid while the AssetBytes does.
+    struct AssetBytes
+    {
+        DX::MappedFile          file;
+        std::vector<uint8_t>    storage;
+        AssetPack::Bytes        bytes;
+    };
+
+    AssetBytes ReadAsset(const AssetPack& pack, const char* name)
+    {
+        AssetBytes asset;
+        if (const AssetPackEntry* entry = pack.Find(name))
+        {
+            asset.bytes = pack.Get(*entry, asset.storage);
+        }
+        else
+        {
+            asset.file = DX::MapData(name);
+            asset.bytes = AssetPack::Bytes{ asset.file.data(), asset.file.size() };
+        }
+        return asset;
+    }
+
+    // DDS or, for anything else, WIC. With a context WIC also generates the mips.
+    void CreateTextureFromAsset(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const std::string& path,
+        const AssetBytes& asset, ID3D11ShaderResourceView** textureView)
+    {
+        if (IsDdsFile(path))
+        {
+            DX::ThrowIfFailed(CreateDDSTextureFromMemory(device, asset.bytes.data, asset.bytes.size, nullptr, textureView));
+        }
+        else if (deviceContext)
+        {
+            DX::ThrowIfFailed(CreateWICTextureFromMemory(device, deviceContext, asset.bytes.data, asset.bytes.size,
+                nullptr, textureView));
+        }
+        else
+        {
+            DX::ThrowIfFailed(CreateWICTextureFromMemory(device, asset.bytes.data, asset.bytes.size, nullptr, textureView));
+        }
+    }
+
+    // Models name their textures by source file; this loads the cooked ones instead, and
+    // from the pack when it has them.
+    class CookedEffectFactory : public EffectFactory
+    {
+    public:
+        CookedEffectFactory(ID3D11Device* device, const TextureManifest& manifest, const AssetPack& pack) :
+            EffectFactory(device),
+            m_device(device),
+            m_manifest(&manifest),
+            m_pack(&pack)
+        {
+        }
 
-            for (size_t i = 0; i < SAMPLE_COUNT; i++)
+        void __cdecl CreateTexture(const wchar_t* name, ID3D11DeviceContext* deviceContext,
+            ID3D11ShaderResourceView** textureView) override
+        {
+            const std::string path = GetTexturePath(*m_manifest, ToAssetName(name).c_str());
+            if (m_pack->Find(path.c_str()))
             {
-                sampleWeights[i].x /= totalWeights;
+                CreateTextureFromAsset(m_device.Get(), deviceContext, path, ReadAsset(*m_pack, path.c_str()), textureView);
+                return;
             }
+            EffectFactory::CreateTexture(ToFileName(path.c_str()).c_str(), deviceContext, textureView);
         }
 
     private:
-        float ComputeGaussian(float n, float theta)
-        {
-            return (float)((1.0 / sqrtf(2 * XM_PI * theta))
-                * expf(-(n * n) / (2 * theta * theta)));
-        }
+        ComPtr<ID3D11Device>    m_device;
+        const TextureManifest*  m_manifest;
+        const AssetPack*        m_pack;
     };
 
-    static_assert(!(sizeof(VS_BLUR_PARAMETERS) % 16),
-        "VS_BLUR_PARAMETERS needs to be 16 bytes aligned");
+    // Mid grey, 1x1 per slice, drawn with until the real texture has loaded.
+    void CreatePlaceholderTexture(ID3D11Device* device, UINT arraySize, bool array,
+        ID3D11ShaderResourceView** textureView)
+    {
+        const uint32_t grey = 0xff808080;
+        std::vector<D3D11_SUBRESOURCE_DATA> initData(arraySize, D3D11_SUBRESOURCE_DATA{ &grey, sizeof(grey), 0 });
 
-    enum BloomPresets
+        CD3D11_TEXTURE2D_DESC desc(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, arraySize, 1);
+        ComPtr<ID3D11Texture2D> texture;
+        DX::ThrowIfFailed(device->CreateTexture2D(&desc, initData.data(), texture.GetAddressOf()));
+
+        CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc(texture.Get(),
+            array ? D3D11_SRV_DIMENSION_TEXTURE2DARRAY : D3D11_SRV_DIMENSION_TEXTURE2D);
+        DX::ThrowIfFailed(device->CreateShaderResourceView(texture.Get(), &srvDesc, textureView));
+    }
+
+    // Post-process graph textures are PooledRenderTargets, pooled or imported.
+    inline const PooledRenderTarget& GetRenderTarget(const FrameGraph& graph, FrameGraph::Resource resource)
+    {
+        return *static_cast<const PooledRenderTarget*>(graph.GetTexture(resource));
+    }
+
+    inline RECT GetRect(const TransientTextureDesc& desc)
+    {
+        RECT rect = { 0, 0, LONG(desc.width), LONG(desc.height) };
+        return rect;
+    }
+
+    const float SCENE_NEAR_PLANE = 0.01f;
+    const float SCENE_FAR_PLANE = 100.f;
+
+    // Render queue key fields. A queue command is its type in the top byte and an index
+    // (a material or ship part) below.
+    enum RenderPass : uint32_t
     {
-        Default = 0,
-        Soft,
-        Desaturated,
-        Saturated,
-        Blurry,
-        Subtle,
-        None
+        BackgroundPass,
+        ScenePass,
+        OverlayPass,
     };
 
-    BloomPresets g_Bloom = Default;
+    enum RenderShader : uint32_t
+    {
+        SpriteShader,
+        SunShader,
+        InstancedSphereShader,
+        ModelShader,
+        ReticleShader,
+    };
 
-    static const VS_BLOOM_PARAMETERS g_BloomPresets[] =
+    enum RenderCommand : uint32_t
     {
-        //Thresh  Blur Bloom  Base  BloomSat BaseSat
-        { 0.25f,  4,   1.25f, 1,    1,       1 }, // Default
-        { 0,      3,   1,     1,    1,       1 }, // Soft
-        { 0.5f,   8,   2,     1,    0,       1 }, // Desaturated
-        { 0.25f,  4,   2,     1,    2,       0 }, // Saturated
-        { 0,      2,   1,     0.1f, 1,       1 }, // Blurry
-        { 0.5f,   2,   1,     1,    1,       1 }, // Subtle
-        { 0.25f,  4,   1.25f, 1,    1,       1 }, // None
+        DrawBackground,
+        DrawSun,
+        DrawSpheres,
+        DrawShipPart,
+        DrawHud,
+        DrawReticle,
     };
-}
 
-namespace
-{
-    const XMVECTORF32 START_POSITION = { 0.f, 0.f, -20.f, 0.f };
-    const XMVECTORF32 ROOM_BOUNDS = { 50.f, 50.f, 50.f, 0.f };
-    const float ROTATION_GAIN = 0.01f;
-    const float MOVEMENT_GAIN = 0.07f;
+    const uint32_t COMMAND_TYPE_SHIFT = 24;
+    const uint32_t COMMAND_INDEX_MASK = (1u << COMMAND_TYPE_SHIFT) - 1;
+
+    inline uint32_t MakeCommand(RenderCommand command, uint32_t index = 0)
+    {
+        return (uint32_t(command) << COMMAND_TYPE_SHIFT) | index;
+    }
+
+    // Forward profiler scopes on the main thread to the GPU timeline.
+    void BeginProfilerAnnotation(void* context, const wchar_t* name)
+    {
+        static_cast<DX::DeviceResources*>(context)->PIXBeginEvent(name);
+    }
+
+    void EndProfilerAnnotation(void* context)
+    {
+        static_cast<DX::DeviceResources*>(context)->PIXEndEvent();
+    }
+
+    // Samples DirectXTK input devices into the device independent input struct.
+    SimulationInput ReadInput(const Mouse::State& mouse, const Keyboard::State& kb)
+    {
+        SimulationInput input = {};
+
+        input.mouseRelative = mouse.positionMode == Mouse::MODE_RELATIVE;
+        input.mouseX = mouse.x;
+        input.mouseY = mouse.y;
+        input.leftButton = mouse.leftButton;
+
+        if (kb.Up || kb.W)
+            input.keys |= SimulationInput::Forward;
+
+        if (kb.Down || kb.S)
+            input.keys |= SimulationInput::Back;
+
+        if (kb.Left || kb.A)
+            input.keys |= SimulationInput::Left;
+
+        if (kb.Right || kb.D)
+            input.keys |= SimulationInput::Right;
+
+        if (kb.PageUp || kb.Space)
+            input.keys |= SimulationInput::Up;
+
+        if (kb.PageDown || kb.X)
+            input.keys |= SimulationInput::Down;
+
+        if (kb.Q)
+            input.keys |= SimulationInput::RollLeft;
+
+        if (kb.E)
+            input.keys |= SimulationInput::RollRight;
+
+        if (kb.Home)
+            input.keys |= SimulationInput::Home;
+
+        if (kb.Escape)
+            input.keys |= SimulationInput::Exit;
+
+        return input;
+    }
 }
 
 Game::Game() noexcept(false) :
-    m_pitch(0),
-    m_yaw(0)
+    m_assetReportShown(false),
+    m_simulationRunning(false),
+    m_resetSimulationTimer(false),
+    m_simulationRate(SIMULATION_RATE),
+    m_requestedInputMode(LiveInput),
+    m_inputMode(LiveInput),
+    m_pendingInput{},
+    m_planetMaterial(0),
+    m_latchedKeys(0),
+    m_sceneTarget(TransientTexturePool::InvalidHandle),
+    m_postProcessGraphKey(~0u)
 {
-    
-    m_cameraPos = START_POSITION.v;
     m_deviceResources = std::make_unique<DX::DeviceResources>();
     m_deviceResources->RegisterDeviceNotify(this);
 }
 Game::~Game()
 {
+    StopSimulation();
+
+    // Loads still in flight use the device and the effect factory.
+    m_assets.reset();
+
+    DX::Profiler::ClearAnnotationCallbacks();
+
     if (m_audEngine)
     {
         m_audEngine->Suspend();
@@ -205,6 +397,10 @@ void Game::Initialize(HWND window, int width, int height)
     m_deviceResources->SetWindow(window, width, height);
 
     m_deviceResources->CreateDeviceResources();
+    DX::Profiler::SetAnnotationCallbacks(m_deviceResources.get(), BeginProfilerAnnotation, EndProfilerAnnotation);
+
+    // The assets load on the workers while the first frames render.
+    m_jobs = std::make_unique<DX::JobSystem>();
     CreateDeviceDependentResources();
 
     m_deviceResources->CreateWindowSizeDependentResources();
@@ -221,11 +417,9 @@ void Game::Initialize(HWND window, int width, int height)
     CreateWindowSizeDependentResources();
 
 
-    // TODO: Change the timer settings if you want something other than the default variable timestep mode.
-    // e.g. for 60 FPS fixed timestep update logic, call:
-    
-    m_timer.SetFixedTimeStep(true);
-    m_timer.SetTargetElapsedSeconds(1.0 / 60);
+    // The render loop runs once per frame at whatever rate Present allows; the 60 Hz
+    // fixed timestep lives on the simulation thread (see SimulationLoop).
+    m_timer.SetFixedTimeStep(false);
     
     m_keyboard = std::make_unique<Keyboard>();
     m_mouse = std::make_unique<Mouse>();
@@ -249,133 +443,101 @@ void Game::Initialize(HWND window, int width, int height)
     m_nightLoop = m_ambient->CreateInstance(SoundEffectInstance_Use3D);
        // | SoundEffectInstance_ReverbUseFilters);
     m_nightLoop->SetVolume(7.0f);
+
+    StartSimulation();
 }
 
 #pragma region Frame Update
 // Executes the basic game loop.
 void Game::Tick()
 {
-    if (rotation > 180) {
-        rotation = -180;
+    if (!DX::Profiler::BeginFrame())
+    {
+        OutputDebugStringA("Profiler: failed to write profile.json\n");
     }
-    rotation++;
 
     m_timer.Tick([&]()
     {
         Update(m_timer);
     });
 
-    Render();
+    m_timer.MeasureRender([&]()
+    {
+        Render();
+    });
 }
 
-// Updates the world.
-void Game::Update(DX::StepTimer const& timer)
+// Samples input for the simulation thread and acts on its latest snapshot.
+void Game::Update(DX::StepTimer const&)
 {
-    float elapsedTime = float(timer.GetElapsedSeconds());
+    PROFILE_SCOPE("Update");
 
     // TODO: Add your game logic here.
-    float time = float(timer.GetTotalSeconds());
-    //m_world = Matrix::CreateRotationZ(cosf(time) * 2.f);
-    //m_world = Matrix::CreateRotationY(time);
     m_world = Matrix::Identity;
 
-    auto mouse = m_mouse->GetState();
+    auto kb = m_keyboard->GetState();
+    m_keys.Update(kb);
 
-    if (mouse.positionMode == Mouse::MODE_RELATIVE)
+    // F9 captures the next 120 frames of CPU scopes as a chrome://tracing file.
+    if (m_keys.IsKeyPressed(Keyboard::F9) && !DX::Profiler::IsCapturing())
     {
-        Vector3 delta = Vector3(float(mouse.x), float(mouse.y), 0.f)
-            * ROTATION_GAIN;
-
-        m_pitch -= delta.y;
-        m_yaw -= delta.x;
-
-        // limit pitch to straight up or straight down
-        // with a little fudge-factor to avoid gimbal lock
-        float limit = XM_PI / 2.0f - 0.01f;
-        m_pitch = std::max(-limit, m_pitch);
-        m_pitch = std::min(+limit, m_pitch);
-
-        // keep longitude in same range by wrapping
-        if (m_yaw > XM_PI)
-        {
-            m_yaw -= XM_PI * 2.0f;
-        }
-        else if (m_yaw < -XM_PI)
-        {
-            m_yaw += XM_PI * 2.0f;
-        }
+        DX::Profiler::BeginCapture(120, "profile.json");
     }
 
-    m_mouse->SetMode(mouse.leftButton ? Mouse::MODE_RELATIVE : Mouse::MODE_ABSOLUTE);
-
-    auto kb = m_keyboard->GetState();
-    if (kb.Escape)
+    // F6 cycles the bloom preset and F7 the blur quality. Everything either needs was
+    // created up front, so the next frame just binds different constants and shaders.
+    if (m_keys.IsKeyPressed(Keyboard::F6))
     {
-        ExitGame();
+        g_Bloom = BloomPresets((g_Bloom + 1) % BloomPresetCount);
     }
-
-    if (kb.Home)
+    if (m_keys.IsKeyPressed(Keyboard::F7))
     {
-        m_cameraPos = START_POSITION.v;
-        m_pitch = m_yaw = 0;
+        g_BloomQuality = BloomQuality((g_BloomQuality + 1) % BloomQualityCount);
     }
 
-    Vector3 move = Vector3::Zero;
-
-    if (kb.Up || kb.W)
-        move.z += 1.f;
-
-    if (kb.Down || kb.S)
-        move.z -= 1.f;
-
-    if (kb.Left || kb.A)
-        move.x += 1.f;
-
-    if (kb.Right || kb.D)
-        move.x -= 1.f;
-
-    if (kb.PageUp || kb.Space)
-        move.y += 1.f;
-
-    if (kb.PageDown || kb.X)
-        move.y -= 1.f;
+    // F8 switches the simulation between 60 and 30 updates a second.
+    if (m_keys.IsKeyPressed(Keyboard::F8))
+    {
+        m_simulationRate = (m_simulationRate == SIMULATION_RATE) ? SIMULATION_RATE / 2 : SIMULATION_RATE;
+    }
 
-    if (kb.Q) {
-        rollMatrix *= Matrix::CreateRotationZ(0.2f);
+    // F10 starts and stops recording, F11 starts and stops a replay.
+    if (m_keys.IsKeyPressed(Keyboard::F10))
+    {
+        m_requestedInputMode = (m_requestedInputMode == RecordingInput) ? LiveInput : RecordingInput;
     }
-    if (kb.E) {
-        rollMatrix *= Matrix::CreateRotationZ(-0.2f);
+    if (m_keys.IsKeyPressed(Keyboard::F11))
+    {
+        m_requestedInputMode = (m_requestedInputMode == ReplayingInput) ? LiveInput : ReplayingInput;
     }
 
-    Quaternion q = Quaternion::CreateFromYawPitchRoll(m_yaw, -m_pitch, 0.f);
-
-    move = Vector3::Transform(move, q);
+    SubmitInput(ReadInput(m_mouse->GetState(), kb));
 
-    move *= MOVEMENT_GAIN;
-
-    m_cameraPos += move;
-    //TODOF CAM BOUNDS
-    Vector3 halfBound = (Vector3(ROOM_BOUNDS.v) / Vector3(2.f))
-        - Vector3(0.1f, 0.1f, 0.1f);
-
-    m_cameraPos = Vector3::Min(m_cameraPos, halfBound);
-    m_cameraPos = Vector3::Max(m_cameraPos, -halfBound);
+    // Keep the last two snapshots for Render to blend between; keep them as they are
+    // if the simulation has not produced another yet.
+    if (m_snapshots.Acquire())
+    {
+        std::swap(m_previousSnapshot, m_currentSnapshot);
+        m_currentSnapshot = m_snapshots.GetReadBuffer();
+    }
+    const RenderSnapshot& snapshot = m_currentSnapshot;
+    if (snapshot.update == 0)
+    {
+        return;
+    }
 
-    
-    //Reset Lights Position
-    //XMVECTOR lightVector = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+    m_mouse->SetMode(snapshot.wantsRelativeMouse ? Mouse::MODE_RELATIVE : Mouse::MODE_ABSOLUTE);
 
-    //lightVector = XMVector3TransformCoord(lightVector, cube1World);
+    if (snapshot.exitRequested)
+    {
+        ExitGame();
+    }
 
-    //light.pos.x = XMVectorGetX(lightVector);
-    //light.pos.y = XMVectorGetY(lightVector);
-    //light.pos.z = XMVectorGetZ(lightVector);
-    
     AudioListener listener;
-    listener.SetPosition(m_cameraPos);
+    listener.SetPosition(snapshot.listenerPosition);
 
     AudioEmitter emitter;
-    emitter.SetPosition(Vector3(0,0,0));
+    emitter.SetPosition(snapshot.emitterPosition);
     m_nightLoop->Apply3D(listener, emitter,false);
     if (m_nightLoop->GetState() != SoundState::PLAYING) {
         m_nightLoop->Play(true);
@@ -398,7 +560,192 @@ void Game::Update(DX::StepTimer const& timer)
             m_retryAudio = true;
         }
     }
-    elapsedTime;
+}
+
+// Runs the simulation at a fixed rate (60 Hz unless F8 halves it), independent of how
+// long Render and Present take.
+void Game::SimulationLoop()
+{
+    DX::StepTimer timer;
+    timer.SetFixedTimeStep(true);
+
+    // Sleep and sleep_for round up to the scheduler quantum, 15.6 ms by default, which
+    // is most of a step; a high resolution waitable timer wakes within a fraction of a
+    // millisecond. Windows before 10 version 1803 only has the ordinary kind.
+    HANDLE waitTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!waitTimer)
+    {
+        waitTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    }
+
+    uint32_t rate = 0;
+    while (m_simulationRunning.load(std::memory_order_acquire))
+    {
+        if (rate != m_simulationRate)
+        {
+            rate = m_simulationRate;
+            timer.SetTargetElapsedSeconds(1.0 / rate);
+        }
+
+        if (m_resetSimulationTimer.exchange(false))
+        {
+            timer.ResetElapsedTime();
+        }
+
+        const InputMode requestedMode = static_cast<InputMode>(m_requestedInputMode.load());
+        if (requestedMode != m_inputMode)
+        {
+            SetInputMode(requestedMode);
+        }
+
+        uint32_t updates = timer.GetFrameCount();
+        timer.Tick([&]()
+        {
+            // Live input is always taken so none of it is left over after a replay.
+            SimulationInput input = TakeInput();
+            uint64_t elapsedTicks = timer.GetElapsedTicks();
+
+            if (m_inputMode == ReplayingInput && !m_playback.Next(elapsedTicks, input))
+            {
+                SetInputMode(LiveInput);
+            }
+            else if (m_inputMode == RecordingInput)
+            {
+                m_recording.Append(elapsedTicks, input);
+            }
+
+            m_simulation.Update(float(DX::StepTimer::TicksToSeconds(elapsedTicks)), input);
+        });
+
+        if (timer.GetFrameCount() != updates)
+        {
+            RenderSnapshot& snapshot = m_snapshots.GetWriteBuffer();
+            m_simulation.WriteSnapshot(snapshot);
+            snapshot.tickCounter = timer.GetLastTickCounter();
+            snapshot.leftOverTicks = timer.GetLeftOverTicks();
+            snapshot.stepTicks = timer.GetTargetElapsedTicks();
+            m_snapshots.Publish();
+        }
+
+        // Sleep until the next update is due. StepTimer ticks and waitable timer due
+        // times are both 100 ns units; a negative due time is relative.
+        const uint64_t sinceTick = timer.GetTicksSince(timer.GetLastTickCounter());
+        const uint64_t pending = timer.GetLeftOverTicks() + sinceTick;
+        if (pending < timer.GetTargetElapsedTicks())
+        {
+            LARGE_INTEGER dueTime;
+            dueTime.QuadPart = -static_cast<LONGLONG>(timer.GetTargetElapsedTicks() - pending);
+            if (waitTimer && SetWaitableTimer(waitTimer, &dueTime, 0, nullptr, nullptr, FALSE))
+            {
+                WaitForSingleObject(waitTimer, INFINITE);
+            }
+            else
+            {
+                Sleep(1);
+            }
+        }
+    }
+
+    if (waitTimer)
+    {
+        CloseHandle(waitTimer);
+    }
+
+    // Keep a recording that was still running when the game exited.
+    SetInputMode(LiveInput);
+}
+
+// Called on the simulation thread. Recording and replay both start from a reset
+// simulation, so replaying a recording repeats its updates exactly.
+void Game::SetInputMode(InputMode mode)
+{
+    if (m_inputMode == RecordingInput)
+    {
+        m_recording.Save(INPUT_RECORDING_PATH);
+    }
+
+    m_inputMode = LiveInput;
+    m_playback = InputPlayback();
+
+    if (mode == RecordingInput)
+    {
+        m_recording.Clear();
+        m_simulation.Reset();
+        m_inputMode = RecordingInput;
+    }
+    else if (mode == ReplayingInput && m_recording.Load(INPUT_RECORDING_PATH) && !m_recording.IsEmpty())
+    {
+        m_playback = InputPlayback(m_recording);
+        m_simulation.Reset();
+        m_inputMode = ReplayingInput;
+    }
+
+    // A replay that could not start, or has finished, shows up as live input again.
+    m_requestedInputMode = m_inputMode;
+}
+
+void Game::StartSimulation()
+{
+    if (m_simulationRunning)
+        return;
+
+    // Workers for the simulation's parallel updates, also available to loaders.
+    if (!m_jobs)
+    {
+        m_jobs = std::make_unique<DX::JobSystem>();
+    }
+    m_simulation.SetJobSystem(m_jobs.get());
+
+    m_simulationRunning = true;
+    m_simulationThread = std::thread([this]() { SimulationLoop(); });
+}
+
+void Game::StopSimulation()
+{
+    m_simulationRunning = false;
+    if (m_simulationThread.joinable())
+    {
+        m_simulationThread.join();
+    }
+}
+
+// Mouse movement accumulates until the simulation consumes it, and Home/Escape
+// stay set until an update has seen them, so nothing is lost between updates.
+void Game::SubmitInput(const SimulationInput& input)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+
+    if (input.mouseRelative && m_pendingInput.mouseRelative)
+    {
+        m_pendingInput.mouseX += input.mouseX;
+        m_pendingInput.mouseY += input.mouseY;
+    }
+    else
+    {
+        m_pendingInput.mouseX = input.mouseX;
+        m_pendingInput.mouseY = input.mouseY;
+    }
+
+    m_pendingInput.keys = input.keys;
+    m_pendingInput.mouseRelative = input.mouseRelative;
+    m_pendingInput.leftButton = input.leftButton;
+    m_latchedKeys |= input.keys & (SimulationInput::Home | SimulationInput::Exit);
+}
+
+SimulationInput Game::TakeInput()
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+
+    SimulationInput input = m_pendingInput;
+    input.keys |= m_latchedKeys;
+    m_latchedKeys = 0;
+
+    if (m_pendingInput.mouseRelative)
+    {
+        m_pendingInput.mouseX = m_pendingInput.mouseY = 0;
+    }
+
+    return input;
 }
 #pragma endregion
 
@@ -406,129 +753,324 @@ void Game::Update(DX::StepTimer const& timer)
 // Draws the scene.
 void Game::Render()
 {
+    // Publish whatever has finished loading since the last frame.
+    m_assets->Update();
 
-    // Don't try to render anything before the first Update.
-    if (m_timer.GetFrameCount() == 0)
+    // Don't try to render anything before the first simulation update.
+    if (m_currentSnapshot.update == 0)
     {
         return;
     }
 
+    PROFILE_SCOPE("Render");
+
+    // How far the simulation clock has got towards its next update, measured from the
+    // tick that produced the current snapshot. The two snapshots can be several updates
+    // apart, when a tick ran more than one or a publish was missed, so the blend is
+    // spread over all of them; either way the drawn state trails the clock by one step.
+    float alpha = 1.f;
+    if (m_currentSnapshot.stepTicks > 0 && m_currentSnapshot.update > m_previousSnapshot.update)
+    {
+        const double steps = double(m_currentSnapshot.update - m_previousSnapshot.update);
+        uint64_t ticks = m_currentSnapshot.leftOverTicks + m_timer.GetTicksSince(m_currentSnapshot.tickCounter);
+        alpha = std::min(float((double(ticks) / double(m_currentSnapshot.stepTicks) + steps - 1.0) / steps), 1.f);
+    }
+    m_renderSnapshot.Interpolate(m_previousSnapshot, m_currentSnapshot, alpha);
+    const RenderSnapshot& snapshot = m_renderSnapshot;
+
+    m_renderTargets->BeginFrame();
+
     Clear();
 
-    m_deviceResources->PIXBeginEvent(L"Render");
     auto context = m_deviceResources->GetD3DDeviceContext();
 
     // TODO: Add your rendering code here.
-    m_world = Matrix::Identity;
-    m_world *= rollMatrix;
+    Vector3 cameraPos(snapshot.cameraPosition);
+    float pitch = snapshot.pitch;
+    float yaw = snapshot.yaw;
 
-    float y = sinf(m_pitch);
-    float r = cosf(m_pitch);
-    float z = r * cosf(m_yaw);
-    float x = r * sinf(m_yaw);
+    Matrix view(snapshot.view);
 
-    XMVECTOR lookAt = m_cameraPos + Vector3(x, y, z);
+    // Test everything against the camera frustum up front.
+    m_cullStats = {};
+    m_culler.SetViewProjection(view * m_proj);
 
-    XMMATRIX view = XMMatrixLookAtRH(m_cameraPos, lookAt, Vector3::Up);
+    uint8_t bodyVisible[Simulation::BodyCount];
+    m_culler.Cull(&snapshot.bodies[0].bounds, Simulation::BodyCount, sizeof(RenderObject), bodyVisible);
+    for (auto body : { Simulation::Sun, Simulation::Earth, Simulation::Asteroid })
+    {
+        m_cullStats.Add(1, bodyVisible[body]);
+    }
 
-    m_spriteBatch->Begin();
-    m_spriteBatch->Draw(m_background.Get(), m_fullscreenRect);
-    m_spriteBatch->End();
-    //m_room->Draw(m_world, view, m_proj, Colors::White, m_roomTex.Get()); 
-    m_world = Matrix::Identity;
+    const size_t asteroidCount = snapshot.asteroids.size();
+    m_asteroidVisible.resize(asteroidCount);
+    if (asteroidCount > 0)
+    {
+        m_cullStats.Add(asteroidCount, m_culler.Cull(&snapshot.asteroids[0].bounds, asteroidCount,
+            sizeof(RenderObject), m_asteroidVisible.data()));
+    }
+
+    // Everything is submitted to the render queue with a sort key, then drawn in key
+    // order: background, opaque scene grouped by shader and material front to back,
+    // translucent scene back to front, then the HUD.
+    m_renderQueue.Clear();
+
+    auto sceneDepth = [](FXMVECTOR position, CXMMATRIX view) -> float
+    {
+        float depth = -XMVectorGetZ(XMVector3Transform(position, view));
+        return (depth - SCENE_NEAR_PLANE) / (SCENE_FAR_PLANE - SCENE_NEAR_PLANE);
+    };
+
+    m_renderQueue.Submit(RenderQueue::MakeOpaqueKey(BackgroundPass, SpriteShader, 0, 0.f), MakeCommand(DrawBackground));
+    //m_room->Draw(Matrix(snapshot.roll), view, m_proj, Colors::White, m_roomTex.Get()); 
     //sun draw
-    m_world *= Matrix::CreateRotationY(rotation * toRadians);
-    m_effectSun->SetMatrices(m_world, view, m_proj);
-    m_effectSun->Apply(context);
-    m_shape->Draw(m_effectSun.get(), m_inputLayout.Get());
-    m_world = Matrix::Identity;
-    ////3D shape ball white orbiting draw
-    //earth draw
-    m_world *= Matrix::CreateTranslation(10.0f, .0f, .0f);
-    m_world *= Matrix::CreateRotationY(rotation * toRadians);
-    Vector3 test = Vector3::Transform(Vector3(1,1,1), m_world);
-    m_effect->SetLightDirection(0, test);
-    float lightDistance = 1 / sqrt(test.x * test.x + test.y * test.y + test.z * test.z);
-    m_effect->SetLightDiffuseColor(0, Vector3(lightDistance, lightDistance, lightDistance));
-    m_effect->SetMatrices(m_world, view, m_proj);
-    m_shape->Draw(m_effect.get(), m_inputLayout.Get());
-    //m_shape->Draw(m_world, view, m_proj, Colors::White, m_texture.Get());
-    
-    //Move and rotate the ball
-    m_world *= Matrix::CreateRotationY(-rotation * toRadians);
-    m_world *= Matrix::CreateTranslation(-10.0f, 2.0f, .0f);
-    m_world *= Matrix::CreateRotationX(rotation * toRadians);
-
-
-    m_world *= Matrix::CreateTranslation(10.0f, 0.0f, 0.0f);
-    m_world *= Matrix::CreateRotationY(rotation * toRadians);
-    //m_world *= Matrix::CreateRotationZ(rotation * toRadians);// *Matrix::CreateRotationY(rotation * toRadians);
-    m_effectAsteroid->SetMatrices(m_world, view, m_proj);
-    test = Vector3::Transform(Vector3(1, 1, 1), m_world);
-    m_effectAsteroid->SetLightDirection(0, test);
-    lightDistance = 1 / sqrt(test.x * test.x + test.y * test.y + test.z * test.z);
-    m_effectAsteroid->SetLightDiffuseColor(0, Vector3(lightDistance, lightDistance, lightDistance));
-
-    m_shape->Draw(m_effectAsteroid.get(), m_inputLayout.Get());
-    m_world = Matrix::Identity;
+    const RenderObject& sun = snapshot.bodies[Simulation::Sun];
+    if (bodyVisible[Simulation::Sun])
+    {
+        m_renderQueue.Submit(RenderQueue::MakeOpaqueKey(ScenePass, SunShader, 0,
+            sceneDepth(XMLoadFloat3(&sun.bounds.Center), view)), MakeCommand(DrawSun));
+    }
+    //earth, the asteroid orbiting it and the asteroid belt, instanced per material
+    m_sphereInstances.Reset(m_sphereRenderer->GetMaterialCount());
+    auto addSphere = [&](const RenderObject& object, uint32_t slice)
+    {
+        m_sphereInstances.Add(m_planetMaterial, XMLoadFloat4x4(&object.world),
+            XMVectorSet(object.lightIntensity, object.lightIntensity, object.lightIntensity, 1.f),
+            XMLoadFloat3(&object.lightDirection), slice);
+    };
+
+    if (bodyVisible[Simulation::Earth])
+    {
+        addSphere(snapshot.bodies[Simulation::Earth], EARTH_SLICE);
+    }
+    if (bodyVisible[Simulation::Asteroid])
+    {
+        addSphere(snapshot.bodies[Simulation::Asteroid], ASTEROID_SLICE);
+    }
+    for (size_t i = 0; i < asteroidCount; ++i)
+    {
+        if (m_asteroidVisible[i])
+        {
+            addSphere(snapshot.asteroids[i], ASTEROID_SLICE + uint32_t(i % BELT_SLICES));
+        }
+    }
+
+    m_sphereRenderer->Upload(context, m_sphereInstances, view, m_proj);
+    for (uint32_t material = 0; material < m_sphereInstances.GetMaterialCount(); ++material)
+    {
+        if (!m_sphereInstances.GetInstances(material).empty())
+        {
+            m_renderQueue.Submit(RenderQueue::MakeOpaqueKey(ScenePass, InstancedSphereShader, material, 0.f),
+                MakeCommand(DrawSpheres, material));
+        }
+    }
 
     //ship draw
     //Matrix m_lightRot = Matrix::CreateTranslation(0.0f, 1.0f, -1.0f) * Matrix::CreateFromYawPitchRoll(-m_yaw, -m_pitch, -45.f* toRadians);
     //m_lightRot = m_lightRot * Matrix::CreateTranslation(0.0f, -1.0f, 1.0f);
 
-    auto quat = Quaternion::CreateFromYawPitchRoll(-m_yaw, -m_pitch, 0);// -45.f * toRadians);
-    Vector3 lightDir = XMVector3Rotate(Vector3(-m_cameraPos.x, -m_cameraPos.y, -m_cameraPos.z), quat);
-    ship_model->UpdateEffects([&](IEffect* effect) {
-        auto lights = dynamic_cast<IEffectLights*> (effect);
-        if (lights) {
-            lights->SetLightEnabled(0, true);
+    // The ship has its own fixed view, so it gets its own frustum.
+    XMMATRIX m_shipview = Matrix::CreateLookAt(Vector3(0.f, 1.f, -5.f),
+        Vector3::Zero, Vector3::UnitY);
+
+    const RenderObject& ship = snapshot.bodies[Simulation::Ship];
+    const Matrix shipWorld(ship.world);
+    BoundingSphere shipBounds;
+    m_shipBounds.Transform(shipBounds, shipWorld);
+    m_culler.SetViewProjection(m_shipview * m_proj);
+    const bool shipVisible = ship_model && m_culler.IsVisible(shipBounds);
+    m_cullStats.Add(1, shipVisible ? 1 : 0);
 
-            lights->SetLightDirection(0, lightDir);
+    if (shipVisible)
+    {
+        ship_model->UpdateEffects([&](IEffect* effect) {
+            auto lights = dynamic_cast<IEffectLights*> (effect);
+            if (lights) {
+                lights->SetLightEnabled(0, true);
+
+                lights->SetLightDirection(0, Vector3(ship.lightDirection));
 
-            float lightDistance = 1 / sqrt(m_cameraPos.x * m_cameraPos.x + m_cameraPos.y * m_cameraPos.y + m_cameraPos.z * m_cameraPos.z);
-            lights->SetLightDiffuseColor(0, Vector3(lightDistance, lightDistance, lightDistance));
+                lights->SetLightDiffuseColor(0, Vector3(ship.lightIntensity, ship.lightIntensity, ship.lightIntensity));
             
-            lights->SetLightEnabled(1, true);
-            lights->SetAmbientLightColor(Colors::LightGoldenrodYellow);
+                lights->SetLightEnabled(1, true);
+                lights->SetAmbientLightColor(Colors::LightGoldenrodYellow);
             
-            lights->SetLightDirection(1, Vector3(0,-1,1));
+                lights->SetLightDirection(1, Vector3(0,-1,1));
 
-        }
-    });
-
-    m_world *= Matrix::CreateScale(0.05f);
-    m_world *= Matrix::CreateTranslation(0.0f, -1.0f, -1.0f);
-    XMMATRIX m_shipview = Matrix::CreateLookAt(Vector3(0.f, 1.f, -5.f),
-        Vector3::Zero, Vector3::UnitY);
+            }
+        });
 
-    ship_model->Draw(context, *m_states, m_world, m_shipview, m_proj);
-    m_world = Matrix::Identity;
+        // Parts are keyed by their mesh's depth in the ship view; the glass is translucent.
+        for (uint32_t i = 0; i < m_shipParts.size(); ++i)
+        {
+            const ShipPart& part = m_shipParts[i];
+            BoundingSphere meshBounds;
+            part.mesh->boundingSphere.Transform(meshBounds, shipWorld);
+            const float depth = sceneDepth(XMLoadFloat3(&meshBounds.Center), m_shipview);
+
+            m_renderQueue.Submit(part.translucent
+                ? RenderQueue::MakeTranslucentKey(ScenePass, ModelShader, part.material, depth)
+                : RenderQueue::MakeOpaqueKey(ScenePass, ModelShader, part.material, depth),
+                MakeCommand(DrawShipPart, i));
+        }
+    }
 
     //std::wstring output = L"x:" + std::to_wstring(lightDir.x) + L" y:" + std::to_wstring(lightDir.y) + L" z:" + std::to_wstring(lightDir.z)
     //    + L" pitch:" + std::to_wstring(m_pitch) + L" yaw:" + std::to_wstring(m_yaw);
-    std::wstring output = L"x:" + std::to_wstring(m_cameraPos.x) + L" y:" + std::to_wstring(m_cameraPos.y) + L" z:" + std::to_wstring(m_cameraPos.z)
-        + L" pitch:" + std::to_wstring(m_pitch) + L" yaw:" + std::to_wstring(m_yaw);
-    m_spriteBatch->Begin();
-    Vector2 origin = m_font->MeasureString(output.c_str()) / 2.f;
-    m_font->DrawString(m_spriteBatch.get(), output.c_str(),
-        m_fontPos, Colors::White, 0.f, origin);
-    m_spriteBatch->End();
+    std::wstring output = L"x:" + std::to_wstring(cameraPos.x) + L" y:" + std::to_wstring(cameraPos.y) + L" z:" + std::to_wstring(cameraPos.z)
+        + L" pitch:" + std::to_wstring(pitch) + L" yaw:" + std::to_wstring(yaw);
+
+    // Frame time percentiles in milliseconds.
+    auto frameTimes = m_timer.GetStatistics().GetSummary(DX::FrameStatistics::FrameTicks);
+    wchar_t frameStats[128] = {};
+    swprintf_s(frameStats, L"\nframe p50 %.2fms p95 %.2fms p99 %.2fms max %.2fms hitches %llu",
+        DX::StepTimer::TicksToSeconds(frameTimes.p50) * 1000.0,
+        DX::StepTimer::TicksToSeconds(frameTimes.p95) * 1000.0,
+        DX::StepTimer::TicksToSeconds(frameTimes.p99) * 1000.0,
+        DX::StepTimer::TicksToSeconds(frameTimes.max) * 1000.0,
+        m_timer.GetStatistics().GetHitchCount());
+    output += frameStats;
+
+    wchar_t cullStats[64] = {};
+    swprintf_s(cullStats, L"\nvisible %u culled %u", m_cullStats.visible, m_cullStats.culled);
+    output += cullStats;
+
+    wchar_t simulationStats[64] = {};
+    static const wchar_t* const c_inputModes[] = { L"", L" recording", L" replaying" };
+    swprintf_s(simulationStats, L"\nsimulation %u Hz blend %.2f%s", m_simulationRate.load(), alpha,
+        c_inputModes[m_requestedInputMode.load()]);
+    output += simulationStats;
+
+    wchar_t bloomStats[96] = {};
+    static const wchar_t* const c_bloomPresets[] = { L"default", L"soft", L"desaturated", L"saturated",
+        L"blurry", L"subtle", L"none" };
+    const BloomChain& bloomChain = m_bloomChains[g_BloomQuality][g_Bloom];
+    const FrameGraph::Statistics& graphStats = m_postProcessGraph.GetStatistics();
+    swprintf_s(bloomStats, L"\nbloom %s %u taps %u levels, %u of %u passes, %u targets",
+        c_bloomPresets[g_Bloom], bloomChain.kernel->sampleCount, bloomChain.levels,
+        graphStats.passes - graphStats.culledPasses, graphStats.passes, graphStats.physicalTextures);
+    output += bloomStats;
+
+    wchar_t targetStats[96] = {};
+    const TransientTexturePool::Statistics& pool = m_renderTargets->GetStatistics();
+    swprintf_s(targetStats, L"\nrender targets %u resident %.1f MB hit rate %.1f%%", pool.texturesResident,
+        double(pool.bytesResident) / (1024.0 * 1024.0), m_renderTargets->GetHitRate() * 100.0);
+    output += targetStats;
+
+    wchar_t assetStats[96] = {};
+    if (m_assets->IsIdle())
+    {
+        swprintf_s(assetStats, L"\nassets %u ready at %.0f ms, first frame at %.0f ms", m_assets->GetAssetCount(),
+            double(m_assets->GetLastReadyTime()) * 1e-6, double(m_assets->GetFirstFrameTime()) * 1e-6);
+    }
+    else
+    {
+        swprintf_s(assetStats, L"\nassets %u of %u loaded", m_assets->GetReadyCount(), m_assets->GetAssetCount());
+    }
+    output += assetStats;
+
+    m_renderQueue.Submit(RenderQueue::MakeOpaqueKey(OverlayPass, SpriteShader, 0, 0.f), MakeCommand(DrawHud));
+    m_renderQueue.Submit(RenderQueue::MakeOpaqueKey(OverlayPass, ReticleShader, 0, 0.f), MakeCommand(DrawReticle));
+
+    {
+        PROFILE_SCOPE("RenderQueue::Sort");
+        m_renderQueue.Sort();
+    }
+
+    // Consecutive ship parts only set up their mesh state when the mesh or blend mode changes.
+    const ModelMesh* preparedMesh = nullptr;
+    bool preparedTranslucent = false;
+    for (const RenderQueue::Item& item : m_renderQueue)
+    {
+        const uint32_t index = item.command & COMMAND_INDEX_MASK;
+        const uint32_t command = item.command >> COMMAND_TYPE_SHIFT;
+        if (command != DrawShipPart)
+        {
+            preparedMesh = nullptr;
+        }
+
+        switch (command)
+        {
+        case DrawBackground:
+            // The clear to black stands in for the sky until it has loaded.
+            if (m_background)
+            {
+                m_spriteBatch->Begin();
+                m_spriteBatch->Draw(m_background.Get(), m_fullscreenRect);
+                m_spriteBatch->End();
+            }
+            break;
+
+        case DrawSun:
+            m_effectSun->SetTexture(m_textureSun ? m_textureSun.Get() : m_placeholderTexture.Get());
+            m_effectSun->SetMatrices(Matrix(sun.world), view, m_proj);
+            m_effectSun->Apply(context);
+            m_shape->Draw(m_effectSun.get(), m_inputLayout.Get());
+            break;
+
+        case DrawSpheres:
+            m_sphereRenderer->DrawMaterial(context, *m_states, index);
+            break;
+
+        case DrawShipPart:
+        {
+            const ShipPart& part = m_shipParts[index];
+            if (part.mesh != preparedMesh || part.translucent != preparedTranslucent)
+            {
+                part.mesh->PrepareForRendering(context, *m_states, part.translucent);
+                preparedMesh = part.mesh;
+                preparedTranslucent = part.translucent;
+            }
 
+            auto matrices = dynamic_cast<IEffectMatrices*>(part.part->effect.get());
+            if (matrices)
+            {
+                matrices->SetMatrices(shipWorld, m_shipview, m_proj);
+            }
+            part.part->Draw(context, part.part->effect.get(), part.part->inputLayout.Get());
+            break;
+        }
 
-    RenderAimReticle(context);
+        case DrawHud:
+        {
+            if (!m_font)
+                break;
+
+            m_spriteBatch->Begin();
+            Vector2 origin = m_font->MeasureString(output.c_str()) / 2.f;
+            m_font->DrawString(m_spriteBatch.get(), output.c_str(),
+                m_fontPos, Colors::White, 0.f, origin);
+            m_spriteBatch->End();
+            break;
+        }
+
+        case DrawReticle:
+            RenderAimReticle(context);
+            break;
+        }
+    }
 
     context;
 
-    m_deviceResources->PIXEndEvent();
     PostProcess();
     // Show the new frame.
-    m_deviceResources->Present();
+    {
+        PROFILE_SCOPE("Present");
+        m_deviceResources->Present();
+    }
+
+    m_assets->MarkFirstFrame();
+    if (!m_assetReportShown && m_assets->IsIdle())
+    {
+        OutputDebugStringA(m_assets->FormatReport().c_str());
+        m_assetReportShown = true;
+    }
 }
 
 // Helper method to clear the back buffers.
 void Game::Clear()
 {
-    m_deviceResources->PIXBeginEvent(L"Clear");
+    PROFILE_SCOPE("Clear");
 
     // Clear the views.
     auto context = m_deviceResources->GetD3DDeviceContext();
@@ -547,8 +1089,6 @@ void Game::Clear()
     // Set the viewport.
     auto viewport = m_deviceResources->GetScreenViewport();
     context->RSSetViewports(1, &viewport);
-
-    m_deviceResources->PIXEndEvent();
 }
 #pragma endregion
 
@@ -573,6 +1113,7 @@ void Game::OnSuspending()
 void Game::OnResuming()
 {
     m_timer.ResetElapsedTime();
+    m_resetSimulationTimer = true;
 
     // TODO: Game is being power-resumed (or returning from minimize).
     m_audEngine->Resume();
@@ -603,7 +1144,7 @@ void Game::GetDefaultSize(int& width, int& height) const
 }
 float Game::GetRotation() const
 {
-    return rotation;
+    return m_renderSnapshot.rotation;
 }
 #pragma endregion
 
@@ -611,18 +1152,41 @@ float Game::GetRotation() const
 // These are the resources that depend on the device.
 void Game::CreateDeviceDependentResources()
 {
+    PROFILE_SCOPE("CreateDeviceDependentResources");
+
     auto device = m_deviceResources->GetD3DDevice();
     auto context = m_deviceResources->GetD3DDeviceContext();
     auto size = m_deviceResources->GetOutputSize();
     // TODO: Initialize device dependent objects here (independent of window size).
+    m_renderTargetBackend = std::make_unique<D3DTextureBackend>(device);
+    m_renderTargets = std::make_unique<TransientTexturePool>(*m_renderTargetBackend,
+        RENDER_TARGET_KEEP_FRAMES, RENDER_TARGET_BUDGET);
+
+    m_assets = std::make_unique<AssetLoader>(*m_jobs);
+    m_assetReportShown = false;
+
+    CreatePlaceholderTexture(device, 1, false, m_placeholderTexture.ReleaseAndGetAddressOf());
+    CreatePlaceholderTexture(device, _countof(PLANET_TEXTURES), true, m_placeholderTextureArray.ReleaseAndGetAddressOf());
+
+    // Missing until the textures have been cooked; everything then loads from source.
+    if (!m_cookedTextures.Load(COOKED_MANIFEST))
+    {
+        OutputDebugStringA("No cooked textures; loading the JPEG and PNG sources\n");
+    }
+
+    // Missing until the assets have been packed; everything then loads from loose files.
+    // It stays open across device resets.
+    if (!m_assetPack.IsOpen() && !m_assetPack.Open(ASSET_PACK))
+    {
+        OutputDebugStringA("No asset pack; loading loose files\n");
+    }
+
     //adding a model of motorbike
-    m_fxFactory = std::make_unique<EffectFactory>(device);
     m_states = std::make_unique<CommonStates>(device);
-    m_fxFactory = std::make_unique<EffectFactory>(device);
+    m_fxFactory = std::make_unique<CookedEffectFactory>(device, m_cookedTextures, m_assetPack);
     PBReffect = std::make_unique<PBREffect>(device);
     PBRfxFactory = std::make_unique<PBREffectFactory>(device);
     PBReffect->SetLightEnabled(0, true);
-    m_font = std::make_unique<SpriteFont>(device, L"Font/myfile.spritefont");
     m_spriteBatch = std::make_unique<SpriteBatch>(context);
     //PBRfxFactory->
     //iEffect = std::make_unique<IEffect>(device);
@@ -660,13 +1224,6 @@ void Game::CreateDeviceDependentResources()
     m_effectSun->SetLightDiffuseColor(2, Colors::Orange);
     m_effectSun->SetLightDirection(2, Vector3(-1, 0, 0.577f));
     
-    m_effectAsteroid = std::make_unique<BasicEffect>(device);
-    m_effectAsteroid->SetTextureEnabled(true);
-    m_effectAsteroid->SetPerPixelLighting(true);
-    m_effectAsteroid->SetLightingEnabled(true);
-    m_effectAsteroid->SetLightEnabled(0, true);
-    m_effectAsteroid->SetLightDiffuseColor(0, Colors::LightSalmon);
-    //m_effectAsteroid->SetLightDirection(0, Vector3::UnitX);
 
     
     //m_effect->SetTexture(m_sunTex.Get());
@@ -676,7 +1233,6 @@ void Game::CreateDeviceDependentResources()
     //m_model->UpdateEffects(&effectBuilt);
 
     //ship_model = Model::CreateFromSDKMESH(device, L"Spaceship/ND Spaceship.sdkmesh", *m_fxFactory);
-    ship_model = Model::CreateFromSDKMESH(device, L"Spaceship/ship.sdkmesh", *m_fxFactory);
     //ship_model = Model::CreateFromCMO(device, L"Spaceship/ship.cmo", *m_fxFactory,false);
 
     //DX::ThrowIfFailed(
@@ -686,10 +1242,6 @@ void Game::CreateDeviceDependentResources()
     //DX::ThrowIfFailed(
     //    CreateWICTextureFromFile(device, L"Sun/Sun_Mesh_BaseColor.png", nullptr,
     //        m_texture.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(
-        CreateWICTextureFromFile(device, L"Sun/Sun_Mesh_BaseColor.png", nullptr,
-            m_textureSun.ReleaseAndGetAddressOf()));
-    m_effectSun->SetTexture(m_textureSun.Get());
 
     //effect->SET(m_texture.Get());
     //m_model = Model::CreateFromSDKMESH(device, L"Sun/Sun.sdkmesh", *m_fxFactory);
@@ -715,60 +1267,143 @@ void Game::CreateDeviceDependentResources()
     m_shape->CreateInputLayout(m_effect.get(),
         m_inputLayout.ReleaseAndGetAddressOf());
 
-    DX::ThrowIfFailed(
-        CreateWICTextureFromFile(device, L"(1) Planet_Mesh_BaseColor.png", nullptr,
-            m_texture.ReleaseAndGetAddressOf()));
-    m_effect->SetTexture(m_texture.Get());
-
-    DX::ThrowIfFailed(
-        CreateWICTextureFromFile(device, L"(2) Planet_Mesh_BaseColor.png", nullptr,
-            m_textureAsteroid.ReleaseAndGetAddressOf()));
-    m_effectAsteroid->SetTexture(m_textureAsteroid.Get());
+    m_sphereRenderer = std::make_unique<InstancedSphereRenderer>(device);
+    m_planetMaterial = m_sphereRenderer->AddMaterial(m_placeholderTextureArray.Get());
     //room
     m_room = GeometricPrimitive::CreateBox(context,
-        XMFLOAT3(ROOM_BOUNDS[0], ROOM_BOUNDS[1], ROOM_BOUNDS[2]),
+        ROOM_BOUNDS,
         false, true);
 
-    DX::ThrowIfFailed(
-        CreateDDSTextureFromFile(device, L"roomtexture.dds",
-            nullptr, m_roomTex.ReleaseAndGetAddressOf()));
-
-    //shader setup
-    DX::ThrowIfFailed(CreateWICTextureFromFile(device,
-        L"sunset.jpg", nullptr,
-        m_background.ReleaseAndGetAddressOf()));
 
     //m_states = std::make_unique<CommonStates>(device);
     //m_shape = GeometricPrimitive::CreateTorus(context);
-    auto blob = DX::ReadData(L"BloomExtract.cso");
-    DX::ThrowIfFailed(device->CreatePixelShader(blob.data(), blob.size(),
-        nullptr, m_bloomExtractPS.ReleaseAndGetAddressOf()));
+    for (int preset = 0; preset < BloomPresetCount; ++preset)
+    {
+        CD3D11_BUFFER_DESC cbDesc(sizeof(VS_BLOOM_PARAMETERS),
+            D3D11_BIND_CONSTANT_BUFFER, D3D11_USAGE_IMMUTABLE);
+        D3D11_SUBRESOURCE_DATA initData = {};
+        initData.pSysMem = &g_BloomPresets[preset];
+        DX::ThrowIfFailed(device->CreateBuffer(&cbDesc, &initData,
+            m_bloomParams[preset].ReleaseAndGetAddressOf()));
+    }
+
+    // The kernels were generated at compile time and are in texels, so these never need
+    // rebuilding when the window is resized.
+    for (int quality = 0; quality < BloomQualityCount; ++quality)
+    {
+        for (int preset = 0; preset < BloomPresetCount; ++preset)
+        {
+            const BlurKernel& kernel = GetBlurKernel(BloomQuality(quality), BloomPresets(preset));
 
-    blob = DX::ReadData(L"BloomCombine.cso");
-    DX::ThrowIfFailed(device->CreatePixelShader(blob.data(), blob.size(),
-        nullptr, m_bloomCombinePS.ReleaseAndGetAddressOf()));
+            CD3D11_BUFFER_DESC cbDesc(sizeof(VS_BLUR_PARAMETERS),
+                D3D11_BIND_CONSTANT_BUFFER, D3D11_USAGE_IMMUTABLE);
+            D3D11_SUBRESOURCE_DATA initData = {};
+            VS_BLUR_PARAMETERS blurData;
+            initData.pSysMem = &blurData;
 
-    blob = DX::ReadData(L"GaussianBlur.cso");
-    DX::ThrowIfFailed(device->CreatePixelShader(blob.data(), blob.size(),
-        nullptr, m_gaussianBlurPS.ReleaseAndGetAddressOf()));
+            blurData.SetKernel(kernel, 1, 0);
+            DX::ThrowIfFailed(device->CreateBuffer(&cbDesc, &initData,
+                m_blurParamsWidth[quality][preset].ReleaseAndGetAddressOf()));
+
+            blurData.SetKernel(kernel, 0, 1);
+            DX::ThrowIfFailed(device->CreateBuffer(&cbDesc, &initData,
+                m_blurParamsHeight[quality][preset].ReleaseAndGetAddressOf()));
+        }
+    }
 
     {
-        CD3D11_BUFFER_DESC cbDesc(sizeof(VS_BLOOM_PARAMETERS),
-            D3D11_BIND_CONSTANT_BUFFER);
-        D3D11_SUBRESOURCE_DATA initData;
-        initData.pSysMem = &g_BloomPresets[g_Bloom];
-        initData.SysMemPitch = sizeof(VS_BLOOM_PARAMETERS);
-        DX::ThrowIfFailed(device->CreateBuffer(&cbDesc, &initData,
-            m_bloomParams.ReleaseAndGetAddressOf()));
+        CD3D11_BLEND_DESC blendDesc(D3D11_DEFAULT);
+        blendDesc.RenderTarget[0].BlendEnable = TRUE;
+        blendDesc.RenderTarget[0].SrcBlend = blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_INV_BLEND_FACTOR;
+        blendDesc.RenderTarget[0].DestBlend = blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_BLEND_FACTOR;
+        DX::ThrowIfFailed(device->CreateBlendState(&blendDesc,
+            m_bloomUpsampleBlend.ReleaseAndGetAddressOf()));
     }
 
+    // Files are read, decoded and turned into device resources on the workers; the
+    // finish functions run at the start of a frame and publish them. Until theirs are
+    // ready, Render draws the sun and planets with placeholders and leaves out the
+    // background, ship, HUD and bloom. Everything the loads use exists by now. Cooked
+    // textures load from their DDS files, mips included; the planet array still comes
+    // from WIC because CreateTextureArray generates its mips on the GPU. Shaders and the
+    // ship are used straight from mapped files. Each asset comes from the pack when it
+    // holds it, with no further file system calls.
+    auto loadTexture = [this, device](const char* name, ComPtr<ID3D11ShaderResourceView>* texture)
+    {
+        m_assets->Load(name, [this, device, name, texture]() -> AssetLoader::FinishFunction
+        {
+            const std::string path = GetTexturePath(m_cookedTextures, name);
+            ComPtr<ID3D11ShaderResourceView> loaded;
+            CreateTextureFromAsset(device, nullptr, path, ReadAsset(m_assetPack, path.c_str()), loaded.GetAddressOf());
+            return [texture, loaded]() { *texture = loaded; };
+        });
+    };
+
+    auto loadPixelShader = [this, device](const char* name, ComPtr<ID3D11PixelShader>* shader)
+    {
+        m_assets->Load(name, [this, device, name, shader]() -> AssetLoader::FinishFunction
+        {
+            const AssetBytes blob = ReadAsset(m_assetPack, name);
+            ComPtr<ID3D11PixelShader> loaded;
+            DX::ThrowIfFailed(device->CreatePixelShader(blob.bytes.data, blob.bytes.size, nullptr, loaded.GetAddressOf()));
+            return [shader, loaded]() { *shader = loaded; };
+        });
+    };
+
+    // The slowest, with its textures, so it goes first.
+    m_assets->Load("Spaceship/ship.sdkmesh", [this, device]() -> AssetLoader::FinishFunction
+    {
+        // std::function needs a copyable capture. The buffers are created from the
+        // mapped file or pack, and the file is unmapped once they exist.
+        const AssetBytes blob = ReadAsset(m_assetPack, "Spaceship/ship.sdkmesh");
+        SdkMesh mesh;
+        mesh.Parse(blob.bytes.data, blob.bytes.size);
+        auto model = std::make_shared<std::unique_ptr<Model>>(
+            CreateModelFromSdkMesh(device, mesh, *m_fxFactory, L"Spaceship/ship.sdkmesh"));
+        return [this, model]()
+        {
+            ship_model = std::move(*model);
+            CreateShipParts();
+        };
+    });
+
+    m_assets->Load("planet textures", [this, device]() -> AssetLoader::FinishFunction
+    {
+        // As InstancedSphereRenderer::LoadTextureSlices loads them, but through the pack.
+        std::vector<ComPtr<ID3D11Texture2D>> slices(_countof(PLANET_TEXTURES));
+        for (size_t i = 0; i < slices.size(); ++i)
+        {
+            const AssetBytes blob = ReadAsset(m_assetPack, ToAssetName(PLANET_TEXTURES[i]).c_str());
+            ComPtr<ID3D11Resource> resource;
+            DX::ThrowIfFailed(CreateWICTextureFromMemory(device, blob.bytes.data, blob.bytes.size,
+                resource.GetAddressOf(), nullptr));
+            DX::ThrowIfFailed(resource.As(&slices[i]));
+        }
+        return [this, slices]()
+        {
+            InstancedSphereRenderer::CreateTextureArray(m_deviceResources->GetD3DDevice(),
+                m_deviceResources->GetD3DDeviceContext(), slices, m_planetTextures.ReleaseAndGetAddressOf());
+            m_sphereRenderer->SetMaterialTexture(m_planetMaterial, m_planetTextures.Get());
+        };
+    });
+
+    loadTexture("Sun/Sun_Mesh_BaseColor.png", &m_textureSun);
+    loadTexture("sunset.jpg", &m_background);
+    loadTexture("roomtexture.dds", &m_roomTex);
+
+    m_assets->Load("Font/myfile.spritefont", [this, device]() -> AssetLoader::FinishFunction
     {
-        CD3D11_BUFFER_DESC cbDesc(sizeof(VS_BLUR_PARAMETERS),
-            D3D11_BIND_CONSTANT_BUFFER);
-        DX::ThrowIfFailed(device->CreateBuffer(&cbDesc, nullptr,
-            m_blurParamsWidth.ReleaseAndGetAddressOf()));
-        DX::ThrowIfFailed(device->CreateBuffer(&cbDesc, nullptr,
-            m_blurParamsHeight.ReleaseAndGetAddressOf()));
+        const AssetBytes blob = ReadAsset(m_assetPack, "Font/myfile.spritefont");
+        auto font = std::make_shared<std::unique_ptr<SpriteFont>>(
+            std::make_unique<SpriteFont>(device, blob.bytes.data, blob.bytes.size));
+        return [this, font]() { m_font = std::move(*font); };
+    });
+
+    loadPixelShader("BloomExtract.cso", &m_bloomExtractPS);
+    loadPixelShader("BloomCombine.cso", &m_bloomCombinePS);
+    for (int quality = 0; quality < BloomQualityCount; ++quality)
+    {
+        loadPixelShader(BLUR_SHADERS[quality], &m_blurPS[quality]);
     }
 
     //AimReticleCreateBatch();
@@ -777,15 +1412,45 @@ void Game::CreateDeviceDependentResources()
     device;
 }
 
+// Culling bounds and render queue parts for the ship once its model has loaded.
+void Game::CreateShipParts()
+{
+    // Model space bounds of the whole ship, for culling.
+    m_shipBounds = ship_model->meshes.front()->boundingSphere;
+    for (auto& mesh : ship_model->meshes)
+    {
+        BoundingSphere::CreateMerged(m_shipBounds, m_shipBounds, mesh->boundingSphere);
+    }
+
+    // Every mesh part is queued on its own. Parts sharing an effect share a material id.
+    m_shipParts.clear();
+    std::vector<IEffect*> shipEffects;
+    for (auto& mesh : ship_model->meshes)
+    {
+        for (auto& meshPart : mesh->meshParts)
+        {
+            auto effect = std::find(shipEffects.begin(), shipEffects.end(), meshPart->effect.get());
+            if (effect == shipEffects.end())
+            {
+                effect = shipEffects.insert(shipEffects.end(), meshPart->effect.get());
+            }
+
+            ShipPart part;
+            part.mesh = mesh.get();
+            part.part = meshPart.get();
+            part.material = static_cast<uint32_t>(effect - shipEffects.begin());
+            part.translucent = meshPart->isAlpha;
+            m_shipParts.push_back(part);
+        }
+    }
+}
+
 // Allocate all memory resources that change on a window SizeChanged event.
 void Game::CreateWindowSizeDependentResources()
 {
     auto backBufferFormat = m_deviceResources->GetBackBufferFormat();
     // TODO: Initialize windows-size dependent objects here.
-    auto device = m_deviceResources->GetD3DDevice();
-    auto context = m_deviceResources->GetD3DDeviceContext();
     auto size = m_deviceResources->GetOutputSize();
-    rollMatrix = Matrix::Identity;
 
     //adding motorbike model
     m_view = Matrix::CreateLookAt(Vector3(2.f, 2.f, 2.f),
@@ -795,7 +1460,7 @@ void Game::CreateWindowSizeDependentResources()
     m_fontPos.y = size.bottom * (3 / 4.f);
 
     m_proj = Matrix::CreatePerspectiveFieldOfView(XMConvertToRadians(70.f),
-        float(size.right) / float(size.bottom), 0.01f, 100.f);
+        float(size.right) / float(size.bottom), SCENE_NEAR_PLANE, SCENE_FAR_PLANE);
     widthWin = size.right / 2;
     heightWin = size.bottom / 2;
     AimReticleCreateBatch();
@@ -811,63 +1476,49 @@ void Game::CreateWindowSizeDependentResources()
     m_projection = Matrix::CreatePerspectiveFieldOfView(XM_PIDIV4,
         float(size.right) / float(size.bottom), 0.01f, 100.f);
 
-    VS_BLUR_PARAMETERS blurData;
-    blurData.SetBlurEffectParameters(1.f / (size.right / 2), 0,
-        g_BloomPresets[g_Bloom]);
-    context->UpdateSubresource(m_blurParamsWidth.Get(), 0, nullptr,
-        &blurData, sizeof(VS_BLUR_PARAMETERS), 0);
-
-    blurData.SetBlurEffectParameters(0, 1.f / (size.bottom / 2),
-        g_BloomPresets[g_Bloom]);
-    context->UpdateSubresource(m_blurParamsHeight.Get(), 0, nullptr,
-        &blurData, sizeof(VS_BLUR_PARAMETERS), 0);
-
-    // Full-size render target for scene
-    CD3D11_TEXTURE2D_DESC sceneDesc(backBufferFormat, size.right, size.bottom,
-        1, 1, D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE);
-    DX::ThrowIfFailed(device->CreateTexture2D(&sceneDesc, nullptr,
-        m_sceneTex.GetAddressOf()));
-    DX::ThrowIfFailed(device->CreateRenderTargetView(m_sceneTex.Get(), nullptr,
-        m_sceneRT.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(device->CreateShaderResourceView(m_sceneTex.Get(), nullptr,
-        m_sceneSRV.ReleaseAndGetAddressOf()));
-
-    // Half-size blurring render targets
-    CD3D11_TEXTURE2D_DESC rtDesc(backBufferFormat, size.right / 2, size.bottom/ 2,
-        1, 1, D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE);
-    Microsoft::WRL::ComPtr<ID3D11Texture2D> rtTexture1;
-    DX::ThrowIfFailed(device->CreateTexture2D(&rtDesc, nullptr,
-        rtTexture1.GetAddressOf()));
-    DX::ThrowIfFailed(device->CreateRenderTargetView(rtTexture1.Get(), nullptr,
-        m_rt1RT.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(device->CreateShaderResourceView(rtTexture1.Get(), nullptr,
-        m_rt1SRV.ReleaseAndGetAddressOf()));
-
-    Microsoft::WRL::ComPtr<ID3D11Texture2D> rtTexture2;
-    DX::ThrowIfFailed(device->CreateTexture2D(&rtDesc, nullptr,
-        rtTexture2.GetAddressOf()));
-    DX::ThrowIfFailed(device->CreateRenderTargetView(rtTexture2.Get(), nullptr,
-        m_rt2RT.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(device->CreateShaderResourceView(rtTexture2.Get(), nullptr,
-        m_rt2SRV.ReleaseAndGetAddressOf()));
-
-    m_bloomRect.left = 0;
-    m_bloomRect.top = 0;
-    m_bloomRect.right = size.right / 2;
-    m_bloomRect.bottom = size.bottom / 2;
+    // Full-size render target for scene. The previous size's stays in the pool for a
+    // while in case the window goes back to it.
+    if (m_sceneTarget != TransientTexturePool::InvalidHandle)
+    {
+        m_renderTargets->Release(m_sceneTarget);
+    }
+    m_sceneTarget = m_renderTargets->Acquire({ UINT(backBufferFormat), UINT(size.right), UINT(size.bottom),
+        D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE });
+    const PooledRenderTarget& scene = D3DTextureBackend::Get(*m_renderTargets, m_sceneTarget);
+    m_sceneTex = scene.texture;
+    m_sceneRT = scene.rtv;
+    m_sceneSRV = scene.srv;
+
+    // Bloom pyramid for every preset and tier; the post-process graph is rebuilt for
+    // the new size on the next frame.
+    for (int quality = 0; quality < BloomQualityCount; ++quality)
+    {
+        for (int preset = 0; preset < BloomPresetCount; ++preset)
+        {
+            m_bloomChains[quality][preset] = GetBloomChain(BloomPresets(preset), BloomQuality(quality),
+                UINT(size.right), UINT(size.bottom));
+        }
+    }
+
+    m_postProcessGraphKey = ~0u;
 }
 
 void Game::OnDeviceLost()
 {
     // TODO: Add Direct3D resource cleanup here.
+    m_assets.reset();
+    m_placeholderTexture.Reset();
+    m_placeholderTextureArray.Reset();
     
     m_shape.reset(); //3D shapes
-    m_texture.Reset();
+    m_sphereRenderer.reset();
+    m_planetTextures.Reset();
     m_textureSun.Reset();
 
     m_states.reset();
     m_fxFactory.reset();
     ship_model.reset();
+    m_shipParts.clear();
 
     m_room.reset();
     m_roomTex.Reset();
@@ -882,19 +1533,34 @@ void Game::OnDeviceLost()
     m_background.Reset();
     m_bloomExtractPS.Reset();
     m_bloomCombinePS.Reset();
-    m_gaussianBlurPS.Reset();
+    for (auto& blurPS : m_blurPS)
+    {
+        blurPS.Reset();
+    }
 
-    m_bloomParams.Reset();
-    m_blurParamsWidth.Reset();
-    m_blurParamsHeight.Reset();
+    for (auto& params : m_bloomParams)
+    {
+        params.Reset();
+    }
+    for (int quality = 0; quality < BloomQualityCount; ++quality)
+    {
+        for (int preset = 0; preset < BloomPresetCount; ++preset)
+        {
+            m_blurParamsWidth[quality][preset].Reset();
+            m_blurParamsHeight[quality][preset].Reset();
+        }
+    }
+    m_bloomUpsampleBlend.Reset();
 
     m_sceneTex.Reset();
     m_sceneSRV.Reset();
     m_sceneRT.Reset();
-    m_rt1SRV.Reset();
-    m_rt1RT.Reset();
-    m_rt2SRV.Reset();
-    m_rt2RT.Reset();
+    m_sceneTarget = TransientTexturePool::InvalidHandle;
+    m_postProcessGraph.Reset();
+    m_postProcessGraphKey = ~0u;
+    m_backBufferTarget = {};
+    m_renderTargets.reset();
+    m_renderTargetBackend.reset();
     m_backBuffer.Reset();
 
     m_font.reset();
@@ -977,70 +1643,193 @@ void Game::AimReticleCreateBatch() {
     mReticle_effect->SetProjection(proj);
     // End initializing state and effects for Triangle Render
 }
-void Game::PostProcess()
+// Declares the post-process passes for the current bloom preset and quality; PostProcess
+// rebuilds the graph when either changes or the window is resized. Every bloom pass is
+// declared, and with the None preset the graph culls them all, leaving the copy.
+void Game::BuildPostProcessGraph(BloomPresets preset, BloomQuality quality)
 {
-    auto device = m_deviceResources->GetD3DDevice();
     auto context = m_deviceResources->GetD3DDeviceContext();
-    auto renderTarget = m_deviceResources->GetRenderTargetView();
-    ID3D11ShaderResourceView* null[] = { nullptr, nullptr };
-
-    if (g_Bloom == None)
+    auto size = m_deviceResources->GetOutputSize();
+    auto opaque = m_states->Opaque();
+
+    // Switching preset or quality only changes which of these get bound.
+    const BloomChain& chain = m_bloomChains[quality][preset];
+    ID3D11Buffer* bloomParams = m_bloomParams[preset].Get();
+    ID3D11Buffer* blurParamsWidth = m_blurParamsWidth[quality][preset].Get();
+    ID3D11Buffer* blurParamsHeight = m_blurParamsHeight[quality][preset].Get();
+    ID3D11PixelShader* blurPS = m_blurPS[quality].Get();
+    ID3D11PixelShader* extractPS = m_bloomExtractPS.Get();
+    ID3D11PixelShader* combinePS = m_bloomCombinePS.Get();
+    ID3D11BlendState* upsampleBlend = m_bloomUpsampleBlend.Get();
+    SpriteBatch* spriteBatch = m_spriteBatch.get();
+    const RECT fullscreenRect = m_fullscreenRect;
+
+    const UINT format = UINT(m_deviceResources->GetBackBufferFormat());
+    const UINT bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+    m_backBufferTarget.texture = m_backBuffer;
+    m_backBufferTarget.rtv = m_deviceResources->GetRenderTargetView();
+
+    FrameGraph& graph = m_postProcessGraph;
+    graph.Reset();
+
+    const FrameGraph::Resource scene = graph.ImportTexture("scene",
+        { format, UINT(size.right), UINT(size.bottom), bindFlags },
+        &D3DTextureBackend::Get(*m_renderTargets, m_sceneTarget));
+    const FrameGraph::Resource backBuffer = graph.ImportTexture("back buffer",
+        { format, UINT(size.right), UINT(size.bottom), D3D11_BIND_RENDER_TARGET }, &m_backBufferTarget);
+
+    // Each level and its blur target are half the size of the level above.
+    FrameGraph::Resource levels[BloomChain::MaxLevels] = {};
+    FrameGraph::Resource blurTargets[BloomChain::MaxLevels] = {};
+    for (uint32_t i = 0; i < chain.levels; ++i)
     {
-        // Pass-through test
-        context->CopyResource(m_backBuffer.Get(), m_sceneTex.Get());
+        const TransientTextureDesc desc = { format, std::max(UINT(size.right) >> (i + 1), 1u),
+            std::max(UINT(size.bottom) >> (i + 1), 1u), bindFlags };
+        levels[i] = graph.CreateTexture(BLOOM_LEVEL_NAMES[i], desc);
+        blurTargets[i] = graph.CreateTexture(BLOOM_BLUR_NAMES[i], desc);
     }
-    else
+
+    // Every bloom pass overwrites its target, so they draw opaque.
+    auto draw = [context, spriteBatch](const FrameGraph& g, FrameGraph::Resource source,
+        FrameGraph::Resource destination, ID3D11BlendState* blend, std::function<void()> setState)
+    {
+        context->OMSetRenderTargets(1, GetRenderTarget(g, destination).rtv.GetAddressOf(), nullptr);
+        spriteBatch->Begin(SpriteSortMode_Immediate, blend, nullptr, nullptr, nullptr, setState);
+        spriteBatch->Draw(GetRenderTarget(g, source).srv.Get(), GetRect(g.GetDesc(destination)));
+        spriteBatch->End();
+    };
+
+    // scene -> level 0 (downsample)
+    FrameGraph::Resource latest[BloomChain::MaxLevels] = {};
+    const FrameGraph::Resource top = levels[0];
+    uint32_t pass = graph.AddPass("BloomExtract", [=](const FrameGraph& g)
     {
-        // scene -> RT1 (downsample)
-        context->OMSetRenderTargets(1, m_rt1RT.GetAddressOf(), nullptr);
-        m_spriteBatch->Begin(SpriteSortMode_Immediate,
-            nullptr, nullptr, nullptr, nullptr,
-            [=]() {
-            context->PSSetConstantBuffers(0, 1, m_bloomParams.GetAddressOf());
-            context->PSSetShader(m_bloomExtractPS.Get(), nullptr, 0);
+        draw(g, scene, top, opaque, [=]() {
+            context->PSSetConstantBuffers(0, 1, &bloomParams);
+            context->PSSetShader(extractPS, nullptr, 0);
         });
-        m_spriteBatch->Draw(m_sceneSRV.Get(), m_bloomRect);
-        m_spriteBatch->End();
-
-        // RT1 -> RT2 (blur horizontal)
-        context->OMSetRenderTargets(1, m_rt2RT.GetAddressOf(), nullptr);
-        m_spriteBatch->Begin(SpriteSortMode_Immediate,
-            nullptr, nullptr, nullptr, nullptr,
-            [=]() {
-            context->PSSetShader(m_gaussianBlurPS.Get(), nullptr, 0);
-            context->PSSetConstantBuffers(0, 1,
-                m_blurParamsWidth.GetAddressOf());
+    });
+    graph.Read(pass, scene);
+    latest[0] = graph.Write(pass, levels[0]);
+
+    for (uint32_t i = 0; i < chain.levels; ++i)
+    {
+        const FrameGraph::Resource level = levels[i];
+        const FrameGraph::Resource blurTarget = blurTargets[i];
+
+        // level above -> level (downsample)
+        if (i > 0)
+        {
+            const FrameGraph::Resource above = levels[i - 1];
+            pass = graph.AddPass("BloomDownsample", [=](const FrameGraph& g)
+            {
+                draw(g, above, level, opaque, nullptr);
+            });
+            graph.Read(pass, latest[i - 1]);
+            latest[i] = graph.Write(pass, level);
+        }
+
+        // level -> blur target (blur horizontal)
+        pass = graph.AddPass("BloomBlurHorizontal", [=](const FrameGraph& g)
+        {
+            draw(g, level, blurTarget, opaque, [=]() {
+                context->PSSetShader(blurPS, nullptr, 0);
+                context->PSSetConstantBuffers(0, 1, &blurParamsWidth);
+            });
         });
-        m_spriteBatch->Draw(m_rt1SRV.Get(), m_bloomRect);
-        m_spriteBatch->End();
-
-        context->PSSetShaderResources(0, 2, null);
-
-        // RT2 -> RT1 (blur vertical)
-        context->OMSetRenderTargets(1, m_rt1RT.GetAddressOf(), nullptr);
-        m_spriteBatch->Begin(SpriteSortMode_Immediate,
-            nullptr, nullptr, nullptr, nullptr,
-            [=]() {
-            context->PSSetShader(m_gaussianBlurPS.Get(), nullptr, 0);
-            context->PSSetConstantBuffers(0, 1,
-                m_blurParamsHeight.GetAddressOf());
+        graph.Read(pass, latest[i]);
+        const FrameGraph::Resource blurred = graph.Write(pass, blurTarget);
+
+        // blur target -> level (blur vertical)
+        pass = graph.AddPass("BloomBlurVertical", [=](const FrameGraph& g)
+        {
+            draw(g, blurTarget, level, opaque, [=]() {
+                context->PSSetShader(blurPS, nullptr, 0);
+                context->PSSetConstantBuffers(0, 1, &blurParamsHeight);
+            });
         });
-        m_spriteBatch->Draw(m_rt2SRV.Get(), m_bloomRect);
-        m_spriteBatch->End();
-
-        // RT1 + scene
-        context->OMSetRenderTargets(1, &renderTarget, nullptr);
-        m_spriteBatch->Begin(SpriteSortMode_Immediate,
-            nullptr, nullptr, nullptr, nullptr,
-            [=]() {
-            context->PSSetShader(m_bloomCombinePS.Get(), nullptr, 0);
-            context->PSSetShaderResources(1, 1, m_rt1SRV.GetAddressOf());
-            context->PSSetConstantBuffers(0, 1, m_bloomParams.GetAddressOf());
+        graph.Read(pass, blurred);
+        latest[i] = graph.Write(pass, level);
+    }
+
+    // level below -> level (upsample), smallest first, so level 0 ends up with every
+    // level's share of the bloom. The blend reads the level it draws into.
+    for (uint32_t i = chain.levels - 1; i > 0; --i)
+    {
+        const FrameGraph::Resource below = levels[i];
+        const FrameGraph::Resource level = levels[i - 1];
+        const float factor = chain.blendFactors[i - 1];
+
+        pass = graph.AddPass("BloomUpsample", [=](const FrameGraph& g)
+        {
+            draw(g, below, level, upsampleBlend, [=]() {
+                // SpriteBatch sets a blend factor of one; replace it with the level's.
+                const float blendFactor[4] = { factor, factor, factor, factor };
+                context->OMSetBlendState(upsampleBlend, blendFactor, 0xFFFFFFFF);
+            });
         });
-        m_spriteBatch->Draw(m_sceneSRV.Get(), m_fullscreenRect);
-        m_spriteBatch->End();
+        graph.Read(pass, latest[i]);
+        graph.Read(pass, latest[i - 1]);
+        latest[i - 1] = graph.Write(pass, level);
     }
 
-    context->PSSetShaderResources(0, 2, null);
+    FrameGraph::Resource output;
+    if (preset == None)
+    {
+        // Pass-through test
+        pass = graph.AddPass("Copy", [=](const FrameGraph& g)
+        {
+            context->CopyResource(GetRenderTarget(g, backBuffer).texture.Get(), GetRenderTarget(g, scene).texture.Get());
+        });
+        graph.Read(pass, scene);
+        output = graph.Write(pass, backBuffer);
+    }
+    else
+    {
+        // level 0 + scene
+        pass = graph.AddPass("BloomCombine", [=](const FrameGraph& g)
+        {
+            ID3D11ShaderResourceView* bloom = GetRenderTarget(g, top).srv.Get();
+            context->OMSetRenderTargets(1, GetRenderTarget(g, backBuffer).rtv.GetAddressOf(), nullptr);
+            spriteBatch->Begin(SpriteSortMode_Immediate,
+                nullptr, nullptr, nullptr, nullptr,
+                [=]() {
+                context->PSSetShader(combinePS, nullptr, 0);
+                context->PSSetShaderResources(1, 1, &bloom);
+                context->PSSetConstantBuffers(0, 1, &bloomParams);
+            });
+            spriteBatch->Draw(GetRenderTarget(g, scene).srv.Get(), fullscreenRect);
+            spriteBatch->End();
+        });
+        graph.Read(pass, scene);
+        graph.Read(pass, latest[0]);
+        output = graph.Write(pass, backBuffer);
+    }
+
+    graph.MarkOutput(output);
+    graph.Compile();
+}
+
+void Game::PostProcess()
+{
+    PROFILE_SCOPE("PostProcess");
+
+    // Bloom is left out until its shaders have loaded.
+    const BloomPresets preset = (m_bloomExtractPS && m_bloomCombinePS && m_blurPS[g_BloomQuality]) ? g_Bloom : None;
+
+    const uint32_t graphKey = uint32_t(preset) * BloomQualityCount + uint32_t(g_BloomQuality);
+    if (graphKey != m_postProcessGraphKey)
+    {
+        BuildPostProcessGraph(preset, g_BloomQuality);
+        m_postProcessGraphKey = graphKey;
+    }
+
+    auto context = m_deviceResources->GetD3DDeviceContext();
+    m_postProcessGraph.Execute(*m_renderTargets, [context](uint32_t inputCount)
+    {
+        ID3D11ShaderResourceView* null[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
+        context->PSSetShaderResources(0, inputCount, null);
+    });
 }
 #pragma endregion
@@ -4,8 +4,26 @@
 
 #pragma once
 
+#include "AssetLoader.h"
+#include "AssetPack.h"
+#include "BloomParameters.h"
+#include "D3DTextureBackend.h"
+#include "FrameGraph.h"
 #include "DeviceResources.h"
+#include "FrustumCuller.h"
+#include "InputRecording.h"
+#include "InstancedSphereRenderer.h"
+#include "RenderQueue.h"
+#include "JobSystem.h"
+#include "RenderSnapshot.h"
+#include "Simulation.h"
 #include "StepTimer.h"
+#include "TextureManifest.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 // A basic game implementation that creates a D3D11 device and
 // provides a game loop.
@@ -45,12 +63,30 @@ private:
     void Update(DX::StepTimer const& timer);
     void Render();
 
+    // Simulation thread
+    void SimulationLoop();
+    void StartSimulation();
+    void StopSimulation();
+    void SubmitInput(const SimulationInput& input);
+    SimulationInput TakeInput();
+
+    enum InputMode : uint32_t
+    {
+        LiveInput,
+        RecordingInput,
+        ReplayingInput,
+    };
+
+    void SetInputMode(InputMode mode);
+
     void Clear();
 
     void CreateDeviceDependentResources();
+    void CreateShipParts();
     void CreateWindowSizeDependentResources();
     void RenderAimReticle(ID3D11DeviceContext1* context);
     void AimReticleCreateBatch();
+    void BuildPostProcessGraph(BloomPresets preset, BloomQuality quality);
     void PostProcess();
     // Device resources.
     std::unique_ptr<DX::DeviceResources>    m_deviceResources;
@@ -59,13 +95,81 @@ private:
     DX::StepTimer                           m_timer;
     std::unique_ptr<DirectX::Keyboard> m_keyboard;
     std::unique_ptr<DirectX::Mouse> m_mouse;
+    DirectX::Keyboard::KeyboardStateTracker m_keys;
+
+    // Worker threads shared by the simulation and loaders.
+    std::unique_ptr<DX::JobSystem>          m_jobs;
+
+    // Loads the textures, ship, font and bloom shaders on those workers. Until each is
+    // ready Render draws with a placeholder or without it; the per asset timings go to
+    // the debugger output once everything has loaded.
+    std::unique_ptr<AssetLoader>            m_assets;
+    bool                                    m_assetReportShown;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_placeholderTexture;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_placeholderTextureArray;
+
+    // Textures the "cook" tool has turned into block compressed DDS files; these load
+    // in place of their sources, the ship's through m_fxFactory.
+    TextureManifest                         m_cookedTextures;
+
+    // Every asset in one mapped file, when "pack" has built one; Find and Get are safe
+    // on the loader's workers. Assets it does not hold load from loose files.
+    AssetPack                               m_assetPack;
+
+    // Camera, orbit and input state. Only the simulation thread touches m_simulation;
+    // the render loop reads the snapshots it publishes.
+    Simulation                              m_simulation;
+    std::thread                             m_simulationThread;
+    std::atomic<bool>                       m_simulationRunning;
+    std::atomic<bool>                       m_resetSimulationTimer;
+    std::atomic<uint32_t>                   m_simulationRate;
+    DX::TripleBuffer<RenderSnapshot>        m_snapshots;
+
+    // The last two published snapshots, and the blend of the two Render draws so the
+    // simulation can run below the display rate without stuttering.
+    RenderSnapshot                          m_previousSnapshot;
+    RenderSnapshot                          m_currentSnapshot;
+    RenderSnapshot                          m_renderSnapshot;
+
+    // Input sampled by the render loop, waiting for the next simulation update.
+    std::mutex                              m_inputMutex;
+    SimulationInput                         m_pendingInput;
+    uint32_t                                m_latchedKeys;
+
+    // F10 records the simulation's input to a file and F11 replays it from a reset
+    // simulation. The render loop requests a mode; the simulation thread owns the rest.
+    std::atomic<uint32_t>                   m_requestedInputMode;
+    InputMode                               m_inputMode;
+    InputRecording                          m_recording;
+    InputPlayback                           m_playback;
+
+    // Objects outside the view frustum are skipped before any effect is set up.
+    FrustumCuller                           m_culler;
+    std::vector<uint8_t>                    m_asteroidVisible;
+    CullStatistics                          m_cullStats;
+    DirectX::BoundingSphere                 m_shipBounds;
+
+    // Earth and every asteroid share the sphere mesh and are drawn instanced.
+    std::unique_ptr<InstancedSphereRenderer> m_sphereRenderer;
+    InstanceBuilder                         m_sphereInstances;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_planetTextures;
+    uint32_t                                m_planetMaterial;
+
+    // Draws are submitted with sort keys and executed in key order.
+    RenderQueue                             m_renderQueue;
+
+    struct ShipPart
+    {
+        DirectX::ModelMesh*                 mesh;
+        DirectX::ModelMeshPart*             part;
+        uint32_t                            material;
+        bool                                translucent;    // The glass (its material has alpha < 1)
+    };
+    std::vector<ShipPart>                   m_shipParts;
 
     std::unique_ptr<DirectX::GeometricPrimitive> m_room;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_roomTex;
     DirectX::SimpleMath::Matrix m_proj;
-    DirectX::SimpleMath::Vector3 m_cameraPos;
-    float m_pitch;
-    float m_yaw;
     float widthWin;
     float heightWin;
 
@@ -73,14 +177,11 @@ private:
     DirectX::SimpleMath::Matrix m_world;
     DirectX::SimpleMath::Matrix m_view;
     std::unique_ptr<DirectX::GeometricPrimitive> m_shape;
-    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_texture;
     std::unique_ptr<DirectX::BasicEffect> m_effect;
     Microsoft::WRL::ComPtr<ID3D11InputLayout> m_inputLayout;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_sunTex;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_textureSun;
-    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_textureAsteroid;
     std::unique_ptr<DirectX::BasicEffect> m_effectSun;
-    std::unique_ptr<DirectX::BasicEffect> m_effectAsteroid;
 
     std::unique_ptr<DirectX::PBREffect> PBReffect;
     std::unique_ptr<DirectX::PBREffectFactory> PBRfxFactory;
@@ -92,9 +193,6 @@ private:
     //drawing a model
     std::unique_ptr<DirectX::Model> ship_model;
 
-    //roll matrix
-    DirectX::SimpleMath::Matrix rollMatrix;
-
     // For rendering aim reticle
     std::unique_ptr<DirectX::PrimitiveBatch<DirectX::VertexPositionColor>> m_batch;
     std::unique_ptr<DirectX::BasicEffect> mReticle_effect;
@@ -121,24 +219,35 @@ private:
 
     Microsoft::WRL::ComPtr<ID3D11PixelShader> m_bloomExtractPS;
     Microsoft::WRL::ComPtr<ID3D11PixelShader> m_bloomCombinePS;
-    Microsoft::WRL::ComPtr<ID3D11PixelShader> m_gaussianBlurPS;
 
-    Microsoft::WRL::ComPtr<ID3D11Buffer> m_bloomParams;
-    Microsoft::WRL::ComPtr<ID3D11Buffer> m_blurParamsWidth;
-    Microsoft::WRL::ComPtr<ID3D11Buffer> m_blurParamsHeight;
+    // Every blur permutation and the constants for every preset and tier, so switching
+    // either at runtime only changes which ones PostProcess binds.
+    Microsoft::WRL::ComPtr<ID3D11PixelShader> m_blurPS[BloomQualityCount];
+    Microsoft::WRL::ComPtr<ID3D11Buffer> m_bloomParams[BloomPresetCount];
+    Microsoft::WRL::ComPtr<ID3D11Buffer> m_blurParamsWidth[BloomQualityCount][BloomPresetCount];
+    Microsoft::WRL::ComPtr<ID3D11Buffer> m_blurParamsHeight[BloomQualityCount][BloomPresetCount];
+
+    // Blends an upsampled level into the one above: src * (1 - factor) + dest * factor.
+    Microsoft::WRL::ComPtr<ID3D11BlendState> m_bloomUpsampleBlend;
 
     Microsoft::WRL::ComPtr<ID3D11Texture2D> m_backBuffer;
 
+    // The scene and bloom targets come from the pool; the scene target is held until the
+    // window size changes, the bloom targets only while the post-process graph runs.
+    std::unique_ptr<D3DTextureBackend> m_renderTargetBackend;
+    std::unique_ptr<TransientTexturePool> m_renderTargets;
+    TransientTexturePool::Handle m_sceneTarget;
+
     Microsoft::WRL::ComPtr<ID3D11Texture2D> m_sceneTex;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_sceneSRV;
     Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_sceneRT;
 
-    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_rt1SRV;
-    Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_rt1RT;
-
-    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_rt2SRV;
-    Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_rt2RT;
+    BloomChain m_bloomChains[BloomQualityCount][BloomPresetCount];
 
-    RECT m_bloomRect;
+    // The bloom passes as a frame graph, built for m_postProcessGraphKey (the preset
+    // and quality) and the window size.
+    FrameGraph m_postProcessGraph;
+    uint32_t m_postProcessGraphKey;
+    PooledRenderTarget m_backBufferTarget;
 
 };
@@ -0,0 +1,31 @@
+Texture2D<float4> Texture : register(t0);
+sampler TextureSampler : register(s0);
+
+// GaussianBlur<N>.hlsl define SAMPLE_COUNT. The constant buffer is laid out for the
+// longest kernel (BlurKernel::MaxSamples) whatever the permutation.
+#define MAX_SAMPLE_COUNT 31
+
+cbuffer VS_BLUR_PARAMETERS : register(b0)
+{
+    float2 SampleOffsets[MAX_SAMPLE_COUNT];
+    float SampleWeights[MAX_SAMPLE_COUNT];
+}
+
+float4 main(float4 color : COLOR0, float2 texCoord : TEXCOORD0) : SV_Target0
+{
+    // Offsets are in texels, so the same buffer serves every size of target.
+    float2 size;
+    Texture.GetDimensions(size.x, size.y);
+    float2 texelSize = 1 / size;
+
+    float4 c = 0;
+
+    // Combine a number of weighted image filter taps.
+    [unroll]
+    for (int i = 0; i < SAMPLE_COUNT; i++)
+    {
+        c += Texture.Sample(TextureSampler, texCoord + SampleOffsets[i] * texelSize) * SampleWeights[i];
+    }
+
+    return c;
+}
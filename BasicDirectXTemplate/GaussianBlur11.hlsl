@@ -0,0 +1,4 @@
+// GaussianBlur with 11 taps; see BloomQuality in BloomParameters.h.
+#define SAMPLE_COUNT 11
+
+#include "GaussianBlur.hlsli"
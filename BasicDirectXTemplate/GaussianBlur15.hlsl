@@ -0,0 +1,4 @@
+// GaussianBlur with 15 taps; see BloomQuality in BloomParameters.h.
+#define SAMPLE_COUNT 15
+
+#include "GaussianBlur.hlsli"
@@ -0,0 +1,4 @@
+// GaussianBlur with 23 taps; see BloomQuality in BloomParameters.h.
+#define SAMPLE_COUNT 23
+
+#include "GaussianBlur.hlsli"
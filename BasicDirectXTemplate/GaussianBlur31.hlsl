@@ -0,0 +1,4 @@
+// GaussianBlur with 31 taps; see BloomQuality in BloomParameters.h.
+#define SAMPLE_COUNT 31
+
+#include "GaussianBlur.hlsli"
@@ -0,0 +1,4 @@
+// GaussianBlur with 7 taps; see BloomQuality in BloomParameters.h.
+#define SAMPLE_COUNT 7
+
+#include "GaussianBlur.hlsli"
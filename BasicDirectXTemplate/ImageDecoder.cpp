@@ -0,0 +1,1358 @@
+//
+// ImageDecoder.cpp
+//
+
+#include "ImageDecoder.h"
+
+#include <algorithm>
+#include <string.h>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+
+namespace
+{
+    [[noreturn]] void Fail(const char* message)
+    {
+        throw std::runtime_error(std::string("ImageDecoder: ") + message);
+    }
+
+    [[noreturn]] void Unsupported(const char* message)
+    {
+        throw UnsupportedImageError(std::string("ImageDecoder: ") + message);
+    }
+
+    inline uint8_t ClampToByte(float value)
+    {
+        return uint8_t(std::min(std::max(value + 0.5f, 0.f), 255.f));
+    }
+
+    inline uint32_t ReadBigEndian16(const uint8_t* data)
+    {
+        return (uint32_t(data[0]) << 8) | data[1];
+    }
+
+    inline uint32_t ReadBigEndian32(const uint8_t* data)
+    {
+        return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+    }
+
+    //-------------------------------------------------------------------------------------
+    // Inflate
+    //-------------------------------------------------------------------------------------
+
+    // Reads bits least significant first. Past the end it reads zeros, which Inflate
+    // turns into an error once it notices.
+    class DeflateBits
+    {
+    public:
+        DeflateBits(const uint8_t* data, size_t size) :
+            m_data(data), m_end(data + size), m_buffer(0), m_count(0), m_overrun(0)
+        {
+        }
+
+        uint32_t Peek(uint32_t bits)
+        {
+            Refill();
+            return uint32_t(m_buffer & ((uint64_t(1) << bits) - 1));
+        }
+
+        void Skip(uint32_t bits)
+        {
+            m_buffer >>= bits;
+            m_count -= bits;
+        }
+
+        uint32_t Read(uint32_t bits)
+        {
+            if (bits == 0)
+                return 0;
+            uint32_t value = Peek(bits);
+            Skip(bits);
+            return value;
+        }
+
+        void AlignToByte()
+        {
+            Skip(m_count & 7);
+        }
+
+        bool Overrun() const
+        {
+            // Refill may run ahead of what has been consumed.
+            return m_overrun * 8 > m_count;
+        }
+
+    private:
+        void Refill()
+        {
+            while (m_count <= 56)
+            {
+                uint64_t byte = 0;
+                if (m_data < m_end)
+                {
+                    byte = *m_data++;
+                }
+                else
+                {
+                    ++m_overrun;
+                }
+                m_buffer |= byte << m_count;
+                m_count += 8;
+            }
+        }
+
+        const uint8_t*  m_data;
+        const uint8_t*  m_end;
+        uint64_t        m_buffer;
+        uint32_t        m_count;
+        uint32_t        m_overrun;
+    };
+
+    // Canonical Huffman code with a lookup table for the short codes.
+    class DeflateHuffman
+    {
+    public:
+        static const uint32_t FastBits = 10;
+
+        void Build(const uint8_t* lengths, uint32_t count)
+        {
+            memset(m_counts, 0, sizeof(m_counts));
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                ++m_counts[lengths[i]];
+            }
+            m_counts[0] = 0;
+
+            // Symbols sorted by code length, then by value: the canonical code order.
+            uint32_t offsets[16] = {};
+            int32_t left = 1;
+            for (uint32_t length = 1; length < 16; ++length)
+            {
+                offsets[length] = offsets[length - 1] + m_counts[length - 1];
+                left = (left << 1) - m_counts[length];
+                if (left < 0)
+                    Fail("invalid deflate code lengths");
+            }
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (lengths[i])
+                {
+                    m_symbols[offsets[lengths[i]]++] = uint16_t(i);
+                }
+            }
+
+            // Codes are assigned most significant bit first but read least significant
+            // first, so the table is indexed by the reversed code.
+            memset(m_fast, 0, sizeof(m_fast));
+            uint32_t code = 0;
+            uint32_t index = 0;
+            for (uint32_t length = 1; length <= FastBits; ++length)
+            {
+                for (uint32_t i = 0; i < m_counts[length]; ++i, ++code, ++index)
+                {
+                    uint32_t reversed = 0;
+                    for (uint32_t bit = 0; bit < length; ++bit)
+                    {
+                        reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+                    }
+                    for (uint32_t fill = reversed; fill < (1u << FastBits); fill += 1u << length)
+                    {
+                        m_fast[fill] = uint16_t((length << 12) | m_symbols[index]);
+                    }
+                }
+                code <<= 1;
+            }
+        }
+
+        uint32_t Decode(DeflateBits& bits) const
+        {
+            const uint16_t entry = m_fast[bits.Peek(FastBits)];
+            if (entry)
+            {
+                bits.Skip(entry >> 12);
+                return entry & 0xfff;
+            }
+
+            // Longer codes, a bit at a time.
+            int32_t code = 0, first = 0, index = 0;
+            const uint32_t peeked = bits.Peek(15);
+            for (uint32_t length = 1; length < 16; ++length)
+            {
+                code |= (peeked >> (length - 1)) & 1;
+                const int32_t count = m_counts[length];
+                if (code - count < first)
+                {
+                    bits.Skip(length);
+                    return m_symbols[index + (code - first)];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            Fail("invalid deflate code");
+        }
+
+    private:
+        uint16_t    m_counts[16];
+        uint16_t    m_symbols[288];
+        uint16_t    m_fast[1 << FastBits];      // length << 12 | symbol, 0 for long codes
+    };
+
+    const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    //-------------------------------------------------------------------------------------
+    // JPEG
+    //-------------------------------------------------------------------------------------
+
+    const uint8_t ZIGZAG[64] =
+    {
+        0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+    };
+
+    // The AAN inverse DCT's per row and column scale factors, cos(k * pi / 16) * sqrt(2).
+    const float AAN_SCALE[8] = { 1.f, 1.387039845f, 1.306562965f, 1.175875602f,
+        1.f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+    // Codes of up to FastBits bits are looked up directly.
+    struct JpegHuffman
+    {
+        static const uint32_t FastBits = 9;
+
+        uint8_t     symbols[256];
+        uint16_t    fast[1 << FastBits];    // length << 8 | symbol, 0 for long codes
+        int32_t     maxCode[18];            // Largest code of each length, -1 if none
+        int32_t     valueOffset[17];        // symbols index minus the first code of each length
+        bool        defined;
+    };
+
+    struct JpegComponent
+    {
+        uint32_t    id;
+        uint32_t    h;
+        uint32_t    v;
+        uint32_t    quantTable;
+        uint32_t    dcTable;
+        uint32_t    acTable;
+        int32_t     dcPrediction;
+        uint32_t    blocksWide;             // Blocks in the component, padded to whole MCUs
+        uint32_t    blocksHigh;
+        std::vector<uint8_t> samples;
+    };
+
+    class JpegDecoder
+    {
+    public:
+        JpegDecoder(const uint8_t* data, size_t size) :
+            m_data(data), m_end(data + size), m_position(data),
+            m_width(0), m_height(0), m_maxH(1), m_maxV(1), m_restartInterval(0),
+            m_adobeTransform(-1), m_bitBuffer(0), m_bitCount(0), m_hitMarker(false)
+        {
+            memset(m_huffman, 0, sizeof(m_huffman));
+            memset(m_quant, 0, sizeof(m_quant));
+        }
+
+        Image Decode()
+        {
+            if (ReadByte() != 0xff || ReadByte() != 0xd8)
+                Fail("not a JPEG");
+
+            bool frame = false;
+            for (;;)
+            {
+                const uint32_t marker = NextMarker();
+                if (marker == 0xd9)
+                    break;
+
+                switch (marker)
+                {
+                case 0xc0:
+                case 0xc1:
+                    ReadFrame();
+                    frame = true;
+                    break;
+
+                case 0xc2:
+                case 0xc6:
+                case 0xca:
+                case 0xce:
+                    Unsupported("progressive JPEGs are not supported");
+
+                case 0xc3:
+                case 0xc5:
+                case 0xc7:
+                case 0xc9:
+                case 0xcb:
+                case 0xcd:
+                case 0xcf:
+                    Unsupported("lossless, hierarchical and arithmetic coded JPEGs are not supported");
+
+                case 0xc4:
+                    ReadHuffmanTables();
+                    break;
+
+                case 0xdb:
+                    ReadQuantizationTables();
+                    break;
+
+                case 0xdd:
+                {
+                    uint32_t length;
+                    const uint8_t* payload = ReadSegment(length);
+                    if (length != 2)
+                        Fail("bad restart interval");
+                    m_restartInterval = ReadBigEndian16(payload);
+                    break;
+                }
+
+                case 0xda:
+                    if (!frame)
+                        Fail("scan before the frame header");
+                    ReadScan();
+                    break;
+
+                case 0xee:
+                    ReadAdobe();
+                    break;
+
+                default:
+                    SkipSegment();
+                    break;
+                }
+            }
+
+            if (!frame)
+                Fail("no frame");
+            return Convert();
+        }
+
+    private:
+        uint8_t ReadByte()
+        {
+            if (m_position >= m_end)
+                Fail("truncated JPEG");
+            return *m_position++;
+        }
+
+        void Need(size_t bytes)
+        {
+            if (size_t(m_end - m_position) < bytes)
+                Fail("truncated JPEG");
+        }
+
+        uint32_t NextMarker()
+        {
+            // Skips fill bytes and anything left over from the last scan.
+            for (;;)
+            {
+                while (ReadByte() != 0xff)
+                {
+                }
+                uint8_t marker = ReadByte();
+                while (marker == 0xff)
+                {
+                    marker = ReadByte();
+                }
+                if (marker != 0 && (marker < 0xd0 || marker > 0xd7))
+                    return marker;
+            }
+        }
+
+        // Returns the segment's payload and moves past it.
+        const uint8_t* ReadSegment(uint32_t& length)
+        {
+            Need(2);
+            length = ReadBigEndian16(m_position);
+            if (length < 2)
+                Fail("bad segment length");
+            Need(length);
+            const uint8_t* payload = m_position + 2;
+            m_position += length;
+            length -= 2;
+            return payload;
+        }
+
+        void SkipSegment()
+        {
+            uint32_t length;
+            ReadSegment(length);
+        }
+
+        void ReadAdobe()
+        {
+            uint32_t length;
+            const uint8_t* payload = ReadSegment(length);
+            if (length >= 12 && memcmp(payload, "Adobe", 5) == 0)
+            {
+                m_adobeTransform = payload[11];
+            }
+        }
+
+        void ReadQuantizationTables()
+        {
+            uint32_t length;
+            const uint8_t* payload = ReadSegment(length);
+            const uint8_t* end = payload + length;
+            while (payload < end)
+            {
+                const uint32_t precision = *payload >> 4;
+                const uint32_t table = *payload & 15;
+                ++payload;
+                if (table > 3 || end - payload < (precision ? 128 : 64))
+                    Fail("bad quantization table");
+
+                // Stored in zigzag order; kept in natural order with the IDCT's scaling.
+                for (uint32_t i = 0; i < 64; ++i)
+                {
+                    const uint32_t value = precision ? ReadBigEndian16(payload + i * 2) : payload[i];
+                    const uint32_t natural = ZIGZAG[i];
+                    m_quant[table][natural] = float(value) * AAN_SCALE[natural >> 3] * AAN_SCALE[natural & 7] / 8.f;
+                }
+                payload += precision ? 128 : 64;
+            }
+        }
+
+        void ReadHuffmanTables()
+        {
+            uint32_t length;
+            const uint8_t* payload = ReadSegment(length);
+            const uint8_t* end = payload + length;
+            while (payload < end)
+            {
+                if (end - payload < 17)
+                    Fail("bad Huffman table");
+
+                const uint32_t tableClass = *payload >> 4;
+                const uint32_t index = *payload & 15;
+                if (tableClass > 1 || index > 3)
+                    Fail("bad Huffman table");
+
+                uint32_t counts[17] = {};
+                uint32_t total = 0;
+                for (uint32_t i = 1; i <= 16; ++i)
+                {
+                    counts[i] = payload[i];
+                    total += counts[i];
+                }
+                payload += 17;
+                if (total > 256 || end - payload < ptrdiff_t(total))
+                    Fail("bad Huffman table");
+
+                JpegHuffman& table = m_huffman[tableClass][index];
+                memcpy(table.symbols, payload, total);
+                payload += total;
+
+                memset(table.fast, 0, sizeof(table.fast));
+                int32_t code = 0;
+                uint32_t symbol = 0;
+                for (uint32_t bits = 1; bits <= 16; ++bits)
+                {
+                    table.valueOffset[bits] = int32_t(symbol) - code;
+                    for (uint32_t i = 0; i < counts[bits]; ++i, ++code, ++symbol)
+                    {
+                        if (bits <= JpegHuffman::FastBits)
+                        {
+                            const uint32_t shift = JpegHuffman::FastBits - bits;
+                            for (uint32_t fill = 0; fill < (1u << shift); ++fill)
+                            {
+                                table.fast[(uint32_t(code) << shift) | fill] = uint16_t((bits << 8) | table.symbols[symbol]);
+                            }
+                        }
+                    }
+                    table.maxCode[bits] = counts[bits] ? code - 1 : -1;
+                    if (code > (1 << bits))
+                        Fail("bad Huffman table");
+                    code <<= 1;
+                }
+                table.maxCode[17] = INT32_MAX;
+                table.defined = true;
+            }
+        }
+
+        void ReadFrame()
+        {
+            if (!m_components.empty())
+                Fail("more than one frame");
+
+            uint32_t length;
+            const uint8_t* payload = ReadSegment(length);
+            if (length < 6)
+                Fail("bad frame header");
+
+            if (payload[0] != 8)
+                Unsupported("only 8 bit JPEGs are supported");
+            m_height = ReadBigEndian16(payload + 1);
+            m_width = ReadBigEndian16(payload + 3);
+            const uint32_t count = payload[5];
+            if (m_width == 0 || m_height == 0)
+                Unsupported("empty or DNL sized JPEGs are not supported");
+            if ((count != 1 && count != 3) || length < 6 + count * 3)
+                Unsupported("only grey and three component JPEGs are supported");
+
+            m_components.resize(count);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                JpegComponent& component = m_components[i];
+                const uint8_t* spec = payload + 6 + i * 3;
+                component.id = spec[0];
+                component.h = spec[1] >> 4;
+                component.v = spec[1] & 15;
+                component.quantTable = spec[2];
+                if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantTable > 3)
+                    Fail("bad component");
+                m_maxH = std::max(m_maxH, component.h);
+                m_maxV = std::max(m_maxV, component.v);
+            }
+
+            m_mcusWide = (m_width + m_maxH * 8 - 1) / (m_maxH * 8);
+            m_mcusHigh = (m_height + m_maxV * 8 - 1) / (m_maxV * 8);
+            for (JpegComponent& component : m_components)
+            {
+                component.blocksWide = m_mcusWide * component.h;
+                component.blocksHigh = m_mcusHigh * component.v;
+                component.samples.assign(size_t(component.blocksWide) * component.blocksHigh * 64, 0);
+            }
+        }
+
+        void ReadScan()
+        {
+            uint32_t length;
+            const uint8_t* payload = ReadSegment(length);
+            const uint32_t count = payload[0];
+            if (count < 1 || count > m_components.size() || length < 4 + count * 2)
+                Fail("bad scan header");
+
+            JpegComponent* scan[4] = {};
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const uint8_t* spec = payload + 1 + i * 2;
+                for (JpegComponent& component : m_components)
+                {
+                    if (component.id == spec[0])
+                    {
+                        scan[i] = &component;
+                    }
+                }
+                if (!scan[i])
+                    Fail("scan names an unknown component");
+                scan[i]->dcTable = spec[1] >> 4;
+                scan[i]->acTable = spec[1] & 15;
+                if (scan[i]->dcTable > 3 || scan[i]->acTable > 3
+                    || !m_huffman[0][scan[i]->dcTable].defined || !m_huffman[1][scan[i]->acTable].defined)
+                    Fail("scan uses an undefined Huffman table");
+                scan[i]->dcPrediction = 0;
+            }
+
+            const uint8_t* selection = payload + 1 + count * 2;
+            if (selection[0] != 0 || selection[1] != 63 || selection[2] != 0)
+                Unsupported("progressive scans are not supported");
+
+            m_bitBuffer = 0;
+            m_bitCount = 0;
+            m_hitMarker = false;
+
+            // One component: its blocks in raster order, covering only the image. More:
+            // interleaved MCUs of each component's h x v blocks.
+            uint32_t unitsWide, unitsHigh;
+            if (count == 1)
+            {
+                const JpegComponent& component = *scan[0];
+                unitsWide = (((m_width * component.h + m_maxH - 1) / m_maxH) + 7) / 8;
+                unitsHigh = (((m_height * component.v + m_maxV - 1) / m_maxV) + 7) / 8;
+            }
+            else
+            {
+                unitsWide = m_mcusWide;
+                unitsHigh = m_mcusHigh;
+            }
+
+            int16_t coefficients[64];
+            uint32_t restartCountdown = m_restartInterval;
+            for (uint32_t unitY = 0; unitY < unitsHigh; ++unitY)
+            {
+                for (uint32_t unitX = 0; unitX < unitsWide; ++unitX)
+                {
+                    if (m_restartInterval)
+                    {
+                        if (restartCountdown == 0)
+                        {
+                            Restart(scan, count);
+                            restartCountdown = m_restartInterval;
+                        }
+                        --restartCountdown;
+                    }
+
+                    for (uint32_t i = 0; i < count; ++i)
+                    {
+                        JpegComponent& component = *scan[i];
+                        const uint32_t blocksX = (count == 1) ? 1 : component.h;
+                        const uint32_t blocksY = (count == 1) ? 1 : component.v;
+                        for (uint32_t by = 0; by < blocksY; ++by)
+                        {
+                            for (uint32_t bx = 0; bx < blocksX; ++bx)
+                            {
+                                DecodeBlock(component, coefficients);
+                                const uint32_t blockX = unitX * blocksX + bx;
+                                const uint32_t blockY = unitY * blocksY + by;
+                                InverseDct(coefficients, m_quant[component.quantTable], component.samples.data()
+                                    + (size_t(blockY) * 8 * component.blocksWide + blockX) * 8, component.blocksWide * 8);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Continue from the marker that ended the entropy coded data.
+            RewindToMarker();
+        }
+
+        void Restart(JpegComponent** scan, uint32_t count)
+        {
+            RewindToMarker();
+            Need(2);
+            if (m_position[0] != 0xff || m_position[1] < 0xd0 || m_position[1] > 0xd7)
+                Fail("missing restart marker");
+            m_position += 2;
+
+            m_bitBuffer = 0;
+            m_bitCount = 0;
+            m_hitMarker = false;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                scan[i]->dcPrediction = 0;
+            }
+        }
+
+        // The bit reader may have read ahead into, but never past, a marker.
+        void RewindToMarker()
+        {
+            m_bitBuffer = 0;
+            m_bitCount = 0;
+            while (m_position < m_end)
+            {
+                if (m_position[0] == 0xff && m_position + 1 < m_end && m_position[1] != 0 && m_position[1] != 0xff)
+                    return;
+                m_position += (m_position[0] == 0xff && m_position + 1 < m_end && m_position[1] == 0) ? 2 : 1;
+            }
+        }
+
+        void FillBits()
+        {
+            while (m_bitCount <= 24)
+            {
+                uint32_t byte = 0;
+                if (!m_hitMarker && m_position < m_end)
+                {
+                    byte = *m_position;
+                    if (byte == 0xff)
+                    {
+                        const uint32_t next = (m_position + 1 < m_end) ? m_position[1] : 0xd9;
+                        if (next == 0)
+                        {
+                            m_position += 2;
+                        }
+                        else
+                        {
+                            // A marker: feed zeros and leave it for RewindToMarker.
+                            m_hitMarker = true;
+                            byte = 0;
+                        }
+                    }
+                    else
+                    {
+                        ++m_position;
+                    }
+                }
+                m_bitBuffer |= byte << (24 - m_bitCount);
+                m_bitCount += 8;
+            }
+        }
+
+        uint32_t ReadBits(uint32_t bits)
+        {
+            if (bits == 0)
+                return 0;
+            FillBits();
+            const uint32_t value = m_bitBuffer >> (32 - bits);
+            m_bitBuffer <<= bits;
+            m_bitCount -= bits;
+            return value;
+        }
+
+        // A value of the given bit count, sign extended the JPEG way.
+        int32_t ReceiveExtend(uint32_t bits)
+        {
+            if (bits == 0)
+                return 0;
+            if (bits > 16)
+                Fail("bad coefficient size");
+            const int32_t value = int32_t(ReadBits(bits));
+            return (value < (1 << (bits - 1))) ? value - (1 << bits) + 1 : value;
+        }
+
+        uint32_t DecodeSymbol(const JpegHuffman& table)
+        {
+            FillBits();
+            const uint16_t entry = table.fast[m_bitBuffer >> (32 - JpegHuffman::FastBits)];
+            if (entry)
+            {
+                const uint32_t bits = entry >> 8;
+                m_bitBuffer <<= bits;
+                m_bitCount -= bits;
+                return entry & 0xff;
+            }
+
+            uint32_t bits = JpegHuffman::FastBits + 1;
+            while (int32_t(m_bitBuffer >> (32 - bits)) > table.maxCode[bits])
+            {
+                ++bits;
+            }
+            if (bits > 16)
+                Fail("bad Huffman code");
+
+            const int32_t code = int32_t(m_bitBuffer >> (32 - bits));
+            m_bitBuffer <<= bits;
+            m_bitCount -= bits;
+            return table.symbols[table.valueOffset[bits] + code];
+        }
+
+        void DecodeBlock(JpegComponent& component, int16_t* coefficients)
+        {
+            memset(coefficients, 0, 64 * sizeof(int16_t));
+
+            const uint32_t dcBits = DecodeSymbol(m_huffman[0][component.dcTable]);
+            component.dcPrediction += ReceiveExtend(dcBits);
+            coefficients[0] = int16_t(component.dcPrediction);
+
+            const JpegHuffman& ac = m_huffman[1][component.acTable];
+            for (uint32_t k = 1; k < 64;)
+            {
+                const uint32_t symbol = DecodeSymbol(ac);
+                const uint32_t run = symbol >> 4;
+                const uint32_t bits = symbol & 15;
+                if (bits == 0)
+                {
+                    if (run != 15)
+                        break;          // End of block
+                    k += 16;
+                    continue;
+                }
+
+                k += run;
+                if (k > 63)
+                    Fail("bad AC coefficients");
+                coefficients[ZIGZAG[k]] = int16_t(ReceiveExtend(bits));
+                ++k;
+            }
+        }
+
+        // The float AAN inverse DCT; the quantization table carries its scale factors.
+        static void InverseDct(const int16_t* coefficients, const float* quant, uint8_t* output, uint32_t stride)
+        {
+            float workspace[64];
+            for (uint32_t column = 0; column < 8; ++column)
+            {
+                const int16_t* in = coefficients + column;
+                const float* q = quant + column;
+                float* ws = workspace + column;
+
+                float tmp0 = in[0] * q[0];
+                float tmp1 = in[16] * q[16];
+                float tmp2 = in[32] * q[32];
+                float tmp3 = in[48] * q[48];
+
+                float tmp10 = tmp0 + tmp2;
+                float tmp11 = tmp0 - tmp2;
+                float tmp13 = tmp1 + tmp3;
+                float tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+
+                tmp0 = tmp10 + tmp13;
+                tmp3 = tmp10 - tmp13;
+                tmp1 = tmp11 + tmp12;
+                tmp2 = tmp11 - tmp12;
+
+                float tmp4 = in[8] * q[8];
+                float tmp5 = in[24] * q[24];
+                float tmp6 = in[40] * q[40];
+                float tmp7 = in[56] * q[56];
+
+                float z13 = tmp6 + tmp5;
+                float z10 = tmp6 - tmp5;
+                float z11 = tmp4 + tmp7;
+                float z12 = tmp4 - tmp7;
+
+                tmp7 = z11 + z13;
+                tmp11 = (z11 - z13) * 1.414213562f;
+                float z5 = (z10 + z12) * 1.847759065f;
+                tmp10 = 1.082392200f * z12 - z5;
+                tmp12 = -2.613125930f * z10 + z5;
+
+                tmp6 = tmp12 - tmp7;
+                tmp5 = tmp11 - tmp6;
+                tmp4 = tmp10 + tmp5;
+
+                ws[0] = tmp0 + tmp7;
+                ws[56] = tmp0 - tmp7;
+                ws[8] = tmp1 + tmp6;
+                ws[48] = tmp1 - tmp6;
+                ws[16] = tmp2 + tmp5;
+                ws[40] = tmp2 - tmp5;
+                ws[32] = tmp3 + tmp4;
+                ws[24] = tmp3 - tmp4;
+            }
+
+            for (uint32_t row = 0; row < 8; ++row)
+            {
+                const float* ws = workspace + row * 8;
+                uint8_t* out = output + row * stride;
+
+                float tmp10 = ws[0] + ws[4];
+                float tmp11 = ws[0] - ws[4];
+                float tmp13 = ws[2] + ws[6];
+                float tmp12 = (ws[2] - ws[6]) * 1.414213562f - tmp13;
+
+                float tmp0 = tmp10 + tmp13;
+                float tmp3 = tmp10 - tmp13;
+                float tmp1 = tmp11 + tmp12;
+                float tmp2 = tmp11 - tmp12;
+
+                float z13 = ws[5] + ws[3];
+                float z10 = ws[5] - ws[3];
+                float z11 = ws[1] + ws[7];
+                float z12 = ws[1] - ws[7];
+
+                float tmp7 = z11 + z13;
+                tmp11 = (z11 - z13) * 1.414213562f;
+                float z5 = (z10 + z12) * 1.847759065f;
+                tmp10 = 1.082392200f * z12 - z5;
+                tmp12 = -2.613125930f * z10 + z5;
+
+                float tmp6 = tmp12 - tmp7;
+                float tmp5 = tmp11 - tmp6;
+                float tmp4 = tmp10 + tmp5;
+
+                out[0] = ClampToByte(tmp0 + tmp7 + 128.f);
+                out[7] = ClampToByte(tmp0 - tmp7 + 128.f);
+                out[1] = ClampToByte(tmp1 + tmp6 + 128.f);
+                out[6] = ClampToByte(tmp1 - tmp6 + 128.f);
+                out[2] = ClampToByte(tmp2 + tmp5 + 128.f);
+                out[5] = ClampToByte(tmp2 - tmp5 + 128.f);
+                out[4] = ClampToByte(tmp3 + tmp4 + 128.f);
+                out[3] = ClampToByte(tmp3 - tmp4 + 128.f);
+            }
+        }
+
+        // Upsamples the chroma by replication and converts to RGBA.
+        Image Convert() const
+        {
+            Image image;
+            image.width = m_width;
+            image.height = m_height;
+            image.channels = uint32_t(m_components.size());
+            image.pixels.resize(size_t(m_width) * m_height * 4);
+
+            // Adobe's transform flag 0 means the components are RGB already.
+            const bool ycc = m_components.size() == 3 && m_adobeTransform != 0;
+
+            for (uint32_t y = 0; y < m_height; ++y)
+            {
+                const uint8_t* rows[3] = {};
+                uint32_t h[3] = {};
+                for (size_t c = 0; c < m_components.size(); ++c)
+                {
+                    const JpegComponent& component = m_components[c];
+                    const uint32_t sampleY = y * component.v / m_maxV;
+                    rows[c] = component.samples.data() + size_t(sampleY) * component.blocksWide * 8;
+                    h[c] = component.h;
+                }
+
+                uint8_t* out = image.pixels.data() + size_t(y) * m_width * 4;
+                for (uint32_t x = 0; x < m_width; ++x, out += 4)
+                {
+                    if (m_components.size() == 1)
+                    {
+                        out[0] = out[1] = out[2] = rows[0][x];
+                    }
+                    else
+                    {
+                        const float c0 = rows[0][x * h[0] / m_maxH];
+                        const float c1 = rows[1][x * h[1] / m_maxH];
+                        const float c2 = rows[2][x * h[2] / m_maxH];
+                        if (ycc)
+                        {
+                            out[0] = ClampToByte(c0 + 1.402f * (c2 - 128.f));
+                            out[1] = ClampToByte(c0 - 0.344136f * (c1 - 128.f) - 0.714136f * (c2 - 128.f));
+                            out[2] = ClampToByte(c0 + 1.772f * (c1 - 128.f));
+                        }
+                        else
+                        {
+                            out[0] = uint8_t(c0);
+                            out[1] = uint8_t(c1);
+                            out[2] = uint8_t(c2);
+                        }
+                    }
+                    out[3] = 255;
+                }
+            }
+            return image;
+        }
+
+        const uint8_t*              m_data;
+        const uint8_t*              m_end;
+        const uint8_t*              m_position;
+
+        uint32_t                    m_width;
+        uint32_t                    m_height;
+        uint32_t                    m_maxH;
+        uint32_t                    m_maxV;
+        uint32_t                    m_mcusWide;
+        uint32_t                    m_mcusHigh;
+        uint32_t                    m_restartInterval;
+        int32_t                     m_adobeTransform;
+        std::vector<JpegComponent>  m_components;
+
+        JpegHuffman                 m_huffman[2][4];        // DC, AC
+        float                       m_quant[4][64];
+
+        uint32_t                    m_bitBuffer;            // Most significant bit first
+        uint32_t                    m_bitCount;
+        bool                        m_hitMarker;
+    };
+
+    //-------------------------------------------------------------------------------------
+    // PNG
+    //-------------------------------------------------------------------------------------
+
+    const uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    enum PngColorType : uint32_t
+    {
+        PngGrey = 0,
+        PngRgb = 2,
+        PngPalette = 3,
+        PngGreyAlpha = 4,
+        PngRgba = 6,
+    };
+
+    inline uint8_t PaethPredictor(int32_t a, int32_t b, int32_t c)
+    {
+        const int32_t p = a + b - c;
+        const int32_t pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return uint8_t(a);
+        return (pb <= pc) ? uint8_t(b) : uint8_t(c);
+    }
+}
+
+Image DecodeImage(const uint8_t* data, size_t size)
+{
+    if (IsJpeg(data, size))
+        return DecodeJpeg(data, size);
+    if (IsPng(data, size))
+        return DecodePng(data, size);
+    Fail("not a JPEG or PNG");
+}
+
+bool IsJpeg(const uint8_t* data, size_t size)
+{
+    return size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+}
+
+bool IsPng(const uint8_t* data, size_t size)
+{
+    return size >= sizeof(PNG_SIGNATURE) && memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0;
+}
+
+Image DecodeJpeg(const uint8_t* data, size_t size)
+{
+    JpegDecoder decoder(data, size);
+    return decoder.Decode();
+}
+
+Image DecodePng(const uint8_t* data, size_t size)
+{
+    if (!IsPng(data, size))
+        Fail("not a PNG");
+
+    uint32_t width = 0, height = 0, bitDepth = 0, colorType = 0;
+    uint8_t palette[256][4] = {};
+    uint32_t paletteSize = 0;
+    std::vector<uint8_t> compressed;
+
+    for (size_t offset = sizeof(PNG_SIGNATURE); ; )
+    {
+        if (size - offset < 12)
+            Fail("truncated PNG");
+
+        const uint32_t length = ReadBigEndian32(data + offset);
+        const uint8_t* type = data + offset + 4;
+        const uint8_t* chunk = data + offset + 8;
+        if (length > size - offset - 12)
+            Fail("truncated PNG");
+
+        if (memcmp(type, "IHDR", 4) == 0)
+        {
+            if (length < 13)
+                Fail("bad PNG header");
+            width = ReadBigEndian32(chunk);
+            height = ReadBigEndian32(chunk + 4);
+            bitDepth = chunk[8];
+            colorType = chunk[9];
+            if (chunk[10] != 0 || chunk[11] != 0)
+                Fail("unknown PNG compression or filter method");
+            if (chunk[12] != 0)
+                Unsupported("interlaced PNGs are not supported");
+            if (width == 0 || height == 0 || width > (1u << 24) || height > (1u << 24))
+                Fail("bad PNG size");
+        }
+        else if (memcmp(type, "PLTE", 4) == 0)
+        {
+            paletteSize = std::min(length / 3, 256u);
+            for (uint32_t i = 0; i < paletteSize; ++i)
+            {
+                palette[i][0] = chunk[i * 3];
+                palette[i][1] = chunk[i * 3 + 1];
+                palette[i][2] = chunk[i * 3 + 2];
+                palette[i][3] = 255;
+            }
+        }
+        else if (memcmp(type, "tRNS", 4) == 0 && colorType == PngPalette)
+        {
+            for (uint32_t i = 0; i < std::min(length, 256u); ++i)
+            {
+                palette[i][3] = chunk[i];
+            }
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            compressed.insert(compressed.end(), chunk, chunk + length);
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            break;
+        }
+        else if (!(type[0] & 0x20))
+        {
+            Fail("unknown critical PNG chunk");
+        }
+
+        offset += size_t(length) + 12;
+    }
+
+    uint32_t samples;
+    switch (colorType)
+    {
+    case PngGrey:       samples = 1; break;
+    case PngRgb:        samples = 3; break;
+    case PngPalette:    samples = 1; break;
+    case PngGreyAlpha:  samples = 2; break;
+    case PngRgba:       samples = 4; break;
+    default:            Fail("bad PNG colour type");
+    }
+
+    bool validDepth;
+    switch (colorType)
+    {
+    case PngGrey:       validDepth = bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16; break;
+    case PngPalette:    validDepth = bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8; break;
+    default:            validDepth = bitDepth == 8 || bitDepth == 16; break;
+    }
+    if (!validDepth)
+        Fail("bad PNG bit depth");
+    if (colorType == PngPalette && paletteSize == 0)
+        Fail("PNG palette missing");
+
+    const size_t rowBytes = (size_t(width) * samples * bitDepth + 7) / 8;
+    const size_t pixelBytes = std::max<size_t>(samples * bitDepth / 8, 1);
+    std::vector<uint8_t> raw = Inflate(compressed.data(), compressed.size(), (rowBytes + 1) * height);
+    if (raw.size() < (rowBytes + 1) * height)
+        Fail("truncated PNG image data");
+
+    // Undo the per row filters in place.
+    std::vector<uint8_t> zeroRow(rowBytes, 0);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint8_t* row = raw.data() + y * (rowBytes + 1);
+        const uint8_t filter = row[0];
+        uint8_t* current = row + 1;
+        const uint8_t* previous = y ? raw.data() + (y - 1) * (rowBytes + 1) + 1 : zeroRow.data();
+
+        switch (filter)
+        {
+        case 0:
+            break;
+        case 1:
+            for (size_t i = pixelBytes; i < rowBytes; ++i)
+                current[i] = uint8_t(current[i] + current[i - pixelBytes]);
+            break;
+        case 2:
+            for (size_t i = 0; i < rowBytes; ++i)
+                current[i] = uint8_t(current[i] + previous[i]);
+            break;
+        case 3:
+            for (size_t i = 0; i < rowBytes; ++i)
+            {
+                const uint32_t left = (i >= pixelBytes) ? current[i - pixelBytes] : 0;
+                current[i] = uint8_t(current[i] + ((left + previous[i]) >> 1));
+            }
+            break;
+        case 4:
+            for (size_t i = 0; i < rowBytes; ++i)
+            {
+                const int32_t left = (i >= pixelBytes) ? current[i - pixelBytes] : 0;
+                const int32_t upLeft = (i >= pixelBytes) ? previous[i - pixelBytes] : 0;
+                current[i] = uint8_t(current[i] + PaethPredictor(left, previous[i], upLeft));
+            }
+            break;
+        default:
+            Fail("bad PNG filter");
+        }
+    }
+
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(size_t(width) * height * 4);
+    switch (colorType)
+    {
+    case PngGrey:       image.channels = 1; break;
+    case PngGreyAlpha:  image.channels = 2; break;
+    case PngRgb:        image.channels = 3; break;
+    default:            image.channels = 4; break;
+    }
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t* row = raw.data() + y * (rowBytes + 1) + 1;
+        uint8_t* out = image.pixels.data() + size_t(y) * width * 4;
+
+        // Sample i of the row, reduced to 8 bits (or a palette index).
+        auto sample = [row, bitDepth](size_t i) -> uint32_t
+        {
+            switch (bitDepth)
+            {
+            case 16:    return row[i * 2];
+            case 8:     return row[i];
+            default:
+            {
+                const size_t bit = i * bitDepth;
+                return (row[bit >> 3] >> (8 - bitDepth - (bit & 7))) & ((1u << bitDepth) - 1);
+            }
+            }
+        };
+
+        for (uint32_t x = 0; x < width; ++x, out += 4)
+        {
+            switch (colorType)
+            {
+            case PngGrey:
+            {
+                uint32_t grey = sample(x);
+                if (bitDepth < 8)
+                {
+                    grey = grey * 255 / ((1u << bitDepth) - 1);
+                }
+                out[0] = out[1] = out[2] = uint8_t(grey);
+                out[3] = 255;
+                break;
+            }
+            case PngGreyAlpha:
+                out[0] = out[1] = out[2] = uint8_t(sample(size_t(x) * 2));
+                out[3] = uint8_t(sample(size_t(x) * 2 + 1));
+                break;
+            case PngRgb:
+                out[0] = uint8_t(sample(size_t(x) * 3));
+                out[1] = uint8_t(sample(size_t(x) * 3 + 1));
+                out[2] = uint8_t(sample(size_t(x) * 3 + 2));
+                out[3] = 255;
+                break;
+            case PngPalette:
+            {
+                const uint32_t index = sample(x);
+                if (index >= paletteSize)
+                    Fail("PNG palette index out of range");
+                memcpy(out, palette[index], 4);
+                break;
+            }
+            default:
+                out[0] = uint8_t(sample(size_t(x) * 4));
+                out[1] = uint8_t(sample(size_t(x) * 4 + 1));
+                out[2] = uint8_t(sample(size_t(x) * 4 + 2));
+                out[3] = uint8_t(sample(size_t(x) * 4 + 3));
+                break;
+            }
+        }
+    }
+
+    // A palette without transparency is opaque RGB.
+    if (colorType == PngPalette)
+    {
+        bool opaque = true;
+        for (uint32_t i = 0; i < paletteSize; ++i)
+        {
+            opaque = opaque && palette[i][3] == 255;
+        }
+        image.channels = opaque ? 3 : 4;
+    }
+
+    return image;
+}
+
+std::vector<uint8_t> Inflate(const uint8_t* data, size_t size, size_t expectedSize)
+{
+    if (size < 2 || (data[0] & 15) != 8 || ((uint32_t(data[0]) << 8) | data[1]) % 31 != 0)
+        Fail("bad zlib header");
+    if (data[1] & 0x20)
+        Unsupported("zlib preset dictionaries are not supported");
+
+    std::vector<uint8_t> output;
+    output.reserve(expectedSize);
+    const size_t limit = expectedSize ? expectedSize : SIZE_MAX;
+
+    DeflateBits bits(data + 2, size - 2);
+    DeflateHuffman literals, distances;
+    bool last = false;
+    while (!last)
+    {
+        last = bits.Read(1) != 0;
+        const uint32_t type = bits.Read(2);
+        if (type == 0)
+        {
+            bits.AlignToByte();
+            const uint32_t length = bits.Read(16);
+            const uint32_t complement = bits.Read(16);
+            if ((length ^ 0xffff) != complement)
+                Fail("bad stored deflate block");
+            if (length > limit - output.size())
+                Fail("deflate stream longer than expected");
+            for (uint32_t i = 0; i < length; ++i)
+            {
+                output.push_back(uint8_t(bits.Read(8)));
+            }
+        }
+        else if (type == 1 || type == 2)
+        {
+            uint8_t lengths[288 + 32];
+            uint32_t literalCount, distanceCount;
+            if (type == 1)
+            {
+                literalCount = 288;
+                distanceCount = 30;
+                memset(lengths, 8, 144);
+                memset(lengths + 144, 9, 112);
+                memset(lengths + 256, 7, 24);
+                memset(lengths + 280, 8, 8);
+                memset(lengths + 288, 5, 30);
+            }
+            else
+            {
+                literalCount = bits.Read(5) + 257;
+                distanceCount = bits.Read(5) + 1;
+                const uint32_t codeLengthCount = bits.Read(4) + 4;
+                if (literalCount > 286 || distanceCount > 30)
+                    Fail("bad dynamic deflate block");
+
+                uint8_t codeLengths[19] = {};
+                for (uint32_t i = 0; i < codeLengthCount; ++i)
+                {
+                    codeLengths[CODE_LENGTH_ORDER[i]] = uint8_t(bits.Read(3));
+                }
+                DeflateHuffman codeLengthCode;
+                codeLengthCode.Build(codeLengths, 19);
+
+                for (uint32_t i = 0; i < literalCount + distanceCount;)
+                {
+                    const uint32_t symbol = codeLengthCode.Decode(bits);
+                    if (symbol < 16)
+                    {
+                        lengths[i++] = uint8_t(symbol);
+                        continue;
+                    }
+
+                    uint32_t repeat;
+                    uint8_t value = 0;
+                    if (symbol == 16)
+                    {
+                        if (i == 0)
+                            Fail("bad dynamic deflate block");
+                        value = lengths[i - 1];
+                        repeat = 3 + bits.Read(2);
+                    }
+                    else if (symbol == 17)
+                    {
+                        repeat = 3 + bits.Read(3);
+                    }
+                    else
+                    {
+                        repeat = 11 + bits.Read(7);
+                    }
+                    if (i + repeat > literalCount + distanceCount)
+                        Fail("bad dynamic deflate block");
+                    memset(lengths + i, value, repeat);
+                    i += repeat;
+                }
+            }
+
+            literals.Build(lengths, literalCount);
+            distances.Build(lengths + literalCount, distanceCount);
+
+            for (;;)
+            {
+                // Past the end every code reads as zeros, which may decode forever.
+                if (bits.Overrun())
+                    Fail("truncated deflate stream");
+
+                const uint32_t symbol = literals.Decode(bits);
+                if (symbol < 256)
+                {
+                    if (output.size() == limit)
+                        Fail("deflate stream longer than expected");
+                    output.push_back(uint8_t(symbol));
+                    continue;
+                }
+                if (symbol == 256)
+                    break;
+                if (symbol > 285)
+                    Fail("bad deflate length");
+
+                const uint32_t length = LENGTH_BASE[symbol - 257] + bits.Read(LENGTH_EXTRA[symbol - 257]);
+                const uint32_t distanceSymbol = distances.Decode(bits);
+                if (distanceSymbol >= 30)
+                    Fail("bad deflate distance");
+                const uint32_t distance = DISTANCE_BASE[distanceSymbol] + bits.Read(DISTANCE_EXTRA[distanceSymbol]);
+                if (distance > output.size())
+                    Fail("deflate distance before the start");
+                if (length > limit - output.size())
+                    Fail("deflate stream longer than expected");
+
+                // Byte by byte, as the copy may overlap what it produces.
+                size_t from = output.size() - distance;
+                for (uint32_t i = 0; i < length; ++i)
+                {
+                    output.push_back(output[from + i]);
+                }
+            }
+        }
+        else
+        {
+            Fail("bad deflate block type");
+        }
+
+        if (bits.Overrun())
+            Fail("truncated deflate stream");
+    }
+
+    return output;
+}
@@ -0,0 +1,46 @@
+//
+// ImageDecoder.h - JPEG and PNG decoding without WIC, for the offline tools
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Pixels are always RGBA8. channels says what the file held, so grey sources can be
+// cooked to one channel formats and opaque ones without alpha.
+struct Image
+{
+    uint32_t                width;
+    uint32_t                height;
+    uint32_t                channels;       // 1 grey, 2 grey and alpha, 3 RGB, 4 RGBA
+    std::vector<uint8_t>    pixels;         // Rows top down, width * 4 bytes each
+};
+
+// A well formed file the decoder leaves out. Callers may fall back to the source file,
+// which they must not do for a corrupt one.
+class UnsupportedImageError : public std::runtime_error
+{
+public:
+    explicit UnsupportedImageError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Covers what the content uses: sequential Huffman JPEGs with one or three components
+// (any sampling factors, restart intervals, multiple scans), and non-interlaced PNGs of
+// every colour type and bit depth. Throws UnsupportedImageError for a file that uses
+// anything else, e.g. progressive JPEGs, and std::runtime_error for a corrupt one.
+Image DecodeImage(const uint8_t* data, size_t size);
+Image DecodeJpeg(const uint8_t* data, size_t size);
+Image DecodePng(const uint8_t* data, size_t size);
+
+bool IsJpeg(const uint8_t* data, size_t size);
+bool IsPng(const uint8_t* data, size_t size);
+
+// Decompresses a zlib stream (RFC 1950 around RFC 1951). A non-zero expectedSize is
+// what the caller knows the stream decodes to: it is allocated up front and a stream
+// that would decode to more is malformed. Throws std::runtime_error on a malformed
+// stream, as soon as it reads past the end of the data.
+std::vector<uint8_t> Inflate(const uint8_t* data, size_t size, size_t expectedSize = 0);
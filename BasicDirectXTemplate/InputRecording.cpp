@@ -0,0 +1,156 @@
+//
+// InputRecording.cpp
+//
+
+#include "InputRecording.h"
+
+#include "StepTimer.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    const char FILE_MAGIC[4] = { 'S', 'I', 'M', 'I' };
+    const uint32_t FILE_VERSION = 1;
+
+    struct FileHeader
+    {
+        char        magic[4];
+        uint32_t    version;
+        uint64_t    ticksPerSecond;
+        uint64_t    runCount;
+    };
+
+    struct FileRun
+    {
+        uint32_t    count;
+        uint32_t    elapsedTicks;
+        uint32_t    keys;
+        int32_t     mouseX;
+        int32_t     mouseY;
+        uint8_t     mouseRelative;
+        uint8_t     leftButton;
+        uint16_t    reserved;
+    };
+
+    static_assert(sizeof(FileHeader) == 24, "Recording header layout changed");
+    static_assert(sizeof(FileRun) == 24, "Recording run layout changed");
+
+    bool SameInput(const SimulationInput& a, const SimulationInput& b)
+    {
+        return a.keys == b.keys
+            && a.mouseX == b.mouseX
+            && a.mouseY == b.mouseY
+            && a.mouseRelative == b.mouseRelative
+            && a.leftButton == b.leftButton;
+    }
+}
+
+void InputRecording::Append(uint64_t elapsedTicks, const SimulationInput& input)
+{
+    // StepTimer clamps an update to a tenth of a second, well inside 32 bits of ticks.
+    const uint32_t ticks = static_cast<uint32_t>(elapsedTicks);
+
+    if (!m_runs.empty())
+    {
+        Run& last = m_runs.back();
+        if (last.elapsedTicks == ticks && last.count < UINT32_MAX && SameInput(last.input, input))
+        {
+            ++last.count;
+            ++m_updateCount;
+            return;
+        }
+    }
+
+    m_runs.push_back({ 1, ticks, input });
+    ++m_updateCount;
+}
+
+bool InputRecording::Save(const char* path) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    FileHeader header = {};
+    memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.ticksPerSecond = DX::StepTimer::TicksPerSecond;
+    header.runCount = m_runs.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (const Run& run : m_runs)
+    {
+        FileRun record = {};
+        record.count = run.count;
+        record.elapsedTicks = run.elapsedTicks;
+        record.keys = run.input.keys;
+        record.mouseX = run.input.mouseX;
+        record.mouseY = run.input.mouseY;
+        record.mouseRelative = run.input.mouseRelative ? 1 : 0;
+        record.leftButton = run.input.leftButton ? 1 : 0;
+        file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+
+    return file.good();
+}
+
+bool InputRecording::Load(const char* path)
+{
+    Clear();
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+
+    FileHeader header = {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0
+        || header.version != FILE_VERSION
+        || header.ticksPerSecond != DX::StepTimer::TicksPerSecond)
+    {
+        return false;
+    }
+
+    std::vector<Run> runs;
+    uint64_t updateCount = 0;
+    for (uint64_t i = 0; i < header.runCount; ++i)
+    {
+        FileRun record;
+        if (!file.read(reinterpret_cast<char*>(&record), sizeof(record)) || record.count == 0)
+            return false;
+
+        Run run = {};
+        run.count = record.count;
+        run.elapsedTicks = record.elapsedTicks;
+        run.input.keys = record.keys;
+        run.input.mouseX = record.mouseX;
+        run.input.mouseY = record.mouseY;
+        run.input.mouseRelative = record.mouseRelative != 0;
+        run.input.leftButton = record.leftButton != 0;
+        runs.push_back(run);
+        updateCount += record.count;
+    }
+
+    m_runs.swap(runs);
+    m_updateCount = updateCount;
+    return true;
+}
+
+bool InputPlayback::Next(uint64_t& elapsedTicks, SimulationInput& input)
+{
+    if (IsFinished())
+        return false;
+
+    const InputRecording::Run& run = m_recording->m_runs[m_run];
+    elapsedTicks = run.elapsedTicks;
+    input = run.input;
+
+    if (++m_repeat >= run.count)
+    {
+        m_repeat = 0;
+        ++m_run;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+//
+// InputRecording.h - Per-update simulation input, saved to disk for deterministic replay
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Simulation.h"
+
+// The input and elapsed time (in StepTimer ticks) of every Simulation::Update in a run.
+// Feeding them back to a freshly reset Simulation reproduces the run exactly, so the
+// game and the headless runner can fly the same camera path before and after a change.
+//
+// Consecutive updates with the same input and elapsed time are stored as one run, so a
+// fixed timestep recording of held keys takes a few bytes a second.
+class InputRecording
+{
+public:
+    InputRecording() noexcept {}
+
+    void Clear()                                        { m_runs.clear(); m_updateCount = 0; }
+
+    void Append(uint64_t elapsedTicks, const SimulationInput& input);
+
+    uint64_t GetUpdateCount() const                     { return m_updateCount; }
+    bool IsEmpty() const                                { return m_updateCount == 0; }
+
+    // Binary file: a header then one 24 byte record per run, little endian. Load rejects
+    // files from another version or tick rate and leaves the recording empty.
+    bool Save(const char* path) const;
+    bool Load(const char* path);
+
+private:
+    friend class InputPlayback;
+
+    struct Run
+    {
+        uint32_t        count;
+        uint32_t        elapsedTicks;
+        SimulationInput input;
+    };
+
+    std::vector<Run>    m_runs;
+    uint64_t            m_updateCount = 0;
+};
+
+// Steps through a recording one update at a time. The recording must outlive it.
+class InputPlayback
+{
+public:
+    InputPlayback() noexcept :
+        m_recording(nullptr),
+        m_run(0),
+        m_repeat(0)
+    {
+    }
+
+    explicit InputPlayback(const InputRecording& recording) noexcept :
+        m_recording(&recording),
+        m_run(0),
+        m_repeat(0)
+    {
+    }
+
+    // Returns false, leaving the arguments alone, once every update has been played.
+    bool Next(uint64_t& elapsedTicks, SimulationInput& input);
+
+    bool IsFinished() const                             { return !m_recording || m_run >= m_recording->m_runs.size(); }
+
+private:
+    const InputRecording*   m_recording;
+    size_t                  m_run;
+    uint32_t                m_repeat;
+};
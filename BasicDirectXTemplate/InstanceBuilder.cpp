@@ -0,0 +1,63 @@
+//
+// InstanceBuilder.cpp
+//
+
+#include "InstanceBuilder.h"
+
+#include <cstring>
+
+using namespace DirectX;
+
+void InstanceBuilder::Reset(uint32_t materialCount)
+{
+    m_materials.resize(materialCount);
+    for (auto& instances : m_materials)
+    {
+        instances.clear();
+    }
+}
+
+void XM_CALLCONV InstanceBuilder::Add(uint32_t material, FXMMATRIX world, FXMVECTOR tint,
+    FXMVECTOR lightDirection, uint32_t slice)
+{
+    m_materials[material].emplace_back();
+    SphereInstance& instance = m_materials[material].back();
+
+    // The last column of an affine world matrix is (0,0,0,1), so three rows of the
+    // transpose are enough for the shader to rebuild it.
+    XMMATRIX transposed = XMMatrixTranspose(world);
+    XMStoreFloat4(&instance.world[0], transposed.r[0]);
+    XMStoreFloat4(&instance.world[1], transposed.r[1]);
+    XMStoreFloat4(&instance.world[2], transposed.r[2]);
+    XMStoreFloat4(&instance.tint, tint);
+    XMStoreFloat3(&instance.lightDirection, lightDirection);
+    instance.slice = slice;
+}
+
+size_t InstanceBuilder::GetInstanceCount() const
+{
+    size_t count = 0;
+    for (auto& instances : m_materials)
+    {
+        count += instances.size();
+    }
+    return count;
+}
+
+void InstanceBuilder::CopyTo(SphereInstance* destination, Range* ranges) const
+{
+    uint32_t first = 0;
+    for (size_t material = 0; material < m_materials.size(); ++material)
+    {
+        auto& instances = m_materials[material];
+        const uint32_t count = static_cast<uint32_t>(instances.size());
+        if (count > 0)
+        {
+            memcpy(destination + first, instances.data(), count * sizeof(SphereInstance));
+        }
+
+        ranges[material].first = first;
+        ranges[material].count = count;
+        first += count;
+    }
+}
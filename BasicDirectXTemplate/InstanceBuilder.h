@@ -0,0 +1,53 @@
+//
+// InstanceBuilder.h - Collects per-instance data for instanced sphere draws, grouped by material
+//
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// One instance as the instanced sphere vertex shader reads it (InstancedSphere.hlsli).
+struct SphereInstance
+{
+    DirectX::XMFLOAT4   world[3];           // Rows of the transposed world matrix (4x3)
+    DirectX::XMFLOAT4   tint;               // rgb scales the diffuse light, a is alpha
+    DirectX::XMFLOAT3   lightDirection;
+    uint32_t            slice;              // Texture array slice
+};
+
+static_assert(sizeof(SphereInstance) == 80, "SphereInstance must match the input layout");
+
+// Instances are appended per material each frame, then copied into one vertex buffer
+// with every material's instances contiguous, so each material is a single draw.
+class InstanceBuilder
+{
+public:
+    struct Range
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    InstanceBuilder() noexcept {}
+
+    // Starts a new frame. Capacity is kept, so steady state building does not allocate.
+    void Reset(uint32_t materialCount);
+
+    void XM_CALLCONV Add(uint32_t material, DirectX::FXMMATRIX world, DirectX::FXMVECTOR tint,
+        DirectX::FXMVECTOR lightDirection, uint32_t slice);
+
+    uint32_t GetMaterialCount() const                   { return static_cast<uint32_t>(m_materials.size()); }
+    size_t GetInstanceCount() const;
+
+    const std::vector<SphereInstance>& GetInstances(uint32_t material) const { return m_materials[material]; }
+
+    // Writes every instance to destination (GetInstanceCount() entries), material by
+    // material, and fills ranges[GetMaterialCount()] with where each one landed.
+    void CopyTo(SphereInstance* destination, Range* ranges) const;
+
+private:
+    std::vector<std::vector<SphereInstance>> m_materials;
+};
@@ -0,0 +1,29 @@
+cbuffer InstancedSphereParameters : register(b0)
+{
+    float4x4 ViewProjection;
+}
+
+struct VSInput
+{
+    float3 position : SV_Position;
+    float3 normal : NORMAL;
+    float2 texCoord : TEXCOORD0;
+
+    // Per instance
+    float4 world0 : WORLD0;
+    float4 world1 : WORLD1;
+    float4 world2 : WORLD2;
+    float4 tint : COLOR0;
+    float3 lightDirection : LIGHTDIRECTION;
+    uint slice : SLICE;
+};
+
+struct PSInput
+{
+    float4 position : SV_Position;
+    float3 normal : NORMAL;
+    float2 texCoord : TEXCOORD0;
+    float4 tint : COLOR0;
+    float3 lightDirection : LIGHTDIRECTION;
+    nointerpolation uint slice : SLICE;
+};
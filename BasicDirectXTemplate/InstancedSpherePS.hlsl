@@ -0,0 +1,15 @@
+Texture2DArray<float4> Texture : register(t0);
+sampler TextureSampler : register(s0);
+
+#include "InstancedSphere.hlsli"
+
+float4 main(PSInput input) : SV_Target0
+{
+    // One directional light, lit per pixel like BasicEffect (which does not normalize
+    // the light direction either).
+    float3 normal = normalize(input.normal);
+    float3 diffuse = saturate(dot(normal, -input.lightDirection)) * input.tint.rgb;
+
+    float4 c = Texture.Sample(TextureSampler, float3(input.texCoord, input.slice));
+    return c * float4(diffuse, input.tint.a);
+}
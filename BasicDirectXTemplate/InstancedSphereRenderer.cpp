@@ -0,0 +1,258 @@
+//
+// InstancedSphereRenderer.cpp
+//
+
+#include "pch.h"
+#include "InstancedSphereRenderer.h"
+
+#include "MappedFile.h"
+
+using namespace DirectX;
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    const float SPHERE_DIAMETER = 1.f;
+    const size_t SPHERE_TESSELLATION = 16;
+
+    const size_t MIN_INSTANCE_CAPACITY = 1024;
+
+    struct InstancedSphereParameters
+    {
+        XMFLOAT4X4 viewProjection;
+    };
+
+    // Slot 0 is the sphere mesh, slot 1 the SphereInstance stream.
+    const D3D11_INPUT_ELEMENT_DESC c_inputElements[] =
+    {
+        { "SV_Position",    0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA,   0 },
+        { "NORMAL",         0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA,   0 },
+        { "TEXCOORD",       0, DXGI_FORMAT_R32G32_FLOAT,       0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA,   0 },
+        { "WORLD",          0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "WORLD",          1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "WORLD",          2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "COLOR",          0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "LIGHTDIRECTION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "SLICE",          0, DXGI_FORMAT_R32_UINT,           1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+    };
+}
+
+InstancedSphereRenderer::InstancedSphereRenderer(ID3D11Device* device) noexcept(false) :
+    m_device(device),
+    m_indexCount(0),
+    m_instanceCapacity(0)
+{
+    std::vector<GeometricPrimitive::VertexType> vertices;
+    std::vector<uint16_t> indices;
+    GeometricPrimitive::CreateSphere(vertices, indices, SPHERE_DIAMETER, SPHERE_TESSELLATION);
+    m_indexCount = static_cast<UINT>(indices.size());
+
+    {
+        CD3D11_BUFFER_DESC desc(static_cast<UINT>(vertices.size() * sizeof(GeometricPrimitive::VertexType)),
+            D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+        D3D11_SUBRESOURCE_DATA initData = { vertices.data(), 0, 0 };
+        DX::ThrowIfFailed(device->CreateBuffer(&desc, &initData, m_vertexBuffer.ReleaseAndGetAddressOf()));
+    }
+
+    {
+        CD3D11_BUFFER_DESC desc(static_cast<UINT>(indices.size() * sizeof(uint16_t)),
+            D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+        D3D11_SUBRESOURCE_DATA initData = { indices.data(), 0, 0 };
+        DX::ThrowIfFailed(device->CreateBuffer(&desc, &initData, m_indexBuffer.ReleaseAndGetAddressOf()));
+    }
+
+    auto blob = DX::MapData("InstancedSphereVS.cso");
+    DX::ThrowIfFailed(device->CreateVertexShader(blob.data(), blob.size(),
+        nullptr, m_vertexShader.ReleaseAndGetAddressOf()));
+    DX::ThrowIfFailed(device->CreateInputLayout(c_inputElements, _countof(c_inputElements),
+        blob.data(), blob.size(), m_inputLayout.ReleaseAndGetAddressOf()));
+
+    blob = DX::MapData("InstancedSpherePS.cso");
+    DX::ThrowIfFailed(device->CreatePixelShader(blob.data(), blob.size(),
+        nullptr, m_pixelShader.ReleaseAndGetAddressOf()));
+
+    CD3D11_BUFFER_DESC cbDesc(sizeof(InstancedSphereParameters), D3D11_BIND_CONSTANT_BUFFER);
+    DX::ThrowIfFailed(device->CreateBuffer(&cbDesc, nullptr, m_parameters.ReleaseAndGetAddressOf()));
+}
+
+uint32_t InstancedSphereRenderer::AddMaterial(ID3D11ShaderResourceView* textureArray)
+{
+    m_materials.emplace_back(textureArray);
+    return static_cast<uint32_t>(m_materials.size() - 1);
+}
+
+void InstancedSphereRenderer::SetMaterialTexture(uint32_t material, ID3D11ShaderResourceView* textureArray)
+{
+    m_materials[material] = textureArray;
+}
+
+void InstancedSphereRenderer::EnsureInstanceCapacity(size_t count)
+{
+    if (count <= m_instanceCapacity)
+        return;
+
+    // Grow geometrically so a slowly growing scene does not recreate the buffer every frame.
+    m_instanceCapacity = std::max(std::max(count, m_instanceCapacity * 2), MIN_INSTANCE_CAPACITY);
+
+    CD3D11_BUFFER_DESC desc(static_cast<UINT>(m_instanceCapacity * sizeof(SphereInstance)),
+        D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+    DX::ThrowIfFailed(m_device->CreateBuffer(&desc, nullptr, m_instanceBuffer.ReleaseAndGetAddressOf()));
+}
+
+void XM_CALLCONV InstancedSphereRenderer::Draw(ID3D11DeviceContext* context, const CommonStates& states,
+    const InstanceBuilder& instances, FXMMATRIX view, CXMMATRIX projection)
+{
+    Upload(context, instances, view, projection);
+
+    for (uint32_t material = 0; material < m_ranges.size(); ++material)
+    {
+        DrawMaterial(context, states, material);
+    }
+}
+
+void XM_CALLCONV InstancedSphereRenderer::Upload(ID3D11DeviceContext* context, const InstanceBuilder& instances,
+    FXMMATRIX view, CXMMATRIX projection)
+{
+    if (instances.GetMaterialCount() > m_materials.size())
+    {
+        throw std::out_of_range("InstancedSphereRenderer: instance material was never added");
+    }
+
+    m_ranges.resize(instances.GetMaterialCount());
+
+    const size_t count = instances.GetInstanceCount();
+    if (count == 0)
+    {
+        std::fill(m_ranges.begin(), m_ranges.end(), InstanceBuilder::Range{ 0, 0 });
+        return;
+    }
+
+    EnsureInstanceCapacity(count);
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    DX::ThrowIfFailed(context->Map(m_instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+    instances.CopyTo(static_cast<SphereInstance*>(mapped.pData), m_ranges.data());
+    context->Unmap(m_instanceBuffer.Get(), 0);
+
+    InstancedSphereParameters parameters;
+    XMStoreFloat4x4(&parameters.viewProjection, XMMatrixTranspose(XMMatrixMultiply(view, projection)));
+    context->UpdateSubresource(m_parameters.Get(), 0, nullptr, &parameters, 0, 0);
+}
+
+void InstancedSphereRenderer::DrawMaterial(ID3D11DeviceContext* context, const CommonStates& states, uint32_t material)
+{
+    if (material >= m_ranges.size() || m_ranges[material].count == 0)
+        return;
+
+    ApplyState(context, states);
+
+    const InstanceBuilder::Range& range = m_ranges[material];
+    context->PSSetShaderResources(0, 1, m_materials[material].GetAddressOf());
+    context->DrawIndexedInstanced(m_indexCount, range.count, 0, 0, range.first);
+
+    // Don't leave the instance stream bound for draws that only expect slot 0.
+    ID3D11Buffer* nullBuffer = nullptr;
+    const UINT zero = 0;
+    context->IASetVertexBuffers(1, 1, &nullBuffer, &zero, &zero);
+}
+
+void InstancedSphereRenderer::ApplyState(ID3D11DeviceContext* context, const CommonStates& states)
+{
+    ID3D11Buffer* vertexBuffers[] = { m_vertexBuffer.Get(), m_instanceBuffer.Get() };
+    const UINT strides[] = { sizeof(GeometricPrimitive::VertexType), sizeof(SphereInstance) };
+    const UINT offsets[] = { 0, 0 };
+    context->IASetVertexBuffers(0, 2, vertexBuffers, strides, offsets);
+    context->IASetIndexBuffer(m_indexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
+    context->IASetInputLayout(m_inputLayout.Get());
+    context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+    context->VSSetConstantBuffers(0, 1, m_parameters.GetAddressOf());
+    context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
+
+    // The same state GeometricPrimitive::Draw sets for a right handed, opaque mesh.
+    ID3D11SamplerState* sampler = states.LinearWrap();
+    context->PSSetSamplers(0, 1, &sampler);
+    context->OMSetBlendState(states.Opaque(), nullptr, 0xFFFFFFFF);
+    context->OMSetDepthStencilState(states.DepthDefault(), 0);
+    context->RSSetState(states.CullCounterClockwise());
+}
+
+void InstancedSphereRenderer::LoadTextureArray(ID3D11Device* device, ID3D11DeviceContext* context,
+    const wchar_t* const* files, size_t count, ID3D11ShaderResourceView** textureArray)
+{
+    std::vector<ComPtr<ID3D11Texture2D>> slices;
+    LoadTextureSlices(device, files, count, slices);
+    CreateTextureArray(device, context, slices, textureArray);
+}
+
+void InstancedSphereRenderer::LoadTextureSlices(ID3D11Device* device, const wchar_t* const* files, size_t count,
+    std::vector<ComPtr<ID3D11Texture2D>>& slices)
+{
+    if (count == 0)
+    {
+        throw std::invalid_argument("InstancedSphereRenderer: empty texture array");
+    }
+
+    // Without a context the WIC loader only fills the top mip; the array gets the rest.
+    slices.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        ComPtr<ID3D11Resource> resource;
+        DX::ThrowIfFailed(CreateWICTextureFromFile(device, files[i], resource.GetAddressOf(), nullptr));
+        DX::ThrowIfFailed(resource.As(&slices[i]));
+    }
+}
+
+void InstancedSphereRenderer::CreateTextureArray(ID3D11Device* device, ID3D11DeviceContext* context,
+    const std::vector<ComPtr<ID3D11Texture2D>>& slices, ID3D11ShaderResourceView** textureArray)
+{
+    if (slices.empty())
+    {
+        throw std::invalid_argument("InstancedSphereRenderer: empty texture array");
+    }
+
+    D3D11_TEXTURE2D_DESC desc;
+    slices[0]->GetDesc(&desc);
+    for (size_t i = 1; i < slices.size(); ++i)
+    {
+        D3D11_TEXTURE2D_DESC sliceDesc;
+        slices[i]->GetDesc(&sliceDesc);
+        if (sliceDesc.Width != desc.Width || sliceDesc.Height != desc.Height || sliceDesc.Format != desc.Format)
+        {
+            throw std::runtime_error("InstancedSphereRenderer: texture array slices differ in size or format");
+        }
+    }
+
+    // A full mip chain, generated on the GPU, where the format allows it.
+    UINT formatSupport = 0;
+    const bool generateMips = SUCCEEDED(device->CheckFormatSupport(desc.Format, &formatSupport))
+        && (formatSupport & D3D11_FORMAT_SUPPORT_MIP_AUTOGEN);
+
+    desc.MipLevels = generateMips ? 0 : 1;
+    desc.ArraySize = static_cast<UINT>(slices.size());
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | (generateMips ? D3D11_BIND_RENDER_TARGET : 0);
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = generateMips ? D3D11_RESOURCE_MISC_GENERATE_MIPS : 0;
+
+    ComPtr<ID3D11Texture2D> array;
+    DX::ThrowIfFailed(device->CreateTexture2D(&desc, nullptr, array.GetAddressOf()));
+    array->GetDesc(&desc);
+
+    for (UINT slice = 0; slice < desc.ArraySize; ++slice)
+    {
+        context->CopySubresourceRegion(array.Get(), D3D11CalcSubresource(0, slice, desc.MipLevels),
+            0, 0, 0, slices[slice].Get(), 0, nullptr);
+    }
+
+    CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc(D3D11_SRV_DIMENSION_TEXTURE2DARRAY, desc.Format,
+        0, desc.MipLevels, 0, desc.ArraySize);
+    DX::ThrowIfFailed(device->CreateShaderResourceView(array.Get(), &srvDesc, textureArray));
+
+    if (generateMips)
+    {
+        context->GenerateMips(*textureArray);
+    }
+}
@@ -0,0 +1,66 @@
+//
+// InstancedSphereRenderer.h - Draws every sphere of a material with one DrawIndexedInstanced
+//
+
+#pragma once
+
+#include "InstanceBuilder.h"
+
+// Owns the unit diameter sphere mesh (as GeometricPrimitive::CreateSphere builds it),
+// the shaders and a dynamic instance buffer. Each material is a texture array; instances
+// pick a slice.
+class InstancedSphereRenderer
+{
+public:
+    InstancedSphereRenderer(ID3D11Device* device) noexcept(false);
+
+    InstancedSphereRenderer(InstancedSphereRenderer const&) = delete;
+    InstancedSphereRenderer& operator= (InstancedSphereRenderer const&) = delete;
+
+    // Returns the material index to pass to InstanceBuilder::Add.
+    uint32_t AddMaterial(ID3D11ShaderResourceView* textureArray);
+    void SetMaterialTexture(uint32_t material, ID3D11ShaderResourceView* textureArray);
+    uint32_t GetMaterialCount() const                   { return static_cast<uint32_t>(m_materials.size()); }
+
+    // Uploads the instances and issues one draw per material that has any.
+    void XM_CALLCONV Draw(ID3D11DeviceContext* context, const DirectX::CommonStates& states,
+        const InstanceBuilder& instances, DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection);
+
+    // The two halves of Draw, for callers that order materials themselves (e.g. through
+    // a RenderQueue). Upload once per frame, then draw each material.
+    void XM_CALLCONV Upload(ID3D11DeviceContext* context, const InstanceBuilder& instances,
+        DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection);
+    void DrawMaterial(ID3D11DeviceContext* context, const DirectX::CommonStates& states, uint32_t material);
+
+    // Loads same sized images into one texture array, one slice per file, with mips.
+    static void LoadTextureArray(ID3D11Device* device, ID3D11DeviceContext* context,
+        const wchar_t* const* files, size_t count, ID3D11ShaderResourceView** textureArray);
+
+    // The two halves of LoadTextureArray. LoadTextureSlices only uses the device, so it
+    // can run on a worker thread; CreateTextureArray copies the slices into the array and
+    // generates its mips on the context.
+    static void LoadTextureSlices(ID3D11Device* device, const wchar_t* const* files, size_t count,
+        std::vector<Microsoft::WRL::ComPtr<ID3D11Texture2D>>& slices);
+    static void CreateTextureArray(ID3D11Device* device, ID3D11DeviceContext* context,
+        const std::vector<Microsoft::WRL::ComPtr<ID3D11Texture2D>>& slices, ID3D11ShaderResourceView** textureArray);
+
+private:
+    void EnsureInstanceCapacity(size_t count);
+    void ApplyState(ID3D11DeviceContext* context, const DirectX::CommonStates& states);
+
+    Microsoft::WRL::ComPtr<ID3D11Device>                m_device;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_vertexBuffer;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_indexBuffer;
+    UINT                                                m_indexCount;
+
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_instanceBuffer;
+    size_t                                              m_instanceCapacity;
+
+    Microsoft::WRL::ComPtr<ID3D11VertexShader>          m_vertexShader;
+    Microsoft::WRL::ComPtr<ID3D11PixelShader>           m_pixelShader;
+    Microsoft::WRL::ComPtr<ID3D11InputLayout>           m_inputLayout;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_parameters;
+
+    std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> m_materials;
+    std::vector<InstanceBuilder::Range>                 m_ranges;
+};
@@ -0,0 +1,19 @@
+#include "InstancedSphere.hlsli"
+
+PSInput main(VSInput input)
+{
+    float4 position = float4(input.position, 1);
+    float3 world = float3(dot(input.world0, position), dot(input.world1, position), dot(input.world2, position));
+
+    // Sphere instances are uniformly scaled, so the world matrix transforms normals too.
+    float3 normal = float3(dot(input.world0.xyz, input.normal), dot(input.world1.xyz, input.normal), dot(input.world2.xyz, input.normal));
+
+    PSInput output;
+    output.position = mul(float4(world, 1), ViewProjection);
+    output.normal = normal;
+    output.texCoord = input.texCoord;
+    output.tint = input.tint;
+    output.lightDirection = input.lightDirection;
+    output.slice = input.slice;
+    return output;
+}
@@ -0,0 +1,340 @@
+//
+// JobSystem.cpp
+//
+
+#include "JobSystem.h"
+
+#include <stdexcept>
+
+using namespace DX;
+
+namespace
+{
+    // Job storage for the calling thread, shared by every JobSystem it uses.
+    struct JobRing
+    {
+        std::unique_ptr<JobSystem::Job[]>   jobs;
+        uint32_t                            next = 0;
+    };
+
+    thread_local JobRing t_jobRing;
+
+    // Which system (if any) the calling thread belongs to, and its queue index.
+    thread_local JobSystem* t_system = nullptr;
+    thread_local uint32_t t_thread = 0;
+
+    // Idle workers spin this many times before going to sleep.
+    const uint32_t c_idleSpins = 64;
+}
+
+JobSystem::WorkQueue::WorkQueue() noexcept :
+    m_top(0),
+    m_bottom(0)
+{
+}
+
+bool JobSystem::WorkQueue::Push(Job* job)
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_acquire);
+    if (bottom - top >= Capacity)
+        return false;
+
+    m_jobs[bottom & (Capacity - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+JobSystem::Job* JobSystem::WorkQueue::Pop()
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // Empty
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = m_jobs[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+        // Last job; race any thief for it.
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            job = nullptr;
+        }
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+JobSystem::Job* JobSystem::WorkQueue::Steal()
+{
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom)
+        return nullptr;
+
+    Job* job = m_jobs[top & (Capacity - 1)].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+
+    return job;
+}
+
+JobSystem::JobSystem(uint32_t workerThreads) noexcept(false) :
+    m_running(true),
+    m_externalCount(0),
+    m_queued(0),
+    m_sleeping(0)
+{
+    if (workerThreads == ~0u)
+    {
+        workerThreads = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    }
+
+    for (uint32_t i = 0; i <= workerThreads; ++i)
+    {
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    t_system = this;
+    t_thread = 0;
+
+    for (uint32_t i = 1; i <= workerThreads; ++i)
+    {
+        m_threads.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+
+    if (t_system == this)
+    {
+        t_system = nullptr;
+    }
+}
+
+uint32_t JobSystem::GetCurrentThread() const
+{
+    return t_system == this ? t_thread : c_externalThread;
+}
+
+JobSystem::Job* JobSystem::AllocateJob(Job* parent)
+{
+    JobRing& ring = t_jobRing;
+    if (!ring.jobs)
+    {
+        ring.jobs.reset(new Job[MaxJobsPerThread]);
+        for (uint32_t i = 0; i < MaxJobsPerThread; ++i)
+        {
+            ring.jobs[i].unfinished.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Job* job = &ring.jobs[ring.next++ & (MaxJobsPerThread - 1)];
+
+    // The ring has wrapped onto a job that is still in flight; help it finish.
+    if (!IsFinished(job))
+    {
+        Wait(job);
+    }
+
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    job->blockers.store(1, std::memory_order_relaxed);
+    job->continuationCount.store(0, std::memory_order_relaxed);
+
+    if (parent)
+    {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+void JobSystem::AddDependency(Job* job, Job* dependency)
+{
+    uint32_t index = dependency->continuationCount.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MaxContinuations)
+    {
+        throw std::runtime_error("JobSystem: too many continuations");
+    }
+
+    job->blockers.fetch_add(1, std::memory_order_relaxed);
+    dependency->continuations[index] = job;
+}
+
+void JobSystem::Run(Job* job)
+{
+    if (job->blockers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        Push(job);
+    }
+}
+
+void JobSystem::Push(Job* job)
+{
+    m_queued.fetch_add(1);
+
+    uint32_t thread = GetCurrentThread();
+    if (thread == c_externalThread)
+    {
+        std::lock_guard<std::mutex> lock(m_externalMutex);
+        m_external.push_back(job);
+        m_externalCount.fetch_add(1, std::memory_order_release);
+    }
+    else if (!m_queues[thread]->Push(job))
+    {
+        // Queue full; run it now rather than fail.
+        m_queued.fetch_sub(1);
+        Execute(job);
+        return;
+    }
+
+    if (m_sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_one();
+    }
+}
+
+JobSystem::Job* JobSystem::FindJob(uint32_t thread)
+{
+    Job* job = nullptr;
+
+    if (thread != c_externalThread)
+    {
+        job = m_queues[thread]->Pop();
+    }
+
+    if (!job && m_externalCount.load(std::memory_order_acquire) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_externalMutex);
+        if (!m_external.empty())
+        {
+            job = m_external.front();
+            m_external.pop_front();
+            m_externalCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!job)
+    {
+        // Steal, starting with the next thread along so thieves spread out.
+        const uint32_t count = GetThreadCount();
+        const uint32_t start = thread == c_externalThread ? 0 : thread + 1;
+        for (uint32_t i = 0; i < count && !job; ++i)
+        {
+            uint32_t victim = (start + i) % count;
+            if (victim != thread)
+            {
+                job = m_queues[victim]->Steal();
+            }
+        }
+    }
+
+    if (job)
+    {
+        m_queued.fetch_sub(1);
+    }
+
+    return job;
+}
+
+void JobSystem::Execute(Job* job)
+{
+    job->execute(job);
+    Finish(job);
+}
+
+void JobSystem::Finish(Job* job)
+{
+    // Once the count reaches zero a waiter may return and the slot may be recycled, so
+    // take everything needed from the job first.
+    Job* parent = job->parent;
+    Job* continuations[MaxContinuations];
+    // std::min takes references; a copy keeps MaxContinuations from needing a definition.
+    const uint32_t continuationCount = std::min(job->continuationCount.load(std::memory_order_relaxed),
+        uint32_t(MaxContinuations));
+    for (uint32_t i = 0; i < continuationCount; ++i)
+    {
+        continuations[i] = job->continuations[i];
+    }
+
+    if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    for (uint32_t i = 0; i < continuationCount; ++i)
+    {
+        Run(continuations[i]);
+    }
+
+    if (parent)
+    {
+        Finish(parent);
+    }
+}
+
+void JobSystem::Wait(const Job* job)
+{
+    const uint32_t thread = GetCurrentThread();
+    while (!IsFinished(job))
+    {
+        if (Job* next = FindJob(thread))
+        {
+            Execute(next);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::WorkerLoop(uint32_t thread)
+{
+    t_system = this;
+    t_thread = thread;
+
+    uint32_t idle = 0;
+    while (m_running.load(std::memory_order_acquire))
+    {
+        if (Job* job = FindJob(thread))
+        {
+            Execute(job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < c_idleSpins)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleeping.fetch_add(1);
+        m_wake.wait(lock, [this]() { return m_queued.load() > 0 || !m_running.load(); });
+        m_sleeping.fetch_sub(1);
+        idle = 0;
+    }
+}
@@ -0,0 +1,166 @@
+//
+// JobSystem.h - Work-stealing job scheduler built on std::thread
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace DX
+{
+    // Each thread that runs jobs owns a deque: it pushes and pops at the bottom while idle
+    // threads steal from the top. The thread that creates the JobSystem is thread 0 and
+    // takes part whenever it waits. Other threads (e.g. the simulation thread) may also
+    // create, run and wait on jobs; their jobs go through a shared queue.
+    //
+    // Jobs are allocated from a per-thread ring of MaxJobsPerThread entries, so a Job*
+    // stays valid until the creating thread has created that many more jobs.
+    class JobSystem
+    {
+    public:
+        static const uint32_t MaxJobsPerThread = 4096;
+        static const uint32_t MaxContinuations = 8;
+        static const size_t StorageSize = 64;
+
+        struct Job
+        {
+            void                    (*execute)(Job*);
+            Job*                    parent;
+            std::atomic<int32_t>    unfinished;         // This job plus unfinished children
+            std::atomic<int32_t>    blockers;           // Unfinished dependencies plus one until Run
+            std::atomic<uint32_t>   continuationCount;
+            Job*                    continuations[MaxContinuations];
+            alignas(16) unsigned char storage[StorageSize];
+        };
+
+        // workerThreads == ~0u uses one worker per hardware thread beyond the calling thread.
+        explicit JobSystem(uint32_t workerThreads = ~0u) noexcept(false);
+        ~JobSystem();
+
+        JobSystem(JobSystem const&) = delete;
+        JobSystem& operator= (JobSystem const&) = delete;
+
+        // Number of threads executing jobs, including the creating thread.
+        uint32_t GetThreadCount() const                     { return static_cast<uint32_t>(m_queues.size()); }
+
+        // Creates a job that calls function(). A child counts towards its parent, so
+        // waiting on the parent also waits for the child. The job does nothing until Run.
+        template<typename F>
+        Job* CreateJob(F&& function, Job* parent = nullptr)
+        {
+            typedef typename std::decay<F>::type Function;
+            static_assert(sizeof(Function) <= StorageSize, "Job function captures too much state");
+            static_assert(alignof(Function) <= 16, "Job function is over-aligned");
+
+            Job* job = AllocateJob(parent);
+            new (job->storage) Function(std::forward<F>(function));
+            job->execute = [](Job* self)
+            {
+                auto f = reinterpret_cast<Function*>(self->storage);
+                (*f)();
+                f->~Function();
+            };
+            return job;
+        }
+
+        // job will not start before dependency has finished (including its children).
+        // Must be called before either job is Run.
+        void AddDependency(Job* job, Job* dependency);
+
+        // Queues the job, or defers it until its dependencies have finished.
+        void Run(Job* job);
+
+        // Executes other jobs until job has finished.
+        void Wait(const Job* job);
+
+        static bool IsFinished(const Job* job)
+        {
+            return job->unfinished.load(std::memory_order_acquire) == 0;
+        }
+
+        // Calls function(begin, end) over [0, count) in chunks of at least grainSize
+        // and waits for them all.
+        template<typename F>
+        void ParallelFor(size_t count, size_t grainSize, const F& function)
+        {
+            if (count == 0)
+                return;
+
+            // A few chunks per thread gives idle threads something to steal.
+            grainSize = std::max<size_t>(grainSize, 1);
+            size_t chunks = std::min((count + grainSize - 1) / grainSize, size_t(GetThreadCount()) * 4);
+            if (chunks <= 1)
+            {
+                function(size_t(0), count);
+                return;
+            }
+
+            Job* root = CreateJob([]() {});
+            const size_t chunkSize = (count + chunks - 1) / chunks;
+            for (size_t begin = 0; begin < count; begin += chunkSize)
+            {
+                size_t end = std::min(begin + chunkSize, count);
+                Run(CreateJob([&function, begin, end]() { function(begin, end); }, root));
+            }
+            Run(root);
+            Wait(root);
+        }
+
+    private:
+        // Fixed capacity Chase-Lev deque.
+        class WorkQueue
+        {
+        public:
+            static const int64_t Capacity = MaxJobsPerThread;
+
+            WorkQueue() noexcept;
+
+            bool Push(Job* job);        // Owner only
+            Job* Pop();                 // Owner only
+            Job* Steal();               // Any thread
+
+        private:
+            // Padding keeps the stealers' and the owner's indices on separate cache lines.
+            std::atomic<int64_t>                m_top;
+            char                                m_padding[64];
+            std::atomic<int64_t>                m_bottom;
+            std::atomic<Job*>                   m_jobs[Capacity];
+        };
+
+        Job* AllocateJob(Job* parent);
+        void Push(Job* job);
+        Job* FindJob(uint32_t thread);
+        void Execute(Job* job);
+        void Finish(Job* job);
+        void WorkerLoop(uint32_t thread);
+        uint32_t GetCurrentThread() const;
+
+        static const uint32_t c_externalThread = ~0u;
+
+        std::vector<std::unique_ptr<WorkQueue>> m_queues;
+        std::vector<std::thread>                m_threads;
+        std::atomic<bool>                       m_running;
+
+        // Jobs run from threads that do not belong to the system.
+        std::mutex                              m_externalMutex;
+        std::deque<Job*>                        m_external;
+        std::atomic<int32_t>                    m_externalCount;
+
+        // Idle workers sleep until a job is queued.
+        std::atomic<int32_t>                    m_queued;
+        std::atomic<int32_t>                    m_sleeping;
+        std::mutex                              m_sleepMutex;
+        std::condition_variable                 m_wake;
+    };
+}
@@ -0,0 +1,303 @@
+//
+// MappedFile.cpp
+//
+
+#include "MappedFile.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DX;
+
+namespace
+{
+    // Smaller than or equal to the page size of every platform the game runs on.
+    const size_t PREFAULT_STRIDE = 4096;
+
+    struct MapRequest
+    {
+        std::string             name;
+        MapDataCallback         done;
+    };
+
+#if defined(_WIN32)
+    std::wstring ToWide(const char* text)
+    {
+        const int length = MultiByteToWideChar(CP_UTF8, 0, text, -1, nullptr, 0);
+        if (length <= 0)
+            return std::wstring();
+        std::wstring wide(size_t(length), L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, text, -1, &wide[0], length);
+        wide.resize(size_t(length - 1));
+        return wide;
+    }
+
+    std::string ToUtf8(const wchar_t* text)
+    {
+        const int length = WideCharToMultiByte(CP_UTF8, 0, text, -1, nullptr, 0, nullptr, nullptr);
+        if (length <= 0)
+            return std::string();
+        std::string utf8(size_t(length), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, text, -1, &utf8[0], length, nullptr, nullptr);
+        utf8.resize(size_t(length - 1));
+        return utf8;
+    }
+#else
+    // wchar_t holds UTF-32 here.
+    std::string ToUtf8(const wchar_t* text)
+    {
+        std::string utf8;
+        for (; *text; ++text)
+        {
+            const uint32_t c = static_cast<uint32_t>(*text);
+            if (c < 0x80)
+            {
+                utf8 += char(c);
+            }
+            else if (c < 0x800)
+            {
+                utf8 += char(0xc0 | (c >> 6));
+                utf8 += char(0x80 | (c & 0x3f));
+            }
+            else if (c < 0x10000)
+            {
+                utf8 += char(0xe0 | (c >> 12));
+                utf8 += char(0x80 | ((c >> 6) & 0x3f));
+                utf8 += char(0x80 | (c & 0x3f));
+            }
+            else
+            {
+                utf8 += char(0xf0 | (c >> 18));
+                utf8 += char(0x80 | ((c >> 12) & 0x3f));
+                utf8 += char(0x80 | ((c >> 6) & 0x3f));
+                utf8 += char(0x80 | (c & 0x3f));
+            }
+        }
+        return utf8;
+    }
+#endif
+
+    // With its trailing separator; empty where there is none to fall back to.
+    std::string GetExecutableDirectory()
+    {
+#if defined(_WIN32)
+#if !defined(WINAPI_FAMILY) || (WINAPI_FAMILY == WINAPI_FAMILY_DESKTOP_APP)
+        wchar_t moduleName[MAX_PATH];
+        const DWORD length = GetModuleFileNameW(nullptr, moduleName, MAX_PATH);
+        if (length == 0 || length == MAX_PATH)
+            return std::string();
+        std::string path = ToUtf8(moduleName);
+#else
+        std::string path;
+#endif
+#else
+        char moduleName[4096];
+        const ssize_t length = readlink("/proc/self/exe", moduleName, sizeof(moduleName));
+        if (length <= 0 || size_t(length) == sizeof(moduleName))
+            return std::string();
+        std::string path(moduleName, size_t(length));
+#endif
+        const size_t separator = path.find_last_of("/\\");
+        return (separator == std::string::npos) ? std::string() : path.substr(0, separator + 1);
+    }
+
+    JobSystem::Job* RunMapRequest(JobSystem& jobs, std::unique_ptr<MapRequest> request)
+    {
+        // Jobs hold 64 bytes, so the request travels by pointer.
+        JobSystem::Job* job = jobs.CreateJob([owned = request.release()]()
+        {
+            std::unique_ptr<MapRequest> request(owned);
+            MappedFile file;
+            std::exception_ptr error;
+            try
+            {
+                file = DX::MapData(request->name.c_str());
+                file.Prefault();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            request->done(std::move(file), error);
+        });
+        jobs.Run(job);
+        return job;
+    }
+}
+
+MappedFile::MappedFile() noexcept :
+    m_data(nullptr),
+    m_size(0),
+    m_open(false)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    m_data(other.m_data),
+    m_size(other.m_size),
+    m_open(other.m_open)
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_open = false;
+}
+
+MappedFile& MappedFile::operator= (MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_open, other.m_open);
+    }
+    return *this;
+}
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileW(ToWide(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || uint64_t(size.QuadPart) > SIZE_MAX)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    // Mapping an empty file fails; there is nothing to map anyway.
+    void* view = nullptr;
+    if (size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            // The view keeps the mapping, and the mapping the file, alive.
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    if (size.QuadPart > 0 && !view)
+        return false;
+
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = size_t(size.QuadPart);
+#else
+    const int file = open(path, O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        close(file);
+        return false;
+    }
+
+    void* view = nullptr;
+    if (status.st_size > 0)
+    {
+        view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+    if (view == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = size_t(status.st_size);
+#endif
+
+    m_open = true;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(m_data);
+#else
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+}
+
+void MappedFile::Prefault() const
+{
+    if (!m_data)
+        return;
+
+#if !defined(_WIN32)
+    // Starts read-ahead of the whole file rather than a page at a time.
+    madvise(const_cast<uint8_t*>(m_data), m_size, MADV_WILLNEED);
+#endif
+
+    // A volatile read the compiler cannot drop.
+    const volatile uint8_t* bytes = m_data;
+    for (size_t offset = 0; offset < m_size; offset += PREFAULT_STRIDE)
+    {
+        (void)bytes[offset];
+    }
+    (void)bytes[m_size - 1];
+}
+
+MappedFile DX::MapData(const char* name)
+{
+    MappedFile file;
+    if (file.Open(name))
+        return file;
+
+    const std::string directory = GetExecutableDirectory();
+    if (!directory.empty() && file.Open((directory + name).c_str()))
+        return file;
+
+    throw std::runtime_error(std::string("MapData: cannot open ") + name);
+}
+
+MappedFile DX::MapData(const wchar_t* name)
+{
+    return MapData(ToUtf8(name).c_str());
+}
+
+JobSystem::Job* DX::MapDataAsync(JobSystem& jobs, const char* name, MapDataCallback done)
+{
+    return RunMapRequest(jobs, std::unique_ptr<MapRequest>(new MapRequest{ name, std::move(done) }));
+}
+
+JobSystem::Job* DX::MapDataAsync(JobSystem& jobs, const wchar_t* name, MapDataCallback done)
+{
+    return RunMapRequest(jobs, std::unique_ptr<MapRequest>(new MapRequest{ ToUtf8(name), std::move(done) }));
+}
@@ -0,0 +1,73 @@
+//
+// MappedFile.h - Read-only memory mapped files, a zero-copy alternative to DX::ReadData
+//
+
+#pragma once
+
+#include "JobSystem.h"
+
+#include <exception>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace DX
+{
+    // A whole file mapped read-only into the address space (mmap on Linux, a file mapping
+    // on Windows). Nothing is read or copied up front: pages come in from the file cache
+    // the first time they are touched and are shared with every other mapping of the file.
+    // The view stays valid until the MappedFile is closed or destroyed. The file's handle
+    // is closed once it is mapped, but on Windows the mapping itself keeps the file in
+    // use: it cannot be deleted, truncated or overwritten (and tools that replace files
+    // by renaming over them fail) until the MappedFile is closed. On Linux the file can
+    // be renamed or deleted while mapped; writing to it changes what the view sees.
+    class MappedFile
+    {
+    public:
+        MappedFile() noexcept;
+        ~MappedFile();
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator= (MappedFile&& other) noexcept;
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator= (MappedFile const&) = delete;
+
+        // Maps path (UTF-8), closing any file mapped before. Returns false and stays
+        // closed if the file cannot be opened or mapped. An empty file opens with no data.
+        bool Open(const char* path);
+        void Close();
+
+        bool IsOpen() const                     { return m_open; }
+
+        // The same names as std::vector, so it can stand in for ReadData's result.
+        const uint8_t* data() const             { return m_data; }
+        size_t size() const                     { return m_size; }
+        bool empty() const                      { return m_size == 0; }
+        const uint8_t* begin() const            { return m_data; }
+        const uint8_t* end() const              { return m_data + m_size; }
+
+        // Reads a byte of every page, so later reads do not fault.
+        void Prefault() const;
+
+    private:
+        const uint8_t*  m_data;
+        size_t          m_size;
+        bool            m_open;
+    };
+
+    // Maps name like ReadData reads it: relative to the working directory, then to the
+    // directory of the executable. Throws std::runtime_error if neither has the file.
+    MappedFile MapData(const char* name);
+    MappedFile MapData(const wchar_t* name);
+
+    // Called on the thread that mapped the file, with the file or, if it could not be
+    // mapped, an empty file and the error MapData threw. It must not throw.
+    typedef std::function<void(MappedFile file, std::exception_ptr error)> MapDataCallback;
+
+    // MapData on one of jobs' threads, which also prefaults the pages before calling done.
+    // The returned job may be waited on, within JobSystem's limits on a Job*'s lifetime;
+    // without worker threads nothing runs until it is.
+    JobSystem::Job* MapDataAsync(JobSystem& jobs, const char* name, MapDataCallback done);
+    JobSystem::Job* MapDataAsync(JobSystem& jobs, const wchar_t* name, MapDataCallback done);
+}
@@ -0,0 +1,617 @@
+//
+// MeshOptimizer.cpp
+//
+
+#include "MeshOptimizer.h"
+
+#include "FileFormat.h"
+#include "SdkMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdarg.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    // Forsyth's constants, from "Linear-Speed Vertex Cache Optimisation".
+    const uint32_t FORSYTH_CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+    const uint32_t VALENCE_TABLE_SIZE = 64;
+
+    const uint32_t FETCH_CACHE_LINES = 256;
+    const uint32_t FETCH_LINE_SIZE = 64;
+
+    const uint32_t UNUSED = ~0u;
+    const size_t BUFFER_ALIGNMENT = 16;
+
+    std::string Format(const char* format, ...)
+    {
+        char message[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+        return message;
+    }
+
+    struct ForsythScores
+    {
+        float   cache[FORSYTH_CACHE_SIZE];
+        float   valence[VALENCE_TABLE_SIZE];
+
+        ForsythScores()
+        {
+            for (uint32_t i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+            {
+                // The last triangle's vertices score the same whatever their order, so
+                // the next triangle does not favour one of its edges.
+                cache[i] = (i < 3) ? LAST_TRIANGLE_SCORE
+                    : powf(1.0f - float(i - 3) / float(FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            }
+            valence[0] = 0;
+            for (uint32_t i = 1; i < VALENCE_TABLE_SIZE; ++i)
+            {
+                valence[i] = VALENCE_BOOST_SCALE * powf(float(i), -VALENCE_BOOST_POWER);
+            }
+        }
+
+        // Vertices with no triangles left score below every other.
+        float Get(int32_t cachePosition, uint32_t remaining) const
+        {
+            if (!remaining)
+                return -1.0f;
+            const float score = (remaining < VALENCE_TABLE_SIZE) ? valence[remaining]
+                : VALENCE_BOOST_SCALE * powf(float(remaining), -VALENCE_BOOST_POWER);
+            return (cachePosition >= 0) ? score + cache[cachePosition] : score;
+        }
+    };
+
+    uint32_t ReadIndex(const uint8_t* data, uint32_t indexSize, uint64_t i)
+    {
+        if (indexSize == 4)
+        {
+            uint32_t index;
+            memcpy(&index, data + i * 4, 4);
+            return index;
+        }
+        uint16_t index;
+        memcpy(&index, data + i * 2, 2);
+        return index;
+    }
+
+    void WriteIndex(uint8_t* data, uint32_t indexSize, uint64_t i, uint32_t index)
+    {
+        if (indexSize == 4)
+        {
+            memcpy(data + i * 4, &index, 4);
+        }
+        else
+        {
+            const uint16_t narrow = uint16_t(index);
+            memcpy(data + i * 2, &narrow, 2);
+        }
+    }
+
+    template<typename T>
+    T& At(std::vector<uint8_t>& file, uint64_t offset)
+    {
+        return *reinterpret_cast<T*>(file.data() + offset);
+    }
+
+    // The subsets drawn from one vertex buffer, and what they leave to be rewritten.
+    struct BufferPlan
+    {
+        std::vector<uint32_t>               subsets;
+        std::vector<uint32_t>               indexBuffers;
+        std::string                         reason;
+
+        std::vector<uint8_t>                vertices;
+        std::vector<std::vector<uint32_t>>  subsetIndices;  // Rebased on each subset's new vertexStart
+        std::vector<uint64_t>               vertexStarts;
+        std::vector<uint64_t>               vertexCounts;
+    };
+
+    // Merges, reorders and renumbers the vertices of one buffer, drawn with the plan's one
+    // index buffer; leaves the plan's reason set instead if the result would not fit it.
+    void OptimizeBuffer(const SdkMesh& mesh, uint32_t bufferIndex, BufferPlan& plan, SdkMeshBufferReport& report)
+    {
+        const SdkMeshVertexBuffer& buffer = mesh.GetVertexBuffers()[bufferIndex];
+        const size_t vertexCount = size_t(buffer.vertexCount);
+        const size_t stride = size_t(buffer.strideBytes);
+        const uint8_t* vertices = mesh.GetVertexData(buffer).data();
+
+        std::vector<uint32_t> duplicates(vertexCount);
+        const size_t distinct = GenerateDuplicateRemap(vertices, vertexCount, stride, duplicates.data());
+
+        const SdkMeshIndexBuffer& indexBuffer = mesh.GetIndexBuffers()[plan.indexBuffers[0]];
+        const uint8_t* indexData = mesh.GetIndexData(indexBuffer).data();
+        const uint32_t indexSize = SdkMesh::GetIndexSize(indexBuffer);
+
+        // Every subset's indices made absolute, in subset order, as drawn before.
+        std::vector<uint32_t> before;
+        std::vector<size_t> starts;
+        for (uint32_t subsetIndex : plan.subsets)
+        {
+            const SdkMeshSubset& subset = mesh.GetSubsets()[subsetIndex];
+            starts.push_back(before.size());
+            for (uint64_t i = 0; i < subset.indexCount; ++i)
+            {
+                before.push_back(uint32_t(subset.vertexStart + ReadIndex(indexData, indexSize, subset.indexStart + i)));
+            }
+        }
+        starts.push_back(before.size());
+
+        std::vector<uint32_t> after(before.size());
+        for (size_t i = 0; i < before.size(); ++i)
+        {
+            after[i] = duplicates[before[i]];
+        }
+        for (size_t s = 0; s + 1 < starts.size(); ++s)
+        {
+            OptimizeVertexCache(after.data() + starts[s], starts[s + 1] - starts[s], vertexCount);
+        }
+
+        std::vector<uint32_t> fetch(vertexCount);
+        const size_t used = GenerateFetchRemap(after.data(), after.size(), vertexCount, fetch.data());
+        for (uint32_t& index : after)
+        {
+            index = fetch[index];
+        }
+
+        report.verticesAfter = used;
+        report.duplicates = vertexCount - distinct;
+        report.cacheBefore = AnalyzeVertexCache(before.data(), before.size(), vertexCount);
+        report.cacheAfter = AnalyzeVertexCache(after.data(), after.size(), used);
+        report.fetchBefore = AnalyzeVertexFetch(before.data(), before.size(), vertexCount, stride);
+        report.fetchAfter = AnalyzeVertexFetch(after.data(), after.size(), used, stride);
+
+        for (size_t s = 0; s + 1 < starts.size(); ++s)
+        {
+            uint32_t low = UNUSED, high = 0;
+            for (size_t i = starts[s]; i < starts[s + 1]; ++i)
+            {
+                low = std::min(low, after[i]);
+                high = std::max(high, after[i]);
+            }
+            if (starts[s] == starts[s + 1])
+                low = high = 0;
+
+            const SdkMeshSubset& subset = mesh.GetSubsets()[plan.subsets[s]];
+            plan.vertexStarts.push_back(low);
+            plan.vertexCounts.push_back(subset.indexCount ? uint64_t(high - low) + 1 : 0);
+            plan.subsetIndices.emplace_back();
+            for (size_t i = starts[s]; i < starts[s + 1]; ++i)
+            {
+                plan.subsetIndices.back().push_back(after[i] - low);
+            }
+            if (indexSize == 2 && high - low > 0xffff)
+            {
+                plan.reason = Format("subset %u would span more vertices than 16 bit indices reach", plan.subsets[s]);
+                return;
+            }
+        }
+
+        plan.vertices.resize(used * stride);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            if (fetch[v] != UNUSED)
+                memcpy(plan.vertices.data() + size_t(fetch[v]) * stride, vertices + v * stride, stride);
+        }
+    }
+
+    // Returns the data's offset in the file.
+    uint64_t AppendAligned(std::vector<uint8_t>& file, const uint8_t* data, size_t size)
+    {
+        file.resize((file.size() + BUFFER_ALIGNMENT - 1) & ~(BUFFER_ALIGNMENT - 1), 0);
+        const uint64_t offset = file.size();
+        file.insert(file.end(), data, data + size);
+        return offset;
+    }
+}
+
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+    uint32_t cacheSize)
+{
+    VertexCacheStatistics statistics = {};
+    statistics.triangles = indexCount / 3;
+
+    // A vertex is in the FIFO while fewer than cacheSize misses have followed its own.
+    std::vector<uint64_t> missedAt(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    uint64_t time = uint64_t(cacheSize) + 1;
+    for (size_t i = 0; i < statistics.triangles * 3; ++i)
+    {
+        const uint32_t vertex = indices[i];
+        if (!used[vertex])
+        {
+            used[vertex] = true;
+            ++statistics.vertices;
+        }
+        if (time - missedAt[vertex] > cacheSize)
+        {
+            missedAt[vertex] = time++;
+            ++statistics.transforms;
+        }
+    }
+
+    statistics.acmr = statistics.triangles ? double(statistics.transforms) / double(statistics.triangles) : 0;
+    statistics.atvr = statistics.vertices ? double(statistics.transforms) / double(statistics.vertices) : 0;
+    return statistics;
+}
+
+VertexFetchStatistics AnalyzeVertexFetch(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+    size_t vertexStride)
+{
+    VertexFetchStatistics statistics = {};
+
+    std::vector<uint64_t> lines(FETCH_CACHE_LINES, ~0ull);
+    std::vector<bool> used(vertexCount, false);
+    uint64_t usedBytes = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        const uint32_t vertex = indices[i];
+        if (!used[vertex])
+        {
+            used[vertex] = true;
+            usedBytes += vertexStride;
+        }
+
+        const uint64_t first = uint64_t(vertex) * vertexStride / FETCH_LINE_SIZE;
+        const uint64_t last = (uint64_t(vertex) * vertexStride + vertexStride - 1) / FETCH_LINE_SIZE;
+        for (uint64_t line = first; line <= last; ++line)
+        {
+            uint64_t& slot = lines[line % FETCH_CACHE_LINES];
+            if (slot != line)
+            {
+                slot = line;
+                statistics.bytesFetched += FETCH_LINE_SIZE;
+            }
+        }
+    }
+
+    statistics.overfetch = usedBytes ? double(statistics.bytesFetched) / double(usedBytes) : 0;
+    return statistics;
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+    static const ForsythScores scores;
+
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    // Each vertex's triangles not yet emitted: adjacency[offsets[v], offsets[v] + remaining[v]).
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        ++remaining[indices[i]];
+    }
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+        {
+            adjacency[filled[indices[i]]++] = uint32_t(i / 3);
+        }
+    }
+
+    std::vector<int32_t> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        vertexScores[v] = scores.Get(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    uint32_t best = 0;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]]
+            + vertexScores[indices[t * 3 + 2]];
+        best = (triangleScores[t] > triangleScores[best]) ? uint32_t(t) : best;
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+    size_t cursor = 0;
+
+    while (output.size() < triangleCount * 3)
+    {
+        // Nothing in the cache has triangles left: start again from the next one in order.
+        if (best == UNUSED)
+        {
+            while (emitted[cursor])
+            {
+                ++cursor;
+            }
+            best = uint32_t(cursor);
+        }
+
+        const uint32_t* triangle = indices + size_t(best) * 3;
+        emitted[best] = true;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            const uint32_t vertex = triangle[corner];
+            uint32_t* begin = adjacency.data() + offsets[vertex];
+            uint32_t* end = begin + remaining[vertex];
+            *std::find(begin, end, best) = *(end - 1);
+            --remaining[vertex];
+        }
+
+        // The triangle's vertices move to the front of the LRU cache.
+        uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+        uint32_t newCount = 0;
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            if (std::find(newCache, newCache + newCount, triangle[corner]) == newCache + newCount)
+                newCache[newCount++] = triangle[corner];
+        }
+        for (uint32_t i = 0; i < cacheCount; ++i)
+        {
+            if (std::find(newCache, newCache + newCount, cache[i]) == newCache + newCount)
+                newCache[newCount++] = cache[i];
+        }
+
+        // Rescores every vertex whose position or triangle count changed (those pushed
+        // out included) and moves the change on to their triangles, while finding the
+        // best triangle left among the cached vertices.
+        best = UNUSED;
+        float bestScore = -1.0f;
+        for (uint32_t i = 0; i < newCount; ++i)
+        {
+            const uint32_t vertex = newCache[i];
+            cachePosition[vertex] = (i < FORSYTH_CACHE_SIZE) ? int32_t(i) : -1;
+            const float score = scores.Get(cachePosition[vertex], remaining[vertex]);
+            const float change = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+
+            for (uint32_t a = offsets[vertex]; a < offsets[vertex] + remaining[vertex]; ++a)
+            {
+                const uint32_t t = adjacency[a];
+                triangleScores[t] += change;
+            }
+        }
+        for (uint32_t i = 0; i < newCount && i < FORSYTH_CACHE_SIZE; ++i)
+        {
+            const uint32_t vertex = newCache[i];
+            for (uint32_t a = offsets[vertex]; a < offsets[vertex] + remaining[vertex]; ++a)
+            {
+                const uint32_t t = adjacency[a];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+
+        cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+        std::copy(newCache, newCache + cacheCount, cache);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+size_t GenerateDuplicateRemap(const uint8_t* vertices, size_t vertexCount, size_t vertexStride, uint32_t* remap)
+{
+    // Open addressing on each vertex's hash, holding the first vertex of each value.
+    size_t bucketCount = 1;
+    while (bucketCount < vertexCount * 2)
+    {
+        bucketCount *= 2;
+    }
+    std::vector<uint32_t> buckets(bucketCount, UNUSED);
+
+    size_t distinct = 0;
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const uint8_t* vertex = vertices + v * vertexStride;
+        size_t bucket = size_t(FileFormat::Hash(vertex, vertexStride)) & (bucketCount - 1);
+        while (buckets[bucket] != UNUSED
+            && memcmp(vertices + size_t(buckets[bucket]) * vertexStride, vertex, vertexStride) != 0)
+        {
+            bucket = (bucket + 1) & (bucketCount - 1);
+        }
+        if (buckets[bucket] == UNUSED)
+        {
+            buckets[bucket] = uint32_t(v);
+            ++distinct;
+        }
+        remap[v] = buckets[bucket];
+    }
+    return distinct;
+}
+
+size_t GenerateFetchRemap(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t* remap)
+{
+    std::fill(remap, remap + vertexCount, UNUSED);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        if (remap[indices[i]] == UNUSED)
+            remap[indices[i]] = next++;
+    }
+    return next;
+}
+
+std::vector<uint8_t> OptimizeSdkMesh(const SdkMesh& mesh, std::vector<SdkMeshBufferReport>* reports)
+{
+    const SdkMeshHeader& header = mesh.GetHeader();
+    const SdkMesh::View<SdkMeshVertexBuffer> vertexBuffers = mesh.GetVertexBuffers();
+    const SdkMesh::View<SdkMeshIndexBuffer> indexBuffers = mesh.GetIndexBuffers();
+    const SdkMesh::View<SdkMeshSubset> subsets = mesh.GetSubsets();
+
+    // Which vertex buffer each index buffer and subset is drawn with; a buffer can only
+    // be renumbered if nothing else draws with its indices.
+    std::vector<BufferPlan> plans(vertexBuffers.size());
+    std::vector<uint32_t> indexBufferOwners(indexBuffers.size(), UNUSED);
+    std::vector<uint32_t> subsetOwners(subsets.size(), UNUSED);
+    for (const SdkMeshMesh& owner : mesh.GetMeshes())
+    {
+        const uint32_t vertexBuffer = owner.vertexBuffers[0];
+        BufferPlan& plan = plans[vertexBuffer];
+        if (owner.vertexStreamCount > 1)
+        {
+            for (uint32_t stream = 0; stream < owner.vertexStreamCount && stream < SdkMeshMesh::MaxVertexStreams; ++stream)
+            {
+                if (owner.vertexBuffers[stream] < plans.size())
+                    plans[owner.vertexBuffers[stream]].reason = Format("mesh %s has %u streams", owner.name,
+                        owner.vertexStreamCount);
+            }
+        }
+
+        uint32_t& indexOwner = indexBufferOwners[owner.indexBuffer];
+        if (indexOwner != UNUSED && indexOwner != vertexBuffer)
+        {
+            plan.reason = Format("index buffer %u is also drawn with vertex buffer %u", owner.indexBuffer, indexOwner);
+            plans[indexOwner].reason = Format("index buffer %u is also drawn with vertex buffer %u", owner.indexBuffer,
+                vertexBuffer);
+        }
+        if (indexOwner == UNUSED)
+            plan.indexBuffers.push_back(owner.indexBuffer);
+        indexOwner = vertexBuffer;
+
+        for (uint32_t subsetIndex : mesh.GetSubsetIndices(owner))
+        {
+            uint32_t& subsetOwner = subsetOwners[subsetIndex];
+            if (subsetOwner != UNUSED)
+            {
+                const std::string reason = Format("subset %u is drawn by more than one mesh", subsetIndex);
+                plan.reason = reason;
+                plans[subsetOwner].reason = reason;
+                continue;
+            }
+            subsetOwner = vertexBuffer;
+            plan.subsets.push_back(subsetIndex);
+            if (subsets[subsetIndex].primitiveType != PrimitiveTriangleList)
+                plan.reason = Format("subset %u is not a triangle list", subsetIndex);
+        }
+    }
+
+    std::vector<SdkMeshBufferReport> bufferReports(vertexBuffers.size());
+    for (uint32_t i = 0; i < plans.size(); ++i)
+    {
+        BufferPlan& plan = plans[i];
+        SdkMeshBufferReport& report = bufferReports[i];
+        report.vertexBuffer = i;
+        report.verticesBefore = report.verticesAfter = vertexBuffers[i].vertexCount;
+        if (plan.subsets.empty() && plan.reason.empty())
+            plan.reason = "no subset draws from it";
+
+        // Subsets drawn from the same indices would be reordered twice.
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        for (uint32_t subsetIndex : plan.subsets)
+        {
+            const SdkMeshSubset& subset = subsets[subsetIndex];
+            ranges.emplace_back(subset.indexStart, subset.indexStart + subset.indexCount);
+        }
+        if (plan.indexBuffers.size() == 1)
+        {
+            std::sort(ranges.begin(), ranges.end());
+            for (size_t r = 1; r < ranges.size(); ++r)
+            {
+                if (ranges[r].first < ranges[r - 1].second && plan.reason.empty())
+                    plan.reason = "subsets share indices";
+            }
+        }
+        else if (plan.indexBuffers.size() > 1 && plan.reason.empty())
+        {
+            plan.reason = "it is drawn with more than one index buffer";
+        }
+
+        if (plan.reason.empty())
+            OptimizeBuffer(mesh, i, plan, report);
+        report.optimized = plan.reason.empty();
+        report.reason = plan.reason;
+        if (!report.optimized)
+            report.verticesAfter = report.verticesBefore;
+    }
+
+    // The header and non-buffer sections as they were; the buffers after them rebuilt
+    // and their headers and the subsets' vertex ranges patched to match.
+    const SdkMesh::View<uint8_t> source = mesh.GetFileData();
+    const uint64_t bufferStart = header.headerSize + header.nonBufferDataSize;
+    std::vector<uint8_t> file(source.data(), source.data() + bufferStart);
+
+    for (uint32_t i = 0; i < vertexBuffers.size(); ++i)
+    {
+        // Appending moves the file, so the header is found again after it.
+        const BufferPlan& plan = plans[i];
+        const uint64_t headerOffset = header.vertexBufferOffset + i * sizeof(SdkMeshVertexBuffer);
+        if (plan.reason.empty())
+        {
+            const uint64_t dataOffset = AppendAligned(file, plan.vertices.data(), plan.vertices.size());
+            SdkMeshVertexBuffer& buffer = At<SdkMeshVertexBuffer>(file, headerOffset);
+            buffer.vertexCount = plan.vertices.size() / buffer.strideBytes;
+            buffer.sizeBytes = plan.vertices.size();
+            buffer.dataOffset = dataOffset;
+        }
+        else
+        {
+            const SdkMesh::View<uint8_t> data = mesh.GetVertexData(vertexBuffers[i]);
+            At<SdkMeshVertexBuffer>(file, headerOffset).dataOffset = AppendAligned(file, data.data(), data.size());
+        }
+    }
+
+    for (uint32_t i = 0; i < indexBuffers.size(); ++i)
+    {
+        const SdkMesh::View<uint8_t> data = mesh.GetIndexData(indexBuffers[i]);
+        std::vector<uint8_t> indices(data.begin(), data.end());
+
+        const uint32_t owner = indexBufferOwners[i];
+        if (owner != UNUSED && plans[owner].reason.empty())
+        {
+            // Indices outside every subset are never drawn; zero keeps them in range.
+            const BufferPlan& plan = plans[owner];
+            const uint32_t indexSize = SdkMesh::GetIndexSize(indexBuffers[i]);
+            std::fill(indices.begin(), indices.end(), uint8_t(0));
+            for (size_t s = 0; s < plan.subsets.size(); ++s)
+            {
+                SdkMeshSubset& subset = At<SdkMeshSubset>(file, header.subsetOffset
+                    + plan.subsets[s] * sizeof(SdkMeshSubset));
+                subset.vertexStart = plan.vertexStarts[s];
+                subset.vertexCount = plan.vertexCounts[s];
+                for (size_t n = 0; n < plan.subsetIndices[s].size(); ++n)
+                {
+                    WriteIndex(indices.data(), indexSize, subset.indexStart + n, plan.subsetIndices[s][n]);
+                }
+            }
+        }
+
+        const uint64_t dataOffset = AppendAligned(file, indices.data(), indices.size());
+        At<SdkMeshIndexBuffer>(file, header.indexBufferOffset + i * sizeof(SdkMeshIndexBuffer)).dataOffset = dataOffset;
+    }
+
+    At<SdkMeshHeader>(file, 0).bufferDataSize = file.size() - bufferStart;
+
+    try
+    {
+        SdkMesh check;
+        check.Parse(file.data(), file.size());
+    }
+    catch (const std::exception& e)
+    {
+        FileFormat::Fail("OptimizeSdkMesh: ", "the optimised mesh does not load: %s", e.what());
+    }
+
+    if (reports)
+        *reports = std::move(bufferReports);
+    return file;
+}
@@ -0,0 +1,75 @@
+//
+// MeshOptimizer.h - Vertex cache and vertex fetch optimisation of indexed triangle lists
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class SdkMesh;
+
+// How well a GPU's post-transform cache, modelled as a FIFO of cacheSize vertices, does
+// on the triangles: ACMR is the vertices transformed per triangle (0.5 at best on a
+// regular grid, 3 at worst), ATVR the vertices transformed per vertex used (1 at best).
+struct VertexCacheStatistics
+{
+    uint64_t    triangles;
+    uint64_t    vertices;           // Distinct vertices the triangles use
+    uint64_t    transforms;         // Cache misses
+    double      acmr;
+    double      atvr;
+};
+
+// How much vertex data the triangles pull through a 16 KB direct mapped cache of 64 byte
+// lines: overfetch is the bytes fetched over the bytes of the vertices used (1 at best).
+struct VertexFetchStatistics
+{
+    uint64_t    bytesFetched;
+    double      overfetch;
+};
+
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+    uint32_t cacheSize = 16);
+VertexFetchStatistics AnalyzeVertexFetch(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+    size_t vertexStride);
+
+// Reorders the triangles (keeping each one's winding) with Tom Forsyth's linear-speed
+// vertex cache optimisation: triangles are emitted greedily by the scores of their
+// vertices, which favour vertices recently used in a 32 entry LRU cache and vertices
+// with few triangles left. Every index must be below vertexCount.
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// Maps each vertex to the first vertex with the same bytes, so the duplicates go unused
+// once the indices are remapped. Returns the number of distinct vertices.
+size_t GenerateDuplicateRemap(const uint8_t* vertices, size_t vertexCount, size_t vertexStride, uint32_t* remap);
+
+// Numbers the vertices in the order the indices first use them, for the best fetch
+// locality; vertices the indices do not use map to ~0u. Returns the number used.
+size_t GenerateFetchRemap(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t* remap);
+
+// What OptimizeSdkMesh did to one vertex buffer and the triangles drawn from it.
+struct SdkMeshBufferReport
+{
+    uint32_t                vertexBuffer;
+    bool                    optimized;
+    std::string             reason;             // Why it was left alone
+    uint64_t                verticesBefore;
+    uint64_t                verticesAfter;      // Without duplicates and unused vertices
+    uint64_t                duplicates;
+    VertexCacheStatistics   cacheBefore;
+    VertexCacheStatistics   cacheAfter;
+    VertexFetchStatistics   fetchBefore;
+    VertexFetchStatistics   fetchAfter;
+};
+
+// A copy of a loaded .sdkmesh with, for each vertex buffer, duplicate vertices merged,
+// each subset's triangles in vertex cache order and the vertices in the order those
+// triangles first use them. Subsets keep their index ranges and materials; their vertex
+// ranges shrink to the vertices they use, and every other structure is copied as it is,
+// so the file loads as before. A vertex buffer is left as it is when its triangles are
+// not all triangle list subsets of first streams with index buffers of their own. The
+// result is parsed again before it is returned; throws std::runtime_error if it fails.
+std::vector<uint8_t> OptimizeSdkMesh(const SdkMesh& mesh, std::vector<SdkMeshBufferReport>* reports = nullptr);
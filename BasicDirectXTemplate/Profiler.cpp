@@ -0,0 +1,279 @@
+//
+// Profiler.cpp
+//
+
+#include "Profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace DX;
+
+namespace
+{
+    // Events kept per thread; older events are overwritten.
+    const uint32_t c_eventCapacity = 1u << 16;
+
+    struct Event
+    {
+        const char* name;
+        uint64_t    begin;
+        uint64_t    end;
+    };
+
+    // One thread's ring, read by WriteTrace while the thread keeps recording. count is
+    // the ring's sequence: the owner writes event count into slot count % capacity, then
+    // publishes count + 1. A reader copies an event and then reads count again; if the
+    // owner has since reached the event's slot again, the copy may be torn and is
+    // dropped. The fields are relaxed atomics so those racing reads are well defined;
+    // on x86 and ARM they compile to ordinary loads and stores.
+    struct RingEvent
+    {
+        std::atomic<const char*>    name;
+        std::atomic<uint64_t>       begin;
+        std::atomic<uint64_t>       end;
+    };
+
+    struct ThreadBuffer
+    {
+        uint32_t                    threadIndex;
+        std::unique_ptr<RingEvent[]> events;
+        std::atomic<uint64_t>       count;
+    };
+
+    // Buffers outlive their threads so a trace can still be written after a worker exits.
+    std::mutex s_buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;
+
+    thread_local ThreadBuffer* t_buffer = nullptr;
+    thread_local bool t_annotate = false;
+
+    void* s_annotationContext = nullptr;
+    Profiler::AnnotationBegin s_annotationBegin = nullptr;
+    Profiler::AnnotationEnd s_annotationEnd = nullptr;
+
+    // Capture state, only touched from the thread calling BeginFrame.
+    struct Capture
+    {
+        std::string             path;
+        uint32_t                framesRemaining = 0;
+        uint64_t                begin = 0;
+        bool                    pending = false;
+        bool                    active = false;
+        std::vector<uint64_t>   frameStarts;
+    };
+
+    Capture s_capture;
+
+    // Pairs profiler ticks with the monotonic clock so ticks can be converted to time.
+    const uint64_t s_referenceTicks = Profiler::Now();
+    const uint64_t s_referenceNs = Profiler::ClockNow();
+
+    double NanosecondsPerTick()
+    {
+#if defined(DX_PROFILER_USE_TSC)
+        uint64_t ticks = Profiler::Now();
+        uint64_t ns = Profiler::ClockNow();
+
+        // Make sure the calibration interval is long enough to be accurate.
+        while (ns - s_referenceNs < 10000000)
+        {
+            ticks = Profiler::Now();
+            ns = Profiler::ClockNow();
+        }
+
+        return double(ns - s_referenceNs) / double(ticks - s_referenceTicks);
+#else
+        return 1.0;
+#endif
+    }
+
+    ThreadBuffer* CreateThreadBuffer()
+    {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->events.reset(new RingEvent[c_eventCapacity]);
+        buffer->count.store(0, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(s_buffersMutex);
+        buffer->threadIndex = static_cast<uint32_t>(s_buffers.size());
+        s_buffers.push_back(std::move(buffer));
+        return s_buffers.back().get();
+    }
+
+    void WriteEscaped(std::ofstream& file, const char* text)
+    {
+        for (; *text; ++text)
+        {
+            if (*text == '"' || *text == '\\')
+                file.put('\\');
+            file.put(*text);
+        }
+    }
+
+    bool WriteTrace(const char* path, uint64_t rangeBegin, uint64_t rangeEnd, const std::vector<uint64_t>& frameStarts)
+    {
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        if (!file)
+            return false;
+
+        char line[256];
+        const char* separator = "";
+        const double usPerTick = NanosecondsPerTick() / 1000.0;
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+        for (size_t i = 0; i < frameStarts.size(); ++i)
+        {
+            snprintf(line, sizeof(line), "%s{\"name\":\"Frame %zu\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}",
+                separator, i, double(frameStarts[i] - rangeBegin) * usPerTick);
+            file << line;
+            separator = ",\n";
+        }
+
+        std::lock_guard<std::mutex> lock(s_buffersMutex);
+        for (auto& buffer : s_buffers)
+        {
+            uint64_t count = buffer->count.load(std::memory_order_acquire);
+            uint64_t start = count > c_eventCapacity ? count - c_eventCapacity : 0;
+
+            for (uint64_t i = start; i < count; ++i)
+            {
+                const RingEvent& slot = buffer->events[i & (c_eventCapacity - 1)];
+                Event event;
+                event.name = slot.name.load(std::memory_order_relaxed);
+                event.begin = slot.begin.load(std::memory_order_relaxed);
+                event.end = slot.end.load(std::memory_order_relaxed);
+
+                // Slot i is rewritten from the time the owner's count reaches i + capacity.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (buffer->count.load(std::memory_order_relaxed) >= i + c_eventCapacity)
+                    continue;
+
+                if (event.begin < rangeBegin || event.end > rangeEnd)
+                    continue;
+
+                file << separator << "{\"name\":\"";
+                WriteEscaped(file, event.name);
+                snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    buffer->threadIndex,
+                    double(event.begin - rangeBegin) * usPerTick,
+                    double(event.end - event.begin) * usPerTick);
+                file << line;
+                separator = ",\n";
+            }
+        }
+
+        file << "\n]}\n";
+        file.close();
+        return !file.fail();
+    }
+}
+
+uint64_t Profiler::ClockNow()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Profiler::Record(const char* name, uint64_t begin, uint64_t end)
+{
+    ThreadBuffer* buffer = t_buffer;
+    if (!buffer)
+    {
+        buffer = t_buffer = CreateThreadBuffer();
+    }
+
+    // Only this thread writes count. The fence keeps the slot's stores after the
+    // previous publish, so a reader that sees any of them also sees count >= index.
+    uint64_t index = buffer->count.load(std::memory_order_relaxed);
+    RingEvent& event = buffer->events[index & (c_eventCapacity - 1)];
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin.store(begin, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+bool Profiler::BeginAnnotation(const wchar_t* name)
+{
+    if (!t_annotate || !s_annotationBegin)
+        return false;
+
+    s_annotationBegin(s_annotationContext, name);
+    return true;
+}
+
+void Profiler::EndAnnotation()
+{
+    if (s_annotationEnd)
+    {
+        s_annotationEnd(s_annotationContext);
+    }
+}
+
+void Profiler::SetAnnotationCallbacks(void* context, AnnotationBegin begin, AnnotationEnd end)
+{
+    s_annotationContext = context;
+    s_annotationBegin = begin;
+    s_annotationEnd = end;
+    t_annotate = true;
+}
+
+void Profiler::ClearAnnotationCallbacks()
+{
+    t_annotate = false;
+    s_annotationBegin = nullptr;
+    s_annotationEnd = nullptr;
+    s_annotationContext = nullptr;
+}
+
+bool Profiler::BeginFrame()
+{
+    uint64_t now = Now();
+
+    if (s_capture.pending)
+    {
+        s_capture.pending = false;
+        s_capture.active = true;
+        s_capture.begin = now;
+        s_capture.frameStarts.clear();
+    }
+    else if (s_capture.active && --s_capture.framesRemaining == 0)
+    {
+        s_capture.active = false;
+        return WriteTrace(s_capture.path.c_str(), s_capture.begin, now, s_capture.frameStarts);
+    }
+
+    if (s_capture.active)
+    {
+        s_capture.frameStarts.push_back(now);
+    }
+    return true;
+}
+
+void Profiler::BeginCapture(uint32_t frameCount, const char* path)
+{
+    if (frameCount == 0 || !path)
+        return;
+
+    s_capture.path = path;
+    s_capture.framesRemaining = frameCount;
+    s_capture.pending = true;
+    s_capture.active = false;
+}
+
+bool Profiler::IsCapturing()
+{
+    return s_capture.pending || s_capture.active;
+}
+
+bool Profiler::WriteChromeTrace(const char* path)
+{
+    return WriteTrace(path, 0, UINT64_MAX, std::vector<uint64_t>());
+}
@@ -0,0 +1,99 @@
+//
+// Profiler.h - Hierarchical CPU timing scopes with Chrome trace export
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define DX_PROFILER_USE_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define DX_PROFILER_USE_TSC
+#endif
+
+namespace DX
+{
+    // Collects CPU timing scopes into per-thread ring buffers and writes a range of
+    // frames out as a chrome://tracing / Perfetto JSON file.
+    class Profiler
+    {
+    public:
+        // Optional forwarding of scopes to a GPU annotation API (PIX).
+        typedef void (*AnnotationBegin)(void* context, const wchar_t* name);
+        typedef void (*AnnotationEnd)(void* context);
+
+        // Marks the start of a frame; call once per Tick on the main thread. Returns false
+        // if this ended a capture and its trace could not be written.
+        static bool BeginFrame();
+
+        // Capture the next frameCount frames and write them to path when done.
+        static void BeginCapture(uint32_t frameCount, const char* path);
+        static bool IsCapturing();
+
+        // Writes every event currently held in the ring buffers. Safe while other threads
+        // record: events overwritten while being read are left out.
+        static bool WriteChromeTrace(const char* path);
+
+        // Scopes opened on the calling thread are forwarded to these callbacks.
+        static void SetAnnotationCallbacks(void* context, AnnotationBegin begin, AnnotationEnd end);
+        static void ClearAnnotationCallbacks();
+
+        // Current timestamp in profiler ticks (the CPU timestamp counter where available).
+        static uint64_t Now()
+        {
+#if defined(DX_PROFILER_USE_TSC)
+            return __rdtsc();
+#else
+            return ClockNow();
+#endif
+        }
+
+        // Monotonic clock in nanoseconds, used to calibrate profiler ticks.
+        static uint64_t ClockNow();
+
+        // Used by ProfileScope.
+        static void Record(const char* name, uint64_t begin, uint64_t end);
+        static bool BeginAnnotation(const wchar_t* name);
+        static void EndAnnotation();
+    };
+
+    // Times the enclosing block. Use through PROFILE_SCOPE.
+    class ProfileScope
+    {
+    public:
+        ProfileScope(const char* name, const wchar_t* wideName) :
+            m_name(name)
+        {
+            m_annotated = Profiler::BeginAnnotation(wideName);
+            m_begin = Profiler::Now();
+        }
+
+        ~ProfileScope()
+        {
+            Profiler::Record(m_name, m_begin, Profiler::Now());
+            if (m_annotated)
+            {
+                Profiler::EndAnnotation();
+            }
+        }
+
+        ProfileScope(ProfileScope const&) = delete;
+        ProfileScope& operator= (ProfileScope const&) = delete;
+
+    private:
+        const char* m_name;
+        uint64_t    m_begin;
+        bool        m_annotated;
+    };
+}
+
+#define DX_PROFILE_CONCAT_(a, b) a##b
+#define DX_PROFILE_CONCAT(a, b) DX_PROFILE_CONCAT_(a, b)
+#define DX_PROFILE_WIDEN_(s) L##s
+#define DX_PROFILE_WIDEN(s) DX_PROFILE_WIDEN_(s)
+
+// Times the enclosing block under the given string literal name.
+#define PROFILE_SCOPE(name) DX::ProfileScope DX_PROFILE_CONCAT(profileScope_, __LINE__)(name, DX_PROFILE_WIDEN(name))
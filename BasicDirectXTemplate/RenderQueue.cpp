@@ -0,0 +1,124 @@
+//
+// RenderQueue.cpp
+//
+
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const uint32_t TRANSLUCENT_SHIFT = 63 - RenderQueue::PassBits;
+    const uint32_t FIELDS_SHIFT = TRANSLUCENT_SHIFT;    // Fields fill the bits below the flag
+
+    // The low bits are never set, so five 11-bit digits cover the rest of the key.
+    const uint32_t UNUSED_BITS = 64 - 1 - RenderQueue::PassBits - RenderQueue::ShaderBits
+        - RenderQueue::MaterialBits - RenderQueue::DepthBits;
+    const uint32_t RADIX_BITS = 11;
+    const uint32_t RADIX_BUCKETS = 1u << RADIX_BITS;
+    const uint32_t RADIX_PASSES = (64 - UNUSED_BITS + RADIX_BITS - 1) / RADIX_BITS;
+
+    inline uint64_t Field(uint32_t value, uint32_t bits)
+    {
+        return uint64_t(value) & ((uint64_t(1) << bits) - 1);
+    }
+
+    inline uint64_t QuantizeDepth(float depth)
+    {
+        const float maximum = float((1u << RenderQueue::DepthBits) - 1);
+        float clamped = std::min(std::max(depth, 0.f), 1.f);
+        return static_cast<uint64_t>(clamped * maximum + 0.5f);
+    }
+
+    inline uint64_t Header(uint32_t pass, bool translucent)
+    {
+        return (Field(pass, RenderQueue::PassBits) << (64 - RenderQueue::PassBits))
+            | (uint64_t(translucent ? 1 : 0) << TRANSLUCENT_SHIFT);
+    }
+}
+
+uint64_t RenderQueue::MakeOpaqueKey(uint32_t pass, uint32_t shader, uint32_t material, float depth)
+{
+    uint32_t shift = FIELDS_SHIFT;
+    uint64_t key = Header(pass, false);
+    key |= Field(shader, ShaderBits) << (shift -= ShaderBits);
+    key |= Field(material, MaterialBits) << (shift -= MaterialBits);
+    key |= QuantizeDepth(depth) << (shift -= DepthBits);
+    return key;
+}
+
+uint64_t RenderQueue::MakeTranslucentKey(uint32_t pass, uint32_t shader, uint32_t material, float depth)
+{
+    // Inverting the depth makes far surfaces sort first.
+    const uint64_t farToNear = Field(~static_cast<uint32_t>(QuantizeDepth(depth)), DepthBits);
+
+    uint32_t shift = FIELDS_SHIFT;
+    uint64_t key = Header(pass, true);
+    key |= farToNear << (shift -= DepthBits);
+    key |= Field(shader, ShaderBits) << (shift -= ShaderBits);
+    key |= Field(material, MaterialBits) << (shift -= MaterialBits);
+    return key;
+}
+
+void RenderQueue::Reserve(size_t count)
+{
+    m_items.reserve(count);
+    m_scratch.reserve(count);
+}
+
+void RenderQueue::Sort()
+{
+    const size_t count = m_items.size();
+    if (count < 2)
+        return;
+
+    static_assert(RADIX_PASSES * RADIX_BITS + UNUSED_BITS >= 64, "Radix digits must cover the key");
+
+    // One read of the keys builds the histogram for every digit.
+    uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS];
+    memset(histograms, 0, sizeof(histograms));
+    for (const Item& item : m_items)
+    {
+        uint64_t key = item.key >> UNUSED_BITS;
+        for (uint32_t pass = 0; pass < RADIX_PASSES; ++pass)
+        {
+            ++histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)];
+        }
+    }
+
+    m_scratch.resize(count);
+    Item* source = m_items.data();
+    Item* destination = m_scratch.data();
+
+    for (uint32_t pass = 0; pass < RADIX_PASSES; ++pass)
+    {
+        uint32_t* histogram = histograms[pass];
+        const uint32_t shift = UNUSED_BITS + pass * RADIX_BITS;
+
+        // Every key has the same digit here (a field nothing varies in).
+        if (histogram[(source[0].key >> shift) & (RADIX_BUCKETS - 1)] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; ++bucket)
+        {
+            uint32_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Item& item = source[i];
+            destination[histogram[(item.key >> shift) & (RADIX_BUCKETS - 1)]++] = item;
+        }
+
+        std::swap(source, destination);
+    }
+
+    if (source != m_items.data())
+    {
+        m_items.swap(m_scratch);
+    }
+}
@@ -0,0 +1,59 @@
+//
+// RenderQueue.h - Draw submissions ordered by packed 64-bit sort keys
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Each submission is a sort key plus a command index the caller interprets when the
+// sorted queue is executed. Keys pack, from the most significant bits down:
+//
+//     opaque:      pass (4) | 0 | shader (10) | material (16) | depth (24) | unused (9)
+//     translucent: pass (4) | 1 | far-to-near depth (24) | shader (10) | material (16) | unused (9)
+//
+// so within a pass opaque draws come first, grouped by shader then material and front
+// to back inside a group, and translucent draws follow back to front. Sort is a stable
+// LSD radix sort over 11-bit digits that skips digits every key shares.
+class RenderQueue
+{
+public:
+    static const uint32_t PassBits = 4;
+    static const uint32_t ShaderBits = 10;
+    static const uint32_t MaterialBits = 16;
+    static const uint32_t DepthBits = 24;
+
+    struct Item
+    {
+        uint64_t key;
+        uint32_t command;
+    };
+
+    RenderQueue() noexcept {}
+
+    // depth is 0 at the near plane and 1 at the far plane; it is clamped to that range.
+    static uint64_t MakeOpaqueKey(uint32_t pass, uint32_t shader, uint32_t material, float depth);
+    static uint64_t MakeTranslucentKey(uint32_t pass, uint32_t shader, uint32_t material, float depth);
+
+    static uint32_t GetPass(uint64_t key)               { return static_cast<uint32_t>(key >> (64 - PassBits)); }
+    static bool IsTranslucent(uint64_t key)             { return ((key >> (63 - PassBits)) & 1) != 0; }
+
+    // Starts a new frame. Capacity is kept between frames.
+    void Clear()                                        { m_items.clear(); }
+    void Reserve(size_t count);
+
+    void Submit(uint64_t key, uint32_t command)         { m_items.push_back({ key, command }); }
+
+    // Orders the submissions by key; equal keys keep submission order.
+    void Sort();
+
+    size_t GetCount() const                             { return m_items.size(); }
+    const Item* begin() const                           { return m_items.data(); }
+    const Item* end() const                             { return m_items.data() + m_items.size(); }
+
+private:
+    std::vector<Item> m_items;
+    std::vector<Item> m_scratch;
+};
@@ -0,0 +1,110 @@
+//
+// RenderSnapshot.cpp
+//
+
+#include "RenderSnapshot.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace
+{
+    // Lerps translation and scale and slerps rotation. Only valid for affine matrices,
+    // which every world and roll matrix in a snapshot is.
+    XMMATRIX XM_CALLCONV InterpolateMatrix(FXMMATRIX a, CXMMATRIX b, float t)
+    {
+        XMVECTOR scaleA, rotationA, translationA;
+        XMVECTOR scaleB, rotationB, translationB;
+        if (!XMMatrixDecompose(&scaleA, &rotationA, &translationA, a)
+            || !XMMatrixDecompose(&scaleB, &rotationB, &translationB, b))
+        {
+            return b;
+        }
+
+        return XMMatrixAffineTransformation(
+            XMVectorLerp(scaleA, scaleB, t),
+            g_XMZero,
+            XMQuaternionSlerp(rotationA, rotationB, t),
+            XMVectorLerp(translationA, translationB, t));
+    }
+
+    void InterpolateMatrix(const XMFLOAT4X4& a, const XMFLOAT4X4& b, float t, XMFLOAT4X4& result)
+    {
+        XMStoreFloat4x4(&result, InterpolateMatrix(XMLoadFloat4x4(&a), XMLoadFloat4x4(&b), t));
+    }
+
+    void InterpolateFloat3(const XMFLOAT3& a, const XMFLOAT3& b, float t, XMFLOAT3& result)
+    {
+        XMStoreFloat3(&result, XMVectorLerp(XMLoadFloat3(&a), XMLoadFloat3(&b), t));
+    }
+
+    // Blends angles that wrap every period the short way round.
+    float InterpolateAngle(float a, float b, float t, float period)
+    {
+        float delta = b - a;
+        if (delta > period * 0.5f)
+        {
+            delta -= period;
+        }
+        else if (delta < -period * 0.5f)
+        {
+            delta += period;
+        }
+        return a + delta * t;
+    }
+
+    void InterpolateObject(const RenderObject& a, const RenderObject& b, float t, RenderObject& result)
+    {
+        InterpolateMatrix(a.world, b.world, t, result.world);
+        InterpolateFloat3(a.bounds.Center, b.bounds.Center, t, result.bounds.Center);
+        result.bounds.Radius = a.bounds.Radius + (b.bounds.Radius - a.bounds.Radius) * t;
+        InterpolateFloat3(a.lightDirection, b.lightDirection, t, result.lightDirection);
+        result.lightIntensity = a.lightIntensity + (b.lightIntensity - a.lightIntensity) * t;
+    }
+}
+
+void RenderSnapshot::Interpolate(const RenderSnapshot& previous, const RenderSnapshot& current, float t)
+{
+    // Flags and timing are never blended; the audio positions are, with the bodies.
+    *this = current;
+
+    if (previous.update == 0 || previous.asteroids.size() != current.asteroids.size() || t >= 1.f)
+        return;
+
+    t = std::max(t, 0.f);
+
+    XMFLOAT3 position;
+    InterpolateFloat3(previous.cameraPosition, current.cameraPosition, t, position);
+    SetCamera(position, previous.pitch + (current.pitch - previous.pitch) * t,
+        InterpolateAngle(previous.yaw, current.yaw, t, XM_2PI));
+    InterpolateMatrix(previous.roll, current.roll, t, roll);
+    rotation = InterpolateAngle(previous.rotation, current.rotation, t, 360.f);
+
+    for (uint32_t body = 0; body < Simulation::BodyCount; ++body)
+    {
+        InterpolateObject(previous.bodies[body], current.bodies[body], t, bodies[body]);
+    }
+
+    for (size_t i = 0; i < asteroids.size(); ++i)
+    {
+        InterpolateObject(previous.asteroids[i], current.asteroids[i], t, asteroids[i]);
+    }
+
+    InterpolateFloat3(previous.listenerPosition, current.listenerPosition, t, listenerPosition);
+    InterpolateFloat3(previous.emitterPosition, current.emitterPosition, t, emitterPosition);
+}
+
+void RenderSnapshot::SetCamera(const XMFLOAT3& position, float cameraPitch, float cameraYaw)
+{
+    cameraPosition = position;
+    pitch = cameraPitch;
+    yaw = cameraYaw;
+
+    XMVECTOR lookDirection = XMVectorSet(
+        cosf(pitch) * sinf(yaw),
+        sinf(pitch),
+        cosf(pitch) * cosf(yaw),
+        0.f);
+    XMStoreFloat4x4(&view, XMMatrixLookToRH(XMLoadFloat3(&cameraPosition), lookDirection, XMVectorSet(0.f, 1.f, 0.f, 0.f)));
+}
@@ -0,0 +1,76 @@
+//
+// RenderSnapshot.h - Everything Render needs from one simulation update
+//
+
+#pragma once
+
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Simulation.h"
+
+// A drawable with its precomputed lighting and world space bounds.
+struct RenderObject
+{
+    DirectX::XMFLOAT4X4 world;
+    DirectX::BoundingSphere bounds;     // Of the unit diameter sphere mesh
+    DirectX::XMFLOAT3   lightDirection;
+    float               lightIntensity;     // Diffuse intensity, falls off as 1 / distance
+};
+
+// Written by the simulation after each update and read by the renderer, which never
+// touches Simulation directly. Snapshots are recycled through a DX::TripleBuffer so
+// the asteroid array keeps its capacity between updates.
+struct RenderSnapshot
+{
+    RenderSnapshot() noexcept :
+        update(0),
+        tickCounter(0),
+        leftOverTicks(0),
+        stepTicks(0)
+    {
+    }
+
+    // Blends previous towards current by t (0..1): positions and scales are lerped,
+    // rotations slerped and angles take the short way round. The view is rebuilt from the
+    // blended camera rather than blended itself. Everything else comes from current, as
+    // does the whole snapshot if the two cannot be blended (e.g. previous is empty or the
+    // asteroid count changed).
+    void Interpolate(const RenderSnapshot& previous, const RenderSnapshot& current, float t);
+
+    // Sets the camera and the view looking from position along pitch and yaw (radians).
+    void SetCamera(const DirectX::XMFLOAT3& position, float cameraPitch, float cameraYaw);
+
+    // Number of updates run when the snapshot was taken; 0 until the first update.
+    uint64_t                    update;
+
+    // Timing of the update, filled in by whoever drives the simulation's StepTimer:
+    // the clock counter of its last tick, the time left over towards the next update
+    // and the fixed step, both in StepTimer ticks.
+    uint64_t                    tickCounter;
+    uint64_t                    leftOverTicks;
+    uint64_t                    stepTicks;
+
+    // Camera
+    DirectX::XMFLOAT3           cameraPosition;
+    float                       pitch;
+    float                       yaw;
+    DirectX::XMFLOAT4X4         view;
+    DirectX::XMFLOAT4X4         roll;
+
+    // Orbit angle of the bodies, in degrees.
+    float                       rotation;
+
+    RenderObject                bodies[Simulation::BodyCount];
+    std::vector<RenderObject>   asteroids;
+
+    // Requests the game should act on.
+    bool                        wantsRelativeMouse;
+    bool                        exitRequested;
+
+    // Audio
+    DirectX::XMFLOAT3           listenerPosition;
+    DirectX::XMFLOAT3           emitterPosition;
+};
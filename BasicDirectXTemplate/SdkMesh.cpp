@@ -0,0 +1,318 @@
+//
+// SdkMesh.cpp
+//
+
+#include "SdkMesh.h"
+
+#include "FileFormat.h"
+
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <utility>
+
+using FileFormat::Fail;
+using FileFormat::FitsIn;
+
+namespace
+{
+    const uint32_t SDKMESH_VERSION = 101;
+    const uint32_t SDKMESH_PBR_VERSION = 200;
+    const uint8_t END_OF_DECLARATION = 0xff;
+    const char* const ERROR_PREFIX = "SdkMesh: ";
+
+    const uint8_t DECL_TYPE_SIZES[DeclUnused + 1] = { 4, 8, 12, 16, 4, 4, 4, 8, 4, 4, 8, 4, 8, 4, 4, 4, 8, 0 };
+
+    const char* const DECL_TYPE_NAMES[DeclUnused + 1] =
+    {
+        "float1", "float2", "float3", "float4", "color", "ubyte4", "short2", "short4", "ubyte4n", "short2n",
+        "short4n", "ushort2n", "ushort4n", "udec3", "dec3n", "float16x2", "float16x4", "unused"
+    };
+
+    const char* const DECL_USAGE_NAMES[UsageSample + 1] =
+    {
+        "position", "blendweight", "blendindices", "normal", "psize", "texcoord", "tangent", "binormal",
+        "tessfactor", "positiont", "color", "fog", "depth", "sample"
+    };
+
+    template<size_t N>
+    void CheckName(const char (&name)[N], const char* what, size_t index)
+    {
+        if (!memchr(name, 0, N))
+            Fail(ERROR_PREFIX, "%s %zu has an unterminated name", what, index);
+    }
+
+    template<typename Index>
+    void CheckIndices(const uint8_t* data, const SdkMeshSubset& subset, uint64_t vertexCount, size_t subsetIndex)
+    {
+        // Every index is offset by the subset's first vertex when drawn.
+        const uint64_t limit = vertexCount - subset.vertexStart;
+        const Index* indices = reinterpret_cast<const Index*>(data) + subset.indexStart;
+        Index largest = 0;
+        for (uint64_t i = 0; i < subset.indexCount; ++i)
+        {
+            largest = (indices[i] > largest) ? indices[i] : largest;
+        }
+        if (subset.indexCount && largest >= limit)
+            Fail(ERROR_PREFIX, "subset %zu indexes vertex %llu of %llu", subsetIndex,
+                static_cast<unsigned long long>(subset.vertexStart + largest), static_cast<unsigned long long>(vertexCount));
+    }
+}
+
+SdkMesh::SdkMesh() noexcept :
+    m_data(nullptr),
+    m_size(0),
+    m_header(nullptr),
+    m_validatedIndices(0)
+{
+}
+
+void SdkMesh::Load(const char* name)
+{
+    DX::MappedFile file = DX::MapData(name);
+    Parse(file.data(), file.size());
+    // The views point into the mapping, which moves with the MappedFile.
+    m_file = std::move(file);
+}
+
+void SdkMesh::Load(const wchar_t* name)
+{
+    DX::MappedFile file = DX::MapData(name);
+    Parse(file.data(), file.size());
+    m_file = std::move(file);
+}
+
+template<typename T>
+SdkMesh::View<T> SdkMesh::GetArray(uint64_t offset, uint64_t count, const char* what) const
+{
+    // Structures stay within the header and non-buffer sections, aligned to be read in place.
+    const uint64_t limit = m_header->headerSize + m_header->nonBufferDataSize;
+    if (offset % alignof(T) != 0)
+        Fail(ERROR_PREFIX, "%s at offset %llu are misaligned", what, static_cast<unsigned long long>(offset));
+    if (count > limit / sizeof(T) || !FitsIn(offset, count * sizeof(T), limit))
+        Fail(ERROR_PREFIX, "%s at offset %llu overrun the file", what, static_cast<unsigned long long>(offset));
+    return View<T>(reinterpret_cast<const T*>(m_data + offset), size_t(count));
+}
+
+void SdkMesh::Parse(const uint8_t* data, size_t size)
+{
+    *this = SdkMesh();
+
+    if (reinterpret_cast<uintptr_t>(data) % alignof(SdkMeshHeader) != 0)
+        Fail(ERROR_PREFIX, "data is not 8 byte aligned");
+    if (size < sizeof(SdkMeshHeader))
+        Fail(ERROR_PREFIX, "%zu bytes is too small for the header", size);
+
+    const SdkMeshHeader& header = *reinterpret_cast<const SdkMeshHeader*>(data);
+    if (header.version != SDKMESH_VERSION && header.version != SDKMESH_PBR_VERSION)
+        Fail(ERROR_PREFIX, "version %u is not supported", header.version);
+    if (header.isBigEndian)
+        Fail(ERROR_PREFIX, "big endian files are not supported");
+    if (header.headerSize != sizeof(SdkMeshHeader) + uint64_t(header.vertexBufferCount) * sizeof(SdkMeshVertexBuffer)
+        + uint64_t(header.indexBufferCount) * sizeof(SdkMeshIndexBuffer))
+        Fail(ERROR_PREFIX, "header size does not match its buffer counts");
+    if (!FitsIn(header.headerSize, header.nonBufferDataSize, size) ||
+        header.bufferDataSize != size - header.headerSize - header.nonBufferDataSize)
+        Fail(ERROR_PREFIX, "section sizes do not add up to the file size");
+    if (!header.vertexBufferCount || !header.indexBufferCount || !header.meshCount || !header.subsetCount
+        || !header.materialCount)
+        Fail(ERROR_PREFIX, "no vertex buffers, index buffers, meshes, subsets or materials");
+
+    m_data = data;
+    m_size = size;
+    m_header = &header;
+    try
+    {
+        m_vertexBuffers = GetArray<SdkMeshVertexBuffer>(header.vertexBufferOffset, header.vertexBufferCount, "vertex buffers");
+        m_indexBuffers = GetArray<SdkMeshIndexBuffer>(header.indexBufferOffset, header.indexBufferCount, "index buffers");
+        m_meshes = GetArray<SdkMeshMesh>(header.meshOffset, header.meshCount, "meshes");
+        m_subsets = GetArray<SdkMeshSubset>(header.subsetOffset, header.subsetCount, "subsets");
+        m_frames = GetArray<SdkMeshFrame>(header.frameOffset, header.frameCount, "frames");
+        if (header.version == SDKMESH_PBR_VERSION)
+        {
+            m_pbrMaterials = GetArray<SdkMeshPbrMaterial>(header.materialOffset, header.materialCount, "materials");
+        }
+        else
+        {
+            m_materials = GetArray<SdkMeshMaterial>(header.materialOffset, header.materialCount, "materials");
+        }
+
+        // Vertex and index data lie in the buffer section.
+        const uint64_t bufferStart = header.headerSize + header.nonBufferDataSize;
+        for (size_t i = 0; i < m_vertexBuffers.size(); ++i)
+        {
+            const SdkMeshVertexBuffer& buffer = m_vertexBuffers[i];
+            if (buffer.dataOffset < bufferStart || !FitsIn(buffer.dataOffset, buffer.sizeBytes, size))
+                Fail(ERROR_PREFIX, "vertex buffer %zu overruns the file", i);
+            if (!buffer.strideBytes || buffer.vertexCount > buffer.sizeBytes / buffer.strideBytes)
+                Fail(ERROR_PREFIX, "vertex buffer %zu holds fewer than %llu vertices", i,
+                    static_cast<unsigned long long>(buffer.vertexCount));
+
+            const View<SdkMeshVertexElement> elements = GetElements(buffer);
+            if (elements.size() == SdkMeshVertexBuffer::MaxElements)
+                Fail(ERROR_PREFIX, "vertex buffer %zu declaration has no end", i);
+            for (const SdkMeshVertexElement& element : elements)
+            {
+                if (element.type >= DeclUnused || element.usage > UsageSample)
+                    Fail(ERROR_PREFIX, "vertex buffer %zu has an element of type %u, usage %u", i, element.type,
+                        element.usage);
+                if (element.offset + GetDeclTypeSize(element.type) > buffer.strideBytes)
+                    Fail(ERROR_PREFIX, "vertex buffer %zu has an element past its %llu byte stride", i,
+                        static_cast<unsigned long long>(buffer.strideBytes));
+            }
+        }
+
+        for (size_t i = 0; i < m_indexBuffers.size(); ++i)
+        {
+            const SdkMeshIndexBuffer& buffer = m_indexBuffers[i];
+            if (buffer.indexType > 1)
+                Fail(ERROR_PREFIX, "index buffer %zu has index type %u", i, buffer.indexType);
+            if (buffer.dataOffset < bufferStart || !FitsIn(buffer.dataOffset, buffer.sizeBytes, size))
+                Fail(ERROR_PREFIX, "index buffer %zu overruns the file", i);
+            if (buffer.dataOffset % GetIndexSize(buffer) != 0)
+                Fail(ERROR_PREFIX, "index buffer %zu is misaligned", i);
+            if (buffer.indexCount > buffer.sizeBytes / GetIndexSize(buffer))
+                Fail(ERROR_PREFIX, "index buffer %zu holds fewer than %llu indices", i,
+                    static_cast<unsigned long long>(buffer.indexCount));
+        }
+
+        for (size_t i = 0; i < m_materials.size(); ++i)
+        {
+            const SdkMeshMaterial& material = m_materials[i];
+            CheckName(material.name, "material", i);
+            CheckName(material.materialInstancePath, "material", i);
+            CheckName(material.diffuseTexture, "material", i);
+            CheckName(material.normalTexture, "material", i);
+            CheckName(material.specularTexture, "material", i);
+        }
+
+        for (size_t i = 0; i < m_pbrMaterials.size(); ++i)
+        {
+            const SdkMeshPbrMaterial& material = m_pbrMaterials[i];
+            CheckName(material.name, "material", i);
+            CheckName(material.rmaTexture, "material", i);
+            CheckName(material.albedoTexture, "material", i);
+            CheckName(material.normalTexture, "material", i);
+            CheckName(material.emissiveTexture, "material", i);
+        }
+
+        for (size_t i = 0; i < m_subsets.size(); ++i)
+        {
+            const SdkMeshSubset& subset = m_subsets[i];
+            CheckName(subset.name, "subset", i);
+            if (subset.material >= header.materialCount)
+                Fail(ERROR_PREFIX, "subset %zu uses material %u of %u", i, subset.material, header.materialCount);
+            if (subset.primitiveType > PrimitiveLineStripAdj)
+                Fail(ERROR_PREFIX, "subset %zu has primitive type %u; patch lists are not supported", i,
+                    subset.primitiveType);
+        }
+
+        for (size_t i = 0; i < m_frames.size(); ++i)
+        {
+            const SdkMeshFrame& frame = m_frames[i];
+            CheckName(frame.name, "frame", i);
+            if ((frame.mesh != SdkMeshFrame::None && frame.mesh >= header.meshCount)
+                || (frame.parent != SdkMeshFrame::None && frame.parent >= header.frameCount)
+                || (frame.child != SdkMeshFrame::None && frame.child >= header.frameCount)
+                || (frame.sibling != SdkMeshFrame::None && frame.sibling >= header.frameCount))
+                Fail(ERROR_PREFIX, "frame %zu refers to a mesh or frame that does not exist", i);
+        }
+
+        // Only a mesh's first stream is drawn (as DirectXTK does; exporters leave the
+        // stream count unreliable), so it is the one its subsets are checked against.
+        for (size_t i = 0; i < m_meshes.size(); ++i)
+        {
+            const SdkMeshMesh& mesh = m_meshes[i];
+            CheckName(mesh.name, "mesh", i);
+            if (mesh.vertexBuffers[0] >= header.vertexBufferCount || mesh.indexBuffer >= header.indexBufferCount)
+                Fail(ERROR_PREFIX, "mesh %zu uses a vertex or index buffer that does not exist", i);
+            if (!mesh.subsetCount)
+                Fail(ERROR_PREFIX, "mesh %zu has no subsets", i);
+
+            const View<uint32_t> frames = GetArray<uint32_t>(mesh.frameInfluenceOffset, mesh.frameInfluenceCount,
+                "frame influences");
+            for (uint32_t frame : frames)
+            {
+                if (frame >= header.frameCount)
+                    Fail(ERROR_PREFIX, "mesh %zu is influenced by frame %u of %u", i, frame, header.frameCount);
+            }
+
+            const SdkMeshVertexBuffer& vertices = m_vertexBuffers[mesh.vertexBuffers[0]];
+            const SdkMeshIndexBuffer& indices = m_indexBuffers[mesh.indexBuffer];
+            const uint8_t* indexData = data + indices.dataOffset;
+            for (uint32_t subsetIndex : GetArray<uint32_t>(mesh.subsetIndexOffset, mesh.subsetCount, "subset indices"))
+            {
+                if (subsetIndex >= header.subsetCount)
+                    Fail(ERROR_PREFIX, "mesh %zu uses subset %u of %u", i, subsetIndex, header.subsetCount);
+
+                const SdkMeshSubset& subset = m_subsets[subsetIndex];
+                if (!FitsIn(subset.indexStart, subset.indexCount, indices.indexCount))
+                    Fail(ERROR_PREFIX, "subset %u overruns index buffer %u", subsetIndex, mesh.indexBuffer);
+                if (!FitsIn(subset.vertexStart, subset.vertexCount, vertices.vertexCount))
+                    Fail(ERROR_PREFIX, "subset %u overruns vertex buffer %u", subsetIndex, mesh.vertexBuffers[0]);
+
+                if (indices.indexType)
+                {
+                    CheckIndices<uint32_t>(indexData, subset, vertices.vertexCount, subsetIndex);
+                }
+                else
+                {
+                    CheckIndices<uint16_t>(indexData, subset, vertices.vertexCount, subsetIndex);
+                }
+                m_validatedIndices += subset.indexCount;
+            }
+        }
+    }
+    catch (...)
+    {
+        *this = SdkMesh();
+        throw;
+    }
+}
+
+SdkMesh::View<uint32_t> SdkMesh::GetSubsetIndices(const SdkMeshMesh& mesh) const
+{
+    return View<uint32_t>(reinterpret_cast<const uint32_t*>(m_data + mesh.subsetIndexOffset), mesh.subsetCount);
+}
+
+SdkMesh::View<uint32_t> SdkMesh::GetFrameInfluences(const SdkMeshMesh& mesh) const
+{
+    return View<uint32_t>(reinterpret_cast<const uint32_t*>(m_data + mesh.frameInfluenceOffset),
+        mesh.frameInfluenceCount);
+}
+
+SdkMesh::View<uint8_t> SdkMesh::GetVertexData(const SdkMeshVertexBuffer& buffer) const
+{
+    return View<uint8_t>(m_data + buffer.dataOffset, size_t(buffer.sizeBytes));
+}
+
+SdkMesh::View<uint8_t> SdkMesh::GetIndexData(const SdkMeshIndexBuffer& buffer) const
+{
+    return View<uint8_t>(m_data + buffer.dataOffset, size_t(buffer.sizeBytes));
+}
+
+SdkMesh::View<SdkMeshVertexElement> SdkMesh::GetElements(const SdkMeshVertexBuffer& buffer)
+{
+    size_t count = 0;
+    while (count < SdkMeshVertexBuffer::MaxElements && buffer.elements[count].stream != END_OF_DECLARATION)
+    {
+        ++count;
+    }
+    return View<SdkMeshVertexElement>(buffer.elements, count);
+}
+
+uint32_t SdkMesh::GetDeclTypeSize(uint8_t type)
+{
+    return (type <= DeclUnused) ? DECL_TYPE_SIZES[type] : 0;
+}
+
+const char* SdkMesh::GetDeclTypeName(uint8_t type)
+{
+    return (type <= DeclUnused) ? DECL_TYPE_NAMES[type] : "unknown";
+}
+
+const char* SdkMesh::GetDeclUsageName(uint8_t usage)
+{
+    return (usage <= UsageSample) ? DECL_USAGE_NAMES[usage] : "unknown";
+}
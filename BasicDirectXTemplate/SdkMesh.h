@@ -0,0 +1,266 @@
+//
+// SdkMesh.h - Validated, zero-copy reader for DXUT .sdkmesh files
+//
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The file's own structures (SDKMesh.h in DirectXTK), laid out as the DXUT exporter
+// wrote them with 8 byte packing, so they are read straight from the file. Pointers the
+// D3D9 era runtime stored in place of offsets are left out of the unions.
+#pragma pack(push, 8)
+
+struct SdkMeshHeader
+{
+    uint32_t    version;                    // 101, or 200 with PBR materials
+    uint8_t     isBigEndian;
+    uint64_t    headerSize;                 // This, the vertex and the index buffer headers
+    uint64_t    nonBufferDataSize;          // Meshes, subsets, frames, materials
+    uint64_t    bufferDataSize;             // Vertex and index data, to the end of the file
+    uint32_t    vertexBufferCount;
+    uint32_t    indexBufferCount;
+    uint32_t    meshCount;
+    uint32_t    subsetCount;
+    uint32_t    frameCount;
+    uint32_t    materialCount;
+    uint64_t    vertexBufferOffset;         // File offsets of each array
+    uint64_t    indexBufferOffset;
+    uint64_t    meshOffset;
+    uint64_t    subsetOffset;
+    uint64_t    frameOffset;
+    uint64_t    materialOffset;
+};
+
+// D3DVERTEXELEMENT9. A stream of 0xff ends the declaration.
+struct SdkMeshVertexElement
+{
+    uint16_t    stream;
+    uint16_t    offset;
+    uint8_t     type;                       // SdkMeshDeclType
+    uint8_t     method;
+    uint8_t     usage;                      // SdkMeshDeclUsage
+    uint8_t     usageIndex;
+};
+
+struct SdkMeshVertexBuffer
+{
+    static const uint32_t MaxElements = 32;
+
+    uint64_t                vertexCount;
+    uint64_t                sizeBytes;
+    uint64_t                strideBytes;
+    SdkMeshVertexElement    elements[MaxElements];
+    uint64_t                dataOffset;
+};
+
+struct SdkMeshIndexBuffer
+{
+    uint64_t    indexCount;
+    uint64_t    sizeBytes;
+    uint32_t    indexType;                  // 0 for 16 bit indices, 1 for 32 bit
+    uint64_t    dataOffset;
+};
+
+struct SdkMeshMesh
+{
+    static const uint32_t MaxVertexStreams = 16;
+
+    char        name[100];
+    uint8_t     vertexStreamCount;
+    uint32_t    vertexBuffers[MaxVertexStreams];
+    uint32_t    indexBuffer;
+    uint32_t    subsetCount;
+    uint32_t    frameInfluenceCount;        // Bones
+    float       boundingBoxCenter[3];
+    float       boundingBoxExtents[3];
+    uint64_t    subsetIndexOffset;          // subsetCount uint32_t indices into the subsets
+    uint64_t    frameInfluenceOffset;       // frameInfluenceCount uint32_t frame indices
+};
+
+struct SdkMeshSubset
+{
+    char        name[100];
+    uint32_t    material;
+    uint32_t    primitiveType;              // SdkMeshPrimitiveType
+    uint64_t    indexStart;
+    uint64_t    indexCount;
+    uint64_t    vertexStart;                // Added to every index
+    uint64_t    vertexCount;
+};
+
+struct SdkMeshFrame
+{
+    static const uint32_t None = ~0u;
+
+    char        name[100];
+    uint32_t    mesh;                       // None when the frame has no mesh
+    uint32_t    parent;                     // Frame indices, or None
+    uint32_t    child;
+    uint32_t    sibling;
+    float       matrix[4][4];
+    uint32_t    animationDataIndex;
+};
+
+struct SdkMeshMaterial
+{
+    char        name[100];
+    char        materialInstancePath[260];
+    char        diffuseTexture[260];
+    char        normalTexture[260];
+    char        specularTexture[260];
+    float       diffuse[4];
+    float       ambient[4];
+    float       specular[4];
+    float       emissive[4];
+    float       power;
+    uint64_t    runtimeData[6];             // Texture pointers, unused on disk
+};
+
+// SDKMESH_MATERIAL_V2, what version 200 files hold instead: textures for DirectXTK's
+// PBR effect.
+struct SdkMeshPbrMaterial
+{
+    char        name[100];
+    char        rmaTexture[260];            // Roughness, metalness, ambient occlusion
+    char        albedoTexture[260];
+    char        normalTexture[260];
+    char        emissiveTexture[260];
+    float       alpha;
+    char        reserved[60];
+    uint64_t    runtimeData[6];
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(SdkMeshHeader) == 104, "SDKMESH_HEADER size");
+static_assert(sizeof(SdkMeshVertexBuffer) == 288, "SDKMESH_VERTEX_BUFFER_HEADER size");
+static_assert(sizeof(SdkMeshIndexBuffer) == 32, "SDKMESH_INDEX_BUFFER_HEADER size");
+static_assert(sizeof(SdkMeshMesh) == 224, "SDKMESH_MESH size");
+static_assert(sizeof(SdkMeshSubset) == 144, "SDKMESH_SUBSET size");
+static_assert(sizeof(SdkMeshFrame) == 184, "SDKMESH_FRAME size");
+static_assert(sizeof(SdkMeshMaterial) == 1256, "SDKMESH_MATERIAL size");
+static_assert(sizeof(SdkMeshPbrMaterial) == 1256, "SDKMESH_MATERIAL_V2 size");
+
+// D3DDECLTYPE.
+enum SdkMeshDeclType : uint8_t
+{
+    DeclFloat1, DeclFloat2, DeclFloat3, DeclFloat4, DeclColor, DeclUByte4, DeclShort2, DeclShort4, DeclUByte4N,
+    DeclShort2N, DeclShort4N, DeclUShort2N, DeclUShort4N, DeclUDec3, DeclDec3N, DeclFloat16x2, DeclFloat16x4,
+    DeclUnused
+};
+
+// D3DDECLUSAGE.
+enum SdkMeshDeclUsage : uint8_t
+{
+    UsagePosition, UsageBlendWeight, UsageBlendIndices, UsageNormal, UsagePointSize, UsageTexCoord, UsageTangent,
+    UsageBinormal, UsageTessFactor, UsagePositionT, UsageColor, UsageFog, UsageDepth, UsageSample
+};
+
+enum SdkMeshPrimitiveType : uint32_t
+{
+    PrimitiveTriangleList, PrimitiveTriangleStrip, PrimitiveLineList, PrimitiveLineStrip, PrimitivePointList,
+    PrimitiveTriangleListAdj, PrimitiveTriangleStripAdj, PrimitiveLineListAdj, PrimitiveLineStripAdj,
+    PrimitiveQuadPatchList, PrimitiveTrianglePatchList
+};
+
+// Validates a whole .sdkmesh up front and then hands out views into it: every count,
+// offset and index is checked against the file, including each subset's indices against
+// its vertex range, so nothing read through the views is out of bounds and the vertex
+// and index data can go to the GPU as they are. Nothing is copied; the views are valid
+// while the SdkMesh (or, for Parse, the caller's memory) is.
+//
+// Loading throws std::runtime_error for files that fail validation, big endian files
+// and versions other than 101 and 200.
+class SdkMesh
+{
+public:
+    template<typename T>
+    class View
+    {
+    public:
+        View() noexcept : m_data(nullptr), m_count(0) {}
+        View(const T* data, size_t count) noexcept : m_data(data), m_count(count) {}
+
+        const T* data() const                   { return m_data; }
+        size_t size() const                     { return m_count; }
+        bool empty() const                      { return m_count == 0; }
+        const T* begin() const                  { return m_data; }
+        const T* end() const                    { return m_data + m_count; }
+        const T& operator[] (size_t i) const    { return m_data[i]; }
+
+    private:
+        const T*    m_data;
+        size_t      m_count;
+    };
+
+    SdkMesh() noexcept;
+
+    SdkMesh(SdkMesh&&) = default;
+    SdkMesh& operator= (SdkMesh&&) = default;
+
+    SdkMesh(SdkMesh const&) = delete;
+    SdkMesh& operator= (SdkMesh const&) = delete;
+
+    // Maps name with DX::MapData and keeps it mapped.
+    void Load(const char* name);
+    void Load(const wchar_t* name);
+
+    // Reads a file already in memory, which must stay there while the views are used.
+    // data must be 8 byte aligned.
+    void Parse(const uint8_t* data, size_t size);
+
+    const SdkMeshHeader& GetHeader() const              { return *m_header; }
+    View<uint8_t> GetFileData() const                   { return View<uint8_t>(m_data, m_size); }
+    View<SdkMeshVertexBuffer> GetVertexBuffers() const  { return m_vertexBuffers; }
+    View<SdkMeshIndexBuffer> GetIndexBuffers() const    { return m_indexBuffers; }
+    View<SdkMeshMesh> GetMeshes() const                 { return m_meshes; }
+    View<SdkMeshSubset> GetSubsets() const              { return m_subsets; }
+    View<SdkMeshFrame> GetFrames() const                { return m_frames; }
+
+    // Version 101 files have the first kind of material, 200 the second; the other view
+    // is empty. Subsets index whichever there is.
+    View<SdkMeshMaterial> GetMaterials() const          { return m_materials; }
+    View<SdkMeshPbrMaterial> GetPbrMaterials() const    { return m_pbrMaterials; }
+    bool HasPbrMaterials() const                        { return !m_pbrMaterials.empty(); }
+
+    // A mesh's subsets, as indices into GetSubsets(), and the frames that influence it.
+    View<uint32_t> GetSubsetIndices(const SdkMeshMesh& mesh) const;
+    View<uint32_t> GetFrameInfluences(const SdkMeshMesh& mesh) const;
+
+    // A buffer's vertices or indices, sizeBytes long. Index data is 2 or 4 bytes per index.
+    View<uint8_t> GetVertexData(const SdkMeshVertexBuffer& buffer) const;
+    View<uint8_t> GetIndexData(const SdkMeshIndexBuffer& buffer) const;
+    static uint32_t GetIndexSize(const SdkMeshIndexBuffer& buffer)  { return buffer.indexType ? 4 : 2; }
+
+    // The elements before the end marker.
+    static View<SdkMeshVertexElement> GetElements(const SdkMeshVertexBuffer& buffer);
+
+    // Bytes an element of the type takes in a vertex, 0 for DeclUnused.
+    static uint32_t GetDeclTypeSize(uint8_t type);
+    static const char* GetDeclTypeName(uint8_t type);
+    static const char* GetDeclUsageName(uint8_t usage);
+
+    // Indices that Parse checked: every index of every subset, once per subset.
+    uint64_t GetValidatedIndexCount() const             { return m_validatedIndices; }
+
+private:
+    template<typename T>
+    View<T> GetArray(uint64_t offset, uint64_t count, const char* what) const;
+
+    DX::MappedFile                  m_file;
+    const uint8_t*                  m_data;
+    size_t                          m_size;
+    const SdkMeshHeader*            m_header;
+    View<SdkMeshVertexBuffer>       m_vertexBuffers;
+    View<SdkMeshIndexBuffer>        m_indexBuffers;
+    View<SdkMeshMesh>               m_meshes;
+    View<SdkMeshSubset>             m_subsets;
+    View<SdkMeshFrame>              m_frames;
+    View<SdkMeshMaterial>           m_materials;
+    View<SdkMeshPbrMaterial>        m_pbrMaterials;
+    uint64_t                        m_validatedIndices;
+};
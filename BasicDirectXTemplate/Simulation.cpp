@@ -0,0 +1,273 @@
+//
+// Simulation.cpp
+//
+
+#include "Simulation.h"
+
+#include "FileFormat.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "RenderSnapshot.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    const XMVECTORF32 START_POSITION = { 0.f, 0.f, -20.f, 0.f };
+    const float ROTATION_GAIN = 0.01f;
+
+    // Rates per second; the values the game was tuned with were per 60 Hz update.
+    const float MOVEMENT_SPEED = 0.07f * 60.f;
+    const float ROLL_SPEED = 0.2f * 60.f;
+    const float ORBIT_DEGREES_PER_SECOND = 60.f;
+
+    const XMVECTORF32 EARTH_ORBIT_RADIUS = { 10.f, 0.f, 0.f, 0.f };
+    const XMVECTORF32 ASTEROID_ORBIT_RADIUS = { 0.f, 2.f, 0.f, 0.f };
+    const XMVECTORF32 SHIP_POSITION = { 0.f, -1.f, -1.f, 0.f };
+    const float SHIP_SCALE = 0.05f;
+
+    // GeometricPrimitive::CreateSphere has a diameter of 1.
+    const float BODY_RADIUS = 0.5f;
+
+    const size_t ASTEROID_COUNT = 256;
+    const uint32_t ASTEROID_SEED = 1;
+    const float ASTEROID_BELT_INNER = 14.f;
+    const float ASTEROID_BELT_OUTER = 20.f;
+
+    // Asteroids per job when the field is updated in parallel.
+    const size_t ASTEROID_GRAIN = 4096;
+
+    // Bounds of the body sphere mesh drawn with world.
+    inline BoundingSphere XM_CALLCONV TransformBounds(FXMMATRIX world)
+    {
+        XMVECTOR scaleSq = XMVectorMax(XMVector3LengthSq(world.r[0]),
+            XMVectorMax(XMVector3LengthSq(world.r[1]), XMVector3LengthSq(world.r[2])));
+
+        BoundingSphere bounds;
+        XMStoreFloat3(&bounds.Center, world.r[3]);
+        bounds.Radius = BODY_RADIUS * sqrtf(XMVectorGetX(scaleSq));
+        return bounds;
+    }
+}
+
+Simulation::Simulation() noexcept(false) :
+    m_jobs(nullptr)
+{
+    m_bodies.Reserve(BodyCount);
+    m_bodies.AddNode();                                 // Sun
+    m_bodies.AddNode(Sun);                              // Earth
+    m_bodies.AddNode(Earth);                            // AsteroidOrbit
+    m_bodies.AddNode(AsteroidOrbit);                    // Asteroid
+    m_bodies.AddNode();                                 // Ship
+
+    m_bodies.SetTranslation(Earth, EARTH_ORBIT_RADIUS);
+    m_bodies.SetTranslation(Asteroid, ASTEROID_ORBIT_RADIUS);
+    m_bodies.SetTranslation(Ship, SHIP_POSITION);
+    m_bodies.SetScale(Ship, XMVectorReplicate(SHIP_SCALE));
+
+    Reset();
+}
+
+void Simulation::Reset()
+{
+    XMStoreFloat3(&m_cameraPos, START_POSITION);
+    m_pitch = 0;
+    m_yaw = 0;
+    XMStoreFloat4x4(&m_rollMatrix, XMMatrixIdentity());
+    m_rotation = 0;
+    m_updateCount = 0;
+    m_wantsRelativeMouse = false;
+    m_exitRequested = false;
+    UpdateBodies();
+
+    m_asteroids.Create(ASTEROID_COUNT, ASTEROID_SEED, ASTEROID_BELT_INNER, ASTEROID_BELT_OUTER);
+}
+
+void Simulation::Update(float elapsedSeconds, const SimulationInput& input)
+{
+    PROFILE_SCOPE("Simulation::Update");
+
+    m_updateCount++;
+
+    // Orbiting bodies advance one degree per 60th of a second.
+    m_rotation += ORBIT_DEGREES_PER_SECOND * elapsedSeconds;
+    if (m_rotation > 180)
+    {
+        m_rotation -= 360;
+    }
+
+    if (input.mouseRelative)
+    {
+        m_pitch -= float(input.mouseY) * ROTATION_GAIN;
+        m_yaw -= float(input.mouseX) * ROTATION_GAIN;
+
+        // limit pitch to straight up or straight down
+        // with a little fudge-factor to avoid gimbal lock
+        float limit = XM_PI / 2.0f - 0.01f;
+        m_pitch = std::max(-limit, m_pitch);
+        m_pitch = std::min(+limit, m_pitch);
+
+        // keep longitude in same range by wrapping
+        if (m_yaw > XM_PI)
+        {
+            m_yaw -= XM_PI * 2.0f;
+        }
+        else if (m_yaw < -XM_PI)
+        {
+            m_yaw += XM_PI * 2.0f;
+        }
+    }
+
+    m_wantsRelativeMouse = input.leftButton;
+    m_exitRequested = (input.keys & SimulationInput::Exit) != 0;
+
+    if (input.keys & SimulationInput::Home)
+    {
+        XMStoreFloat3(&m_cameraPos, START_POSITION);
+        m_pitch = m_yaw = 0;
+    }
+
+    XMFLOAT3 move(0.f, 0.f, 0.f);
+
+    if (input.keys & SimulationInput::Forward)
+        move.z += 1.f;
+
+    if (input.keys & SimulationInput::Back)
+        move.z -= 1.f;
+
+    if (input.keys & SimulationInput::Left)
+        move.x += 1.f;
+
+    if (input.keys & SimulationInput::Right)
+        move.x -= 1.f;
+
+    if (input.keys & SimulationInput::Up)
+        move.y += 1.f;
+
+    if (input.keys & SimulationInput::Down)
+        move.y -= 1.f;
+
+    XMMATRIX roll = XMLoadFloat4x4(&m_rollMatrix);
+    if (input.keys & SimulationInput::RollLeft)
+    {
+        roll = XMMatrixMultiply(roll, XMMatrixRotationZ(ROLL_SPEED * elapsedSeconds));
+    }
+    if (input.keys & SimulationInput::RollRight)
+    {
+        roll = XMMatrixMultiply(roll, XMMatrixRotationZ(-ROLL_SPEED * elapsedSeconds));
+    }
+    XMStoreFloat4x4(&m_rollMatrix, roll);
+
+    XMVECTOR q = XMQuaternionRotationRollPitchYaw(-m_pitch, m_yaw, 0.f);
+
+    XMVECTOR delta = XMVector3Rotate(XMLoadFloat3(&move), q);
+    delta = XMVectorScale(delta, MOVEMENT_SPEED * elapsedSeconds);
+
+    XMVECTOR cameraPos = XMVectorAdd(XMLoadFloat3(&m_cameraPos), delta);
+
+    XMVECTOR halfBound = XMVectorSubtract(XMVectorScale(XMLoadFloat3(&ROOM_BOUNDS), 0.5f),
+        XMVectorReplicate(0.1f));
+
+    cameraPos = XMVectorMin(cameraPos, halfBound);
+    cameraPos = XMVectorMax(cameraPos, XMVectorNegate(halfBound));
+    XMStoreFloat3(&m_cameraPos, cameraPos);
+
+    UpdateBodies();
+
+    if (m_jobs)
+    {
+        const size_t batches = (m_asteroids.GetCount() + AsteroidField::BatchSize - 1) / AsteroidField::BatchSize;
+        m_jobs->ParallelFor(batches, ASTEROID_GRAIN / AsteroidField::BatchSize, [&](size_t begin, size_t end)
+        {
+            m_asteroids.UpdateRange(begin * AsteroidField::BatchSize, (end - begin) * AsteroidField::BatchSize, elapsedSeconds);
+        });
+    }
+    else
+    {
+        m_asteroids.Update(elapsedSeconds);
+    }
+}
+
+// The sun spins and carries the earth around it; the asteroid circles the earth
+// on a pivot that rolls about X at the same rate.
+void Simulation::UpdateBodies()
+{
+    float angle = XMConvertToRadians(m_rotation);
+
+    m_bodies.SetRotation(Sun, XMQuaternionRotationRollPitchYaw(0.f, angle, 0.f));
+    m_bodies.SetRotation(AsteroidOrbit, XMQuaternionRotationRollPitchYaw(angle, 0.f, 0.f));
+    m_bodies.Update();
+}
+
+void Simulation::WriteSnapshot(RenderSnapshot& snapshot) const
+{
+    PROFILE_SCOPE("Simulation::WriteSnapshot");
+
+    snapshot.update = m_updateCount;
+
+    XMVECTOR cameraPos = XMLoadFloat3(&m_cameraPos);
+    snapshot.SetCamera(m_cameraPos, m_pitch, m_yaw);
+    snapshot.roll = m_rollMatrix;
+    snapshot.rotation = m_rotation;
+
+    // The bodies are lit along their transformed (1,1,1) corner, dimming with distance.
+    const XMVECTOR corner = XMVectorReplicate(1.f);
+    for (uint32_t body = 0; body < BodyCount; ++body)
+    {
+        RenderObject& object = snapshot.bodies[body];
+        XMMATRIX world = m_bodies.GetWorld(body);
+        XMVECTOR light = XMVector3Transform(corner, world);
+
+        XMStoreFloat4x4(&object.world, world);
+        object.bounds = TransformBounds(world);
+        XMStoreFloat3(&object.lightDirection, light);
+        object.lightIntensity = 1.f / XMVectorGetX(XMVector3Length(light));
+    }
+
+    // The ship is drawn in view space, so its light follows the sun relative to the camera.
+    RenderObject& ship = snapshot.bodies[Ship];
+    XMVECTOR shipLight = XMVector3Rotate(XMVectorNegate(cameraPos),
+        XMQuaternionRotationRollPitchYaw(-m_pitch, -m_yaw, 0.f));
+    XMStoreFloat3(&ship.lightDirection, shipLight);
+    ship.lightIntensity = 1.f / XMVectorGetX(XMVector3Length(cameraPos));
+
+    // Asteroids in the belt are lit from the sun.
+    const size_t asteroidCount = m_asteroids.GetCount();
+    snapshot.asteroids.resize(asteroidCount);
+    for (size_t i = 0; i < asteroidCount; ++i)
+    {
+        RenderObject& object = snapshot.asteroids[i];
+        XMVECTOR position = m_asteroids.GetPosition(i);
+
+        XMMATRIX world = m_asteroids.GetWorld(i);
+        XMStoreFloat4x4(&object.world, world);
+        object.bounds = TransformBounds(world);
+        XMStoreFloat3(&object.lightDirection, position);
+        object.lightIntensity = 1.f / XMVectorGetX(XMVector3Length(position));
+    }
+
+    snapshot.wantsRelativeMouse = m_wantsRelativeMouse;
+    snapshot.exitRequested = m_exitRequested;
+    snapshot.listenerPosition = GetListenerPosition();
+    snapshot.emitterPosition = GetEmitterPosition();
+}
+
+uint64_t Simulation::GetStateHash() const
+{
+    uint64_t hash = FileFormat::FnvOffsetBasis;
+    hash = FileFormat::Hash(&m_cameraPos, sizeof(m_cameraPos), hash);
+    hash = FileFormat::Hash(&m_pitch, sizeof(m_pitch), hash);
+    hash = FileFormat::Hash(&m_yaw, sizeof(m_yaw), hash);
+    hash = FileFormat::Hash(&m_rollMatrix, sizeof(m_rollMatrix), hash);
+    hash = FileFormat::Hash(&m_rotation, sizeof(m_rotation), hash);
+
+    const size_t asteroidBytes = m_asteroids.GetCount() * sizeof(float);
+    hash = FileFormat::Hash(m_asteroids.GetPositionsX(), asteroidBytes, hash);
+    hash = FileFormat::Hash(m_asteroids.GetPositionsY(), asteroidBytes, hash);
+    hash = FileFormat::Hash(m_asteroids.GetPositionsZ(), asteroidBytes, hash);
+    hash = FileFormat::Hash(m_asteroids.GetSpinAngles(), asteroidBytes, hash);
+    return hash;
+}
@@ -0,0 +1,122 @@
+//
+// Simulation.h - Camera, orbit and input logic that does not depend on a D3D device
+//
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+
+#include "AsteroidField.h"
+#include "TransformHierarchy.h"
+
+struct RenderSnapshot;
+
+namespace DX
+{
+    class JobSystem;
+}
+
+// Box the camera is kept inside.
+const DirectX::XMFLOAT3 ROOM_BOUNDS(50.f, 50.f, 50.f);
+
+// Input for a single update. The game fills this from DirectXTK's Keyboard and
+// Mouse; the headless runner fills it from a script.
+struct SimulationInput
+{
+    enum Keys : uint32_t
+    {
+        Forward     = 0x001,    // Up / W
+        Back        = 0x002,    // Down / S
+        Left        = 0x004,    // Left / A
+        Right       = 0x008,    // Right / D
+        Up          = 0x010,    // PageUp / Space
+        Down        = 0x020,    // PageDown / X
+        RollLeft    = 0x040,    // Q
+        RollRight   = 0x080,    // E
+        Home        = 0x100,
+        Exit        = 0x200,    // Escape
+    };
+
+    uint32_t keys;
+
+    // Mouse movement since the last update; only used while the mouse is in relative mode.
+    int32_t mouseX;
+    int32_t mouseY;
+    bool    mouseRelative;
+    bool    leftButton;
+};
+
+class Simulation
+{
+public:
+    // Nodes of the body hierarchy, in creation order.
+    enum Body : uint32_t
+    {
+        Sun,
+        Earth,
+        AsteroidOrbit,  // Pivot on the earth the asteroid circles around
+        Asteroid,
+        Ship,
+        BodyCount
+    };
+
+    Simulation() noexcept(false);
+
+    void Reset();
+
+    // Optional; large asteroid fields are then updated across the job system's threads.
+    void SetJobSystem(DX::JobSystem* jobs)              { m_jobs = jobs; }
+
+    // Advances the simulation by one update.
+    void Update(float elapsedSeconds, const SimulationInput& input);
+
+    // Camera
+    const DirectX::XMFLOAT3& GetCameraPosition() const  { return m_cameraPos; }
+    float GetPitch() const                              { return m_pitch; }
+    float GetYaw() const                                { return m_yaw; }
+    DirectX::XMMATRIX GetRollMatrix() const             { return DirectX::XMLoadFloat4x4(&m_rollMatrix); }
+
+    // Orbit angle of the bodies, in degrees.
+    float GetRotation() const                           { return m_rotation; }
+
+    // World transforms of the bodies, rebuilt at the end of each update.
+    const TransformHierarchy& GetBodies() const         { return m_bodies; }
+    DirectX::XMMATRIX GetBodyWorld(Body body) const     { return m_bodies.GetWorld(body); }
+
+    // Asteroid belt around the sun.
+    const AsteroidField& GetAsteroidField() const       { return m_asteroids; }
+
+    // Requests the game should act on after an update.
+    bool WantsRelativeMouse() const                     { return m_wantsRelativeMouse; }
+    bool ExitRequested() const                          { return m_exitRequested; }
+
+    // Audio listener and emitter positions.
+    const DirectX::XMFLOAT3& GetListenerPosition() const { return m_cameraPos; }
+    DirectX::XMFLOAT3 GetEmitterPosition() const        { return DirectX::XMFLOAT3(0.f, 0.f, 0.f); }
+
+    // Number of updates since the last Reset.
+    uint64_t GetUpdateCount() const                     { return m_updateCount; }
+
+    // Captures the camera, body transforms and lighting for the renderer.
+    void WriteSnapshot(RenderSnapshot& snapshot) const;
+
+    // FNV-1a hash of the simulated state, used to compare runs.
+    uint64_t GetStateHash() const;
+
+private:
+    void UpdateBodies();
+
+    DirectX::XMFLOAT3   m_cameraPos;
+    float               m_pitch;
+    float               m_yaw;
+    DirectX::XMFLOAT4X4 m_rollMatrix;
+    float               m_rotation;
+    TransformHierarchy  m_bodies;
+    AsteroidField       m_asteroids;
+    uint64_t            m_updateCount;
+    DX::JobSystem*      m_jobs;
+
+    bool                m_wantsRelativeMouse;
+    bool                m_exitRequested;
+};
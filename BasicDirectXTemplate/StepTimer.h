@@ -4,39 +4,136 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <exception>
+#include <stdexcept>
 #include <stdint.h>
 
+#include "FrameStatistics.h"
+
+#if !defined(_WIN32)
+#include <time.h>
+#endif
+
 namespace DX
 {
+    // Clock sources for BasicStepTimer. A clock exposes a raw monotonic counter and the
+    // number of counter units per second; the timer converts to its canonical tick format.
+
+#if defined(_WIN32)
+    // High resolution clock backed by QueryPerformanceCounter.
+    class QpcClock
+    {
+    public:
+        QpcClock() noexcept(false)
+        {
+            LARGE_INTEGER frequency;
+            if (!QueryPerformanceFrequency(&frequency))
+            {
+                throw std::exception( "QueryPerformanceFrequency" );
+            }
+
+            m_frequency = static_cast<uint64_t>(frequency.QuadPart);
+        }
+
+        uint64_t GetFrequency() const                       { return m_frequency; }
+
+        uint64_t GetCounter() const
+        {
+            LARGE_INTEGER currentTime;
+            if (!QueryPerformanceCounter(&currentTime))
+            {
+                throw std::exception( "QueryPerformanceCounter" );
+            }
+
+            return static_cast<uint64_t>(currentTime.QuadPart);
+        }
+
+    private:
+        uint64_t m_frequency;
+    };
+#endif
+
+    // Portable monotonic clock (clock_gettime on POSIX, std::chrono::steady_clock elsewhere).
+    class MonotonicClock
+    {
+    public:
+#if !defined(_WIN32)
+        uint64_t GetFrequency() const                       { return 1000000000ull; }
+
+        uint64_t GetCounter() const
+        {
+            timespec now;
+            if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+            {
+                throw std::runtime_error( "clock_gettime" );
+            }
+
+            return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+        }
+#else
+        uint64_t GetFrequency() const
+        {
+            return static_cast<uint64_t>(std::chrono::steady_clock::period::den / std::chrono::steady_clock::period::num);
+        }
+
+        uint64_t GetCounter() const
+        {
+            return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        }
+#endif
+    };
+
+    // Clock that only moves when it is explicitly advanced. Driving a fixed timestep
+    // timer from this clock makes every run bit-reproducible.
+    class VirtualClock
+    {
+    public:
+        explicit VirtualClock(uint64_t frequency = 10000000) noexcept :
+            m_frequency(frequency),
+            m_counter(0)
+        {
+        }
+
+        uint64_t GetFrequency() const                       { return m_frequency; }
+        uint64_t GetCounter() const                         { return m_counter; }
+
+        void Advance(uint64_t counts)                       { m_counter += counts; }
+        void AdvanceSeconds(double seconds)                 { m_counter += static_cast<uint64_t>(seconds * static_cast<double>(m_frequency)); }
+
+    private:
+        uint64_t m_frequency;
+        uint64_t m_counter;
+    };
+
     // Helper class for animation and simulation timing.
-    class StepTimer
+    template<typename TClock>
+    class BasicStepTimer
     {
     public:
-        StepTimer() noexcept(false) :
+        BasicStepTimer() noexcept(false) :
             m_elapsedTicks(0),
             m_totalTicks(0),
             m_leftOverTicks(0),
             m_frameCount(0),
             m_framesPerSecond(0),
             m_framesThisSecond(0),
-            m_qpcSecondCounter(0),
+            m_secondCounter(0),
             m_isFixedTimeStep(false),
             m_targetElapsedTicks(TicksPerSecond / 60)
         {
-            if (!QueryPerformanceFrequency(&m_qpcFrequency))
+            m_frequency = m_clock.GetFrequency();
+            if (m_frequency == 0)
             {
-                throw std::exception( "QueryPerformanceFrequency" );
+                throw std::runtime_error( "StepTimer clock frequency" );
             }
 
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            m_lastTime = m_clock.GetCounter();
 
             // Initialize max delta to 1/10 of a second.
-            m_qpcMaxDelta = static_cast<uint64_t>(m_qpcFrequency.QuadPart / 10);
+            m_maxDelta = m_frequency / 10;
         }
 
         // Get elapsed time since the previous Update call.
@@ -59,6 +156,33 @@ namespace DX
         // Set how often to call Update when in fixed timestep mode.
         void SetTargetElapsedTicks(uint64_t targetElapsed)	{ m_targetElapsedTicks = targetElapsed; }
         void SetTargetElapsedSeconds(double targetElapsed)	{ m_targetElapsedTicks = SecondsToTicks(targetElapsed); }
+        uint64_t GetTargetElapsedTicks() const              { return m_targetElapsedTicks; }
+
+        // Time accumulated towards the next fixed update, and that as a fraction of a step:
+        // how far to blend from the previous update's state to the latest one. Always 1 in
+        // variable timestep mode, where the latest state is current.
+        uint64_t GetLeftOverTicks() const                   { return m_leftOverTicks; }
+        double GetInterpolationFactor() const
+        {
+            if (!m_isFixedTimeStep || m_targetElapsedTicks == 0)
+                return 1.0;
+
+            return std::min(static_cast<double>(m_leftOverTicks) / static_cast<double>(m_targetElapsedTicks), 1.0);
+        }
+
+        // Clock counter sampled by the last Tick, and canonical ticks elapsed since such a
+        // counter. Lets another thread, with its own timer on the same clock, work out how
+        // much time has passed since this timer last ticked.
+        uint64_t GetLastTickCounter() const                 { return m_lastTime; }
+        uint64_t GetTicksSince(uint64_t counter) const      { return ClockToTicks(m_clock.GetCounter() - counter); }
+
+        // Frame time percentiles, render durations and hitches.
+        const FrameStatistics& GetStatistics() const        { return m_statistics; }
+        void ResetStatistics()                              { m_statistics.Reset(); }
+
+        // Access the underlying clock (e.g. to advance a VirtualClock by hand).
+        TClock& GetClock()                                  { return m_clock; }
+        const TClock& GetClock() const                      { return m_clock; }
 
         // Integer format represents time using 10,000,000 ticks per second.
         static const uint64_t TicksPerSecond = 10000000;
@@ -72,15 +196,12 @@ namespace DX
 
         void ResetElapsedTime()
         {
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception("QueryPerformanceCounter");
-            }
+            m_lastTime = m_clock.GetCounter();
 
             m_leftOverTicks = 0;
             m_framesPerSecond = 0;
             m_framesThisSecond = 0;
-            m_qpcSecondCounter = 0;
+            m_secondCounter = 0;
         }
 
         // Update timer state, calling the specified Update function the appropriate number of times.
@@ -88,27 +209,24 @@ namespace DX
         void Tick(const TUpdate& update)
         {
             // Query the current time.
-            LARGE_INTEGER currentTime;
+            uint64_t currentTime = m_clock.GetCounter();
 
-            if (!QueryPerformanceCounter(&currentTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            uint64_t timeDelta = currentTime - m_lastTime;
 
-            uint64_t timeDelta = static_cast<uint64_t>(currentTime.QuadPart - m_qpcLastTime.QuadPart);
+            m_lastTime = currentTime;
+            m_secondCounter += timeDelta;
 
-            m_qpcLastTime = currentTime;
-            m_qpcSecondCounter += timeDelta;
+            uint64_t rawTicks = ClockToTicks(timeDelta);
 
             // Clamp excessively large time deltas (e.g. after paused in the debugger).
-            if (timeDelta > m_qpcMaxDelta)
+            if (timeDelta > m_maxDelta)
             {
-                timeDelta = m_qpcMaxDelta;
+                timeDelta = m_maxDelta;
             }
 
-            // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
+            // Convert clock units into a canonical tick format. This cannot overflow due to the previous clamp.
             timeDelta *= TicksPerSecond;
-            timeDelta /= static_cast<uint64_t>(m_qpcFrequency.QuadPart);
+            timeDelta /= m_frequency;
 
             uint32_t lastFrameCount = m_frameCount;
 
@@ -157,19 +275,47 @@ namespace DX
                 m_framesThisSecond++;
             }
 
-            if (m_qpcSecondCounter >= static_cast<uint64_t>(m_qpcFrequency.QuadPart))
+            if (m_secondCounter >= m_frequency)
             {
                 m_framesPerSecond = m_framesThisSecond;
                 m_framesThisSecond = 0;
-                m_qpcSecondCounter %= static_cast<uint64_t>(m_qpcFrequency.QuadPart);
+                m_secondCounter %= m_frequency;
             }
+
+            // Record the raw frame time, the size of any catch-up burst and hitches (frames over twice the target).
+            uint32_t updates = m_frameCount - lastFrameCount;
+            m_statistics.Record(FrameStatistics::FrameTicks, rawTicks);
+            m_statistics.Record(FrameStatistics::UpdatesPerTick, updates);
+
+            if (rawTicks > m_targetElapsedTicks * 2)
+            {
+                m_statistics.RecordHitch(m_frameCount, rawTicks, updates);
+            }
+        }
+
+        // Call the specified Render function, recording how long it took.
+        template<typename TRender>
+        void MeasureRender(const TRender& render)
+        {
+            uint64_t start = m_clock.GetCounter();
+
+            render();
+
+            m_statistics.Record(FrameStatistics::RenderTicks, ClockToTicks(m_clock.GetCounter() - start));
         }
 
     private:
-        // Source timing data uses QPC units.
-        LARGE_INTEGER m_qpcFrequency;
-        LARGE_INTEGER m_qpcLastTime;
-        uint64_t m_qpcMaxDelta;
+        // Converts clock units to canonical ticks without overflowing on long pauses.
+        uint64_t ClockToTicks(uint64_t counts) const
+        {
+            return (counts / m_frequency) * TicksPerSecond + ((counts % m_frequency) * TicksPerSecond) / m_frequency;
+        }
+
+        // Source timing data uses clock units.
+        TClock   m_clock;
+        uint64_t m_frequency;
+        uint64_t m_lastTime;
+        uint64_t m_maxDelta;
 
         // Derived timing data uses a canonical tick format.
         uint64_t m_elapsedTicks;
@@ -180,10 +326,22 @@ namespace DX
         uint32_t m_frameCount;
         uint32_t m_framesPerSecond;
         uint32_t m_framesThisSecond;
-        uint64_t m_qpcSecondCounter;
+        uint64_t m_secondCounter;
 
         // Members for configuring fixed timestep mode.
         bool m_isFixedTimeStep;
         uint64_t m_targetElapsedTicks;
+
+        // Rolling frame timing statistics.
+        FrameStatistics m_statistics;
     };
+
+#if defined(_WIN32)
+    using StepTimer = BasicStepTimer<QpcClock>;
+#else
+    using StepTimer = BasicStepTimer<MonotonicClock>;
+#endif
+
+    // Timer driven by hand; advance GetClock() before each Tick.
+    using VirtualStepTimer = BasicStepTimer<VirtualClock>;
 }
@@ -0,0 +1,279 @@
+//
+// TextureCooker.cpp
+//
+
+#include "TextureCooker.h"
+
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+    // DXGI_FORMAT values; the tools build without the Windows headers.
+    const CookedFormat FORMAT_BC1 = { "BC1_UNORM", 71, BlockBC1 };
+    const CookedFormat FORMAT_BC3 = { "BC3_UNORM", 77, BlockBC3 };
+    const CookedFormat FORMAT_BC4 = { "BC4_UNORM", 80, BlockBC4 };
+    const CookedFormat FORMAT_BC5 = { "BC5_UNORM", 83, BlockBC5 };
+    const CookedFormat FORMAT_BC7 = { "BC7_UNORM", 98, BlockBC7 };
+
+    const char* const ROLE_NAMES[TextureRoleCount] = { "color", "normal", "mask", "metallic smoothness", "emission" };
+
+    struct RoleSuffix
+    {
+        const char*     suffix;
+        TextureRole     role;
+    };
+
+    // Longest first where one ends another.
+    const RoleSuffix ROLE_SUFFIXES[] =
+    {
+        { "_metallicsmoothness", TextureMetallicSmoothness },
+        { "_normal", TextureNormal },
+        { "_ao", TextureMask },
+        { "_height", TextureMask },
+        { "_roughness", TextureMask },
+        { "_metallic", TextureMask },
+        { "_emission", TextureEmission },
+        { "_emissive", TextureEmission },
+    };
+
+    // DDS_HEADER and DDS_HEADER_DXT10 from DDS.h, after the "DDS " magic.
+    struct DdsPixelFormat
+    {
+        uint32_t    size;
+        uint32_t    flags;
+        uint32_t    fourCC;
+        uint32_t    rgbBitCount;
+        uint32_t    rBitMask;
+        uint32_t    gBitMask;
+        uint32_t    bBitMask;
+        uint32_t    aBitMask;
+    };
+
+    struct DdsHeader
+    {
+        uint32_t        size;
+        uint32_t        flags;
+        uint32_t        height;
+        uint32_t        width;
+        uint32_t        pitchOrLinearSize;
+        uint32_t        depth;
+        uint32_t        mipMapCount;
+        uint32_t        reserved1[11];
+        DdsPixelFormat  pixelFormat;
+        uint32_t        caps;
+        uint32_t        caps2;
+        uint32_t        caps3;
+        uint32_t        caps4;
+        uint32_t        reserved2;
+    };
+
+    struct DdsHeaderDx10
+    {
+        uint32_t    dxgiFormat;
+        uint32_t    resourceDimension;
+        uint32_t    miscFlag;
+        uint32_t    arraySize;
+        uint32_t    miscFlags2;
+    };
+
+    static_assert(sizeof(DdsHeader) == 124, "DDS header size");
+    static_assert(sizeof(DdsHeaderDx10) == 20, "DDS DX10 header size");
+
+    const uint32_t DDS_MAGIC = 0x20534444;                  // "DDS "
+    const uint32_t DDS_FOURCC_DX10 = 0x30315844;            // "DX10"
+    const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+    const uint32_t DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+    const uint32_t DDPF_FOURCC = 0x4;
+    const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+    const uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+    bool EndsWith(const std::string& text, const char* suffix)
+    {
+        const size_t length = strlen(suffix);
+        return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+    }
+
+    bool HasAlpha(const Image& image)
+    {
+        if (image.channels != 2 && image.channels != 4)
+            return false;
+        for (size_t i = 3; i < image.pixels.size(); i += 4)
+        {
+            if (image.pixels[i] != 255)
+                return true;
+        }
+        return false;
+    }
+
+    Image Downsample(const Image& source, TextureRole role)
+    {
+        Image mip;
+        mip.width = std::max(source.width / 2, 1u);
+        mip.height = std::max(source.height / 2, 1u);
+        mip.channels = source.channels;
+        mip.pixels.resize(size_t(mip.width) * mip.height * 4);
+
+        const uint32_t stepX = (source.width > 1) ? 1 : 0;
+        const uint32_t stepY = (source.height > 1) ? 1 : 0;
+        for (uint32_t y = 0; y < mip.height; ++y)
+        {
+            const uint8_t* row0 = source.pixels.data() + size_t(y * 2) * source.width * 4;
+            const uint8_t* row1 = row0 + size_t(stepY) * source.width * 4;
+            uint8_t* out = mip.pixels.data() + size_t(y) * mip.width * 4;
+            for (uint32_t x = 0; x < mip.width; ++x, out += 4)
+            {
+                const size_t left = size_t(x * 2) * 4;
+                const size_t right = left + stepX * 4;
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    out[c] = uint8_t((row0[left + c] + row0[right + c] + row1[left + c] + row1[right + c] + 2) / 4);
+                }
+
+                if (role == TextureNormal)
+                {
+                    // Averaging shortens the normals; put them back on the unit sphere.
+                    float n[3];
+                    for (uint32_t c = 0; c < 3; ++c)
+                    {
+                        n[c] = out[c] / 127.5f - 1.f;
+                    }
+                    const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (length > 1e-3f)
+                    {
+                        for (uint32_t c = 0; c < 3; ++c)
+                        {
+                            out[c] = uint8_t(std::min(std::max((n[c] / length + 1.f) * 127.5f + 0.5f, 0.f), 255.f));
+                        }
+                    }
+                }
+            }
+        }
+        return mip;
+    }
+}
+
+uint64_t CookedTexture::GetByteCount() const
+{
+    uint64_t bytes = 0;
+    for (const auto& mip : mips)
+    {
+        bytes += mip.size();
+    }
+    return bytes;
+}
+
+TextureRole GetTextureRole(const char* path)
+{
+    // The file name without its extension, lower case.
+    std::string name = path;
+    const size_t slash = name.find_last_of("/\\");
+    if (slash != std::string::npos)
+    {
+        name.erase(0, slash + 1);
+    }
+    const size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos)
+    {
+        name.erase(dot);
+    }
+    std::transform(name.begin(), name.end(), name.begin(),
+        [](char c) { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; });
+
+    for (const RoleSuffix& suffix : ROLE_SUFFIXES)
+    {
+        if (EndsWith(name, suffix.suffix))
+            return suffix.role;
+    }
+    return TextureColor;
+}
+
+const char* GetTextureRoleName(TextureRole role)
+{
+    return ROLE_NAMES[role];
+}
+
+const CookedFormat& ChooseCookedFormat(TextureRole role, const Image& image)
+{
+    switch (role)
+    {
+    case TextureNormal:
+        return FORMAT_BC5;
+    case TextureMask:
+        return FORMAT_BC4;
+    case TextureMetallicSmoothness:
+    case TextureEmission:
+        return HasAlpha(image) ? FORMAT_BC3 : FORMAT_BC1;
+    default:
+        return FORMAT_BC7;
+    }
+}
+
+std::vector<Image> GenerateMips(const Image& image, TextureRole role)
+{
+    std::vector<Image> mips;
+    mips.push_back(image);
+    while (mips.back().width > 1 || mips.back().height > 1)
+    {
+        Image mip = Downsample(mips.back(), role);
+        mips.push_back(std::move(mip));
+    }
+    return mips;
+}
+
+CookedTexture CookTexture(const Image& image, TextureRole role, const BlockOptions& options)
+{
+    CookedTexture texture;
+    texture.format = &ChooseCookedFormat(role, image);
+    texture.width = image.width;
+    texture.height = image.height;
+
+    for (const Image& mip : GenerateMips(image, role))
+    {
+        texture.mips.push_back(CompressImage(mip.pixels.data(), mip.width, mip.height, texture.format->blockFormat,
+            options));
+    }
+
+    const std::vector<uint8_t> decoded = DecompressImage(texture.mips.front().data(), image.width, image.height,
+        texture.format->blockFormat);
+    texture.psnr = ComputePsnr(image.pixels.data(), decoded.data(), size_t(image.width) * image.height,
+        texture.format->blockFormat);
+    return texture;
+}
+
+bool SaveDds(const char* path, const CookedTexture& texture)
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    DdsHeader header = {};
+    header.size = sizeof(DdsHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = texture.height;
+    header.width = texture.width;
+    header.pitchOrLinearSize = static_cast<uint32_t>(texture.mips.front().size());
+    header.mipMapCount = static_cast<uint32_t>(texture.mips.size());
+    header.pixelFormat.size = sizeof(DdsPixelFormat);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+    header.caps = DDSCAPS_TEXTURE | ((texture.mips.size() > 1) ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    DdsHeaderDx10 extension = {};
+    extension.dxgiFormat = texture.format->dxgiFormat;
+    extension.resourceDimension = D3D10_RESOURCE_DIMENSION_TEXTURE2D;
+    extension.arraySize = 1;
+
+    file.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(&extension), sizeof(extension));
+    for (const auto& mip : texture.mips)
+    {
+        file.write(reinterpret_cast<const char*>(mip.data()), std::streamsize(mip.size()));
+    }
+
+    return file.good();
+}
@@ -0,0 +1,65 @@
+//
+// TextureCooker.h - Mip generation, block compression and DDS output for source textures
+//
+
+#pragma once
+
+#include "BlockCompression.h"
+#include "ImageDecoder.h"
+
+#include <stdint.h>
+#include <vector>
+
+// What a texture holds, from the suffix of its file name (Unity's export names):
+//
+//  _Normal                                 tangent space normal, BC5 (x and y; the shader
+//                                          rebuilds z)
+//  _AO, _Height, _Roughness, _Metallic     one channel masks, BC4
+//  _MetallicSmoothness                     metallic in red, smoothness in alpha, BC3, or
+//                                          BC1 when the source has no alpha
+//  _Emission, _Emissive                    BC1, or BC3 with alpha
+//  anything else                           colour (albedo, base colour), BC7
+//
+// The game renders to a UNORM back buffer and samples the WIC loaded sources as UNORM, so
+// colours are cooked to UNORM formats too and look the same as before.
+enum TextureRole : uint32_t
+{
+    TextureColor,
+    TextureNormal,
+    TextureMask,
+    TextureMetallicSmoothness,
+    TextureEmission,
+    TextureRoleCount
+};
+
+struct CookedFormat
+{
+    const char*     name;           // As in TextureManifest, e.g. "BC7_UNORM"
+    uint32_t        dxgiFormat;
+    BlockFormat     blockFormat;
+};
+
+struct CookedTexture
+{
+    const CookedFormat*                 format;
+    uint32_t                            width;
+    uint32_t                            height;
+    std::vector<std::vector<uint8_t>>   mips;       // Blocks of each mip, largest first
+    double                              psnr;       // Of the top mip against the source, in dB
+
+    uint64_t GetByteCount() const;
+};
+
+TextureRole GetTextureRole(const char* path);
+const char* GetTextureRoleName(TextureRole role);
+const CookedFormat& ChooseCookedFormat(TextureRole role, const Image& image);
+
+// The full chain down to 1x1, each level a 2x2 box filter of the one above (odd sizes
+// drop the last row or column). Normal maps are renormalized at every level.
+std::vector<Image> GenerateMips(const Image& image, TextureRole role);
+
+// Compresses every mip to the format chosen for the role.
+CookedTexture CookTexture(const Image& image, TextureRole role, const BlockOptions& options = GetDefaultBlockOptions());
+
+// DDS with the DX10 header extension, as DDSTextureLoader reads it.
+bool SaveDds(const char* path, const CookedTexture& texture);
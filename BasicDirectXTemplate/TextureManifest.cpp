@@ -0,0 +1,146 @@
+//
+// TextureManifest.cpp
+//
+
+#include "TextureManifest.h"
+
+#include "FileFormat.h"
+
+#include <algorithm>
+#include <fstream>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using FileFormat::ComparePaths;
+
+namespace
+{
+    const char* const FILE_HEADER = "# texture manifest v1";
+
+    bool ParseNumber(const std::string& text, uint64_t& value, int base)
+    {
+        if (text.empty())
+            return false;
+        char* end = nullptr;
+        value = strtoull(text.c_str(), &end, base);
+        return *end == 0;
+    }
+}
+
+void TextureManifest::Set(const Entry& entry)
+{
+    auto position = std::lower_bound(m_entries.begin(), m_entries.end(), entry,
+        [](const Entry& a, const Entry& b) { return ComparePaths(a.source.c_str(), b.source.c_str()) < 0; });
+
+    if (position != m_entries.end() && ComparePaths(position->source.c_str(), entry.source.c_str()) == 0)
+    {
+        *position = entry;
+    }
+    else
+    {
+        m_entries.insert(position, entry);
+    }
+}
+
+void TextureManifest::Remove(const char* source)
+{
+    if (const Entry* entry = Find(source))
+    {
+        m_entries.erase(m_entries.begin() + (entry - m_entries.data()));
+    }
+}
+
+const TextureManifest::Entry* TextureManifest::Find(const char* source) const
+{
+    auto position = std::lower_bound(m_entries.begin(), m_entries.end(), source,
+        [](const Entry& a, const char* b) { return ComparePaths(a.source.c_str(), b) < 0; });
+
+    if (position != m_entries.end() && ComparePaths(position->source.c_str(), source) == 0)
+        return &*position;
+    return nullptr;
+}
+
+bool TextureManifest::Save(const char* path) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    file << FILE_HEADER << "\n# source\tcooked\tformat\twidth\theight\tmips\thash\tbytes\n";
+    for (const Entry& entry : m_entries)
+    {
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016" PRIx64, entry.hash);
+        file << entry.source << '\t' << entry.cooked << '\t' << entry.format << '\t' << entry.width << '\t'
+            << entry.height << '\t' << entry.mipCount << '\t' << hash << '\t' << entry.bytes << '\n';
+    }
+
+    return file.good();
+}
+
+bool TextureManifest::Load(const char* path)
+{
+    Clear();
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+
+    // Tolerates the line ends changing on the way through source control.
+    std::string line;
+    auto readLine = [&file, &line]()
+    {
+        if (!std::getline(file, line))
+            return false;
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        return true;
+    };
+
+    if (!readLine() || line != FILE_HEADER)
+        return false;
+
+    std::vector<Entry> entries;
+    while (readLine())
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::vector<std::string> fields;
+        for (size_t begin = 0; ; )
+        {
+            const size_t end = line.find('\t', begin);
+            fields.push_back(line.substr(begin, end - begin));
+            if (end == std::string::npos)
+                break;
+            begin = end + 1;
+        }
+
+        uint64_t width, height, mipCount;
+        Entry entry = {};
+        if (fields.size() != 8 || fields[0].empty() || fields[1].empty() || fields[2].empty()
+            || !ParseNumber(fields[3], width, 10) || !ParseNumber(fields[4], height, 10)
+            || !ParseNumber(fields[5], mipCount, 10) || !ParseNumber(fields[6], entry.hash, 16)
+            || !ParseNumber(fields[7], entry.bytes, 10))
+        {
+            return false;
+        }
+
+        entry.source = fields[0];
+        entry.cooked = fields[1];
+        entry.format = fields[2];
+        entry.width = uint32_t(width);
+        entry.height = uint32_t(height);
+        entry.mipCount = uint32_t(mipCount);
+        entries.push_back(std::move(entry));
+    }
+
+    for (const Entry& entry : entries)
+    {
+        Set(entry);
+    }
+    return true;
+}
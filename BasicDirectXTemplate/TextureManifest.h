@@ -0,0 +1,55 @@
+//
+// TextureManifest.h - Which source textures have been cooked, to what, from which contents
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Written by the "cook" tool next to the DDS files it produces and read by the game,
+// which loads a texture's cooked file instead of decoding the source when the source is
+// listed. Source and cooked paths are relative to the source and output directories,
+// with forward slashes.
+//
+// The hash covers the source file's bytes and the settings it was cooked with, so the
+// cooker only rebuilds entries whose hash changed or whose output is missing.
+class TextureManifest
+{
+public:
+    struct Entry
+    {
+        std::string     source;
+        std::string     cooked;
+        std::string     format;         // DXGI format name without the prefix, e.g. "BC7_UNORM_SRGB"
+        uint32_t        width;
+        uint32_t        height;
+        uint32_t        mipCount;
+        uint64_t        hash;
+        uint64_t        bytes;          // Of the cooked file
+    };
+
+    TextureManifest() noexcept {}
+
+    void Clear()                                        { m_entries.clear(); }
+
+    // Replaces the entry for the same source, if any.
+    void Set(const Entry& entry);
+    void Remove(const char* source);
+
+    // Paths compare case insensitively and with either slash, as on Windows.
+    const Entry* Find(const char* source) const;
+
+    // Sorted by source.
+    const std::vector<Entry>& GetEntries() const        { return m_entries; }
+
+    // Tab separated text, one entry per line after a version line. Load rejects other
+    // versions and malformed lines and leaves the manifest empty.
+    bool Save(const char* path) const;
+    bool Load(const char* path);
+
+private:
+    std::vector<Entry>  m_entries;
+};
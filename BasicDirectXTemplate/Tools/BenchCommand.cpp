@@ -0,0 +1,2090 @@
+//
+// BenchCommand.cpp - CPU micro-benchmarks for the device independent systems
+//
+// usage: bench <name> [options]
+//
+
+#include "ToolCommands.h"
+
+#include "AssetLoader.h"
+#include "AssetPack.h"
+#include "AsteroidField.h"
+#include "BlockCompression.h"
+#include "BloomReference.h"
+#include "FrameGraph.h"
+#include "FrustumCuller.h"
+#include "ImageDecoder.h"
+#include "InstanceBuilder.h"
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+#include "SdkMesh.h"
+#include "TransformHierarchy.h"
+#include "TransientTexturePool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Cost of a PROFILE_SCOPE with nothing inside it.
+    int BenchProfiler(int argc, char** argv)
+    {
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 10000000ll);
+
+        auto start = Clock::now();
+        for (long long i = 0; i < iterations; ++i)
+        {
+            PROFILE_SCOPE("Bench");
+        }
+        double seconds = SecondsSince(start);
+
+        printf("profiler: %lld scopes, %.1f ns/scope\n", iterations, seconds * 1e9 / double(iterations));
+
+        // Traces written while another thread keeps lapping its ring must only hold whole
+        // events: a torn one would show up as a negative duration.
+        const std::string tracePath = (std::filesystem::temp_directory_path() / "BenchProfiler.json").string();
+        std::atomic<bool> recording(true);
+        std::thread recorder([&recording]()
+        {
+            while (recording.load(std::memory_order_relaxed))
+            {
+                PROFILE_SCOPE("BenchRecorder");
+            }
+        });
+
+        const int traces = 20;
+        int tornTraces = 0, unwritten = 0;
+        size_t events = 0;
+        for (int i = 0; i < traces; ++i)
+        {
+            if (!DX::Profiler::WriteChromeTrace(tracePath.c_str()))
+            {
+                ++unwritten;
+                continue;
+            }
+            std::ifstream file(tracePath);
+            const std::string trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            tornTraces += (trace.find("\"dur\":-") != std::string::npos) ? 1 : 0;
+            for (size_t at = trace.find("\"ph\":\"X\""); at != std::string::npos; at = trace.find("\"ph\":\"X\"", at + 1))
+            {
+                ++events;
+            }
+        }
+        recording = false;
+        recorder.join();
+        std::filesystem::remove(tracePath);
+
+        printf("  %d traces written while recording, %zu events, %d torn\n", traces - unwritten, events, tornTraces);
+        return (tornTraces || unwritten) ? 1 : 0;
+    }
+
+    // World matrix rebuilds for systems of bodies orbiting bodies.
+    int BenchTransforms(int argc, char** argv)
+    {
+        const long long bodies = Tools::GetOption(argc, argv, "--bodies", 10000ll);
+        const long long depth = Tools::GetOption(argc, argv, "--depth", 4ll);
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 1000ll);
+
+        if (bodies <= 0 || depth <= 0 || iterations <= 0)
+        {
+            fprintf(stderr, "bench transforms: --bodies, --depth and --iterations must be positive\n");
+            return 1;
+        }
+
+        // Chains of 'depth' nodes: a star, its planet, the planet's moon, ...
+        TransformHierarchy hierarchy;
+        hierarchy.Reserve(size_t(bodies));
+        std::vector<uint32_t> roots;
+
+        uint32_t parent = TransformHierarchy::NoParent;
+        for (long long i = 0; i < bodies; ++i)
+        {
+            if (i % depth == 0)
+            {
+                parent = TransformHierarchy::NoParent;
+            }
+
+            uint32_t node = hierarchy.AddNode(parent);
+            hierarchy.SetTranslation(node, XMVectorSet(float(i % 7) + 2.f, 0.f, float(i % 3), 0.f));
+            if (parent == TransformHierarchy::NoParent)
+            {
+                roots.push_back(node);
+            }
+            parent = node;
+        }
+        hierarchy.Update();
+
+        // A parent that does not exist yet, itself included, must be rejected and leave
+        // the hierarchy as it was.
+        const size_t nodeCount = hierarchy.GetNodeCount();
+        uint32_t badParentsAccepted = 0;
+        for (uint32_t badParent : { uint32_t(nodeCount), uint32_t(nodeCount + 5) })
+        {
+            try
+            {
+                hierarchy.AddNode(badParent);
+                ++badParentsAccepted;
+            }
+            catch (const std::out_of_range&)
+            {
+            }
+        }
+        if (badParentsAccepted || hierarchy.GetNodeCount() != nodeCount)
+        {
+            fprintf(stderr, "bench transforms: AddNode accepted %u parents that do not exist\n", badParentsAccepted);
+            return 1;
+        }
+
+        // Every root rotates, so every world matrix is rebuilt.
+        size_t updated = 0;
+        auto start = Clock::now();
+        for (long long i = 0; i < iterations; ++i)
+        {
+            XMVECTOR rotation = XMQuaternionRotationRollPitchYaw(0.f, float(i) * 0.01f, 0.f);
+            for (uint32_t root : roots)
+            {
+                hierarchy.SetRotation(root, rotation);
+            }
+            updated += hierarchy.Update();
+        }
+        double dirtySeconds = SecondsSince(start);
+
+        // Nothing changed; Update only walks the dirty flags.
+        start = Clock::now();
+        for (long long i = 0; i < iterations; ++i)
+        {
+            updated += hierarchy.Update();
+        }
+        double cleanSeconds = SecondsSince(start);
+
+        printf("transforms: %lld bodies, depth %lld, %zu rebuilt\n", bodies, depth, updated);
+        printf("  all dirty:   %.3f ms/update, %.1f ns/body\n",
+            dirtySeconds * 1e3 / double(iterations), dirtySeconds * 1e9 / double(iterations * bodies));
+        printf("  none dirty:  %.3f ms/update, %.1f ns/body\n",
+            cleanSeconds * 1e3 / double(iterations), cleanSeconds * 1e9 / double(iterations * bodies));
+        return 0;
+    }
+
+    // Asteroid field updates, on one thread and split across threads.
+    int BenchAsteroids(int argc, char** argv)
+    {
+        const long long count = Tools::GetOption(argc, argv, "--count", 100000ll);
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 1000ll);
+        const long long threads = Tools::GetOption(argc, argv, "--threads",
+            static_cast<long long>(std::max(1u, std::thread::hardware_concurrency())));
+
+        if (count <= 0 || iterations <= 0 || threads <= 0)
+        {
+            fprintf(stderr, "bench asteroids: --count, --iterations and --threads must be positive\n");
+            return 1;
+        }
+
+        const float dt = 1.f / 60.f;
+
+        AsteroidField field;
+        field.Create(size_t(count), 1, 14.f, 20.f);
+
+        auto start = Clock::now();
+        for (long long i = 0; i < iterations; ++i)
+        {
+            field.Update(dt);
+        }
+        double singleSeconds = SecondsSince(start);
+
+        // Each thread owns a whole number of batches and runs every iteration on them.
+        const size_t batches = (size_t(count) + AsteroidField::BatchSize - 1) / AsteroidField::BatchSize;
+        const size_t batchesPerThread = (batches + size_t(threads) - 1) / size_t(threads);
+
+        std::vector<std::thread> workers;
+        start = Clock::now();
+        for (long long t = 0; t < threads; ++t)
+        {
+            size_t first = size_t(t) * batchesPerThread * AsteroidField::BatchSize;
+            size_t length = batchesPerThread * AsteroidField::BatchSize;
+            workers.emplace_back([&field, first, length, iterations, dt]()
+            {
+                for (long long i = 0; i < iterations; ++i)
+                {
+                    field.UpdateRange(first, length, dt);
+                }
+            });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        double multiSeconds = SecondsSince(start);
+
+        const double updates = double(count) * double(iterations);
+        printf("asteroids: %lld bodies, %lld iterations\n", count, iterations);
+        printf("  1 thread:    %.3f ms/update, %.1f M bodies/s\n",
+            singleSeconds * 1e3 / double(iterations), updates / singleSeconds * 1e-6);
+        printf("  %lld threads:  %.3f ms/update, %.1f M bodies/s\n", threads,
+            multiSeconds * 1e3 / double(iterations), updates / multiSeconds * 1e-6);
+        return 0;
+    }
+
+    // Parallel asteroid updates and raw job throughput with 1 to N threads.
+    int BenchJobs(int argc, char** argv)
+    {
+        const long long maxThreads = Tools::GetOption(argc, argv, "--max-threads",
+            static_cast<long long>(std::max(1u, std::thread::hardware_concurrency())));
+        const long long count = Tools::GetOption(argc, argv, "--count", 1000000ll);
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 100ll);
+        const long long jobCount = Tools::GetOption(argc, argv, "--jobs", 1000000ll);
+
+        if (maxThreads <= 0 || count <= 0 || iterations <= 0 || jobCount <= 0)
+        {
+            fprintf(stderr, "bench jobs: --max-threads, --count, --iterations and --jobs must be positive\n");
+            return 1;
+        }
+
+        const float dt = 1.f / 60.f;
+        const size_t batches = (size_t(count) + AsteroidField::BatchSize - 1) / AsteroidField::BatchSize;
+        const long long jobGroup = 1024;
+
+        AsteroidField field;
+        field.Create(size_t(count), 1, 14.f, 20.f);
+
+        printf("jobs: %lld asteroids, %lld iterations, %lld empty jobs\n", count, iterations, jobCount);
+        printf("  threads  ms/update  speedup  M jobs/s\n");
+
+        double baseline = 0;
+        for (long long threads = 1; threads <= maxThreads; ++threads)
+        {
+            DX::JobSystem jobs(static_cast<uint32_t>(threads - 1));
+
+            auto start = Clock::now();
+            for (long long i = 0; i < iterations; ++i)
+            {
+                jobs.ParallelFor(batches, 64, [&](size_t begin, size_t end)
+                {
+                    field.UpdateRange(begin * AsteroidField::BatchSize, (end - begin) * AsteroidField::BatchSize, dt);
+                });
+            }
+            double updateSeconds = SecondsSince(start) / double(iterations);
+            if (threads == 1)
+            {
+                baseline = updateSeconds;
+            }
+
+            // Empty jobs, spawned under a root in groups that fit in the job ring.
+            start = Clock::now();
+            for (long long done = 0; done < jobCount; done += jobGroup)
+            {
+                auto root = jobs.CreateJob([]() {});
+                for (long long i = 0; i < jobGroup; ++i)
+                {
+                    jobs.Run(jobs.CreateJob([]() {}, root));
+                }
+                jobs.Run(root);
+                jobs.Wait(root);
+            }
+            double jobSeconds = SecondsSince(start);
+
+            printf("  %7lld  %9.3f  %7.2f  %8.2f\n", threads, updateSeconds * 1e3, baseline / updateSeconds,
+                double((jobCount + jobGroup - 1) / jobGroup * (jobGroup + 1)) / jobSeconds * 1e-6);
+        }
+
+        return 0;
+    }
+
+    // Frustum tests over a large synthetic scene, checked against the scalar test.
+    int BenchCulling(int argc, char** argv)
+    {
+        const long long count = Tools::GetOption(argc, argv, "--count", 1000000ll);
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 100ll);
+        const long long extent = Tools::GetOption(argc, argv, "--extent", 200ll);
+
+        if (count <= 0 || iterations <= 0 || extent <= 0)
+        {
+            fprintf(stderr, "bench culling: --count, --iterations and --extent must be positive\n");
+            return 1;
+        }
+
+        // Spheres scattered through a cube centred on the camera, which uses the game's
+        // projection with a far plane at half the cube's extent.
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(-float(extent), float(extent));
+        std::uniform_real_distribution<float> radius(0.1f, 2.f);
+
+        std::vector<BoundingSphere> spheres(static_cast<size_t>(count));
+        for (auto& sphere : spheres)
+        {
+            sphere.Center = XMFLOAT3(position(random), position(random), position(random));
+            sphere.Radius = radius(random);
+        }
+
+        XMMATRIX view = XMMatrixLookToRH(XMVectorZero(), XMVectorSet(0.3f, 0.1f, 1.f, 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+        XMMATRIX projection = XMMatrixPerspectiveFovRH(XMConvertToRadians(70.f), 16.f / 9.f, 0.01f, float(extent) * 0.5f);
+
+        FrustumCuller culler;
+        culler.SetViewProjection(XMMatrixMultiply(view, projection));
+
+        std::vector<uint8_t> visible(spheres.size());
+        size_t visibleCount = 0;
+        auto start = Clock::now();
+        for (long long i = 0; i < iterations; ++i)
+        {
+            visibleCount = culler.Cull(spheres.data(), spheres.size(), sizeof(BoundingSphere), visible.data());
+        }
+        double batchSeconds = SecondsSince(start);
+
+        size_t scalarCount = 0;
+        size_t mismatches = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < spheres.size(); ++i)
+        {
+            bool inside = culler.IsVisible(spheres[i]);
+            scalarCount += inside ? 1 : 0;
+            mismatches += (inside ? 1 : 0) != visible[i] ? 1 : 0;
+        }
+        double scalarSeconds = SecondsSince(start);
+
+        const double tested = double(count) * double(iterations);
+        printf("culling: %lld spheres, %lld iterations\n", count, iterations);
+        printf("  visible %zu culled %zu\n", visibleCount, spheres.size() - visibleCount);
+        printf("  batched:  %.2f ns/sphere, %.3f ms/frame\n",
+            batchSeconds * 1e9 / tested, batchSeconds * 1e3 / double(iterations));
+        printf("  scalar:   %.2f ns/sphere\n", scalarSeconds * 1e9 / double(count));
+
+        if (mismatches != 0 || scalarCount != visibleCount)
+        {
+            fprintf(stderr, "bench culling: %zu spheres differ from the scalar test\n", mismatches);
+            return 1;
+        }
+        return 0;
+    }
+
+    // Building and copying out a frame of sphere instances, as the instanced renderer does.
+    int BenchInstances(int argc, char** argv)
+    {
+        const long long count = Tools::GetOption(argc, argv, "--count", 100000ll);
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 100ll);
+        const long long materials = Tools::GetOption(argc, argv, "--materials", 2ll);
+
+        if (count <= 0 || iterations <= 0 || materials <= 0)
+        {
+            fprintf(stderr, "bench instances: --count, --iterations and --materials must be positive\n");
+            return 1;
+        }
+
+        AsteroidField field;
+        field.Create(size_t(count), 1, 14.f, 20.f);
+
+        InstanceBuilder builder;
+        std::vector<SphereInstance> uploaded(static_cast<size_t>(count));
+        std::vector<InstanceBuilder::Range> ranges(static_cast<size_t>(materials));
+
+        double buildSeconds = 0;
+        double copySeconds = 0;
+        for (long long i = 0; i < iterations; ++i)
+        {
+            auto start = Clock::now();
+            builder.Reset(static_cast<uint32_t>(materials));
+            for (size_t a = 0; a < size_t(count); ++a)
+            {
+                XMVECTOR position = field.GetPosition(a);
+                builder.Add(uint32_t(a % size_t(materials)), field.GetWorld(a), g_XMOne, position, uint32_t(a & 3));
+            }
+            buildSeconds += SecondsSince(start);
+
+            start = Clock::now();
+            builder.CopyTo(uploaded.data(), ranges.data());
+            copySeconds += SecondsSince(start);
+        }
+
+        if (ranges.back().first + ranges.back().count != uint32_t(count))
+        {
+            fprintf(stderr, "bench instances: ranges do not cover every instance\n");
+            return 1;
+        }
+
+        const double instances = double(count) * double(iterations);
+        printf("instances: %lld spheres, %lld materials, %lld iterations (%.2f MB per frame)\n",
+            count, materials, iterations, double(count) * sizeof(SphereInstance) / (1024.0 * 1024.0));
+        printf("  build:  %.2f ns/instance, %.3f ms/frame\n",
+            buildSeconds * 1e9 / instances, buildSeconds * 1e3 / double(iterations));
+        printf("  copy:   %.2f ns/instance, %.3f ms/frame\n",
+            copySeconds * 1e9 / instances, copySeconds * 1e3 / double(iterations));
+        return 0;
+    }
+
+    // Key building, submission and sorting of a frame of draws, checked against std::stable_sort.
+    int BenchQueue(int argc, char** argv)
+    {
+        const long long count = Tools::GetOption(argc, argv, "--count", 100000ll);
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 100ll);
+
+        if (count <= 0 || iterations <= 0)
+        {
+            fprintf(stderr, "bench queue: --count and --iterations must be positive\n");
+            return 1;
+        }
+
+        // A few passes and shaders, many materials, one draw in ten translucent.
+        struct Draw
+        {
+            uint32_t pass;
+            uint32_t shader;
+            uint32_t material;
+            float depth;
+            bool translucent;
+        };
+
+        std::mt19937 random(1);
+        std::uniform_int_distribution<uint32_t> pass(0, 2);
+        std::uniform_int_distribution<uint32_t> shader(0, 7);
+        std::uniform_int_distribution<uint32_t> material(0, 511);
+        std::uniform_real_distribution<float> depth(0.f, 1.f);
+        std::uniform_int_distribution<uint32_t> translucent(0, 9);
+
+        std::vector<Draw> draws(static_cast<size_t>(count));
+        for (auto& draw : draws)
+        {
+            draw = { pass(random), shader(random), material(random), depth(random), translucent(random) == 0 };
+        }
+
+        RenderQueue queue;
+        queue.Reserve(draws.size());
+
+        double submitSeconds = 0;
+        double sortSeconds = 0;
+        for (long long i = 0; i < iterations; ++i)
+        {
+            auto start = Clock::now();
+            queue.Clear();
+            for (uint32_t d = 0; d < uint32_t(count); ++d)
+            {
+                const Draw& draw = draws[d];
+                queue.Submit(draw.translucent
+                    ? RenderQueue::MakeTranslucentKey(draw.pass, draw.shader, draw.material, draw.depth)
+                    : RenderQueue::MakeOpaqueKey(draw.pass, draw.shader, draw.material, draw.depth), d);
+            }
+            submitSeconds += SecondsSince(start);
+
+            start = Clock::now();
+            queue.Sort();
+            sortSeconds += SecondsSince(start);
+        }
+
+        // The radix sort is stable, so it must match std::stable_sort of the submissions exactly.
+        std::vector<RenderQueue::Item> expected(queue.begin(), queue.end());
+        std::sort(expected.begin(), expected.end(), [](const RenderQueue::Item& a, const RenderQueue::Item& b)
+        {
+            return a.command < b.command;
+        });
+
+        auto start = Clock::now();
+        std::stable_sort(expected.begin(), expected.end(), [](const RenderQueue::Item& a, const RenderQueue::Item& b)
+        {
+            return a.key < b.key;
+        });
+        double stdSeconds = SecondsSince(start);
+
+        size_t mismatches = 0;
+        size_t orderErrors = 0;
+        const RenderQueue::Item* item = queue.begin();
+        for (size_t i = 0; i < expected.size(); ++i, ++item)
+        {
+            mismatches += (item->key != expected[i].key || item->command != expected[i].command) ? 1 : 0;
+
+            // Translucent draws within a pass must come out far to near.
+            if (i > 0 && RenderQueue::IsTranslucent(item->key) && RenderQueue::IsTranslucent(item[-1].key)
+                && RenderQueue::GetPass(item->key) == RenderQueue::GetPass(item[-1].key))
+            {
+                orderErrors += draws[item->command].depth > draws[item[-1].command].depth + 1e-6f ? 1 : 0;
+            }
+        }
+
+        const double submissions = double(count) * double(iterations);
+        printf("queue: %lld submissions, %lld iterations\n", count, iterations);
+        printf("  submit:       %.2f ns/draw, %.3f ms/frame\n",
+            submitSeconds * 1e9 / submissions, submitSeconds * 1e3 / double(iterations));
+        printf("  radix sort:   %.2f ns/draw, %.3f ms/frame\n",
+            sortSeconds * 1e9 / submissions, sortSeconds * 1e3 / double(iterations));
+        printf("  stable_sort:  %.2f ns/draw, %.3f ms/frame\n",
+            stdSeconds * 1e9 / double(count), stdSeconds * 1e3);
+
+        if (mismatches != 0 || orderErrors != 0)
+        {
+            fprintf(stderr, "bench queue: %zu items out of place, %zu translucent draws out of depth order\n",
+                mismatches, orderErrors);
+            return 1;
+        }
+        return 0;
+    }
+
+    // A dark gradient with scattered highlights, so every bloom pass has work to do.
+    void MakeBloomScene(uint32_t width, uint32_t height, FloatImage& scene)
+    {
+        scene.Resize(width, height);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            XMFLOAT4* row = scene.GetRow(y);
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                float u = float(x) / float(width);
+                float v = float(y) / float(height);
+                row[x] = XMFLOAT4(0.2f * u, 0.1f * v, 0.15f * (1.f - u), 1.f);
+            }
+        }
+
+        std::mt19937 random(7);
+        std::uniform_int_distribution<uint32_t> column(0, width - 1);
+        std::uniform_int_distribution<uint32_t> line(0, height - 1);
+        for (uint32_t i = 0; i < width * height / 500; ++i)
+        {
+            scene.GetRow(line(random))[column(random)] = XMFLOAT4(4.f, 3.f, 2.f, 1.f);
+        }
+    }
+
+    // The horizontal blur as GaussianBlur.hlsli samples it, one tap and one bilinear fetch
+    // at a time, for checking the reference's resolved kernel.
+    float ShaderBlurError(const FloatImage& source, const FloatImage& blurred, const BlurKernel& kernel)
+    {
+        VS_BLUR_PARAMETERS blur;
+        blur.SetKernel(kernel, 1.f, 0.f);
+
+        float maxError = 0.f;
+        for (uint32_t y = 0; y < source.height; y += 61)
+        {
+            const XMFLOAT4* row = source.GetRow(y);
+            for (uint32_t x = 0; x < source.width; ++x)
+            {
+                XMVECTOR sum = XMVectorZero();
+                for (uint32_t i = 0; i < kernel.sampleCount; ++i)
+                {
+                    float u = (float(x) + 0.5f + blur.sampleOffsets[i].x) / float(source.width);
+                    float position = u * float(source.width) - 0.5f;
+                    float texel = std::floor(position);
+                    float blend = position - texel;
+                    int32_t x0 = std::min(std::max(int32_t(texel), 0), int32_t(source.width) - 1);
+                    int32_t x1 = std::min(std::max(int32_t(texel) + 1, 0), int32_t(source.width) - 1);
+                    XMVECTOR sample = XMVectorLerp(XMLoadFloat4(&row[x0]), XMLoadFloat4(&row[x1]), blend);
+                    sum = XMVectorMultiplyAdd(sample, XMVectorReplicate(blur.sampleWeights[i].x), sum);
+                }
+
+                XMVECTOR difference = XMVectorAbs(XMVectorSubtract(sum, XMLoadFloat4(&blurred.GetRow(y)[x])));
+                XMFLOAT4 error;
+                XMStoreFloat4(&error, difference);
+                maxError = std::max(maxError, std::max(std::max(error.x, error.y), std::max(error.z, error.w)));
+            }
+        }
+        return maxError;
+    }
+
+    float GetBloomChainCost(BloomPresets preset, uint32_t width, uint32_t height)
+    {
+        const BloomChain chain = GetBloomChain(preset, g_DefaultBloomQuality, width, height);
+        return GetBloomCost(chain.kernel->sampleCount, chain.levels);
+    }
+
+    // The CPU bloom reference at 1080p and 4K (or --width x --height), on one thread and
+    // across the job system. Both must produce the same image.
+    int BenchBloom(int argc, char** argv)
+    {
+        const long long width = Tools::GetOption(argc, argv, "--width", 0ll);
+        const long long height = Tools::GetOption(argc, argv, "--height", 0ll);
+        const long long preset = Tools::GetOption(argc, argv, "--preset", static_cast<long long>(Default));
+        const long long quality = Tools::GetOption(argc, argv, "--quality", static_cast<long long>(g_DefaultBloomQuality));
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 10ll);
+        const long long threads = Tools::GetOption(argc, argv, "--threads",
+            static_cast<long long>(std::max(1u, std::thread::hardware_concurrency())));
+
+        if (width < 0 || height < 0 || (width == 0) != (height == 0) || iterations <= 0 || threads <= 0
+            || preset < 0 || preset >= BloomPresetCount || quality < 0 || quality >= BloomQualityCount)
+        {
+            fprintf(stderr, "bench bloom: --width and --height must be given together, --iterations and --threads must be positive, --preset below %d and --quality below %d\n",
+                int(BloomPresetCount), int(BloomQualityCount));
+            return 1;
+        }
+
+        struct Size { uint32_t width, height; };
+        std::vector<Size> sizes;
+        if (width > 0)
+        {
+            sizes.push_back({ uint32_t(width), uint32_t(height) });
+        }
+        else
+        {
+            sizes.push_back({ 1920, 1080 });
+            sizes.push_back({ 3840, 2160 });
+        }
+
+        // The blur amount sets the chain length, so the softer presets must be cheaper
+        // than Default at the game's tier.
+        const float defaultCost = GetBloomChainCost(Default, 1920, 1080);
+        for (BloomPresets softer : { Soft, Blurry })
+        {
+            const float cost = GetBloomChainCost(softer, 1920, 1080);
+            if (cost >= defaultCost)
+            {
+                fprintf(stderr, "bench bloom: preset %d costs %.2f fetches/pixel, not less than Default's %.2f\n",
+                    int(softer), cost, defaultCost);
+                return 1;
+            }
+        }
+
+        const BloomPresets bloomPreset = BloomPresets(preset);
+        const BloomQuality bloomQuality = BloomQuality(quality);
+        DX::JobSystem jobs(static_cast<uint32_t>(threads - 1));
+
+        printf("bloom: preset %lld, %u taps, %lld iterations\n", preset,
+            GetBlurKernel(bloomQuality, bloomPreset).sampleCount, iterations);
+        bool failed = false;
+        for (const Size& size : sizes)
+        {
+            FloatImage scene, single, multi;
+            MakeBloomScene(size.width, size.height, scene);
+
+            BloomReference bloom;
+            bloom.Process(scene, bloomPreset, bloomQuality, single);
+            auto start = Clock::now();
+            for (long long i = 0; i < iterations; ++i)
+            {
+                bloom.Process(scene, bloomPreset, bloomQuality, single);
+            }
+            double singleSeconds = SecondsSince(start) / double(iterations);
+            const float blurError = ShaderBlurError(bloom.GetExtracted(), bloom.GetBlurredHorizontal(),
+                *bloom.GetChain().kernel);
+
+            bloom.SetJobSystem(&jobs);
+            bloom.Process(scene, bloomPreset, bloomQuality, multi);
+            start = Clock::now();
+            for (long long i = 0; i < iterations; ++i)
+            {
+                bloom.Process(scene, bloomPreset, bloomQuality, multi);
+            }
+            double multiSeconds = SecondsSince(start) / double(iterations);
+
+            const double megapixels = double(size.width) * double(size.height) * 1e-6;
+            const bool identical = memcmp(single.pixels.data(), multi.pixels.data(),
+                single.pixels.size() * sizeof(XMFLOAT4)) == 0;
+
+            printf("  %ux%u, %u levels, %.2f fetches/pixel (baseline %.2f)\n", size.width, size.height,
+                bloom.GetChain().levels, GetBloomCost(bloom.GetChain().kernel->sampleCount, bloom.GetChain().levels),
+                g_BloomBaselineCost);
+            printf("    1 thread:    %.2f ms/frame, %.1f Mpixels/s\n", singleSeconds * 1e3, megapixels / singleSeconds);
+            printf("    %lld threads:  %.2f ms/frame, %.1f Mpixels/s\n", threads, multiSeconds * 1e3, megapixels / multiSeconds);
+            printf("    blur vs shader taps: max error %.2e; threaded output %s\n", blurError,
+                identical ? "identical" : "DIFFERS");
+
+            failed = failed || !identical;
+        }
+
+        return failed ? 1 : 0;
+    }
+
+    // One frame of Game's render target use: the scene target is held while the size
+    // stays the same and each bloom level's two targets are acquired for the frame.
+    struct PoolFrameUser
+    {
+        PoolFrameUser() noexcept :
+            sceneWidth(0),
+            sceneHeight(0),
+            scene(TransientTexturePool::InvalidHandle)
+        {
+        }
+
+        void Frame(TransientTexturePool& pool, uint32_t width, uint32_t height, BloomPresets preset,
+            BloomQuality quality, bool allowLarger)
+        {
+            const uint32_t format = 87;     // DXGI_FORMAT_B8G8R8A8_UNORM
+            const uint32_t bindFlags = 0x28;  // D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET
+
+            pool.BeginFrame();
+            if (width != sceneWidth || height != sceneHeight)
+            {
+                if (scene != TransientTexturePool::InvalidHandle)
+                {
+                    pool.Release(scene);
+                }
+                scene = pool.Acquire({ format, width, height, bindFlags }, allowLarger);
+                sceneWidth = width;
+                sceneHeight = height;
+            }
+
+            const BloomChain chain = GetBloomChain(preset, quality, width, height);
+            TransientTexturePool::Handle targets[BloomChain::MaxLevels * 2];
+            for (uint32_t i = 0; i < chain.levels; ++i)
+            {
+                const TransientTextureDesc desc = { format, std::max(width >> (i + 1), 1u),
+                    std::max(height >> (i + 1), 1u), bindFlags };
+                targets[i * 2] = pool.Acquire(desc, allowLarger);
+                targets[i * 2 + 1] = pool.Acquire(desc, allowLarger);
+            }
+            for (uint32_t i = 0; i < chain.levels * 2; ++i)
+            {
+                pool.Release(targets[i]);
+            }
+        }
+
+        void Finish(TransientTexturePool& pool)
+        {
+            if (scene != TransientTexturePool::InvalidHandle)
+            {
+                pool.Release(scene);
+                scene = TransientTexturePool::InvalidHandle;
+            }
+        }
+
+        uint32_t sceneWidth;
+        uint32_t sceneHeight;
+        TransientTexturePool::Handle scene;
+    };
+
+    // The render target pool's policy against a scripted session on the null backend:
+    // steady frames, a window drag that resizes every frame, maximize and restore, and
+    // bloom preset and quality changes. Compared with creating every target on each
+    // resize, as the game used to.
+    int BenchPool(int argc, char** argv)
+    {
+        const long long keepFrames = Tools::GetOption(argc, argv, "--keep-frames", 60ll);
+        const long long budgetMB = Tools::GetOption(argc, argv, "--budget-mb", 256ll);
+        if (keepFrames < 0 || budgetMB < 0)
+        {
+            fprintf(stderr, "bench pool: --keep-frames and --budget-mb must not be negative\n");
+            return 1;
+        }
+
+        struct Step { uint32_t width, height; BloomPresets preset; BloomQuality quality; };
+        std::vector<Step> session;
+        auto hold = [&session](uint32_t frames, uint32_t width, uint32_t height, BloomPresets preset, BloomQuality quality)
+        {
+            session.insert(session.end(), frames, Step{ width, height, preset, quality });
+        };
+
+        hold(300, 1800, 1000, Default, g_DefaultBloomQuality);
+        for (uint32_t i = 0; i < 120; ++i)
+        {
+            hold(1, 1800 - i * 8, 1000 - i * 4, Default, g_DefaultBloomQuality);
+        }
+        hold(120, 840, 520, Default, g_DefaultBloomQuality);
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            hold(30, 2560, 1377, Default, g_DefaultBloomQuality);
+            hold(30, 1800, 1000, Default, g_DefaultBloomQuality);
+        }
+        for (int preset = 0; preset < BloomPresetCount; ++preset)
+        {
+            for (int quality = 0; quality < BloomQualityCount; ++quality)
+            {
+                hold(20, 1800, 1000, BloomPresets(preset), BloomQuality(quality));
+            }
+        }
+        hold(300, 1800, 1000, Default, g_DefaultBloomQuality);
+
+        // Creating every target on every resize, keeping them all.
+        uint64_t unpooledCreations = 0;
+        {
+            uint32_t width = 0, height = 0;
+            for (const Step& step : session)
+            {
+                if (step.width != width || step.height != height)
+                {
+                    unpooledCreations += 1 + GetBloomLevelLimit(step.width, step.height) * 2;
+                    width = step.width;
+                    height = step.height;
+                }
+            }
+        }
+
+        printf("pool: %zu frames, keep %lld frames, budget %lld MB; without pooling %llu textures created\n",
+            session.size(), keepFrames, budgetMB, static_cast<unsigned long long>(unpooledCreations));
+
+        bool failed = false;
+        for (int allowLarger = 0; allowLarger < 2; ++allowLarger)
+        {
+            NullTextureBackend backend;
+            {
+                TransientTexturePool pool(backend, static_cast<uint32_t>(keepFrames),
+                    static_cast<uint64_t>(budgetMB) * 1024 * 1024);
+                PoolFrameUser user;
+
+                auto start = Clock::now();
+                for (const Step& step : session)
+                {
+                    user.Frame(pool, step.width, step.height, step.preset, step.quality, allowLarger != 0);
+                }
+                double seconds = SecondsSince(start);
+
+                const TransientTexturePool::Statistics& statistics = pool.GetStatistics();
+                printf("  %s\n", allowLarger ? "reusing larger textures" : "exact sizes");
+                printf("    %llu acquires, hit rate %.1f%%, %llu created, %llu destroyed, %.2f us/frame\n",
+                    static_cast<unsigned long long>(statistics.acquires), pool.GetHitRate() * 100.0,
+                    static_cast<unsigned long long>(statistics.creations),
+                    static_cast<unsigned long long>(statistics.destructions), seconds * 1e6 / double(session.size()));
+                printf("    resident %u textures, %.1f MB (peak %.1f MB)\n", statistics.texturesResident,
+                    double(statistics.bytesResident) / (1024.0 * 1024.0),
+                    double(statistics.peakBytesResident) / (1024.0 * 1024.0));
+
+                user.Finish(pool);
+                pool.Trim();
+                failed = failed || pool.GetStatistics().texturesResident != 0 || pool.GetStatistics().bytesResident != 0;
+            }
+            failed = failed || backend.GetLiveCount() != 0;
+        }
+
+        if (failed)
+        {
+            printf("  textures leaked\n");
+        }
+        return failed ? 1 : 0;
+    }
+
+    // Stands in for the GPU when running a FrameGraph on the null backend: each write
+    // stamps the texture with the resource and version written, and each read checks
+    // the texture still holds the version it asked for, which aliasing must preserve.
+    struct GraphChecker
+    {
+        struct Accesses
+        {
+            const char*                         name;
+            std::vector<FrameGraph::Resource>   reads;
+            std::vector<FrameGraph::Resource>   writes;
+        };
+
+        GraphChecker() noexcept : failed(false) {}
+
+        uint32_t AddPass(FrameGraph& graph, const char* name, std::initializer_list<FrameGraph::Resource> reads,
+            std::initializer_list<FrameGraph::Resource> writes, FrameGraph::Resource* written = nullptr)
+        {
+            auto accesses = std::make_shared<Accesses>();
+            accesses->name = name;
+
+            const uint32_t pass = graph.AddPass(name, [this, accesses](const FrameGraph& g)
+            {
+                for (const FrameGraph::Resource& read : accesses->reads)
+                {
+                    auto found = contents.find(g.GetTexture(read));
+                    if (found == contents.end() || found->second.first != read.index
+                        || found->second.second != read.version)
+                    {
+                        printf("    %s read a texture another resource had overwritten\n", accesses->name);
+                        failed = true;
+                    }
+                }
+                for (const FrameGraph::Resource& write : accesses->writes)
+                {
+                    contents[g.GetTexture(write)] = std::make_pair(write.index, write.version);
+                }
+            });
+
+            for (const FrameGraph::Resource& read : reads)
+            {
+                graph.Read(pass, read);
+                accesses->reads.push_back(read);
+            }
+            for (const FrameGraph::Resource& write : writes)
+            {
+                FrameGraph::Resource version = graph.Write(pass, write);
+                accesses->writes.push_back(version);
+                if (written)
+                {
+                    *written++ = version;
+                }
+            }
+            return pass;
+        }
+
+        // Imported textures start out holding their first version.
+        FrameGraph::Resource Import(FrameGraph& graph, const char* name, const TransientTextureDesc& desc, const void* texture)
+        {
+            FrameGraph::Resource resource = graph.ImportTexture(name, desc, texture);
+            contents[texture] = std::make_pair(resource.index, 0u);
+            return resource;
+        }
+
+        std::map<const void*, std::pair<uint32_t, uint32_t>> contents;
+        bool failed;
+    };
+
+    // Game::BuildPostProcessGraph's passes, reads and writes.
+    void BuildBloomGraph(FrameGraph& graph, GraphChecker& checker, BloomPresets preset, BloomQuality quality,
+        uint32_t width, uint32_t height, const void* sceneTexture, const void* backBufferTexture)
+    {
+        const uint32_t format = 87;         // DXGI_FORMAT_B8G8R8A8_UNORM
+        const uint32_t bindFlags = 0x28;    // D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET
+        static const char* const c_levelNames[BloomChain::MaxLevels] = { "level 0", "level 1", "level 2", "level 3", "level 4", "level 5" };
+        static const char* const c_blurNames[BloomChain::MaxLevels] = { "blur 0", "blur 1", "blur 2", "blur 3", "blur 4", "blur 5" };
+
+        const BloomChain chain = GetBloomChain(preset, quality, width, height);
+        const FrameGraph::Resource scene = checker.Import(graph, "scene", { format, width, height, bindFlags }, sceneTexture);
+        const FrameGraph::Resource backBuffer = checker.Import(graph, "back buffer", { format, width, height, 0x20 }, backBufferTexture);
+
+        FrameGraph::Resource levels[BloomChain::MaxLevels] = {};
+        FrameGraph::Resource blurTargets[BloomChain::MaxLevels] = {};
+        for (uint32_t i = 0; i < chain.levels; ++i)
+        {
+            const TransientTextureDesc desc = { format, std::max(width >> (i + 1), 1u), std::max(height >> (i + 1), 1u), bindFlags };
+            levels[i] = graph.CreateTexture(c_levelNames[i], desc);
+            blurTargets[i] = graph.CreateTexture(c_blurNames[i], desc);
+        }
+
+        checker.AddPass(graph, "BloomExtract", { scene }, { levels[0] }, &levels[0]);
+        for (uint32_t i = 0; i < chain.levels; ++i)
+        {
+            if (i > 0)
+            {
+                checker.AddPass(graph, "BloomDownsample", { levels[i - 1] }, { levels[i] }, &levels[i]);
+            }
+            checker.AddPass(graph, "BloomBlurHorizontal", { levels[i] }, { blurTargets[i] }, &blurTargets[i]);
+            checker.AddPass(graph, "BloomBlurVertical", { blurTargets[i] }, { levels[i] }, &levels[i]);
+        }
+        for (uint32_t i = chain.levels - 1; i > 0; --i)
+        {
+            checker.AddPass(graph, "BloomUpsample", { levels[i], levels[i - 1] }, { levels[i - 1] }, &levels[i - 1]);
+        }
+
+        FrameGraph::Resource output;
+        if (preset == None)
+        {
+            checker.AddPass(graph, "Copy", { scene }, { backBuffer }, &output);
+        }
+        else
+        {
+            checker.AddPass(graph, "BloomCombine", { scene, levels[0] }, { backBuffer }, &output);
+        }
+        graph.MarkOutput(output);
+    }
+
+    // Compiles and runs the post-process graph for every preset and quality on the null
+    // backend, then a chain of full size passes that aliasing can fold onto two textures.
+    // Fails if None keeps anything but the copy, or any pass reads a clobbered texture.
+    int BenchGraph(int argc, char** argv)
+    {
+        const long long width = Tools::GetOption(argc, argv, "--width", 1920ll);
+        const long long height = Tools::GetOption(argc, argv, "--height", 1080ll);
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 1000ll);
+        if (width < 2 || height < 2 || iterations <= 0)
+        {
+            fprintf(stderr, "bench graph: --width and --height must be at least 2 and --iterations positive\n");
+            return 1;
+        }
+
+        const uint32_t w = uint32_t(width), h = uint32_t(height);
+        const int sceneTexture = 0, backBufferTexture = 0;
+        NullTextureBackend backend;
+        bool failed = false;
+
+        printf("graph: %ux%u\n", w, h);
+        {
+            TransientTexturePool pool(backend);
+            for (int preset = 0; preset < BloomPresetCount; ++preset)
+            {
+                for (int quality = 0; quality < BloomQualityCount; ++quality)
+                {
+                    FrameGraph graph;
+                    GraphChecker checker;
+                    BuildBloomGraph(graph, checker, BloomPresets(preset), BloomQuality(quality), w, h,
+                        &sceneTexture, &backBufferTexture);
+
+                    graph.Compile();
+                    graph.Execute(pool, nullptr);
+
+                    const FrameGraph::Statistics& statistics = graph.GetStatistics();
+                    const uint32_t kept = statistics.passes - statistics.culledPasses;
+                    const bool culledCorrectly = (preset != None) ? statistics.culledPasses == 0 : kept == 1;
+                    failed = failed || checker.failed || !culledCorrectly;
+
+                    if (quality == g_DefaultBloomQuality || !culledCorrectly || checker.failed)
+                    {
+                        printf("  preset %d quality %d: %u of %u passes, %u textures on %u, %u unbinds%s\n", preset, quality,
+                            kept, statistics.passes, statistics.transientTextures, statistics.physicalTextures,
+                            statistics.unbinds, culledCorrectly ? "" : " (culling FAILED)");
+                    }
+                }
+            }
+        }
+
+        // A ping-pong chain: pass i reads texture i and writes texture i + 1.
+        {
+            const uint32_t chainLength = 8;
+            static const char* const c_names[chainLength + 1] = { "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7", "t8" };
+
+            FrameGraph graph;
+            GraphChecker checker;
+            TransientTexturePool pool(backend);
+            FrameGraph::Resource textures[chainLength + 1];
+            for (uint32_t i = 0; i <= chainLength; ++i)
+            {
+                textures[i] = graph.CreateTexture(c_names[i], { 87, w, h, 0x28 });
+            }
+
+            checker.AddPass(graph, "Clear", {}, { textures[0] }, &textures[0]);
+            for (uint32_t i = 0; i < chainLength; ++i)
+            {
+                checker.AddPass(graph, "Filter", { textures[i] }, { textures[i + 1] }, &textures[i + 1]);
+            }
+            graph.MarkOutput(textures[chainLength]);
+            graph.Compile();
+            graph.Execute(pool, nullptr);
+
+            const FrameGraph::Statistics& statistics = graph.GetStatistics();
+            printf("  ping-pong: %u textures on %u, %.1f Mtexels on %.1f, %u unbinds\n", statistics.transientTextures,
+                statistics.physicalTextures, double(statistics.transientTexels) * 1e-6,
+                double(statistics.physicalTexels) * 1e-6, statistics.unbinds);
+            failed = failed || checker.failed || statistics.physicalTextures != 2;
+        }
+
+        // Building and compiling the Default graph, as the game does when the preset,
+        // quality or window size changes.
+        {
+            TransientTexturePool pool(backend);
+            FrameGraph graph;
+            auto start = Clock::now();
+            for (long long i = 0; i < iterations; ++i)
+            {
+                GraphChecker checker;
+                graph.Reset();
+                BuildBloomGraph(graph, checker, Default, g_DefaultBloomQuality, w, h, &sceneTexture, &backBufferTexture);
+                graph.Compile();
+            }
+            printf("  build and compile: %.2f us\n", SecondsSince(start) * 1e6 / double(iterations));
+        }
+
+        failed = failed || backend.GetLiveCount() != 0;
+        return failed ? 1 : 0;
+    }
+
+    // Stands in for reading a file (sleeping) and decoding it (spinning).
+    void LoadAsset(double readSeconds, double decodeSeconds)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(readSeconds));
+        auto start = Clock::now();
+        while (SecondsSince(start) < decodeSeconds)
+        {
+        }
+    }
+
+    // Synthetic assets, the first ten times the size of the rest as the ship is, loaded
+    // one after another and then through the AssetLoader while a frame loop calls
+    // Update. Fails unless every finish function runs once on the frame loop's thread,
+    // and a throwing load is reported, with or without worker threads.
+    int BenchLoader(int argc, char** argv)
+    {
+        const long long assetCount = Tools::GetOption(argc, argv, "--assets", 40ll);
+        const long long readUs = Tools::GetOption(argc, argv, "--read-us", 2000ll);
+        const long long decodeUs = Tools::GetOption(argc, argv, "--decode-us", 3000ll);
+        const long long maxThreads = Tools::GetOption(argc, argv, "--max-threads",
+            static_cast<long long>(std::max(1u, std::thread::hardware_concurrency())));
+        const bool report = Tools::HasFlag(argc, argv, "--report");
+        if (assetCount <= 0 || readUs < 0 || decodeUs < 0 || maxThreads <= 0)
+        {
+            fprintf(stderr, "bench loader: --assets and --max-threads must be positive, --read-us and --decode-us not negative\n");
+            return 1;
+        }
+
+        // The profiler keeps the names, so they outlive every loader here.
+        std::vector<std::string> names(static_cast<size_t>(assetCount));
+        std::vector<double> scales(static_cast<size_t>(assetCount));
+        std::mt19937 random(7);
+        std::uniform_real_distribution<double> scale(0.5, 2.0);
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            names[i] = "asset " + std::to_string(i);
+            scales[i] = (i == 0) ? 10.0 : scale(random);
+        }
+
+        const double readSeconds = double(readUs) * 1e-6;
+        const double decodeSeconds = double(decodeUs) * 1e-6;
+        const auto frameTime = std::chrono::microseconds(16667);
+        const std::thread::id frameThread = std::this_thread::get_id();
+        bool failed = false;
+
+        auto start = Clock::now();
+        for (double assetScale : scales)
+        {
+            LoadAsset(readSeconds * assetScale, decodeSeconds * assetScale);
+        }
+        const double serialSeconds = SecondsSince(start);
+
+        printf("loader: %lld assets, %lld us read, %lld us decode\n", assetCount, readUs, decodeUs);
+        printf("  serial: %.1f ms before the first frame\n", serialSeconds * 1e3);
+        printf("  threads  first frame ms  all ready ms  frames  speedup\n");
+
+        for (long long threads = 1; threads <= maxThreads; ++threads)
+        {
+            DX::JobSystem jobs(static_cast<uint32_t>(threads - 1));
+            AssetLoader loader(jobs);
+            std::vector<uint32_t> finishes(names.size());
+            bool wrongThread = false;
+
+            for (size_t i = 0; i < names.size(); ++i)
+            {
+                const double assetScale = scales[i];
+                uint32_t* finishCount = &finishes[i];
+                loader.Load(names[i].c_str(), [=, &wrongThread]() -> AssetLoader::FinishFunction
+                {
+                    LoadAsset(readSeconds * assetScale, decodeSeconds * assetScale);
+                    return [=, &wrongThread]()
+                    {
+                        ++*finishCount;
+                        wrongThread = wrongThread || std::this_thread::get_id() != frameThread;
+                    };
+                });
+            }
+
+            uint32_t frames = 0;
+            while (!loader.IsIdle())
+            {
+                auto frameStart = Clock::now();
+                loader.Update();
+                if (frames++ == 0)
+                {
+                    loader.MarkFirstFrame();
+                }
+                std::this_thread::sleep_until(frameStart + frameTime);
+            }
+
+            const bool finishedOnce = std::all_of(finishes.begin(), finishes.end(), [](uint32_t n) { return n == 1; });
+            failed = failed || !finishedOnce || wrongThread || loader.GetReadyCount() != names.size();
+
+            const double ready = double(loader.GetLastReadyTime()) * 1e-9;
+            printf("  %7lld  %14.2f  %12.1f  %6u  %7.2f%s\n", threads, double(loader.GetFirstFrameTime()) * 1e-6,
+                ready * 1e3, frames, serialSeconds / ready,
+                (finishedOnce && !wrongThread) ? "" : " (finish functions FAILED)");
+            if (report && threads == maxThreads)
+            {
+                printf("%s", loader.FormatReport().c_str());
+            }
+        }
+
+        // A failed load surfaces from Update; the next call finishes the rest.
+        for (uint32_t workers : { 0u, 1u })
+        {
+            DX::JobSystem jobs(workers);
+            AssetLoader loader(jobs);
+            loader.Load("good", []() -> AssetLoader::FinishFunction { return nullptr; });
+            loader.Load("missing", []() -> AssetLoader::FinishFunction { throw std::runtime_error("file not found"); });
+
+            bool reported = false;
+            for (int attempt = 0; attempt < 2 && !loader.IsIdle(); ++attempt)
+            {
+                try
+                {
+                    loader.FinishAll();
+                }
+                catch (const std::runtime_error& e)
+                {
+                    reported = strstr(e.what(), "missing") != nullptr;
+                }
+            }
+
+            const bool correct = reported && loader.IsIdle() && loader.GetReadyCount() == 1
+                && loader.GetAsset(1).state == AssetLoader::Failed;
+            printf("  failing load, %u workers: %s\n", workers, correct ? "reported" : "FAILED");
+            failed = failed || !correct;
+        }
+
+        return failed ? 1 : 0;
+    }
+
+    // Every block format at every quality (or the one given): single threaded scalar,
+    // single threaded with the best instruction set compiled in, and that split across
+    // --threads threads, with the PSNR against the source. The image is --input (JPEG
+    // or PNG) or a synthetic --size square of gradients and noise. Fails unless every
+    // variant writes the same blocks and Inflate rejects corrupt streams.
+    int BenchBlockCompression(int argc, char** argv)
+    {
+        const char* inputPath = Tools::GetOption(argc, argv, "--input");
+        const char* qualityOption = Tools::GetOption(argc, argv, "--quality", "all");
+        const long long size = Tools::GetOption(argc, argv, "--size", 512ll);
+        const long long threads = Tools::GetOption(argc, argv, "--threads",
+            static_cast<long long>(std::max(1u, std::thread::hardware_concurrency())));
+        if (size <= 0 || threads <= 0)
+        {
+            fprintf(stderr, "bench bcn: --size and --threads must be positive\n");
+            return 1;
+        }
+
+        std::vector<BlockQuality> qualities;
+        for (uint32_t quality = 0; quality < BlockQualityCount; ++quality)
+        {
+            if (strcmp(qualityOption, "all") == 0 || strcmp(qualityOption, GetBlockQualityName(BlockQuality(quality))) == 0)
+            {
+                qualities.push_back(BlockQuality(quality));
+            }
+        }
+        if (qualities.empty())
+        {
+            fprintf(stderr, "bench bcn: --quality must be fast, normal, high or all\n");
+            return 1;
+        }
+
+        Image image;
+        if (inputPath)
+        {
+            std::ifstream file(inputPath, std::ios::in | std::ios::binary);
+            std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            try
+            {
+                image = DecodeImage(data.data(), data.size());
+            }
+            catch (const std::exception& e)
+            {
+                fprintf(stderr, "bench bcn: %s: %s\n", inputPath, e.what());
+                return 1;
+            }
+        }
+        else
+        {
+            image.width = image.height = static_cast<uint32_t>(size);
+            image.channels = 4;
+            image.pixels.resize(size_t(size) * size * 4);
+            std::mt19937 random(11);
+            std::uniform_int_distribution<int> noise(-12, 12);
+            for (uint32_t y = 0; y < image.height; ++y)
+            {
+                for (uint32_t x = 0; x < image.width; ++x)
+                {
+                    uint8_t* pixel = &image.pixels[(size_t(y) * image.width + x) * 4];
+                    const float u = float(x) / float(image.width), v = float(y) / float(image.height);
+                    const float base[4] = { 255.f * u, 255.f * v, 128.f + 127.f * sinf(20.f * u * v), 255.f * (1.f - u * v) };
+                    for (uint32_t c = 0; c < 4; ++c)
+                    {
+                        pixel[c] = uint8_t(std::min(std::max(base[c] + float(noise(random)), 0.f), 255.f));
+                    }
+                }
+            }
+        }
+
+        DX::JobSystem jobs(static_cast<uint32_t>(threads - 1));
+        const double megapixels = double(image.width) * image.height * 1e-6;
+        const BlockInstructionSet best = GetBestInstructionSet();
+        bool failed = false;
+
+        printf("bcn: %ux%u %s, %s, %u threads\n", image.width, image.height, inputPath ? inputPath : "synthetic",
+            GetInstructionSetName(best), jobs.GetThreadCount());
+        printf("  format  quality  scalar MP/s  %6s MP/s  threaded MP/s  speedup   PSNR dB\n", GetInstructionSetName(best));
+        for (uint32_t format = 0; format < BlockFormatCount; ++format)
+        {
+            for (BlockQuality quality : qualities)
+            {
+                BlockOptions options = { quality, BlockScalar, nullptr };
+                auto start = Clock::now();
+                const std::vector<uint8_t> scalar = CompressImage(image.pixels.data(), image.width, image.height,
+                    BlockFormat(format), options);
+                const double scalarSeconds = SecondsSince(start);
+
+                options.instructionSet = best;
+                start = Clock::now();
+                const std::vector<uint8_t> simd = CompressImage(image.pixels.data(), image.width, image.height,
+                    BlockFormat(format), options);
+                const double simdSeconds = SecondsSince(start);
+
+                options.jobs = &jobs;
+                start = Clock::now();
+                const std::vector<uint8_t> threaded = CompressImage(image.pixels.data(), image.width, image.height,
+                    BlockFormat(format), options);
+                const double threadedSeconds = SecondsSince(start);
+
+                const std::vector<uint8_t> decoded = DecompressImage(threaded.data(), image.width, image.height,
+                    BlockFormat(format));
+                const double psnr = ComputePsnr(image.pixels.data(), decoded.data(), size_t(image.width) * image.height,
+                    BlockFormat(format));
+
+                printf("  %-6s  %-7s  %11.2f  %11.2f  %13.2f  %6.1fx  %8.2f\n", GetBlockFormatName(BlockFormat(format)),
+                    GetBlockQualityName(quality), megapixels / scalarSeconds, megapixels / simdSeconds,
+                    megapixels / threadedSeconds, scalarSeconds / threadedSeconds, psnr);
+
+                if (simd != scalar || threaded != scalar)
+                {
+                    fprintf(stderr, "bench bcn: %s %s blocks differ between implementations\n",
+                        GetBlockFormatName(BlockFormat(format)), GetBlockQualityName(quality));
+                    failed = true;
+                }
+            }
+        }
+
+        // Corrupt zlib streams, as a damaged PNG hands them over, must fail rather than
+        // decode until memory runs out. The dynamic block codes literal 0 as a single 0
+        // bit and has no data, so the zeros read past its end decode to literals forever.
+        std::vector<uint8_t> endless = { 0x78, 0x01 };
+        uint32_t bitBuffer = 0, bitCount = 0;
+        auto writeBits = [&](uint32_t value, uint32_t count)
+        {
+            bitBuffer |= value << bitCount;
+            for (bitCount += count; bitCount >= 8; bitCount -= 8, bitBuffer >>= 8)
+            {
+                endless.push_back(uint8_t(bitBuffer));
+            }
+        };
+        writeBits(1, 1);
+        writeBits(2, 2);
+        writeBits(0, 5);
+        writeBits(0, 5);
+        writeBits(14, 4);
+        const uint32_t codeLengthLengths[18] = { 0, 0, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+        for (uint32_t length : codeLengthLengths)
+        {
+            writeBits(length, 3);
+        }
+        // Lengths 1 and 0 (x255) for the literals, then 1 for the one distance. Length
+        // 1 codes as 0, and 18, repeat zero, as 11 which reads reversed as the same.
+        writeBits(0, 1);
+        writeBits(3, 2);
+        writeBits(138 - 11, 7);
+        writeBits(3, 2);
+        writeBits(117 - 11, 7);
+        writeBits(0, 1);
+        writeBits(0, 1);
+        writeBits(0, 8);
+
+        std::vector<uint8_t> overlong = { 0x78, 0x01, 0x01, 0x08, 0x00, 0xf7, 0xff };
+        overlong.resize(overlong.size() + 8, 0x55);
+
+        const struct { const char* name; const std::vector<uint8_t>& stream; size_t expectedSize; } corrupt[] =
+        {
+            { "truncated", endless, 0 },
+            { "truncated, sized", endless, size_t(1) << 20 },
+            { "overlong", overlong, 4 },
+        };
+        for (const auto& test : corrupt)
+        {
+            bool rejected = false;
+            try
+            {
+                Inflate(test.stream.data(), test.stream.size(), test.expectedSize);
+            }
+            catch (const std::runtime_error&)
+            {
+                rejected = true;
+            }
+            printf("  inflate %s stream: %s\n", test.name, rejected ? "rejected" : "FAILED");
+            failed = failed || !rejected;
+        }
+
+        return failed ? 1 : 0;
+    }
+
+    // DX::ReadData's approach, which the tools cannot include: seek to the end for the
+    // size, allocate that much and copy the file in.
+    std::vector<uint8_t> ReadWholeFile(const char* path)
+    {
+        std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!file)
+            throw std::runtime_error(std::string("cannot open ") + path);
+
+        std::vector<uint8_t> blob(static_cast<size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        file.read(reinterpret_cast<char*>(blob.data()), std::streamsize(blob.size()));
+        if (!file)
+            throw std::runtime_error(std::string("cannot read ") + path);
+        return blob;
+    }
+
+    // Files under directory with one of the extensions (lower case, with the dot), sorted.
+    std::vector<std::string> FindFiles(const char* directory, std::initializer_list<const char*> extensions)
+    {
+        std::vector<std::string> paths;
+        std::error_code error;
+        for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end;
+            it.increment(error))
+        {
+            std::string extension = it->path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(),
+                [](char c) { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; });
+            if (it->is_regular_file() && std::any_of(extensions.begin(), extensions.end(),
+                [&extension](const char* wanted) { return extension == wanted; }))
+            {
+                paths.push_back(it->path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    // Stands in for CreateVertexShader or the mesh loader reading every byte; cheap
+    // enough (it vectorizes) that the loads dominate.
+    uint64_t SumBytes(const uint8_t* data, size_t size)
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            sum += data[i];
+        }
+        return sum;
+    }
+
+    // Every .sdkmesh and .cso under --source loaded --iterations times with ReadData's
+    // copy and with MapData, each followed by a pass over the bytes, then all of them
+    // mapped at once with MapDataAsync on --threads threads. The files stay in the OS
+    // cache after the first pass, so this measures the allocation and copy that mapping
+    // saves, not the disk. Fails unless every load sees the same bytes and a missing file
+    // reaches the async callback as an error.
+    int BenchMappedFiles(int argc, char** argv)
+    {
+        const char* sourceOption = Tools::GetOption(argc, argv, "--source", ".");
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 200ll);
+        const long long threads = Tools::GetOption(argc, argv, "--threads",
+            static_cast<long long>(std::max(1u, std::thread::hardware_concurrency())));
+        if (iterations <= 0 || threads <= 0)
+        {
+            fprintf(stderr, "bench mapped: --iterations and --threads must be positive\n");
+            return 1;
+        }
+
+        const std::vector<std::string> paths = FindFiles(sourceOption, { ".sdkmesh", ".cso" });
+        if (paths.empty())
+        {
+            fprintf(stderr, "bench mapped: no .sdkmesh or .cso files under %s\n", sourceOption);
+            return 1;
+        }
+
+        std::vector<uint64_t> sums(paths.size());
+        double readTotal = 0, mapTotal = 0;
+        uint64_t bytesTotal = 0;
+        bool failed = false;
+
+        printf("mapped: %zu files, %lld iterations\n", paths.size(), iterations);
+        printf("  %-56s %9s  %11s  %10s  %7s  %s\n", "file", "bytes", "ReadData us", "MapData us", "speedup",
+            "allocations, heap bytes");
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            const char* path = paths[i].c_str();
+            uint64_t readSum = 0, mapSum = 0;
+            size_t bytes = 0;
+            try
+            {
+                // Warms the OS cache for both.
+                bytes = ReadWholeFile(path).size();
+
+                uint64_t allocations = GetAllocationCount();
+                auto start = Clock::now();
+                for (long long n = 0; n < iterations; ++n)
+                {
+                    const std::vector<uint8_t> blob = ReadWholeFile(path);
+                    readSum = SumBytes(blob.data(), blob.size());
+                }
+                const double readSeconds = SecondsSince(start) / double(iterations);
+                const uint64_t readAllocations = (GetAllocationCount() - allocations) / uint64_t(iterations);
+
+                allocations = GetAllocationCount();
+                start = Clock::now();
+                for (long long n = 0; n < iterations; ++n)
+                {
+                    const DX::MappedFile file = DX::MapData(path);
+                    mapSum = SumBytes(file.data(), file.size());
+                }
+                const double mapSeconds = SecondsSince(start) / double(iterations);
+                const uint64_t mapAllocations = (GetAllocationCount() - allocations) / uint64_t(iterations);
+
+                // ReadData's copy is the only allocation that scales with the file.
+                printf("  %-56s %9zu  %11.1f  %10.1f  %6.2fx  %llu, %zu / %llu, 0\n",
+                    std::filesystem::path(path).lexically_relative(sourceOption).generic_string().c_str(), bytes,
+                    readSeconds * 1e6, mapSeconds * 1e6, readSeconds / mapSeconds,
+                    static_cast<unsigned long long>(readAllocations), bytes, static_cast<unsigned long long>(mapAllocations));
+                readTotal += readSeconds;
+                mapTotal += mapSeconds;
+                bytesTotal += bytes;
+            }
+            catch (const std::exception& e)
+            {
+                fprintf(stderr, "bench mapped: %s: %s\n", path, e.what());
+                failed = true;
+                continue;
+            }
+
+            if (readSum != mapSum)
+            {
+                fprintf(stderr, "bench mapped: %s: mapped bytes differ from the bytes read\n", path);
+                failed = true;
+            }
+            sums[i] = readSum;
+        }
+        printf("  %-56s %9llu  %11.1f  %10.1f  %6.2fx\n", "all files", static_cast<unsigned long long>(bytesTotal),
+            readTotal * 1e6, mapTotal * 1e6, readTotal / mapTotal);
+
+        // The callbacks run on the workers; each writes only its own entry.
+        DX::JobSystem jobs(static_cast<uint32_t>(threads - 1));
+        std::vector<uint64_t> asyncSums(paths.size());
+        std::vector<DX::JobSystem::Job*> pending;
+        bool missingReported = false;
+
+        auto start = Clock::now();
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            uint64_t* sum = &asyncSums[i];
+            pending.push_back(DX::MapDataAsync(jobs, paths[i].c_str(), [sum](DX::MappedFile file, std::exception_ptr)
+            {
+                *sum = SumBytes(file.data(), file.size());
+            }));
+        }
+        pending.push_back(DX::MapDataAsync(jobs, "missing.cso", [&missingReported](DX::MappedFile file,
+            std::exception_ptr error)
+        {
+            missingReported = error && !file.IsOpen();
+        }));
+        for (DX::JobSystem::Job* job : pending)
+        {
+            jobs.Wait(job);
+        }
+        const double asyncSeconds = SecondsSince(start);
+
+        const bool asyncCorrect = asyncSums == sums;
+        printf("  MapDataAsync: %zu files in %.1f us on %u threads, %s; missing file %s\n", paths.size(),
+            asyncSeconds * 1e6, jobs.GetThreadCount(), asyncCorrect ? "same bytes" : "bytes DIFFER",
+            missingReported ? "reported" : "NOT reported");
+        failed = failed || !asyncCorrect || !missingReported;
+
+        return failed ? 1 : 0;
+    }
+
+    // A copy of an .sdkmesh with one thing broken, for the validation checks.
+    struct SdkMeshCorruption
+    {
+        const char* what;
+        void        (*apply)(std::vector<uint64_t>& file, size_t& size);
+    };
+
+    SdkMeshHeader& GetHeader(std::vector<uint64_t>& file)
+    {
+        return *reinterpret_cast<SdkMeshHeader*>(file.data());
+    }
+
+    template<typename T>
+    T& GetFirst(std::vector<uint64_t>& file, uint64_t offset)
+    {
+        return *reinterpret_cast<T*>(reinterpret_cast<uint8_t*>(file.data()) + offset);
+    }
+
+    const SdkMeshCorruption c_sdkMeshCorruptions[] =
+    {
+        { "truncated", [](std::vector<uint64_t>&, size_t& size) { --size; } },
+        { "version", [](std::vector<uint64_t>& file, size_t&) { GetHeader(file).version = 100; } },
+        { "material", [](std::vector<uint64_t>& file, size_t&)
+            {
+                GetFirst<SdkMeshSubset>(file, GetHeader(file).subsetOffset).material = GetHeader(file).materialCount;
+            } },
+        { "vertex data", [](std::vector<uint64_t>& file, size_t& size)
+            {
+                GetFirst<SdkMeshVertexBuffer>(file, GetHeader(file).vertexBufferOffset).dataOffset = size;
+            } },
+        { "subset array", [](std::vector<uint64_t>& file, size_t&)
+            {
+                GetFirst<SdkMeshMesh>(file, GetHeader(file).meshOffset).subsetIndexOffset += 2;
+            } },
+        { "index", [](std::vector<uint64_t>& file, size_t&)
+            {
+                // The first index of the first mesh's first subset, past every vertex.
+                const SdkMeshMesh& mesh = GetFirst<SdkMeshMesh>(file, GetHeader(file).meshOffset);
+                const SdkMeshSubset& subset = GetFirst<SdkMeshSubset>(file, GetHeader(file).subsetOffset
+                    + GetFirst<uint32_t>(file, mesh.subsetIndexOffset) * sizeof(SdkMeshSubset));
+                const SdkMeshIndexBuffer& indices = GetFirst<SdkMeshIndexBuffer>(file, GetHeader(file).indexBufferOffset
+                    + mesh.indexBuffer * sizeof(SdkMeshIndexBuffer));
+                const uint64_t offset = indices.dataOffset + subset.indexStart * SdkMesh::GetIndexSize(indices);
+                if (indices.indexType)
+                {
+                    GetFirst<uint32_t>(file, offset) = ~0u;
+                }
+                else
+                {
+                    GetFirst<uint16_t>(file, offset) = 0xffff;
+                }
+            } },
+    };
+
+    // Every .sdkmesh under --source, --iterations times: read into a copy and parsed, as
+    // Model::CreateFromSDKMESH does with ReadData, against SdkMesh::Load mapping and
+    // validating it in place, with the parse alone timed on the copy. Fails unless each
+    // file loads and every corrupted copy of it (truncated, wrong version, out of range
+    // material, vertex data past the end, misaligned subset array, out of range index)
+    // is rejected.
+    int BenchSdkMesh(int argc, char** argv)
+    {
+        const char* sourceOption = Tools::GetOption(argc, argv, "--source", ".");
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 200ll);
+        if (iterations <= 0)
+        {
+            fprintf(stderr, "bench sdkmesh: --iterations must be positive\n");
+            return 1;
+        }
+
+        const std::vector<std::string> paths = FindFiles(sourceOption, { ".sdkmesh" });
+        if (paths.empty())
+        {
+            fprintf(stderr, "bench sdkmesh: no .sdkmesh files under %s\n", sourceOption);
+            return 1;
+        }
+
+        bool failed = false;
+        printf("sdkmesh: %zu files, %lld iterations\n", paths.size(), iterations);
+        printf("  %-32s %8s %6s %7s %9s %8s %8s  %14s  %7s  %8s  %s\n", "file", "bytes", "meshes", "subsets",
+            "materials", "vertices", "indices", "read+parse us", "load us", "parse us", "corruptions rejected");
+        for (const std::string& path : paths)
+        {
+            const std::string name = std::filesystem::path(path).lexically_relative(sourceOption).generic_string();
+            try
+            {
+                // Warms the OS cache.
+                std::vector<uint8_t> original = ReadWholeFile(path.c_str());
+
+                SdkMesh mesh;
+                auto start = Clock::now();
+                for (long long n = 0; n < iterations; ++n)
+                {
+                    const std::vector<uint8_t> blob = ReadWholeFile(path.c_str());
+                    mesh.Parse(blob.data(), blob.size());
+                }
+                const double readSeconds = SecondsSince(start) / double(iterations);
+
+                start = Clock::now();
+                for (long long n = 0; n < iterations; ++n)
+                {
+                    mesh.Load(path.c_str());
+                }
+                const double loadSeconds = SecondsSince(start) / double(iterations);
+
+                SdkMesh parsed;
+                start = Clock::now();
+                for (long long n = 0; n < iterations; ++n)
+                {
+                    parsed.Parse(original.data(), original.size());
+                }
+                const double parseSeconds = SecondsSince(start) / double(iterations);
+
+                uint64_t vertices = 0, indices = 0;
+                for (const SdkMeshVertexBuffer& buffer : mesh.GetVertexBuffers())
+                {
+                    vertices += buffer.vertexCount;
+                }
+                for (const SdkMeshIndexBuffer& buffer : mesh.GetIndexBuffers())
+                {
+                    indices += buffer.indexCount;
+                }
+
+                // Copies in 8 byte aligned storage, as Parse requires.
+                std::string rejected;
+                for (const SdkMeshCorruption& corruption : c_sdkMeshCorruptions)
+                {
+                    std::vector<uint64_t> copy((original.size() + 7) / 8);
+                    memcpy(copy.data(), original.data(), original.size());
+                    size_t size = original.size();
+                    corruption.apply(copy, size);
+                    try
+                    {
+                        SdkMesh corrupted;
+                        corrupted.Parse(reinterpret_cast<const uint8_t*>(copy.data()), size);
+                        fprintf(stderr, "bench sdkmesh: %s: accepted a copy with a bad %s\n", name.c_str(), corruption.what);
+                        failed = true;
+                    }
+                    catch (const std::runtime_error&)
+                    {
+                        rejected += rejected.empty() ? "" : ", ";
+                        rejected += corruption.what;
+                    }
+                }
+
+                printf("  %-32s %8zu %6zu %7zu %9zu %8llu %8llu  %14.1f  %7.1f  %8.1f  %s\n", name.c_str(),
+                    original.size(), mesh.GetMeshes().size(), mesh.GetSubsets().size(), size_t(mesh.GetHeader().materialCount),
+                    static_cast<unsigned long long>(vertices), static_cast<unsigned long long>(indices),
+                    readSeconds * 1e6, loadSeconds * 1e6, parseSeconds * 1e6, rejected.c_str());
+            }
+            catch (const std::exception& e)
+            {
+                fprintf(stderr, "bench sdkmesh: %s: %s\n", name.c_str(), e.what());
+                failed = true;
+            }
+        }
+
+        return failed ? 1 : 0;
+    }
+
+    // Every asset of the kinds the game loads under --source, --iterations times: each
+    // mapped as a loose file with MapData, against one pack opened and every asset found
+    // and read from it, once with every asset stored and once with LZ4 where it helps.
+    // Each asset is summed, so stored ones are paged in and compressed ones decompressed.
+    // Fails unless the packs give back the loose bytes, a missing path is not found, and
+    // LZ4 blocks and packs with one thing broken (truncated, wrong hash, payload past
+    // the end) are rejected.
+    int BenchPack(int argc, char** argv)
+    {
+        const char* sourceOption = Tools::GetOption(argc, argv, "--source", ".");
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 20ll);
+        if (iterations <= 0)
+        {
+            fprintf(stderr, "bench pack: --iterations must be positive\n");
+            return 1;
+        }
+
+        const std::vector<std::string> paths = FindFiles(sourceOption,
+            { ".jpg", ".jpeg", ".png", ".bmp", ".dds", ".cso", ".sdkmesh", ".spritefont", ".wav" });
+        if (paths.empty())
+        {
+            fprintf(stderr, "bench pack: no assets under %s\n", sourceOption);
+            return 1;
+        }
+
+        std::vector<std::string> names;
+        for (const std::string& path : paths)
+        {
+            names.push_back(std::filesystem::path(path).lexically_relative(sourceOption).generic_string());
+        }
+
+        bool failed = false;
+        uint64_t looseSum = 0, looseBytes = 0;
+        auto start = Clock::now();
+        for (long long n = 0; n < iterations; ++n)
+        {
+            looseSum = 0;
+            looseBytes = 0;
+            for (const std::string& path : paths)
+            {
+                const DX::MappedFile file = DX::MapData(path.c_str());
+                looseSum += SumBytes(file.data(), file.size());
+                looseBytes += file.size();
+            }
+        }
+        const double looseSeconds = SecondsSince(start) / double(iterations);
+        printf("pack: %zu assets, %lld iterations\n", paths.size(), iterations);
+        printf("  %-28s %9s %8s  %12s  %9s  %s\n", "", "MB", "opens", "build ms", "read ms", "speedup");
+        printf("  %-28s %9.1f %8zu  %12s  %9.2f\n", "loose files, MapData", double(looseBytes) / (1024 * 1024), paths.size(), "", looseSeconds * 1e3);
+
+        const std::string packPath = (std::filesystem::temp_directory_path() / "BenchAssets.pack").string();
+        std::vector<uint8_t> packed;
+        for (bool compress : { false, true })
+        {
+            AssetPackWriter writer;
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                writer.Add(names[i].c_str(), ReadWholeFile(paths[i].c_str()), compress);
+            }
+            start = Clock::now();
+            if (!writer.Save(packPath.c_str()))
+            {
+                fprintf(stderr, "bench pack: cannot write %s\n", packPath.c_str());
+                return 1;
+            }
+            const double buildSeconds = SecondsSince(start);
+
+            uint64_t packSum = 0;
+            uint64_t fileSize = 0;
+            bool missingFound = false;
+            start = Clock::now();
+            for (long long n = 0; n < iterations; ++n)
+            {
+                AssetPack pack;
+                pack.Open(packPath.c_str());
+                std::vector<uint8_t> storage;
+                packSum = 0;
+                for (const std::string& name : names)
+                {
+                    const AssetPackEntry* entry = pack.Find(name.c_str());
+                    if (!entry)
+                        continue;
+                    const AssetPack::Bytes bytes = pack.Get(*entry, storage);
+                    packSum += SumBytes(bytes.data, bytes.size);
+                }
+                missingFound = missingFound || pack.Find("missing.cso");
+                fileSize = pack.GetFileSize();
+            }
+            const double packSeconds = SecondsSince(start) / double(iterations);
+
+            printf("  %-28s %9.1f %8d  %12.1f  %9.2f  %6.2fx\n", compress ? "pack, lz4 where it helps" : "pack, stored",
+                double(fileSize) / (1024 * 1024), 1, buildSeconds * 1e3, packSeconds * 1e3, looseSeconds / packSeconds);
+            if (packSum != looseSum || missingFound)
+            {
+                fprintf(stderr, "bench pack: the %s pack %s\n", compress ? "compressed" : "stored",
+                    missingFound ? "found a missing path" : "gave back different bytes");
+                failed = true;
+            }
+            if (compress)
+            {
+                packed = ReadWholeFile(packPath.c_str());
+            }
+        }
+
+        // Every truncation of a compressed mesh's block must fail to decompress rather
+        // than read past it.
+        size_t sample = 0;
+        while (sample + 1 < names.size() && names[sample].find(".sdkmesh") == std::string::npos)
+        {
+            ++sample;
+        }
+        const std::vector<uint8_t> original = ReadWholeFile(paths[sample].c_str());
+        const std::vector<uint8_t> block = CompressLz4(original.data(), original.size());
+        std::vector<uint8_t> output(original.size());
+        uint32_t truncationsAccepted = 0;
+        const bool roundTrip = DecompressLz4(block.data(), block.size(), output.data(), output.size())
+            && output == original;
+        for (size_t size = 0; size < block.size(); size += 1 + block.size() / 997)
+        {
+            truncationsAccepted += DecompressLz4(block.data(), size, output.data(), output.size()) ? 1 : 0;
+        }
+
+        struct Corruption
+        {
+            const char* what;
+            void        (*apply)(std::vector<uint8_t>& file);
+        };
+        const Corruption corruptions[] =
+        {
+            { "truncated", [](std::vector<uint8_t>& file) { file.pop_back(); } },
+            { "path hash", [](std::vector<uint8_t>& file)
+                {
+                    reinterpret_cast<AssetPackEntry*>(file.data() + sizeof(AssetPackHeader))->pathHash ^= 1;
+                } },
+            { "payload", [](std::vector<uint8_t>& file)
+                {
+                    reinterpret_cast<AssetPackEntry*>(file.data() + sizeof(AssetPackHeader))->offset = file.size();
+                } },
+            { "lz4 size", [](std::vector<uint8_t>& file)
+                {
+                    // More than any block of that length can expand to, so Get never
+                    // allocates for it.
+                    const AssetPackHeader& header = *reinterpret_cast<const AssetPackHeader*>(file.data());
+                    AssetPackEntry* entries = reinterpret_cast<AssetPackEntry*>(file.data() + header.entryOffset);
+                    uint32_t victim = 0;
+                    while (victim + 1 < header.entryCount && entries[victim].compression != AssetPackLz4)
+                    {
+                        ++victim;
+                    }
+                    entries[victim].size = entries[victim].storedSize * 256 + 4096;
+                } },
+        };
+        std::string rejected;
+        for (const Corruption& corruption : corruptions)
+        {
+            std::vector<uint8_t> copy = packed;
+            corruption.apply(copy);
+            std::ofstream(packPath, std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char*>(copy.data()),
+                std::streamsize(copy.size()));
+            try
+            {
+                AssetPack pack;
+                pack.Open(packPath.c_str());
+                fprintf(stderr, "bench pack: accepted a pack with a bad %s\n", corruption.what);
+                failed = true;
+            }
+            catch (const std::runtime_error&)
+            {
+                rejected += rejected.empty() ? "" : ", ";
+                rejected += corruption.what;
+            }
+        }
+
+        // A flipped byte in a compressed payload leaves the table of contents valid, so
+        // the pack opens, but Get must notice it whether or not the block still decodes.
+        {
+            std::vector<uint8_t> copy = packed;
+            const AssetPackHeader& header = *reinterpret_cast<const AssetPackHeader*>(copy.data());
+            const AssetPackEntry* entries = reinterpret_cast<const AssetPackEntry*>(copy.data() + header.entryOffset);
+            uint32_t victim = 0;
+            while (victim + 1 < header.entryCount && entries[victim].compression != AssetPackLz4)
+            {
+                ++victim;
+            }
+            const AssetPackEntry& entry = entries[victim];
+            const char* what = "lz4 contents";
+            copy[size_t(entry.offset + entry.storedSize / 2)] ^= 0x10;
+            std::ofstream(packPath, std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char*>(copy.data()),
+                std::streamsize(copy.size()));
+            try
+            {
+                AssetPack pack;
+                pack.Open(packPath.c_str());
+                std::vector<uint8_t> storage;
+                pack.Get(pack.GetEntries()[victim], storage);
+                fprintf(stderr, "bench pack: read a pack with bad %s\n", what);
+                failed = true;
+            }
+            catch (const std::runtime_error&)
+            {
+                rejected += rejected.empty() ? "" : ", ";
+                rejected += what;
+            }
+        }
+        std::filesystem::remove(packPath);
+
+        printf("  lz4: %s %zu -> %zu bytes %s, %u truncations accepted; corruptions rejected: %s\n",
+            names[sample].c_str(), original.size(), block.size(), roundTrip ? "round trips" : "does NOT round trip",
+            truncationsAccepted, rejected.c_str());
+        failed = failed || !roundTrip || truncationsAccepted;
+
+        return failed ? 1 : 0;
+    }
+
+    // Every .sdkmesh under --source optimised --iterations times, reporting the time
+    // taken and the FIFO 16 ACMR before and after over every buffer optimised. Fails
+    // unless OptimizeVertexCache keeps the triangles, windings included, of random index
+    // lists, degenerate triangles and all.
+    int BenchMeshOptimizer(int argc, char** argv)
+    {
+        const char* sourceOption = Tools::GetOption(argc, argv, "--source", ".");
+        const long long iterations = Tools::GetOption(argc, argv, "--iterations", 20ll);
+        if (iterations <= 0)
+        {
+            fprintf(stderr, "bench meshopt: --iterations must be positive\n");
+            return 1;
+        }
+
+        const std::vector<std::string> paths = FindFiles(sourceOption, { ".sdkmesh" });
+        if (paths.empty())
+        {
+            fprintf(stderr, "bench meshopt: no .sdkmesh files under %s\n", sourceOption);
+            return 1;
+        }
+
+        bool failed = false;
+        printf("meshopt: %zu files, %lld iterations\n", paths.size(), iterations);
+        printf("  %-32s %9s %9s  %8s  %15s  %17s\n", "file", "triangles", "vertices", "ms", "ACMR", "overfetch");
+        for (const std::string& path : paths)
+        {
+            const std::string name = std::filesystem::path(path).lexically_relative(sourceOption).generic_string();
+            try
+            {
+                SdkMesh mesh;
+                mesh.Load(path.c_str());
+
+                std::vector<SdkMeshBufferReport> reports;
+                auto start = Clock::now();
+                for (long long n = 0; n < iterations; ++n)
+                {
+                    OptimizeSdkMesh(mesh, &reports);
+                }
+                const double seconds = SecondsSince(start) / double(iterations);
+
+                uint64_t triangles = 0, vertices = 0, transformsBefore = 0, transformsAfter = 0;
+                uint64_t usedBytesBefore = 0, usedBytesAfter = 0, fetchedBefore = 0, fetchedAfter = 0;
+                for (const SdkMeshBufferReport& report : reports)
+                {
+                    if (!report.optimized)
+                        continue;
+                    const uint64_t stride = mesh.GetVertexBuffers()[report.vertexBuffer].strideBytes;
+                    triangles += report.cacheBefore.triangles;
+                    vertices += report.verticesAfter;
+                    transformsBefore += report.cacheBefore.transforms;
+                    transformsAfter += report.cacheAfter.transforms;
+                    usedBytesBefore += report.cacheBefore.vertices * stride;
+                    usedBytesAfter += report.cacheAfter.vertices * stride;
+                    fetchedBefore += report.fetchBefore.bytesFetched;
+                    fetchedAfter += report.fetchAfter.bytesFetched;
+                }
+                printf("  %-32s %9llu %9llu  %8.2f  %6.3f -> %6.3f  %7.3f -> %7.3f\n", name.c_str(),
+                    static_cast<unsigned long long>(triangles), static_cast<unsigned long long>(vertices), seconds * 1e3,
+                    triangles ? double(transformsBefore) / double(triangles) : 0.0,
+                    triangles ? double(transformsAfter) / double(triangles) : 0.0,
+                    usedBytesBefore ? double(fetchedBefore) / double(usedBytesBefore) : 0.0,
+                    usedBytesAfter ? double(fetchedAfter) / double(usedBytesAfter) : 0.0);
+            }
+            catch (const std::exception& e)
+            {
+                fprintf(stderr, "bench meshopt: %s: %s\n", name.c_str(), e.what());
+                failed = true;
+            }
+        }
+
+        // Each triangle rotated to start at its smallest index, so windings compare.
+        auto getTriangles = [](const std::vector<uint32_t>& indices)
+        {
+            std::vector<std::array<uint32_t, 3>> triangles;
+            for (size_t i = 0; i + 2 < indices.size(); i += 3)
+            {
+                std::array<uint32_t, 3> triangle = { indices[i], indices[i + 1], indices[i + 2] };
+                std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+                triangles.push_back(triangle);
+            }
+            std::sort(triangles.begin(), triangles.end());
+            return triangles;
+        };
+
+        std::mt19937 random(1);
+        uint32_t mismatches = 0;
+        const uint32_t lists = 200;
+        for (uint32_t list = 0; list < lists; ++list)
+        {
+            const size_t vertexCount = 1 + random() % 64;
+            std::vector<uint32_t> indices((1 + random() % 256) * 3);
+            for (uint32_t& index : indices)
+            {
+                index = uint32_t(random() % vertexCount);
+            }
+            std::vector<uint32_t> optimized = indices;
+            OptimizeVertexCache(optimized.data(), optimized.size(), vertexCount);
+            mismatches += (getTriangles(optimized) != getTriangles(indices)) ? 1 : 0;
+        }
+        printf("  random index lists: %u of %u keep their triangles\n", lists - mismatches, lists);
+
+        return (failed || mismatches) ? 1 : 0;
+    }
+
+    struct Benchmark
+    {
+        const char* name;
+        int (*run)(int argc, char** argv);
+    };
+
+    const Benchmark c_benchmarks[] =
+    {
+        { "profiler", BenchProfiler },
+        { "transforms", BenchTransforms },
+        { "asteroids", BenchAsteroids },
+        { "jobs", BenchJobs },
+        { "culling", BenchCulling },
+        { "instances", BenchInstances },
+        { "queue", BenchQueue },
+        { "bloom", BenchBloom },
+        { "pool", BenchPool },
+        { "graph", BenchGraph },
+        { "loader", BenchLoader },
+        { "bcn", BenchBlockCompression },
+        { "mapped", BenchMappedFiles },
+        { "sdkmesh", BenchSdkMesh },
+        { "pack", BenchPack },
+        { "meshopt", BenchMeshOptimizer },
+    };
+}
+
+int RunBench(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        printf("usage: bench <name> [options]\n\nbenchmarks:\n");
+        for (auto& benchmark : c_benchmarks)
+        {
+            printf("  %s\n", benchmark.name);
+        }
+        return 1;
+    }
+
+    for (auto& benchmark : c_benchmarks)
+    {
+        if (strcmp(argv[0], benchmark.name) == 0)
+        {
+            return benchmark.run(argc - 1, argv + 1);
+        }
+    }
+
+    fprintf(stderr, "bench: unknown benchmark '%s'\n", argv[0]);
+    return 1;
+}
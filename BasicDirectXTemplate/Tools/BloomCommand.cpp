@@ -0,0 +1,104 @@
+//
+// BloomCommand.cpp - Applies the CPU bloom reference to a linear float image
+//
+// usage: bloom --input FILE --output FILE [--preset N] [--quality N] [--threads N] [--extracted FILE] [--blurred FILE]
+//
+// Images are portable float maps (.pfm). --preset picks one of g_BloomPresets (0 is
+// Default, 6 is None, which copies the scene as the game does) and --quality one of the
+// BloomQuality tiers (0 is 7 taps, 4 is 31; 2, 15 taps, is the game's default).
+// --extracted and --blurred also save the half size intermediate images, to compare with
+// the render targets of the matching GPU passes.
+//
+
+#include "ToolCommands.h"
+
+#include "BloomReference.h"
+#include "JobSystem.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+int RunBloom(int argc, char** argv)
+{
+    const char* inputPath = Tools::GetOption(argc, argv, "--input");
+    const char* outputPath = Tools::GetOption(argc, argv, "--output");
+    const char* extractedPath = Tools::GetOption(argc, argv, "--extracted");
+    const char* blurredPath = Tools::GetOption(argc, argv, "--blurred");
+    const long long preset = Tools::GetOption(argc, argv, "--preset", static_cast<long long>(Default));
+    const long long quality = Tools::GetOption(argc, argv, "--quality", static_cast<long long>(g_DefaultBloomQuality));
+    const long long threads = Tools::GetOption(argc, argv, "--threads", 0ll);
+
+    if (!inputPath || !outputPath)
+    {
+        fprintf(stderr, "bloom: --input and --output are required\n");
+        return 1;
+    }
+
+    if (preset < 0 || preset >= BloomPresetCount)
+    {
+        fprintf(stderr, "bloom: --preset must be below %d\n", int(BloomPresetCount));
+        return 1;
+    }
+
+    if (quality < 0 || quality >= BloomQualityCount)
+    {
+        fprintf(stderr, "bloom: --quality must be below %d\n", int(BloomQualityCount));
+        return 1;
+    }
+
+    FloatImage scene;
+    if (!scene.LoadPfm(inputPath))
+    {
+        fprintf(stderr, "bloom: failed to read '%s'\n", inputPath);
+        return 1;
+    }
+
+    if (scene.width < 2 || scene.height < 2)
+    {
+        fprintf(stderr, "bloom: '%s' is smaller than 2x2\n", inputPath);
+        return 1;
+    }
+
+    // Like Game::PostProcess, the None preset passes the scene through.
+    FloatImage output;
+    BloomReference bloom;
+    double seconds = 0;
+    if (preset == None)
+    {
+        output = scene;
+    }
+    else
+    {
+        std::unique_ptr<DX::JobSystem> jobs;
+        if (threads > 0)
+        {
+            jobs = std::make_unique<DX::JobSystem>(static_cast<uint32_t>(threads - 1));
+            bloom.SetJobSystem(jobs.get());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bloom.Process(scene, BloomPresets(preset), BloomQuality(quality), output);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (!output.SavePfm(outputPath))
+    {
+        fprintf(stderr, "bloom: failed to write '%s'\n", outputPath);
+        return 1;
+    }
+
+    if (preset != None)
+    {
+        if ((extractedPath && !bloom.GetExtracted().SavePfm(extractedPath))
+            || (blurredPath && !bloom.GetBlurred().SavePfm(blurredPath)))
+        {
+            fprintf(stderr, "bloom: failed to write the intermediate images\n");
+            return 1;
+        }
+    }
+
+    printf("bloom: %ux%u, preset %lld, quality %lld, %.2f ms\n", scene.width, scene.height, preset, quality,
+        seconds * 1e3);
+    return 0;
+}
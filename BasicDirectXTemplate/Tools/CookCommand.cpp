@@ -0,0 +1,353 @@
+//
+// CookCommand.cpp - Cooks JPEG and PNG textures into mipmapped, block compressed DDS files
+//
+// usage: cook --source DIR --output DIR [--quality fast|normal|high] [--threads N] [--force]
+//
+// Every .jpg, .jpeg and .png under --source (except under --output) is decoded, given a
+// full mip chain and compressed to the BC format for its role (see TextureCooker.h).
+// The DDS files keep the sources' relative paths with a .dds extension, and
+// manifest.txt in --output lists them for the game. Sources whose contents and cooker
+// settings hash the same as in the existing manifest, and whose DDS file is still
+// there, are not cooked again unless --force is given. Sources the decoder does not
+// support (progressive JPEGs) are skipped and left to WIC; corrupt ones fail the cook.
+// --quality is the block encoder's (see BlockCompression.h) and is part of the hash;
+// each cooked texture's PSNR against its source is reported.
+//
+
+#include "ToolCommands.h"
+
+#include "FileFormat.h"
+#include "JobSystem.h"
+#include "TextureCooker.h"
+#include "TextureManifest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Part of every hash, so changing how textures are cooked rebuilds them all.
+    const uint32_t COOKER_VERSION = 1;
+
+    const char* const MANIFEST_NAME = "manifest.txt";
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    bool ReadFile(const fs::path& path, std::vector<uint8_t>& data)
+    {
+        std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+
+        data.resize(size_t(file.tellg()));
+        file.seekg(0);
+        return bool(file.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size())));
+    }
+
+    bool IsSourceTexture(const fs::path& path)
+    {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+            [](char c) { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; });
+        return extension == ".jpg" || extension == ".jpeg" || extension == ".png";
+    }
+
+    // The manifest is one line per entry with tab separated fields.
+    bool IsManifestSafe(const std::string& path)
+    {
+        return std::none_of(path.begin(), path.end(), [](char c) { return uint8_t(c) < 0x20; });
+    }
+
+    enum Outcome
+    {
+        Pending,
+        Cooked,
+        UpToDate,
+        Skipped,            // Unsupported format; the game keeps using the source
+        Failed,
+    };
+
+    struct Source
+    {
+        fs::path                    path;
+        std::string                 name;           // Relative to --source
+        std::string                 cooked;         // Relative to --output
+        TextureRole                 role;
+
+        Outcome                     outcome;
+        std::string                 message;
+        TextureManifest::Entry      entry;
+        uint64_t                    rgbaBytes;      // As WIC loads it: RGBA8, one mip
+        double                      decodeSeconds;  // Reading and decoding the source
+        double                      cookSeconds;    // Mips and compression
+        double                      ddsReadSeconds;
+        double                      psnr;
+    };
+
+    void CookSource(Source& source, const fs::path& output, const TextureManifest& manifest,
+        const BlockOptions& options, bool force)
+    {
+        auto start = Clock::now();
+        std::vector<uint8_t> data;
+        if (!ReadFile(source.path, data))
+        {
+            source.outcome = Failed;
+            source.message = "cannot read the file";
+            return;
+        }
+
+        uint64_t hash = FileFormat::Hash(data.data(), data.size());
+        hash = FileFormat::Hash(&COOKER_VERSION, sizeof(COOKER_VERSION), hash);
+        hash = FileFormat::Hash(&source.role, sizeof(source.role), hash);
+        hash = FileFormat::Hash(&options.quality, sizeof(options.quality), hash);
+
+        const fs::path cookedPath = output / fs::path(source.cooked);
+        const TextureManifest::Entry* previous = manifest.Find(source.name.c_str());
+        std::error_code error;
+        if (!force && previous && previous->hash == hash && previous->cooked == source.cooked
+            && fs::file_size(cookedPath, error) == previous->bytes && !error)
+        {
+            source.outcome = UpToDate;
+            source.entry = *previous;
+            source.rgbaBytes = uint64_t(previous->width) * previous->height * 4;
+            return;
+        }
+
+        Image image;
+        try
+        {
+            image = DecodeImage(data.data(), data.size());
+        }
+        catch (const UnsupportedImageError& e)
+        {
+            source.outcome = Skipped;
+            source.message = e.what();
+            return;
+        }
+        source.decodeSeconds = SecondsSince(start);
+
+        start = Clock::now();
+        const CookedTexture texture = CookTexture(image, source.role, options);
+        source.cookSeconds = SecondsSince(start);
+        source.psnr = texture.psnr;
+
+        fs::create_directories(cookedPath.parent_path(), error);
+        if (!SaveDds(cookedPath.string().c_str(), texture))
+        {
+            source.outcome = Failed;
+            source.message = "cannot write " + cookedPath.string();
+            return;
+        }
+
+        // What loading the cooked file costs instead of decoding the source.
+        start = Clock::now();
+        std::vector<uint8_t> dds;
+        ReadFile(cookedPath, dds);
+        source.ddsReadSeconds = SecondsSince(start);
+
+        source.outcome = Cooked;
+        source.rgbaBytes = uint64_t(image.width) * image.height * 4;
+        source.entry.source = source.name;
+        source.entry.cooked = source.cooked;
+        source.entry.format = texture.format->name;
+        source.entry.width = texture.width;
+        source.entry.height = texture.height;
+        source.entry.mipCount = static_cast<uint32_t>(texture.mips.size());
+        source.entry.hash = hash;
+        source.entry.bytes = dds.size();
+    }
+}
+
+int RunCook(int argc, char** argv)
+{
+    const char* sourceOption = Tools::GetOption(argc, argv, "--source");
+    const char* outputOption = Tools::GetOption(argc, argv, "--output");
+    const long long threads = Tools::GetOption(argc, argv, "--threads", 0ll);
+    const char* qualityOption = Tools::GetOption(argc, argv, "--quality", "normal");
+    const bool force = Tools::HasFlag(argc, argv, "--force");
+
+    BlockOptions options = GetDefaultBlockOptions();
+    options.quality = BlockQualityCount;
+    for (uint32_t quality = 0; quality < BlockQualityCount; ++quality)
+    {
+        if (strcmp(qualityOption, GetBlockQualityName(BlockQuality(quality))) == 0)
+        {
+            options.quality = BlockQuality(quality);
+        }
+    }
+
+    if (!sourceOption || !outputOption)
+    {
+        fprintf(stderr, "cook: --source and --output are required\n");
+        return 1;
+    }
+
+    if (options.quality == BlockQualityCount)
+    {
+        fprintf(stderr, "cook: --quality must be fast, normal or high\n");
+        return 1;
+    }
+
+    std::error_code error;
+    const fs::path sourceRoot = fs::weakly_canonical(sourceOption, error);
+    if (error || !fs::is_directory(sourceRoot))
+    {
+        fprintf(stderr, "cook: '%s' is not a directory\n", sourceOption);
+        return 1;
+    }
+
+    fs::create_directories(outputOption, error);
+    const fs::path outputRoot = fs::weakly_canonical(outputOption, error);
+    if (error || !fs::is_directory(outputRoot))
+    {
+        fprintf(stderr, "cook: cannot create '%s'\n", outputOption);
+        return 1;
+    }
+
+    // Sorted so the output and the manifest do not depend on the directory order.
+    std::vector<Source> sources;
+    std::set<std::string> cookedNames;
+    for (auto it = fs::recursive_directory_iterator(sourceRoot, error); it != fs::recursive_directory_iterator(); ++it)
+    {
+        if (it->is_directory() && fs::equivalent(it->path(), outputRoot, error))
+        {
+            it.disable_recursion_pending();
+            continue;
+        }
+        if (!it->is_regular_file() || !IsSourceTexture(it->path()))
+            continue;
+
+        Source source = {};
+        source.path = it->path();
+        source.name = fs::relative(it->path(), sourceRoot).generic_string();
+        source.cooked = fs::path(source.name).replace_extension(".dds").generic_string();
+        source.role = GetTextureRole(source.name.c_str());
+        sources.push_back(std::move(source));
+    }
+    std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) { return a.name < b.name; });
+
+    for (Source& source : sources)
+    {
+        if (!IsManifestSafe(source.name))
+        {
+            source.outcome = Skipped;
+            source.message = "control characters in the file name";
+        }
+        else if (!cookedNames.insert(source.cooked).second)
+        {
+            source.outcome = Failed;
+            source.message = "another source also cooks to " + source.cooked;
+        }
+    }
+
+    const fs::path manifestPath = outputRoot / MANIFEST_NAME;
+    TextureManifest manifest;
+    if (fs::exists(manifestPath) && !manifest.Load(manifestPath.string().c_str()))
+    {
+        printf("cook: ignoring unreadable %s\n", manifestPath.string().c_str());
+    }
+
+    std::unique_ptr<DX::JobSystem> jobs = (threads > 0)
+        ? std::make_unique<DX::JobSystem>(static_cast<uint32_t>(threads - 1))
+        : std::make_unique<DX::JobSystem>();
+
+    auto start = Clock::now();
+    jobs->ParallelFor(sources.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            Source& source = sources[i];
+            if (source.outcome != Pending)
+                continue;
+            try
+            {
+                CookSource(source, outputRoot, manifest, options, force);
+            }
+            catch (const std::exception& e)
+            {
+                source.outcome = Failed;
+                source.message = e.what();
+            }
+        }
+    });
+    const double seconds = SecondsSince(start);
+
+    // Entries for sources that are gone, or no longer cook, go too.
+    TextureManifest updated;
+    uint32_t counts[Failed + 1] = {};
+    double decodeSeconds = 0, cookSeconds = 0, ddsReadSeconds = 0, psnr = 0;
+    uint32_t psnrCount = 0;
+    uint64_t rgbaBytes = 0, cookedBytes = 0;
+    for (const Source& source : sources)
+    {
+        ++counts[source.outcome];
+        switch (source.outcome)
+        {
+        case Cooked:
+            printf("  %-56s %-19s %-9s %4ux%-4u %2u mips  decode %6.1f ms  cook %7.1f ms  %5.1f dB\n",
+                source.name.c_str(), GetTextureRoleName(source.role), source.entry.format.c_str(), source.entry.width,
+                source.entry.height, source.entry.mipCount, source.decodeSeconds * 1e3, source.cookSeconds * 1e3,
+                source.psnr);
+            decodeSeconds += source.decodeSeconds;
+            cookSeconds += source.cookSeconds;
+            ddsReadSeconds += source.ddsReadSeconds;
+            // Textures that compress exactly (flat masks) would make the mean infinite.
+            if (std::isfinite(source.psnr))
+            {
+                psnr += source.psnr;
+                ++psnrCount;
+            }
+            break;
+        case Skipped:
+            printf("  %-56s skipped: %s\n", source.name.c_str(), source.message.c_str());
+            continue;
+        case Failed:
+            fprintf(stderr, "  %-56s failed: %s\n", source.name.c_str(), source.message.c_str());
+            continue;
+        default:
+            break;
+        }
+
+        updated.Set(source.entry);
+        rgbaBytes += source.rgbaBytes;
+        cookedBytes += source.entry.bytes;
+    }
+
+    if (!updated.Save(manifestPath.string().c_str()))
+    {
+        fprintf(stderr, "cook: failed to write %s\n", manifestPath.string().c_str());
+        return 1;
+    }
+
+    printf("cook: %zu sources, %u cooked, %u up to date, %u skipped, %u failed, %.2f s on %u threads\n",
+        sources.size(), counts[Cooked], counts[UpToDate], counts[Skipped], counts[Failed], seconds,
+        jobs->GetThreadCount());
+    if (counts[Cooked])
+    {
+        printf("cook: cooked sources took %.1f ms to read and decode, their DDS files %.1f ms to read (%.1fx); "
+            "%.1f ms of mips and %s compression (%s), %.1f dB mean PSNR\n", decodeSeconds * 1e3, ddsReadSeconds * 1e3,
+            ddsReadSeconds > 0 ? decodeSeconds / ddsReadSeconds : 0.0, cookSeconds * 1e3,
+            GetBlockQualityName(options.quality), GetInstructionSetName(options.instructionSet), psnrCount ? psnr / psnrCount : INFINITY);
+    }
+    printf("cook: texture memory %.1f MB as RGBA8 without mips, %.1f MB cooked with mips (%.1fx smaller)\n",
+        double(rgbaBytes) / (1024 * 1024), double(cookedBytes) / (1024 * 1024),
+        cookedBytes ? double(rgbaBytes) / double(cookedBytes) : 0.0);
+
+    return counts[Failed] ? 1 : 0;
+}
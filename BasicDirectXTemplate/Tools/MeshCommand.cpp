@@ -0,0 +1,168 @@
+//
+// MeshCommand.cpp - Optimises .sdkmesh files for the vertex cache and vertex fetch
+//
+// usage: mesh --input FILE [--output FILE]
+//
+// Merges duplicate vertices, puts each subset's triangles in vertex cache order and the
+// vertices in the order the triangles use them (see MeshOptimizer.h), and reports each
+// vertex buffer's ACMR, ATVR and overfetch before and after. With --output the optimised
+// mesh is written there; it loads wherever the input did, so it can replace it (--output
+// may be the input). The output is checked to draw the same triangles, with the same
+// winding and vertex data, from every subset.
+//
+
+#include "ToolCommands.h"
+
+#include "FileFormat.h"
+#include "MeshOptimizer.h"
+#include "SdkMesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Each of a subset's triangles as the hash of its three vertices' bytes, starting at
+    // the smallest so rotations compare equal and mirrored windings do not; sorted.
+    std::vector<uint64_t> GetTriangles(const SdkMesh& mesh, const SdkMeshMesh& owner, const SdkMeshSubset& subset)
+    {
+        const SdkMeshVertexBuffer& vertices = mesh.GetVertexBuffers()[owner.vertexBuffers[0]];
+        const SdkMeshIndexBuffer& indices = mesh.GetIndexBuffers()[owner.indexBuffer];
+        const uint8_t* vertexData = mesh.GetVertexData(vertices).data();
+        const uint8_t* indexData = mesh.GetIndexData(indices).data();
+        const size_t stride = size_t(vertices.strideBytes);
+
+        std::vector<uint64_t> triangles;
+        for (uint64_t t = 0; t + 2 < subset.indexCount; t += 3)
+        {
+            uint64_t corners[3];
+            for (uint64_t c = 0; c < 3; ++c)
+            {
+                const uint64_t i = subset.indexStart + t + c;
+                uint32_t index;
+                if (indices.indexType)
+                {
+                    memcpy(&index, indexData + i * 4, 4);
+                }
+                else
+                {
+                    uint16_t narrow;
+                    memcpy(&narrow, indexData + i * 2, 2);
+                    index = narrow;
+                }
+                corners[c] = FileFormat::Hash(vertexData + (subset.vertexStart + index) * stride, stride);
+            }
+            std::rotate(corners, std::min_element(corners, corners + 3), corners + 3);
+            triangles.push_back(FileFormat::Hash(corners, sizeof(corners)));
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    bool SameTriangles(const SdkMesh& before, const SdkMesh& after)
+    {
+        for (size_t m = 0; m < before.GetMeshes().size(); ++m)
+        {
+            const SdkMeshMesh& mesh = before.GetMeshes()[m];
+            for (uint32_t subset : before.GetSubsetIndices(mesh))
+            {
+                if (GetTriangles(before, mesh, before.GetSubsets()[subset])
+                    != GetTriangles(after, after.GetMeshes()[m], after.GetSubsets()[subset]))
+                {
+                    fprintf(stderr, "mesh: subset %u of %s draws different triangles\n", subset, mesh.name);
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+int RunMesh(int argc, char** argv)
+{
+    const char* inputOption = Tools::GetOption(argc, argv, "--input");
+    const char* outputOption = Tools::GetOption(argc, argv, "--output");
+    if (!inputOption)
+    {
+        fprintf(stderr, "mesh: --input is required\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> optimized;
+    try
+    {
+        SdkMesh mesh;
+        mesh.Load(inputOption);
+
+        std::vector<SdkMeshBufferReport> reports;
+        auto start = Clock::now();
+        optimized = OptimizeSdkMesh(mesh, &reports);
+        const double seconds = SecondsSince(start);
+
+        SdkMesh check;
+        check.Parse(optimized.data(), optimized.size());
+        if (!SameTriangles(mesh, check))
+            return 1;
+
+        printf("  %-6s %9s %9s %6s  %15s  %15s  %17s\n", "buffer", "vertices", "after", "dupes", "ACMR (FIFO 16)",
+            "ATVR", "overfetch");
+        uint64_t triangles = 0, transformsBefore = 0, transformsAfter = 0;
+        uint64_t verticesBefore = 0, verticesAfter = 0;
+        for (const SdkMeshBufferReport& report : reports)
+        {
+            if (!report.optimized)
+            {
+                printf("  %-6u %9llu  left as it is: %s\n", report.vertexBuffer,
+                    static_cast<unsigned long long>(report.verticesBefore), report.reason.c_str());
+                continue;
+            }
+            printf("  %-6u %9llu %9llu %6llu  %6.3f -> %6.3f  %6.3f -> %6.3f  %7.3f -> %7.3f\n", report.vertexBuffer,
+                static_cast<unsigned long long>(report.verticesBefore), static_cast<unsigned long long>(report.verticesAfter),
+                static_cast<unsigned long long>(report.duplicates), report.cacheBefore.acmr, report.cacheAfter.acmr,
+                report.cacheBefore.atvr, report.cacheAfter.atvr, report.fetchBefore.overfetch, report.fetchAfter.overfetch);
+            triangles += report.cacheBefore.triangles;
+            transformsBefore += report.cacheBefore.transforms;
+            transformsAfter += report.cacheAfter.transforms;
+            verticesBefore += report.verticesBefore;
+            verticesAfter += report.verticesAfter;
+        }
+        if (triangles)
+        {
+            printf("mesh: %s, %llu triangles, %llu -> %llu vertices, ACMR %.3f -> %.3f, optimised in %.1f ms\n",
+                inputOption, static_cast<unsigned long long>(triangles), static_cast<unsigned long long>(verticesBefore),
+                static_cast<unsigned long long>(verticesAfter), double(transformsBefore) / double(triangles),
+                double(transformsAfter) / double(triangles), seconds * 1e3);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "mesh: %s\n", e.what());
+        return 1;
+    }
+
+    // The input is unmapped by now, so it can be overwritten.
+    if (outputOption)
+    {
+        std::ofstream file(outputOption, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(optimized.data()), std::streamsize(optimized.size())))
+        {
+            fprintf(stderr, "mesh: failed to write %s\n", outputOption);
+            return 1;
+        }
+        printf("mesh: wrote %s, %zu bytes\n", outputOption, optimized.size());
+    }
+
+    return 0;
+}
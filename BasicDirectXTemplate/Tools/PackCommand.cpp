@@ -0,0 +1,230 @@
+//
+// PackCommand.cpp - Builds and lists asset packs
+//
+// usage: pack build --source DIR --output FILE [--store] [--threads N]
+//        pack list FILE
+//
+// build packs every asset the game loads from under --source (textures, cooked DDS
+// files, compiled shaders, meshes, fonts and sounds) into one file, keyed by their paths
+// relative to --source, which is where the game runs from. Each asset is LZ4 compressed
+// where that saves at least an eighth, unless --store is given; JPEG, PNG and BC
+// compressed textures rarely qualify. The pack is then opened again and every asset
+// checked against its source. list prints a pack's table of contents.
+//
+
+#include "ToolCommands.h"
+
+#include "AssetPack.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const char* const ASSET_EXTENSIONS[] =
+    {
+        ".jpg", ".jpeg", ".png", ".bmp", ".dds", ".cso", ".sdkmesh", ".spritefont", ".wav"
+    };
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    bool ReadFile(const fs::path& path, std::vector<uint8_t>& data)
+    {
+        std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+
+        data.resize(size_t(file.tellg()));
+        file.seekg(0);
+        return bool(file.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size())));
+    }
+
+    bool IsAsset(const fs::path& path)
+    {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+            [](char c) { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; });
+        return std::find_if(std::begin(ASSET_EXTENSIONS), std::end(ASSET_EXTENSIONS),
+            [&extension](const char* asset) { return extension == asset; }) != std::end(ASSET_EXTENSIONS);
+    }
+
+    const char* GetCompressionName(uint32_t compression)
+    {
+        return (compression == AssetPackLz4) ? "lz4" : "stored";
+    }
+
+    int BuildPack(int argc, char** argv)
+    {
+        const char* sourceOption = Tools::GetOption(argc, argv, "--source");
+        const char* outputOption = Tools::GetOption(argc, argv, "--output");
+        const long long threads = Tools::GetOption(argc, argv, "--threads", 0ll);
+        const bool store = Tools::HasFlag(argc, argv, "--store");
+
+        if (!sourceOption || !outputOption)
+        {
+            fprintf(stderr, "pack build: --source and --output are required\n");
+            return 1;
+        }
+
+        std::error_code error;
+        const fs::path sourceRoot = fs::weakly_canonical(sourceOption, error);
+        if (error || !fs::is_directory(sourceRoot))
+        {
+            fprintf(stderr, "pack build: '%s' is not a directory\n", sourceOption);
+            return 1;
+        }
+
+        // Sorted so the pack does not depend on the directory order.
+        std::vector<fs::path> paths;
+        for (auto it = fs::recursive_directory_iterator(sourceRoot, error); it != fs::recursive_directory_iterator(); ++it)
+        {
+            if (it->is_regular_file() && IsAsset(it->path()))
+                paths.push_back(it->path());
+        }
+        std::sort(paths.begin(), paths.end());
+
+        AssetPackWriter writer;
+        uint64_t sourceBytes = 0;
+        auto start = Clock::now();
+        try
+        {
+            for (const fs::path& path : paths)
+            {
+                std::vector<uint8_t> contents;
+                if (!ReadFile(path, contents))
+                {
+                    fprintf(stderr, "pack build: cannot read %s\n", path.string().c_str());
+                    return 1;
+                }
+                sourceBytes += contents.size();
+                writer.Add(fs::relative(path, sourceRoot).generic_string().c_str(), std::move(contents), !store);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            fprintf(stderr, "pack build: %s\n", e.what());
+            return 1;
+        }
+        const double readSeconds = SecondsSince(start);
+
+        std::unique_ptr<DX::JobSystem> jobs = (threads > 0)
+            ? std::make_unique<DX::JobSystem>(static_cast<uint32_t>(threads - 1))
+            : std::make_unique<DX::JobSystem>();
+
+        start = Clock::now();
+        if (!writer.Save(outputOption, jobs.get()))
+        {
+            fprintf(stderr, "pack build: failed to write %s\n", outputOption);
+            return 1;
+        }
+        const double saveSeconds = SecondsSince(start);
+
+        // Everything read back through the pack, as the game will read it.
+        start = Clock::now();
+        AssetPack pack;
+        uint32_t compressed = 0;
+        try
+        {
+            if (!pack.Open(outputOption))
+            {
+                fprintf(stderr, "pack build: cannot open %s\n", outputOption);
+                return 1;
+            }
+
+            std::vector<uint8_t> storage;
+            for (const AssetPackWriter::Entry& source : writer.GetEntries())
+            {
+                const AssetPackEntry* entry = pack.Find(source.path.c_str());
+                const AssetPack::Bytes bytes = entry ? pack.Get(*entry, storage) : AssetPack::Bytes{ nullptr, 0 };
+                if (!entry || bytes.size != source.contents.size()
+                    || (bytes.size && memcmp(bytes.data, source.contents.data(), bytes.size) != 0)
+                    || AssetPack::HashContents(bytes.data, bytes.size) != entry->contentHash)
+                {
+                    fprintf(stderr, "pack build: %s does not read back from the pack\n", source.path.c_str());
+                    return 1;
+                }
+                compressed += (entry->compression == AssetPackLz4) ? 1 : 0;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            fprintf(stderr, "pack build: %s\n", e.what());
+            return 1;
+        }
+        const double verifySeconds = SecondsSince(start);
+
+        printf("pack build: %u assets (%u compressed), %.1f MB in %.1f MB, read %.1f ms, %s %.1f ms on %u threads, "
+            "verified %.1f ms\n", pack.GetEntryCount(), compressed, double(sourceBytes) / (1024 * 1024),
+            double(pack.GetFileSize()) / (1024 * 1024), readSeconds * 1e3, store ? "written" : "compressed and written",
+            saveSeconds * 1e3, jobs->GetThreadCount(), verifySeconds * 1e3);
+        return 0;
+    }
+
+    int ListPack(int argc, char** argv)
+    {
+        if (argc < 1)
+        {
+            fprintf(stderr, "pack list: a pack file is required\n");
+            return 1;
+        }
+
+        AssetPack pack;
+        try
+        {
+            if (!pack.Open(argv[0]))
+            {
+                fprintf(stderr, "pack list: cannot open %s\n", argv[0]);
+                return 1;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            fprintf(stderr, "pack list: %s\n", e.what());
+            return 1;
+        }
+
+        const AssetPackHeader& header = pack.GetHeader();
+        uint64_t size = 0, storedSize = 0;
+        printf("  %-64s %12s %12s %-7s %12s\n", "path", "size", "stored", "", "offset");
+        for (uint32_t i = 0; i < pack.GetEntryCount(); ++i)
+        {
+            const AssetPackEntry& entry = pack.GetEntries()[i];
+            printf("  %-64s %12llu %12llu %-7s %12llu\n", pack.GetPath(entry), static_cast<unsigned long long>(entry.size),
+                static_cast<unsigned long long>(entry.storedSize), GetCompressionName(entry.compression),
+                static_cast<unsigned long long>(entry.offset));
+            size += entry.size;
+            storedSize += entry.storedSize;
+        }
+        printf("pack list: %u assets, %.1f MB stored as %.1f MB in a %.1f MB file; %u buckets, %u byte pages, "
+            "%llu byte table of contents\n", pack.GetEntryCount(), double(size) / (1024 * 1024),
+            double(storedSize) / (1024 * 1024), double(pack.GetFileSize()) / (1024 * 1024), header.bucketCount,
+            header.pageSize, static_cast<unsigned long long>(header.pathOffset + header.pathSize));
+        return 0;
+    }
+}
+
+int RunPack(int argc, char** argv)
+{
+    if (argc >= 1 && strcmp(argv[0], "build") == 0)
+        return BuildPack(argc - 1, argv + 1);
+    if (argc >= 1 && strcmp(argv[0], "list") == 0)
+        return ListPack(argc - 1, argv + 1);
+
+    fprintf(stderr, "pack: expected 'build' or 'list'\n");
+    return 1;
+}
@@ -0,0 +1,314 @@
+//
+// SimulateCommand.cpp - Drives Simulation::Update for N frames without a D3D device
+//
+// usage: simulate [--frames N] [--rate HZ] [--script FILE] [--trace FILE [--trace-frames N]] [--snapshots] [--threads N]
+//                 [--record FILE | --replay FILE]
+//
+// A script is a text file with one step per line:
+//
+//     <updates> <keys> <mouseX> <mouseY> [lmb]
+//
+// where <keys> is '-' or a '+' separated list of W A S D SPACE X Q E HOME ESC.
+// Lines starting with '#' are ignored. The script repeats until N frames are run.
+//
+// --snapshots publishes a render snapshot after every update and consumes it, as the
+// game's render loop does, so its cost and allocations show up in the report. Each
+// snapshot is also culled with the game's projection at 16:9.
+//
+// --threads N attaches a job system with N threads (including the calling one); the
+// state hash must not change with the thread count.
+//
+// --record FILE saves the input and elapsed time of every update as an InputRecording.
+// --replay FILE runs one frame per recorded update instead of the script, with the
+// recorded input and elapsed time (--frames and --rate are ignored). Replaying the
+// game's recordings (F10) flies the same path it did, for benchmarking before and after
+// a change; the state hash tells whether the simulation itself changed.
+//
+
+#include "ToolCommands.h"
+
+#include "FrustumCuller.h"
+#include "InputRecording.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "RenderSnapshot.h"
+#include "Simulation.h"
+#include "StepTimer.h"
+#include "TripleBuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    struct ScriptStep
+    {
+        uint32_t        count;
+        SimulationInput input;
+    };
+
+    uint32_t ParseKeys(const std::string& text)
+    {
+        static const struct { const char* name; uint32_t key; } c_keys[] =
+        {
+            { "W", SimulationInput::Forward },
+            { "S", SimulationInput::Back },
+            { "A", SimulationInput::Left },
+            { "D", SimulationInput::Right },
+            { "SPACE", SimulationInput::Up },
+            { "X", SimulationInput::Down },
+            { "Q", SimulationInput::RollLeft },
+            { "E", SimulationInput::RollRight },
+            { "HOME", SimulationInput::Home },
+            { "ESC", SimulationInput::Exit },
+        };
+
+        uint32_t keys = 0;
+        std::stringstream stream(text);
+        std::string name;
+        while (std::getline(stream, name, '+'))
+        {
+            for (auto& key : c_keys)
+            {
+                if (name == key.name)
+                    keys |= key.key;
+            }
+        }
+        return keys;
+    }
+
+    ScriptStep MakeStep(uint32_t count, uint32_t keys, int32_t mouseX, int32_t mouseY, bool leftButton)
+    {
+        ScriptStep step = {};
+        step.count = count;
+        step.input.keys = keys;
+        step.input.mouseX = mouseX;
+        step.input.mouseY = mouseY;
+        step.input.leftButton = leftButton;
+        step.input.mouseRelative = leftButton;
+        return step;
+    }
+
+    // Fly forward, look around, strafe, roll and return home.
+    std::vector<ScriptStep> DefaultScript()
+    {
+        return
+        {
+            MakeStep(120, SimulationInput::Forward, 0, 0, false),
+            MakeStep(90, SimulationInput::Forward, 6, -2, true),
+            MakeStep(60, SimulationInput::Left | SimulationInput::Up, -4, 3, true),
+            MakeStep(30, SimulationInput::RollLeft, 0, 0, false),
+            MakeStep(120, SimulationInput::Back | SimulationInput::Right, 2, 1, true),
+            MakeStep(1, SimulationInput::Home, 0, 0, false),
+        };
+    }
+
+    bool LoadScript(const char* path, std::vector<ScriptStep>& script)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::stringstream stream(line);
+            uint32_t count = 0;
+            std::string keys, button;
+            int32_t mouseX = 0, mouseY = 0;
+            if (!(stream >> count >> keys >> mouseX >> mouseY))
+                continue;
+            stream >> button;
+
+            script.push_back(MakeStep(count, ParseKeys(keys), mouseX, mouseY, button == "lmb"));
+        }
+
+        return !script.empty();
+    }
+}
+
+int RunSimulate(int argc, char** argv)
+{
+    long long frames = Tools::GetOption(argc, argv, "--frames", 3600ll);
+    const long long rate = Tools::GetOption(argc, argv, "--rate", 60ll);
+    const char* scriptPath = Tools::GetOption(argc, argv, "--script");
+    const char* tracePath = Tools::GetOption(argc, argv, "--trace");
+    const long long traceFrames = Tools::GetOption(argc, argv, "--trace-frames", 300ll);
+    const bool snapshots = Tools::HasFlag(argc, argv, "--snapshots");
+    const long long threads = Tools::GetOption(argc, argv, "--threads", 0ll);
+    const char* recordPath = Tools::GetOption(argc, argv, "--record");
+    const char* replayPath = Tools::GetOption(argc, argv, "--replay");
+
+    if (frames <= 0 || rate <= 0)
+    {
+        fprintf(stderr, "simulate: --frames and --rate must be positive\n");
+        return 1;
+    }
+
+    InputRecording recording;
+    InputPlayback playback;
+    if (replayPath)
+    {
+        if (!recording.Load(replayPath) || recording.IsEmpty())
+        {
+            fprintf(stderr, "simulate: failed to read recording '%s'\n", replayPath);
+            return 1;
+        }
+        playback = InputPlayback(recording);
+        frames = static_cast<long long>(recording.GetUpdateCount());
+    }
+
+    std::vector<ScriptStep> script;
+    if (scriptPath)
+    {
+        if (!LoadScript(scriptPath, script))
+        {
+            fprintf(stderr, "simulate: failed to read script '%s'\n", scriptPath);
+            return 1;
+        }
+    }
+    else
+    {
+        script = DefaultScript();
+    }
+
+    const uint64_t tickStep = DX::VirtualStepTimer::TicksPerSecond / uint64_t(rate);
+
+    DX::VirtualStepTimer timer;
+    timer.SetFixedTimeStep(true);
+    timer.SetTargetElapsedTicks(tickStep);
+
+    Simulation simulation;
+
+    std::unique_ptr<DX::JobSystem> jobs;
+    if (threads > 0)
+    {
+        jobs = std::make_unique<DX::JobSystem>(static_cast<uint32_t>(threads - 1));
+        simulation.SetJobSystem(jobs.get());
+    }
+    DX::TripleBuffer<RenderSnapshot> snapshotBuffer;
+    uint64_t snapshotsRead = 0;
+
+    const XMMATRIX projection = XMMatrixPerspectiveFovRH(XMConvertToRadians(70.f), 16.f / 9.f, 0.01f, 100.f);
+    FrustumCuller culler;
+    std::vector<uint8_t> visible;
+    CullStatistics cullStats = {};
+
+    if (tracePath)
+    {
+        DX::Profiler::BeginCapture(static_cast<uint32_t>(traceFrames), tracePath);
+    }
+
+    size_t step = 0;
+    uint32_t stepFrame = 0;
+
+    const uint64_t allocationsBefore = GetAllocationCount();
+    auto start = std::chrono::steady_clock::now();
+
+    for (long long frame = 0; frame < frames; ++frame)
+    {
+        if (!DX::Profiler::BeginFrame())
+        {
+            fprintf(stderr, "simulate: failed to write %s\n", tracePath);
+        }
+
+        SimulationInput input = script[step].input;
+        if (++stepFrame >= script[step].count)
+        {
+            stepFrame = 0;
+            step = (step + 1) % script.size();
+        }
+
+        // A replayed update advances the clock by exactly its recorded step.
+        uint64_t frameTicks = tickStep;
+        if (replayPath)
+        {
+            playback.Next(frameTicks, input);
+            timer.SetTargetElapsedTicks(frameTicks);
+        }
+
+        timer.GetClock().Advance(frameTicks);
+        timer.Tick([&]()
+        {
+            if (recordPath)
+            {
+                recording.Append(timer.GetElapsedTicks(), input);
+            }
+            simulation.Update(float(timer.GetElapsedSeconds()), input);
+        });
+
+        if (snapshots)
+        {
+            simulation.WriteSnapshot(snapshotBuffer.GetWriteBuffer());
+            snapshotBuffer.Publish();
+
+            if (snapshotBuffer.Acquire())
+            {
+                const RenderSnapshot& snapshot = snapshotBuffer.GetReadBuffer();
+                snapshotsRead += snapshot.update != 0 ? 1 : 0;
+
+                culler.SetViewProjection(XMMatrixMultiply(XMLoadFloat4x4(&snapshot.view), projection));
+                visible.resize(std::max<size_t>(snapshot.asteroids.size(), Simulation::BodyCount));
+                cullStats.Add(Simulation::BodyCount, culler.Cull(&snapshot.bodies[0].bounds,
+                    Simulation::BodyCount, sizeof(RenderObject), visible.data()));
+                if (!snapshot.asteroids.empty())
+                {
+                    cullStats.Add(snapshot.asteroids.size(), culler.Cull(&snapshot.asteroids[0].bounds,
+                        snapshot.asteroids.size(), sizeof(RenderObject), visible.data()));
+                }
+            }
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    const uint64_t allocations = GetAllocationCount() - allocationsBefore;
+
+    const double totalNs = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    const auto& camera = simulation.GetCameraPosition();
+
+    printf("frames:          %lld (%u updates)\n", frames, timer.GetFrameCount());
+    printf("ns/frame:        %.1f\n", totalNs / double(frames));
+    printf("allocs/frame:    %.3f\n", double(allocations) / double(frames));
+    printf("camera:          %.4f %.4f %.4f pitch %.4f yaw %.4f\n",
+        camera.x, camera.y, camera.z, simulation.GetPitch(), simulation.GetYaw());
+    printf("state hash:      %016llx\n", static_cast<unsigned long long>(simulation.GetStateHash()));
+
+    auto& statistics = timer.GetStatistics();
+    auto frameTicks = statistics.GetSummary(DX::FrameStatistics::FrameTicks);
+    auto updates = statistics.GetSummary(DX::FrameStatistics::UpdatesPerTick);
+    printf("frame ticks:     p50 %u p95 %u p99 %u max %u\n", frameTicks.p50, frameTicks.p95, frameTicks.p99, frameTicks.max);
+    printf("updates/tick:    p50 %u p95 %u p99 %u max %u\n", updates.p50, updates.p95, updates.p99, updates.max);
+    printf("hitches:         %llu\n", static_cast<unsigned long long>(statistics.GetHitchCount()));
+
+    if (snapshots)
+    {
+        printf("snapshots read:  %llu\n", static_cast<unsigned long long>(snapshotsRead));
+        printf("cull/snapshot:   visible %.1f culled %.1f\n",
+            double(cullStats.visible) / double(std::max<uint64_t>(snapshotsRead, 1)),
+            double(cullStats.culled) / double(std::max<uint64_t>(snapshotsRead, 1)));
+    }
+
+    if (recordPath)
+    {
+        if (!recording.Save(recordPath))
+        {
+            fprintf(stderr, "simulate: failed to write recording '%s'\n", recordPath);
+            return 1;
+        }
+        printf("recorded:        %llu updates to %s\n",
+            static_cast<unsigned long long>(recording.GetUpdateCount()), recordPath);
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+//
+// ToolCommands.h - Entry points and helpers for the command-line tools
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Each command receives the arguments that follow its name.
+int RunSimulate(int argc, char** argv);
+int RunBench(int argc, char** argv);
+int RunBloom(int argc, char** argv);
+int RunCook(int argc, char** argv);
+int RunPack(int argc, char** argv);
+int RunMesh(int argc, char** argv);
+
+// Number of heap allocations made by the process so far.
+uint64_t GetAllocationCount();
+
+namespace Tools
+{
+    // Returns the value following "name" on the command line, or defaultValue.
+    inline const char* GetOption(int argc, char** argv, const char* name, const char* defaultValue = nullptr)
+    {
+        for (int i = 0; i + 1 < argc; ++i)
+        {
+            if (strcmp(argv[i], name) == 0)
+                return argv[i + 1];
+        }
+        return defaultValue;
+    }
+
+    inline long long GetOption(int argc, char** argv, const char* name, long long defaultValue)
+    {
+        const char* value = GetOption(argc, argv, name);
+        return value ? strtoll(value, nullptr, 10) : defaultValue;
+    }
+
+    inline bool HasFlag(int argc, char** argv, const char* name)
+    {
+        for (int i = 0; i < argc; ++i)
+        {
+            if (strcmp(argv[i], name) == 0)
+                return true;
+        }
+        return false;
+    }
+}
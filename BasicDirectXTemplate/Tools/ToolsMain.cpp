@@ -0,0 +1,96 @@
+//
+// ToolsMain.cpp - Command-line entry point for the headless tools
+//
+// The tools only depend on the device independent sources (no D3D, no DirectXTK)
+// so they build as a console application on Windows and on Linux.
+//
+
+#include "ToolCommands.h"
+
+#include <atomic>
+#include <cstdio>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> s_allocationCount(0);
+
+    struct Command
+    {
+        const char* name;
+        int (*run)(int argc, char** argv);
+        const char* description;
+    };
+
+    const Command c_commands[] =
+    {
+        { "simulate", RunSimulate, "Tick the simulation for N frames with scripted input" },
+        { "bench", RunBench, "Run a CPU micro-benchmark" },
+        { "bloom", RunBloom, "Apply the CPU bloom reference to a .pfm image" },
+        { "cook", RunCook, "Cook JPEG and PNG textures into block compressed DDS files" },
+        { "pack", RunPack, "Build or list a packed asset archive" },
+        { "mesh", RunMesh, "Optimise an .sdkmesh for the vertex cache and vertex fetch" },
+    };
+
+    void PrintUsage()
+    {
+        printf("usage: BasicDirectXTemplateTools <command> [options]\n\n");
+        for (auto& command : c_commands)
+        {
+            printf("  %-20s %s\n", command.name, command.description);
+        }
+    }
+}
+
+// Count every heap allocation so commands can report allocations per frame.
+void* operator new(size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// The library's nothrow new (used by std::stable_sort's buffer) must come from the same
+// heap as the delete below.
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+uint64_t GetAllocationCount()
+{
+    return s_allocationCount.load(std::memory_order_relaxed);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    for (auto& command : c_commands)
+    {
+        if (strcmp(argv[1], command.name) == 0)
+        {
+            return command.run(argc - 2, argv + 2);
+        }
+    }
+
+    fprintf(stderr, "unknown command '%s'\n\n", argv[1]);
+    PrintUsage();
+    return 1;
+}
@@ -0,0 +1,104 @@
+//
+// TransformHierarchy.cpp
+//
+
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace DirectX;
+
+void TransformHierarchy::Clear()
+{
+    m_parents.clear();
+    m_translations.clear();
+    m_rotations.clear();
+    m_scales.clear();
+    m_worlds.clear();
+    m_dirty.clear();
+}
+
+void TransformHierarchy::Reserve(size_t count)
+{
+    m_parents.reserve(count);
+    m_translations.reserve(count);
+    m_rotations.reserve(count);
+    m_scales.reserve(count);
+    m_worlds.reserve(count);
+    m_dirty.reserve(count);
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent)
+{
+    auto node = static_cast<uint32_t>(m_parents.size());
+    if (parent != NoParent && parent >= node)
+        throw std::out_of_range("TransformHierarchy: a parent must be added before its children");
+
+    XMFLOAT4X4 identity;
+    XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+    m_parents.push_back(parent);
+    m_translations.push_back(XMFLOAT3(0.f, 0.f, 0.f));
+    m_rotations.push_back(XMFLOAT4(0.f, 0.f, 0.f, 1.f));
+    m_scales.push_back(XMFLOAT3(1.f, 1.f, 1.f));
+    m_worlds.push_back(identity);
+    m_dirty.push_back(1);
+    return node;
+}
+
+void XM_CALLCONV TransformHierarchy::SetTranslation(uint32_t node, FXMVECTOR translation)
+{
+    XMStoreFloat3(&m_translations[node], translation);
+    m_dirty[node] = 1;
+}
+
+void XM_CALLCONV TransformHierarchy::SetRotation(uint32_t node, FXMVECTOR quaternion)
+{
+    XMStoreFloat4(&m_rotations[node], quaternion);
+    m_dirty[node] = 1;
+}
+
+void XM_CALLCONV TransformHierarchy::SetScale(uint32_t node, FXMVECTOR scale)
+{
+    XMStoreFloat3(&m_scales[node], scale);
+    m_dirty[node] = 1;
+}
+
+size_t TransformHierarchy::Update()
+{
+    const size_t count = m_parents.size();
+    const XMVECTOR origin = XMVectorZero();
+    size_t updated = 0;
+
+    // Parents precede their children, so by the time a node is visited its parent's
+    // dirty flag says whether the parent's world matrix changed during this pass.
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t parent = m_parents[i];
+        if (parent != NoParent && m_dirty[parent])
+        {
+            m_dirty[i] = 1;
+        }
+
+        if (!m_dirty[i])
+            continue;
+
+        XMMATRIX world = XMMatrixAffineTransformation(
+            XMLoadFloat3(&m_scales[i]),
+            origin,
+            XMLoadFloat4(&m_rotations[i]),
+            XMLoadFloat3(&m_translations[i]));
+
+        if (parent != NoParent)
+        {
+            world = XMMatrixMultiply(world, XMLoadFloat4x4(&m_worlds[parent]));
+        }
+
+        XMStoreFloat4x4(&m_worlds[i], world);
+        ++updated;
+    }
+
+    std::fill(m_dirty.begin(), m_dirty.end(), uint8_t(0));
+    return updated;
+}
@@ -0,0 +1,50 @@
+//
+// TransformHierarchy.h - Flat parent/child transform hierarchy stored as structure of arrays
+//
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+// Nodes are stored in creation order and a parent must be created before its children,
+// so a single forward pass over the arrays computes every world matrix.
+class TransformHierarchy
+{
+public:
+    static const uint32_t NoParent = UINT32_MAX;
+
+    TransformHierarchy() noexcept {}
+
+    void Clear();
+    void Reserve(size_t count);
+
+    // Adds a node with an identity local transform and returns its index. Throws
+    // std::out_of_range unless parent is NoParent or an existing node.
+    uint32_t AddNode(uint32_t parent = NoParent);
+
+    // Local transform relative to the parent; marks the node dirty.
+    void XM_CALLCONV SetTranslation(uint32_t node, DirectX::FXMVECTOR translation);
+    void XM_CALLCONV SetRotation(uint32_t node, DirectX::FXMVECTOR quaternion);
+    void XM_CALLCONV SetScale(uint32_t node, DirectX::FXMVECTOR scale);
+
+    // Recomputes the world matrix of every dirty node and its descendants.
+    // Returns the number of world matrices that were rebuilt.
+    size_t Update();
+
+    size_t GetNodeCount() const                         { return m_parents.size(); }
+    uint32_t GetParent(uint32_t node) const             { return m_parents[node]; }
+
+    // World matrices as of the last Update.
+    DirectX::XMMATRIX GetWorld(uint32_t node) const     { return DirectX::XMLoadFloat4x4(&m_worlds[node]); }
+    const DirectX::XMFLOAT4X4* GetWorlds() const        { return m_worlds.data(); }
+
+private:
+    std::vector<uint32_t>               m_parents;
+    std::vector<DirectX::XMFLOAT3>      m_translations;
+    std::vector<DirectX::XMFLOAT4>      m_rotations;
+    std::vector<DirectX::XMFLOAT3>      m_scales;
+    std::vector<DirectX::XMFLOAT4X4>    m_worlds;
+    std::vector<uint8_t>                m_dirty;
+};
@@ -0,0 +1,188 @@
+//
+// TransientTexturePool.cpp
+//
+
+#include "TransientTexturePool.h"
+
+#include <stdexcept>
+
+void* NullTextureBackend::Create(const TransientTextureDesc& desc, uint64_t& bytes)
+{
+    bytes = uint64_t(desc.width) * desc.height * m_bytesPerTexel;
+    ++m_liveCount;
+    return reinterpret_cast<void*>(++m_nextTexture);
+}
+
+void NullTextureBackend::Destroy(void*) noexcept
+{
+    --m_liveCount;
+}
+
+TransientTexturePool::TransientTexturePool(TransientTextureBackend& backend, uint32_t keepFrames,
+    uint64_t budgetBytes, float maxOversize) noexcept :
+    m_backend(&backend),
+    m_keepFrames(keepFrames),
+    m_budgetBytes(budgetBytes),
+    m_maxOversize(maxOversize),
+    m_frame(0),
+    m_statistics{}
+{
+}
+
+TransientTexturePool::~TransientTexturePool()
+{
+    for (Entry& entry : m_entries)
+    {
+        if (entry.texture)
+        {
+            Destroy(entry);
+        }
+    }
+}
+
+void TransientTexturePool::BeginFrame()
+{
+    ++m_frame;
+
+    for (Entry& entry : m_entries)
+    {
+        if (entry.texture && !entry.inUse && m_frame - entry.lastUsedFrame > m_keepFrames)
+        {
+            Destroy(entry);
+        }
+    }
+}
+
+TransientTexturePool::Handle TransientTexturePool::Acquire(const TransientTextureDesc& desc, bool allowLarger)
+{
+    if (desc.width == 0 || desc.height == 0)
+        throw std::invalid_argument("TransientTexturePool: textures must not be empty");
+
+    ++m_statistics.acquires;
+
+    // An exact match wins; otherwise the smallest larger texture within maxOversize.
+    const double area = double(desc.width) * desc.height;
+    Handle best = InvalidHandle;
+    double bestArea = 0;
+    Handle emptySlot = InvalidHandle;
+    for (Handle i = 0; i < m_entries.size(); ++i)
+    {
+        const Entry& entry = m_entries[i];
+        if (!entry.texture)
+        {
+            emptySlot = i;
+            continue;
+        }
+
+        if (entry.inUse || entry.desc.format != desc.format || entry.desc.bindFlags != desc.bindFlags)
+            continue;
+
+        if (entry.desc.width == desc.width && entry.desc.height == desc.height)
+        {
+            best = i;
+            break;
+        }
+
+        const double entryArea = double(entry.desc.width) * entry.desc.height;
+        if (allowLarger && entry.desc.width >= desc.width && entry.desc.height >= desc.height
+            && entryArea <= area * m_maxOversize && (best == InvalidHandle || entryArea < bestArea))
+        {
+            best = i;
+            bestArea = entryArea;
+        }
+    }
+
+    if (best != InvalidHandle)
+    {
+        ++m_statistics.hits;
+    }
+    else
+    {
+        if (emptySlot == InvalidHandle)
+        {
+            emptySlot = static_cast<Handle>(m_entries.size());
+            m_entries.push_back({});
+        }
+
+        Entry& entry = m_entries[emptySlot];
+        uint64_t bytes = 0;
+        entry.texture = m_backend->Create(desc, bytes);
+        entry.desc = desc;
+        entry.bytes = bytes;
+        entry.inUse = true;
+
+        ++m_statistics.creations;
+        ++m_statistics.texturesResident;
+        m_statistics.bytesResident += bytes;
+        best = emptySlot;
+
+        EvictOverBudget();
+        if (m_statistics.bytesResident > m_statistics.peakBytesResident)
+        {
+            m_statistics.peakBytesResident = m_statistics.bytesResident;
+        }
+    }
+
+    Entry& entry = m_entries[best];
+    entry.inUse = true;
+    entry.lastUsedFrame = m_frame;
+    return best;
+}
+
+void TransientTexturePool::Release(Handle handle)
+{
+    if (handle >= m_entries.size() || !m_entries[handle].inUse)
+        throw std::invalid_argument("TransientTexturePool: released a texture that was not acquired");
+
+    Entry& entry = m_entries[handle];
+    entry.inUse = false;
+    entry.lastUsedFrame = m_frame;
+}
+
+void TransientTexturePool::Trim()
+{
+    for (Entry& entry : m_entries)
+    {
+        if (entry.texture && !entry.inUse)
+        {
+            Destroy(entry);
+        }
+    }
+}
+
+float TransientTexturePool::GetHitRate() const
+{
+    return m_statistics.acquires ? float(double(m_statistics.hits) / double(m_statistics.acquires)) : 0.f;
+}
+
+// Textures in use are never evicted, so the pool can stay over budget while they are.
+void TransientTexturePool::EvictOverBudget()
+{
+    while (m_budgetBytes > 0 && m_statistics.bytesResident > m_budgetBytes)
+    {
+        Entry* oldest = nullptr;
+        for (Entry& entry : m_entries)
+        {
+            if (entry.texture && !entry.inUse && (!oldest || entry.lastUsedFrame < oldest->lastUsedFrame))
+            {
+                oldest = &entry;
+            }
+        }
+
+        if (!oldest)
+            return;
+
+        Destroy(*oldest);
+    }
+}
+
+void TransientTexturePool::Destroy(Entry& entry)
+{
+    m_backend->Destroy(entry.texture);
+
+    ++m_statistics.destructions;
+    --m_statistics.texturesResident;
+    m_statistics.bytesResident -= entry.bytes;
+
+    entry = {};
+}
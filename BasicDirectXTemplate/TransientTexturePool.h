@@ -0,0 +1,124 @@
+//
+// TransientTexturePool.h - Render targets reused across frames and window sizes
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// format and bindFlags are a DXGI_FORMAT and D3D11_BIND_FLAG; the pool only compares them.
+struct TransientTextureDesc
+{
+    uint32_t    format;
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    bindFlags;
+};
+
+// Creates and destroys the textures a TransientTexturePool hands out. The pool treats
+// them as opaque pointers.
+class TransientTextureBackend
+{
+public:
+    virtual ~TransientTextureBackend() {}
+
+    // Throws on failure. bytes is the memory the texture occupies.
+    virtual void* Create(const TransientTextureDesc& desc, uint64_t& bytes) = 0;
+    virtual void Destroy(void* texture) noexcept = 0;
+};
+
+// Allocates nothing: textures are counters, sized at bytesPerTexel. For exercising the
+// pool's policy without a device (see "bench pool").
+class NullTextureBackend : public TransientTextureBackend
+{
+public:
+    explicit NullTextureBackend(uint32_t bytesPerTexel = 4) noexcept :
+        m_bytesPerTexel(bytesPerTexel),
+        m_nextTexture(0),
+        m_liveCount(0)
+    {
+    }
+
+    void* Create(const TransientTextureDesc& desc, uint64_t& bytes) override;
+    void Destroy(void* texture) noexcept override;
+
+    uint32_t GetLiveCount() const                       { return m_liveCount; }
+
+private:
+    uint32_t    m_bytesPerTexel;
+    uintptr_t   m_nextTexture;
+    uint32_t    m_liveCount;
+};
+
+// Hands out textures by (format, size, bind flags). A released texture stays resident
+// and is given to the next matching Acquire; textures nobody has acquired for keepFrames
+// frames are destroyed by BeginFrame. So targets used every frame are created once,
+// targets only some settings use (e.g. deeper bloom levels) go away a while after
+// they stop being used, and a window that goes back to a recent size (maximize and
+// restore) finds its old targets still there. When a creation takes the pool over
+// budgetBytes (0 for no budget), the least recently used free textures go first.
+//
+// Acquire can also reuse a larger texture, up to maxOversize times the requested
+// area, for callers that render into and sample from just its top left.
+class TransientTexturePool
+{
+public:
+    typedef uint32_t Handle;
+    static const Handle InvalidHandle = ~0u;
+
+    struct Statistics
+    {
+        uint64_t    acquires;
+        uint64_t    hits;                   // Acquires served by a resident texture
+        uint64_t    creations;
+        uint64_t    destructions;
+        uint32_t    texturesResident;
+        uint64_t    bytesResident;
+        uint64_t    peakBytesResident;
+    };
+
+    explicit TransientTexturePool(TransientTextureBackend& backend, uint32_t keepFrames = 60,
+        uint64_t budgetBytes = 0, float maxOversize = 2.f) noexcept;
+    ~TransientTexturePool();
+
+    TransientTexturePool(TransientTexturePool const&) = delete;
+    TransientTexturePool& operator= (TransientTexturePool const&) = delete;
+
+    // Destroys the free textures that have not been used for keepFrames frames.
+    void BeginFrame();
+
+    Handle Acquire(const TransientTextureDesc& desc, bool allowLarger = false);
+    void Release(Handle handle);
+
+    // desc is the texture's own size, which allowLarger can make bigger than requested.
+    void* GetTexture(Handle handle) const               { return m_entries[handle].texture; }
+    const TransientTextureDesc& GetDesc(Handle handle) const { return m_entries[handle].desc; }
+
+    // Destroys every free texture, e.g. before the device goes away.
+    void Trim();
+
+    const Statistics& GetStatistics() const             { return m_statistics; }
+    float GetHitRate() const;
+
+private:
+    struct Entry
+    {
+        void*                   texture;    // nullptr once destroyed; the slot is then reused
+        TransientTextureDesc    desc;
+        uint64_t                bytes;
+        uint64_t                lastUsedFrame;
+        bool                    inUse;
+    };
+
+    void Destroy(Entry& entry);
+    void EvictOverBudget();
+
+    TransientTextureBackend*    m_backend;
+    uint32_t                    m_keepFrames;
+    uint64_t                    m_budgetBytes;
+    float                       m_maxOversize;
+    uint64_t                    m_frame;
+    std::vector<Entry>          m_entries;
+    Statistics                  m_statistics;
+};
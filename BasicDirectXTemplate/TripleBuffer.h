@@ -0,0 +1,64 @@
+//
+// TripleBuffer.h - Lock-free single producer / single consumer triple buffer
+//
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace DX
+{
+    // The producer fills the write slot and publishes it; the consumer picks up the most
+    // recently published slot. Neither side ever waits: the producer always has a free
+    // slot to write and the consumer keeps reading its slot until something newer arrives.
+    // Slots are reused, so a T holding containers stops allocating once they have grown.
+    template<typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() noexcept(false) :
+            m_middle(1),
+            m_write(0),
+            m_read(2)
+        {
+        }
+
+        TripleBuffer(TripleBuffer const&) = delete;
+        TripleBuffer& operator= (TripleBuffer const&) = delete;
+
+        // Producer: the slot to fill for the next Publish.
+        T& GetWriteBuffer()                                 { return m_slots[m_write]; }
+
+        // Producer: hands the write slot to the consumer and takes back an unused one.
+        void Publish()
+        {
+            uint32_t previous = m_middle.exchange(m_write | c_fresh, std::memory_order_acq_rel);
+            m_write = previous & c_indexMask;
+        }
+
+        // Consumer: switches to the newest published slot. Returns false if nothing
+        // was published since the last call, in which case the read slot is unchanged.
+        bool Acquire()
+        {
+            if (!(m_middle.load(std::memory_order_relaxed) & c_fresh))
+                return false;
+
+            uint32_t previous = m_middle.exchange(m_read, std::memory_order_acq_rel);
+            m_read = previous & c_indexMask;
+            return true;
+        }
+
+        // Consumer: the slot picked up by the last successful Acquire.
+        const T& GetReadBuffer() const                      { return m_slots[m_read]; }
+
+    private:
+        static const uint32_t c_fresh = 4;
+        static const uint32_t c_indexMask = 3;
+
+        T                       m_slots[3];
+        std::atomic<uint32_t>   m_middle;
+        uint32_t                m_write;    // Only touched by the producer
+        uint32_t                m_read;     // Only touched by the consumer
+    };
+}